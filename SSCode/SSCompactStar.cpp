@@ -0,0 +1,417 @@
+// SSCompactStar.cpp
+// SSCore
+//
+// Compact in-memory representation of large arrays of stars: fixed-size numeric
+// records, with names and spectral types interned in a shared string pool, and
+// identifiers kept in a per-array side table.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#include <string.h>
+
+#include "SSCompactStar.hpp"
+
+static_assert ( sizeof ( SSCompactStar ) == 88, "SSCompactStar should be 88 bytes" );
+
+// Constructs a string pool containing only the empty string, at index zero.
+
+SSStringPool::SSStringPool ( void )
+{
+    intern ( "" );
+}
+
+// Returns the index of a string (str) in the pool, adding it if not already present.
+
+uint32_t SSStringPool::intern ( const string &str )
+{
+    lock_guard<mutex> lock ( _mutex );
+
+    auto it = _index.find ( str );
+    if ( it != _index.end() )
+        return it->second;
+
+    uint32_t index = (uint32_t) _strings.size();
+    it = _index.emplace ( str, index ).first;
+    _strings.push_back ( &it->first );
+    return index;
+}
+
+// Returns a copy of the string at an index in the pool, or an empty string if the index is out of range.
+
+string SSStringPool::get ( uint32_t index ) const
+{
+    lock_guard<mutex> lock ( _mutex );
+    return index < _strings.size() ? *_strings[index] : string();
+}
+
+// Returns number of distinct strings in the pool, including the empty string.
+
+size_t SSStringPool::size ( void ) const
+{
+    lock_guard<mutex> lock ( _mutex );
+    return _strings.size();
+}
+
+// Returns approximate memory used by the pool, in bytes: its string heap storage,
+// hash table nodes (each with a next pointer and cached hash) and buckets, and index vector.
+
+size_t SSStringPool::memoryUsage ( void ) const
+{
+    lock_guard<mutex> lock ( _mutex );
+
+    size_t bytes = sizeof ( SSStringPool ) + _strings.capacity() * sizeof ( const string * )
+                 + _index.bucket_count() * sizeof ( void * )
+                 + _index.size() * ( sizeof ( pair<const string,uint32_t> ) + 2 * sizeof ( void * ) );
+
+    for ( const string *pStr : _strings )
+        bytes += SSObject::stringHeapSize ( *pStr );
+
+    return bytes;
+}
+
+// Adds a star or deep sky object (pObject) to the array; its strings are interned in the array's
+// string pool. The object is copied, not retained; the caller may delete it afterwards.
+// Returns true if successful, or false if the object is not a star or deep sky object.
+
+bool SSCompactStarArray::add ( SSObjectPtr pObject )
+{
+    SSStarPtr pStar = SSGetStarPtr ( pObject );
+    if ( pStar == nullptr )
+        return false;
+
+    SSCompactStar rec = { 0 };
+
+    SSVector pos = pStar->getFundamentalPosition();
+    SSVector vel = pStar->getFundamentalVelocity();
+
+    rec.position[0] = pos.x;
+    rec.position[1] = pos.y;
+    rec.position[2] = pos.z;
+    rec.velocity[0] = vel.x;
+    rec.velocity[1] = vel.y;
+    rec.velocity[2] = vel.z;
+    rec.parallax = pStar->getParallax();
+    rec.radvel = pStar->getRadVel();
+    rec.vmag = pStar->getVMagnitude();
+    rec.bmag = pStar->getBMagnitude();
+    rec.type = pStar->getType();
+    rec.spectrum = _pPool->intern ( pStar->getSpectralType() );
+    rec.description = _pPool->intern ( pStar->getDescription() );
+
+    vector<string> names = pStar->getNames();
+    if ( names.size() > UINT8_MAX )
+        names.resize ( UINT8_MAX );
+    rec.nNames = names.size();
+    rec.names = (uint32_t) _names.size();
+    for ( const string &name : names )
+        _names.push_back ( _pPool->intern ( name ) );
+
+    vector<SSIdentifier> idents = pStar->getIdentifiers();
+    if ( idents.size() > UINT16_MAX )
+        idents.resize ( UINT16_MAX );
+    rec.nIdents = idents.size();
+    rec.idents = (uint32_t) _idents.size();
+    _idents.insert ( _idents.end(), idents.begin(), idents.end() );
+
+    // Double stars, variable stars, and deep sky objects get an extra record.
+
+    rec.extra = -1;
+    SSDoubleStarPtr pDouble = SSGetDoubleStarPtr ( pStar );
+    SSVariableStarPtr pVariable = SSGetVariableStarPtr ( pStar );
+    SSDeepSkyPtr pDeepSky = SSGetDeepSkyPtr ( pStar );
+
+    if ( pDouble || pVariable || pDeepSky )
+    {
+        SSCompactExtra extra = { 0 };
+
+        extra.orbit[0] = INFINITY;
+        extra.varEpoch = INFINITY;
+        extra.magDelta = extra.sep = extra.PA = extra.PAyr = INFINITY;
+        extra.majAxis = extra.minAxis = INFINITY;
+        extra.varMaxMag = extra.varMinMag = extra.varPeriod = INFINITY;
+
+        if ( pDouble )
+        {
+            extra.comps = _pPool->intern ( pDouble->getComponents() );
+            extra.magDelta = pDouble->getMagnitudeDelta();
+            extra.sep = pDouble->getSeparation();
+            extra.PA = pDouble->getPositionAngle();
+            extra.PAyr = pDouble->getPositionAngleYear();
+            if ( pDouble->hasOrbit() )
+            {
+                SSOrbit orbit = pDouble->getOrbit();
+                double o[8] = { orbit.t, orbit.q, orbit.e, orbit.i, orbit.w, orbit.n, orbit.m, orbit.mm };
+                memcpy ( extra.orbit, o, sizeof ( o ) );
+            }
+        }
+
+        if ( pVariable )
+        {
+            extra.varType = _pPool->intern ( pVariable->getVariableType() );
+            extra.varMaxMag = pVariable->getMaximumMagnitude();
+            extra.varMinMag = pVariable->getMinimumMagnitude();
+            extra.varPeriod = pVariable->getPeriod();
+            extra.varEpoch = pVariable->getEpoch();
+        }
+
+        if ( pDeepSky )
+        {
+            extra.majAxis = pDeepSky->getMajorAxis();
+            extra.minAxis = pDeepSky->getMinorAxis();
+            extra.PA = pDeepSky->getPositionAngle();
+        }
+
+        rec.extra = (int32_t) _extras.size();
+        _extras.push_back ( extra );
+    }
+
+    _stars.push_back ( rec );
+    return true;
+}
+
+// Adds all stars and deep sky objects in an object array (objects), which keeps ownership of them.
+// Returns the number of objects added.
+
+int SSCompactStarArray::add ( SSObjectVec &objects )
+{
+    int n = 0;
+
+    _stars.reserve ( _stars.size() + objects.size() );
+    for ( size_t i = 0; i < objects.size(); i++ )
+        if ( add ( objects.get ( i ) ) )
+            n++;
+
+    return n;
+}
+
+// Removes all stars from the array, and frees its memory. Strings stay in the shared pool.
+
+void SSCompactStarArray::clear ( void )
+{
+    vector<SSCompactStar>().swap ( _stars );
+    vector<uint32_t>().swap ( _names );
+    vector<SSIdentifier>().swap ( _idents );
+    vector<SSCompactExtra>().swap ( _extras );
+}
+
+// Releases unused capacity of the array's tables; call after adding all stars.
+
+void SSCompactStarArray::shrink ( void )
+{
+    _stars.shrink_to_fit();
+    _names.shrink_to_fit();
+    _idents.shrink_to_fit();
+    _extras.shrink_to_fit();
+}
+
+// Returns approximate memory used by the array, in bytes, excluding the shared string pool.
+
+size_t SSCompactStarArray::memoryUsage ( void )
+{
+    return sizeof ( SSCompactStarArray ) + _stars.capacity() * sizeof ( SSCompactStar )
+         + _names.capacity() * sizeof ( uint32_t ) + _idents.capacity() * sizeof ( SSIdentifier )
+         + _extras.capacity() * sizeof ( SSCompactExtra );
+}
+
+// Returns object type of i-th star without creating an object;
+// returns kTypeNonexistent if i is out of range.
+
+SSObjectType SSCompactStarArray::getType ( size_t i )
+{
+    const SSCompactStar *pRec = getRecord ( i );
+    return pRec ? (SSObjectType) pRec->type : kTypeNonexistent;
+}
+
+// Returns fundamental position unit vector of i-th star without creating an object;
+// returns infinite vector if i is out of range.
+
+SSVector SSCompactStarArray::getPosition ( size_t i )
+{
+    const SSCompactStar *pRec = getRecord ( i );
+    if ( pRec == nullptr )
+        return SSVector ( INFINITY, INFINITY, INFINITY );
+
+    return SSVector ( pRec->position[0], pRec->position[1], pRec->position[2] );
+}
+
+// Returns visual magnitude of i-th star, or blue magnitude if visual is unknown;
+// returns infinity if both are unknown or i is out of range.
+
+float SSCompactStarArray::getMagnitude ( size_t i )
+{
+    const SSCompactStar *pRec = getRecord ( i );
+    if ( pRec == nullptr )
+        return INFINITY;
+
+    return ::isinf ( pRec->vmag ) ? pRec->bmag : pRec->vmag;
+}
+
+// Returns number of names of i-th star, or zero if i is out of range.
+
+int SSCompactStarArray::countNames ( size_t i )
+{
+    const SSCompactStar *pRec = getRecord ( i );
+    return pRec ? pRec->nNames : 0;
+}
+
+// Returns k-th name of i-th star, or empty string if either index is out of range.
+
+string SSCompactStarArray::getName ( size_t i, int k )
+{
+    const SSCompactStar *pRec = getRecord ( i );
+    if ( pRec == nullptr || k < 0 || k >= pRec->nNames )
+        return string();
+
+    return _pPool->get ( _names[ pRec->names + k ] );
+}
+
+// Returns i-th star's identifier in a specific catalog (cat),
+// or null identifier if not present or i is out of range.
+
+SSIdentifier SSCompactStarArray::getIdentifier ( size_t i, SSCatalog cat )
+{
+    const SSCompactStar *pRec = getRecord ( i );
+    if ( pRec == nullptr )
+        return SSIdentifier();
+
+    for ( int k = 0; k < pRec->nIdents; k++ )
+        if ( _idents[ pRec->idents + k ].catalog() == cat )
+            return _idents[ pRec->idents + k ];
+
+    return SSIdentifier();
+}
+
+// Returns spectral type (or galaxy type) of i-th star, or empty string if i is out of range.
+
+string SSCompactStarArray::getSpectralType ( size_t i )
+{
+    const SSCompactStar *pRec = getRecord ( i );
+    return pRec ? _pPool->get ( pRec->spectrum ) : string();
+}
+
+// Returns index of the first star with a given identifier (ident), or -1 if none.
+// This is a linear scan of the identifier table, which needs no additional memory.
+
+int SSCompactStarArray::find ( SSIdentifier ident )
+{
+    for ( size_t i = 0; i < _stars.size(); i++ )
+    {
+        const SSCompactStar &rec = _stars[i];
+        for ( int k = 0; k < rec.nIdents; k++ )
+            if ( _idents[ rec.idents + k ] == ident )
+                return (int) i;
+    }
+
+    return -1;
+}
+
+// Creates a new star object from the i-th star in the array.
+// Returns nullptr if i is out of range or the star's type is not a star or deep sky object.
+// The caller owns the returned object and is responsible for deleting it.
+
+SSObjectPtr SSCompactStarArray::getObject ( size_t i )
+{
+    const SSCompactStar *pRec = getRecord ( i );
+    if ( pRec == nullptr )
+        return nullptr;
+
+    SSObjectType type = (SSObjectType) pRec->type;
+    if ( type != kTypeNonexistent && ( type < kTypeStar || type > kTypeGalaxy ) )
+        return nullptr;
+
+    SSStarPtr pStar = SSGetStarPtr ( SSNewObject ( type ) );
+    if ( pStar == nullptr )
+        return nullptr;
+
+    pStar->setFundamentalPosition ( SSVector ( pRec->position[0], pRec->position[1], pRec->position[2] ) );
+    pStar->setFundamentalVelocity ( SSVector ( pRec->velocity[0], pRec->velocity[1], pRec->velocity[2] ) );
+    pStar->setParallax ( pRec->parallax );
+    pStar->setRadVel ( pRec->radvel );
+    pStar->setVMagnitude ( pRec->vmag );
+    pStar->setBMagnitude ( pRec->bmag );
+    pStar->setSpectralType ( _pPool->get ( pRec->spectrum ) );
+    if ( pRec->description )
+        pStar->setDescription ( _pPool->get ( pRec->description ) );
+
+    if ( pRec->nNames > 0 )
+    {
+        vector<string> names ( pRec->nNames );
+        for ( int k = 0; k < pRec->nNames; k++ )
+            names[k] = _pPool->get ( _names[ pRec->names + k ] );
+        pStar->setNames ( names );
+    }
+
+    if ( pRec->nIdents > 0 )
+    {
+        vector<SSIdentifier> idents ( _idents.begin() + pRec->idents, _idents.begin() + pRec->idents + pRec->nIdents );
+        pStar->setIdentifiers ( idents );
+    }
+
+    // Copy double star, variable star, and deep sky fields from extra record, if any.
+
+    if ( pRec->extra >= 0 && pRec->extra < (int32_t) _extras.size() )
+    {
+        const SSCompactExtra *pExtra = &_extras[ pRec->extra ];
+
+        SSDoubleStarPtr pDouble = SSGetDoubleStarPtr ( pStar );
+        if ( pDouble != nullptr )
+        {
+            pDouble->setComponents ( _pPool->get ( pExtra->comps ) );
+            pDouble->setMagnitudeDelta ( pExtra->magDelta );
+            pDouble->setSeparation ( pExtra->sep );
+            pDouble->setPositionAngle ( pExtra->PA );
+            pDouble->setPositionAngleYear ( pExtra->PAyr );
+
+            const double *o = pExtra->orbit;
+            if ( ! ::isinf ( o[0] ) )
+                pDouble->setOrbit ( SSOrbit ( o[0], o[1], o[2], o[3], o[4], o[5], o[6], o[7] ) );
+        }
+
+        SSVariableStarPtr pVariable = SSGetVariableStarPtr ( pStar );
+        if ( pVariable != nullptr )
+        {
+            pVariable->setVariableType ( _pPool->get ( pExtra->varType ) );
+            pVariable->setMaximumMagnitude ( pExtra->varMaxMag );
+            pVariable->setMinimumMagnitude ( pExtra->varMinMag );
+            pVariable->setPeriod ( pExtra->varPeriod );
+            pVariable->setEpoch ( pExtra->varEpoch );
+        }
+
+        SSDeepSkyPtr pDeepSky = SSGetDeepSkyPtr ( pStar );
+        if ( pDeepSky != nullptr )
+        {
+            pDeepSky->setMajorAxis ( pExtra->majAxis );
+            pDeepSky->setMinorAxis ( pExtra->minAxis );
+            pDeepSky->setPositionAngle ( pExtra->PA );
+        }
+    }
+
+    return pStar;
+}
+
+// Materializes all stars in the array and appends the ones which pass
+// an optional filter function (filter) to an object array (objects).
+// Returns the number of objects appended.
+
+int SSCompactStarArray::getObjects ( SSObjectVec &objects, SSObjectFilter filter, void *userData )
+{
+    int numObjects = 0;
+
+    for ( size_t i = 0; i < size(); i++ )
+    {
+        SSObjectPtr pObject = getObject ( i );
+        if ( pObject == nullptr )
+            continue;
+
+        if ( filter == nullptr || filter ( pObject, userData ) )
+        {
+            objects.append ( pObject );
+            numObjects++;
+        }
+        else
+        {
+            delete pObject;
+        }
+    }
+
+    return numObjects;
+}
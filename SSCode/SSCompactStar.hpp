@@ -0,0 +1,124 @@
+// SSCompactStar.hpp
+// SSCore
+//
+// Compact in-memory representation of large arrays of stars: fixed-size numeric
+// records, with names and spectral types interned in a shared string pool, and
+// identifiers kept in a per-array side table.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#ifndef SSCOMPACTSTAR_HPP
+#define SSCOMPACTSTAR_HPP
+
+#include <mutex>
+#include <unordered_map>
+
+#include "SSStar.hpp"
+
+// Stores each distinct string once, and identifies it by a 32-bit index.
+// Index zero is always the empty string. Interned strings are never removed,
+// so a pool can be shared by many star arrays (e.g. all regions of an HTM),
+// and intern() may be called from several threads at once.
+
+class SSStringPool
+{
+protected:
+    unordered_map<string,uint32_t>  _index;     // index of each interned string
+    vector<const string *>          _strings;   // interned strings, in order of index; keys of _index
+    mutable mutex                   _mutex;     // serializes access from multiple threads
+
+public:
+
+    SSStringPool ( void );
+    SSStringPool ( const SSStringPool &other ) = delete;
+    SSStringPool &operator = ( const SSStringPool &other ) = delete;
+
+    uint32_t intern ( const string &str );
+    string get ( uint32_t index ) const;
+    size_t size ( void ) const;
+    size_t memoryUsage ( void ) const;
+};
+
+// Numeric data of a single star in an SSCompactStarArray; 88 bytes versus several hundred for
+// an SSStar with its names, identifiers, and strings on the heap. Strings are string pool indexes;
+// names and identifiers are runs of consecutive entries in the array's name and identifier tables.
+
+struct SSCompactStar
+{
+    double   position[3];   // fundamental position unit vector (x,y,z)
+    double   velocity[3];   // fundamental space velocity in radians per year; infinite if unknown
+    float    parallax;      // parallax in arcsec; zero if unknown
+    float    radvel;        // radial velocity as fraction of light speed; infinite if unknown
+    float    vmag;          // visual magnitude; infinite if unknown
+    float    bmag;          // blue magnitude; infinite if unknown
+    uint32_t spectrum;      // string pool index of spectral type (or galaxy type)
+    uint32_t description;   // string pool index of description
+    uint32_t names;         // index of first name in array's name table
+    uint32_t idents;        // index of first identifier in array's identifier table
+    int32_t  extra;         // index of extra record, or -1 if none
+    uint8_t  type;          // SSObjectType
+    uint8_t  nNames;        // number of consecutive names in name table
+    uint16_t nIdents;       // number of consecutive identifiers in identifier table
+};
+
+// Double star, variable star, and deep sky data of a star in an SSCompactStarArray.
+
+struct SSCompactExtra
+{
+    double   orbit[8];      // binary star orbit t,q,e,i,w,n,m,mm; orbit[0] is infinite if none
+    double   varEpoch;      // variability epoch (JD); infinite if unknown
+    float    magDelta;      // double star magnitude difference
+    float    sep;           // double star separation in radians
+    float    PA;            // double star position angle, or deep sky position angle, in radians
+    float    PAyr;          // double star position angle year
+    float    majAxis;       // deep sky major axis in radians
+    float    minAxis;       // deep sky minor axis in radians
+    float    varMaxMag;     // variable star maximum magnitude
+    float    varMinMag;     // variable star minimum magnitude
+    float    varPeriod;     // variable star period in days
+    uint32_t comps;         // string pool index of double star components
+    uint32_t varType;       // string pool index of variable star type
+};
+
+// An array of stars (and deep sky objects) in compact form, such as the contents of one HTM region.
+// Positions, magnitudes, names, and identifiers can be read without creating any objects;
+// getObject() materializes an equivalent SSStar (or subclass) on demand. The string pool
+// is not owned by the array, and must outlive it.
+
+class SSCompactStarArray
+{
+protected:
+    SSStringPool            *_pPool = nullptr;  // shared string pool; not owned
+    vector<SSCompactStar>   _stars;             // star records
+    vector<uint32_t>        _names;             // name table: string pool indexes of star names
+    vector<SSIdentifier>    _idents;            // identifier table
+    vector<SSCompactExtra>  _extras;            // extra records
+
+    const SSCompactStar *getRecord ( size_t i ) { return i < _stars.size() ? &_stars[i] : nullptr; }
+
+public:
+
+    SSCompactStarArray ( SSStringPool *pPool ) { _pPool = pPool; }
+
+    SSStringPool *getStringPool ( void ) { return _pPool; }
+
+    bool add ( SSObjectPtr pObject );
+    int add ( SSObjectVec &objects );
+    void clear ( void );
+    void shrink ( void );
+    size_t size ( void ) { return _stars.size(); }
+    size_t memoryUsage ( void );
+
+    SSObjectType getType ( size_t i );
+    SSVector getPosition ( size_t i );
+    float getMagnitude ( size_t i );
+    int countNames ( size_t i );
+    string getName ( size_t i, int k );
+    SSIdentifier getIdentifier ( size_t i, SSCatalog cat );
+    string getSpectralType ( size_t i );
+    int find ( SSIdentifier ident );
+
+    SSObjectPtr getObject ( size_t i );
+    int getObjects ( SSObjectVec &objects, SSObjectFilter filter = nullptr, void *userData = nullptr );
+};
+
+#endif /* SSCOMPACTSTAR_HPP */
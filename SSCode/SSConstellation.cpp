@@ -51,8 +51,16 @@ SSConstellationPtr SSGetConstellationPtr ( SSObjectPtr ptr )
 
 SSObjectPtr SSConstellation::fromCSV ( string csv )
 {
-    vector<string> fields = split ( csv, "," );
-    
+    vector<const char *> fields;
+    split_csv_inplace ( csv, fields );
+    return fromCSV ( fields );
+}
+
+// Allocates a new SSConstellation and initializes it from a vector of trimmed CSV fields,
+// as from split_csv_inplace(). Returns nullptr on error.
+
+SSObjectPtr SSConstellation::fromCSV ( const vector<const char *> &fields )
+{
     SSObjectType type = SSObject::codeToType ( fields[0] );
     if ( type < kTypeConstellation || type > kTypeAsterism || fields.size() < 8 )
         return nullptr;
@@ -69,7 +77,7 @@ SSObjectPtr SSConstellation::fromCSV ( string csv )
     pCon->setDirection ( center );
     pCon->setArea ( degtorad ( degtorad ( strtofloat64 ( fields[3] ) ) ) );
     pCon->setRank ( strtoint ( fields[4] ) );
-    pCon->setNames ( vector<string> ( &fields[5], &fields[8] ) );
+    pCon->setNames ( vector<string> ( fields.begin() + 5, fields.begin() + 8 ) );
 
     return pObject;
 }
@@ -737,18 +745,98 @@ static CData _table[357] =
     {  0.0000, 24.0000, -90.0000, "Oct" }
 };
 
+// The B1875 sky is divided into a grid of one-degree cells in right ascension and declination. Each cell
+// lists the rows of the table above which contain any point in the cell, in table order, ending with the
+// first row which contains the whole cell. The first of a cell's rows which contains a point is therefore
+// the same row that a search of the whole table would find. Most cells list only one row.
+
+static const int kGridRA = 360;        // cells in right ascension; 4 minutes of RA each
+static const int kGridDec = 180;       // cells in declination; 1 degree each
+
+struct CGrid
+{
+    vector<uint32_t> cells;     // index of each cell's first row in (rows), plus one past last cell's last row
+    vector<uint16_t> rows;      // table rows for each cell, in table order
+    vector<int>      cons;      // constellation index (1-88) for each table row
+};
+
+// Builds the constellation identification grid. Cell edges are widened slightly, so that points
+// which round into a neighboring cell are still covered by the rows listed for that cell.
+
+static CGrid makeGrid ( void )
+{
+    const int numRows = sizeof ( _table ) / sizeof ( _table[0] );
+    const double eps = 1.0e-6;
+    CGrid grid;
+
+    for ( int i = 0; i < numRows; i++ )
+        grid.cons.push_back ( string_to_con ( _table[i].con, true ) );
+
+    grid.cells.reserve ( kGridRA * kGridDec + 1 );
+    for ( int d = 0; d < kGridDec; d++ )
+    {
+        double dec0 = d - 90.0 - eps, dec1 = d - 89.0 + eps;
+        for ( int r = 0; r < kGridRA; r++ )
+        {
+            double ra0 = r / 15.0 - eps, ra1 = ( r + 1 ) / 15.0 + eps;
+            grid.cells.push_back ( (uint32_t) grid.rows.size() );
+            for ( int i = 0; i < numRows; i++ )
+            {
+                if ( _table[i].ral > ra1 || _table[i].rau <= ra0 || _table[i].decl > dec1 )
+                    continue;
+
+                grid.rows.push_back ( i );
+                if ( _table[i].ral <= ra0 && _table[i].rau > ra1 && _table[i].decl <= dec0 )
+                    break;
+            }
+        }
+    }
+
+    grid.cells.push_back ( (uint32_t) grid.rows.size() );
+    return grid;
+}
+
+// Returns the constellation identification grid. The grid is built once, on first use,
+// so this may be called from several threads at once.
+
+static const CGrid &getGrid ( void )
+{
+    static const CGrid grid = makeGrid();
+    return grid;
+}
+
+// Returns row of the constellation table containing a B1875 position (ra) in decimal hours and (dec)
+// in decimal degrees, or -1 if none does (which only happens for positions outside the sphere).
+
+static int identifyRow ( double ra, double dec )
+{
+    const CGrid &grid = getGrid();
+
+    if ( ! ( ra >= 0.0 && ra < 24.0 && dec >= -90.0 && dec <= 90.0 ) )
+        return -1;
+
+    int r = min ( (int) ( ra * 15.0 ), kGridRA - 1 );
+    int d = min ( (int) ( dec + 90.0 ), kGridDec - 1 );
+    int cell = d * kGridRA + r;
+
+    for ( uint32_t k = grid.cells[cell]; k < grid.cells[cell + 1]; k++ )
+    {
+        int i = grid.rows[k];
+        if ( ra >= _table[i].ral && ra < _table[i].rau && dec >= _table[i].decl )
+            return i;
+    }
+
+    return -1;
+}
+
 // identifies constellation from position in B1875 equatorial cooordinates
-// (ra,dec) both in radians; returns 3-letter constellation abbreviation string.
+// (ra,dec) both in radians; returns 3-letter constellation abbreviation string,
+// or empty string if (ra,dec) is not a valid position.
 
 string SSConstellation::identify ( double ra, double dec )
 {
-    ra *= SSAngle::kHourPerRad;
-    dec *= SSAngle::kDegPerRad;
-    
-    int i = 0;
-    while ( ra < _table[i].ral || ra >= _table[i].rau || dec < _table[i].decl )
-        i++;
-    return string ( _table[i].con );
+    int i = identifyRow ( ra * SSAngle::kHourPerRad, dec * SSAngle::kDegPerRad );
+    return i < 0 ? string ( "" ) : string ( _table[i].con );
 }
 
 // identifies constellation from unit position vector in J2000 equatorial cooordinates.
@@ -760,3 +848,40 @@ string SSConstellation::identify ( SSVector position )
     SSSpherical coords = precess * position;
     return identify ( coords.lon, coords.lat );
 }
+
+// As above, but returns constellation index from 1 (Andromeda) to 88 (Vulpecula),
+// or 0 if (ra,dec) is not a valid position.
+
+int SSConstellation::identifyIndex ( double ra, double dec )
+{
+    int i = identifyRow ( ra * SSAngle::kHourPerRad, dec * SSAngle::kDegPerRad );
+    return i < 0 ? 0 : getGrid().cons[i];
+}
+
+int SSConstellation::identifyIndex ( SSVector position )
+{
+    static SSMatrix precess = SSCoordinates::getPrecessionMatrix ( SSTime::fromBesselianYear ( 1875.0 ) );
+    SSSpherical coords = precess * position;
+    return identifyIndex ( coords.lon, coords.lat );
+}
+
+// Identifies constellations containing a vector of unit positions in J2000 equatorial coordinates.
+// Constellation indexes from 1 (Andromeda) to 88 (Vulpecula), or 0 if not identified, are returned
+// in (indexes) in the same order as (positions). Returns number of positions identified.
+
+int SSConstellation::identify ( const vector<SSVector> &positions, vector<int> &indexes )
+{
+    SSMatrix precess = SSCoordinates::getPrecessionMatrix ( SSTime::fromBesselianYear ( 1875.0 ) );
+    int n = 0;
+
+    indexes.resize ( positions.size() );
+    for ( size_t i = 0; i < positions.size(); i++ )
+    {
+        SSSpherical coords = precess * positions[i];
+        indexes[i] = identifyIndex ( coords.lon, coords.lat );
+        if ( indexes[i] > 0 )
+            n++;
+    }
+
+    return n;
+}
@@ -51,12 +51,16 @@ public:
     // imports/exports from/to CSV-format text string
     
     static SSObjectPtr fromCSV ( string csv );
+    static SSObjectPtr fromCSV ( const vector<const char *> &fields );
     string toCSV ( void );
     
     // identifies constellation from equatorial cooordinates (B1875 spherical or J2000 rectangular unit vector)
     
     static string identify ( double ra, double dec );   // B1875 coordinates
     static string identify ( SSVector position );       // J2000 coordinates
+    static int identifyIndex ( double ra, double dec ); // B1875 coordinates; returns constellation index 1-88, or 0 if invalid
+    static int identifyIndex ( SSVector position );     // J2000 coordinates; returns constellation index 1-88, or 0 if invalid
+    static int identify ( const vector<SSVector> &positions, vector<int> &indexes );   // J2000 coordinates; returns number identified
 };
 
 // convenient alias for pointer to SSConstellation
@@ -0,0 +1,202 @@
+// SSCrossMatch.cpp
+// SSCore
+//
+// Positional cross-matching of two star catalogs, with proper motion propagation
+// to a common epoch, on multiple threads.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#include <algorithm>
+
+#include "SSCrossMatch.hpp"
+#include "SSKDTree.hpp"
+#include "SSThreadPool.hpp"
+
+// Stars are matched in chunks of at least this many stars; each thread matches one chunk at a time.
+
+static const size_t kMatchChunkStars = 4096;
+
+// Returns a star's fundamental position unit vector, propagated by its space velocity over
+// a number of Julian years (years), which may be negative. If the star's space velocity is unknown,
+// returns its fundamental position unchanged.
+
+SSVector SSPropagatePosition ( SSStarPtr pStar, double years )
+{
+    SSVector pos = pStar->getFundamentalPosition();
+    SSVector vel = pStar->getFundamentalVelocity();
+
+    if ( years == 0.0 || ! isfinite ( vel.x ) || ! isfinite ( vel.y ) || ! isfinite ( vel.z ) )
+        return pos;
+
+    return ( pos + vel * years ).normalize();
+}
+
+// Returns a star's magnitude for matching: visual magnitude if known, otherwise blue magnitude.
+
+static float matchMagnitude ( SSStarPtr pStar )
+{
+    float mag = pStar->getVMagnitude();
+    return isinf ( mag ) ? pStar->getBMagnitude() : mag;
+}
+
+// Computes positions of all stars in an array (stars) propagated over (years), and their magnitudes,
+// into (positions) and (mags). If (pTree) is not null, also builds a k-d tree of the positions there,
+// with array indexes as IDs. Objects in the array which are not stars get infinite positions,
+// and are not added to the tree.
+
+static void prepareStars ( SSObjectVec &stars, double years, vector<SSVector> &positions, vector<float> &mags, SSKDTree *pTree )
+{
+    positions.resize ( stars.size() );
+    mags.resize ( stars.size() );
+    if ( pTree )
+        pTree->reserve ( stars.size() );
+
+    for ( size_t i = 0; i < stars.size(); i++ )
+    {
+        SSStarPtr pStar = SSGetStarPtr ( stars[i] );
+        if ( pStar )
+        {
+            positions[i] = SSPropagatePosition ( pStar, years );
+            mags[i] = matchMagnitude ( pStar );
+            if ( pTree )
+                pTree->add ( positions[i], (uint32_t) i );
+        }
+        else
+        {
+            positions[i] = SSVector ( INFINITY, INFINITY, INFINITY );
+            mags[i] = INFINITY;
+        }
+    }
+
+    if ( pTree )
+        pTree->build();
+}
+
+// Star positions, magnitudes, and spatial index of one catalog, shared by all matching threads.
+
+struct MatchSide
+{
+    vector<SSVector> positions;     // star positions at common epoch; infinite if not a star
+    vector<float>    mags;          // star magnitudes; infinite if unknown
+    SSKDTree         tree;          // spatial index of positions; only built where needed
+};
+
+// Matches stars from (begin) up to but not including (end) in catalog (from) against all stars in catalog (to).
+// Appends all matches within (radius) whose magnitude difference is unknown or does not exceed (maxMagDelta)
+// to (matches), in order of star index in (from), then increasing separation; or only the nearest match
+// of each star if (all) is false. In each match, index1 is the star's index in (from) and index2 in (to).
+
+static void matchStars ( const MatchSide &from, const MatchSide &to, double radius, float maxMagDelta, bool all, size_t begin, size_t end, SSCrossMatchVec &matches )
+{
+    vector<uint32_t> ids;
+
+    for ( size_t i = begin; i < end; i++ )
+    {
+        SSVector pos = from.positions[i];
+        if ( ! isfinite ( pos.x ) )
+            continue;
+
+        // Search the index with a slightly larger radius to allow for rounding error, then apply the exact test.
+
+        ids.clear();
+        to.tree.search ( pos, radius * ( 1.0 + 1.0e-9 ) + 1.0e-15, ids );
+
+        size_t first = matches.size();
+        for ( uint32_t id : ids )
+        {
+            double sep = pos.angularSeparation ( to.positions[id] );
+            if ( sep >= radius )
+                continue;
+
+            float magDelta = isinf ( from.mags[i] ) || isinf ( to.mags[id] ) ? INFINITY : to.mags[id] - from.mags[i];
+            if ( ! isinf ( magDelta ) && fabs ( magDelta ) > maxMagDelta )
+                continue;
+
+            SSCrossMatch match = { i, id, sep, magDelta };
+            if ( all || matches.size() == first )
+                matches.push_back ( match );
+            else if ( sep < matches[first].sep || ( sep == matches[first].sep && id < matches[first].index2 ) )
+                matches[first] = match;
+        }
+
+        if ( all )
+            sort ( matches.begin() + first, matches.end(), [] ( const SSCrossMatch &m1, const SSCrossMatch &m2 )
+                  { return m1.sep < m2.sep || ( m1.sep == m2.sep && m1.index2 < m2.index2 ); } );
+    }
+}
+
+// Matches all stars in catalog (from) against catalog (to), as in matchStars(), in chunks on (numThreads) threads.
+// Appends matches to (matches) in order of star index in (from).
+
+static void matchAllStars ( const MatchSide &from, const MatchSide &to, double radius, float maxMagDelta, bool all, int numThreads, SSCrossMatchVec &matches )
+{
+    size_t numStars = from.positions.size();
+    size_t numChunks = min ( (size_t) numThreads * 4, ( numStars + kMatchChunkStars - 1 ) / kMatchChunkStars );
+    if ( numThreads < 2 || numChunks < 2 )
+    {
+        matchStars ( from, to, radius, maxMagDelta, all, 0, numStars, matches );
+        return;
+    }
+
+    vector<SSCrossMatchVec> chunks ( numChunks );
+    size_t chunkSize = ( numStars + numChunks - 1 ) / numChunks;
+    SSThreadPool pool ( numThreads );
+
+    for ( size_t c = 0; c < numChunks; c++ )
+    {
+        size_t begin = c * chunkSize, end = min ( numStars, begin + chunkSize );
+        pool.submit ( [&, c, begin, end] () { matchStars ( from, to, radius, maxMagDelta, all, begin, end, chunks[c] ); } );
+    }
+
+    pool.wait();
+    for ( SSCrossMatchVec &chunk : chunks )
+        matches.insert ( matches.end(), chunk.begin(), chunk.end() );
+}
+
+// Cross-matches two arrays of stars (stars1, stars2) by position. The stars' fundamental positions are
+// given at Julian epochs (epoch1, epoch2), e.g. 2000.0 for J2000 or 2016.0 for GAIA DR3; stars in the
+// first array are propagated to the second array's epoch using their space velocities, if known.
+// Pairs separated by less than (radius) are matched; if (maxMagDelta) is finite, pairs whose magnitudes
+// (visual, or blue if visual is unknown) are both known and differ by more than that are rejected.
+// The (mode) selects whether all pairs, the nearest star in the second array to each star in the first,
+// or only mutually nearest pairs are returned. Matches are appended to (matches) in order of first star
+// index, then increasing separation. Objects which are not stars are ignored. Matching runs on (numThreads)
+// threads, or all hardware threads if zero. Returns number of matches found.
+
+int SSCrossMatchStars ( SSObjectVec &stars1, double epoch1, SSObjectVec &stars2, double epoch2, SSAngle radius, SSCrossMatchMode mode, SSCrossMatchVec &matches, float maxMagDelta, int numThreads )
+{
+#if USE_THREADS
+    if ( numThreads < 1 )
+        numThreads = max ( 1, (int) thread::hardware_concurrency() );
+#else
+    numThreads = 1;
+#endif
+
+    MatchSide side1, side2;
+    prepareStars ( stars1, epoch2 - epoch1, side1.positions, side1.mags, mode == kMatchMutual ? &side1.tree : nullptr );
+    prepareStars ( stars2, 0.0, side2.positions, side2.mags, &side2.tree );
+
+    size_t n = matches.size();
+    if ( mode == kMatchMutual )
+    {
+        // Find each star's nearest match in the other array, in both directions,
+        // then keep pairs which are each other's nearest match.
+
+        SSCrossMatchVec best12, best21;
+        matchAllStars ( side1, side2, radius, maxMagDelta, false, numThreads, best12 );
+        matchAllStars ( side2, side1, radius, maxMagDelta, false, numThreads, best21 );
+
+        vector<int64_t> nearest1 ( stars2.size(), -1 );
+        for ( SSCrossMatch &match : best21 )
+            nearest1[ match.index1 ] = match.index2;
+
+        for ( SSCrossMatch &match : best12 )
+            if ( nearest1[ match.index2 ] == (int64_t) match.index1 )
+                matches.push_back ( match );
+    }
+    else
+    {
+        matchAllStars ( side1, side2, radius, maxMagDelta, mode == kMatchAll, numThreads, matches );
+    }
+
+    return (int) ( matches.size() - n );
+}
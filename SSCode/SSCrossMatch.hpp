@@ -0,0 +1,39 @@
+// SSCrossMatch.hpp
+// SSCore
+//
+// Positional cross-matching of two star catalogs, with proper motion propagation
+// to a common epoch, on multiple threads.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#ifndef SSCROSSMATCH_HPP
+#define SSCROSSMATCH_HPP
+
+#include "SSStar.hpp"
+
+// Which pairs of stars within the match radius are returned by SSCrossMatchStars().
+
+enum SSCrossMatchMode
+{
+    kMatchAll = 0,      // all pairs of stars within match radius
+    kMatchBest = 1,     // nearest star in second array, for each star in first array
+    kMatchMutual = 2,   // pairs of stars which are each other's nearest star
+};
+
+// A pair of matching stars: indexes in the first and second star arrays,
+// their angular separation at the common epoch, and magnitude difference.
+
+struct SSCrossMatch
+{
+    size_t index1;      // index of star in first array
+    size_t index2;      // index of star in second array
+    double sep;         // angular separation in radians
+    float  magDelta;    // magnitude of second star minus first star; infinite if either is unknown
+};
+
+typedef vector<SSCrossMatch> SSCrossMatchVec;
+
+SSVector SSPropagatePosition ( SSStarPtr pStar, double years );
+
+int SSCrossMatchStars ( SSObjectVec &stars1, double epoch1, SSObjectVec &stars2, double epoch2, SSAngle radius, SSCrossMatchMode mode, SSCrossMatchVec &matches, float maxMagDelta = INFINITY, int numThreads = 0 );
+
+#endif /* SSCROSSMATCH_HPP */
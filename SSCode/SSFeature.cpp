@@ -46,10 +46,16 @@ SSObjectPtr SSFeature::fromCSV ( string csv )
     // split string into comma-delimited fields,
     // remove leading & trailing whitespace/line breaks from each field.
     
-    vector<string> fields = split_csv ( csv );
-    for ( int i = 0; i < fields.size(); i++ )
-        fields[i] = trim ( fields[i] );
-    
+    vector<const char *> fields;
+    split_csv_inplace ( csv, fields );
+    return fromCSV ( fields );
+}
+
+// Allocates a new SSFeature or SSCity and initializes it from a vector of trimmed CSV fields,
+// as from split_csv_inplace(). Returns nullptr on error.
+
+SSObjectPtr SSFeature::fromCSV ( const vector<const char *> &fields )
+{
     SSObjectType type = SSObject::codeToType ( fields[0] );
     if ( type != kTypeFeature && type != kTypeCity )
         return nullptr;
@@ -94,7 +100,7 @@ SSObjectPtr SSFeature::fromCSV ( string csv )
         pCity->setCountryCode ( fields[5] );
         pCity->setAdmin1Code ( fields[6] );
         pCity->setPopulation ( strtoint ( fields[7] ) );
-        if ( fields[8] != "" ) pCity->setElevation ( strtofloat ( fields[8] ) );
+        if ( *fields[8] ) pCity->setElevation ( strtofloat ( fields[8] ) );
         pCity->setTimezoneName ( fields[9] );
         pCity->setAdmin1Name ( fields[10] );
         pCity->setDaylightSaving ( !!strtoint( fields[11] ) );
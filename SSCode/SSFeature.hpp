@@ -60,6 +60,7 @@ public:
     // imports/exports from/to CSV-format text string
     
     static SSObjectPtr fromCSV ( string csv );
+    static SSObjectPtr fromCSV ( const vector<const char *> &fields );
     virtual string toCSV ( void );
     
     // computes apparent direction and distance; planet must already have ephemeris computed.
@@ -9,6 +9,7 @@
 #include <string.h>
 
 #include "SSHTM.hpp"
+#include "SSHTMIndex.hpp"
 
 uint64_t cc_vector2ID ( double x, double y, double z, int depth );
 int cc_IDlevel ( uint64_t htmid );
@@ -16,6 +17,8 @@ int cc_isinside ( const double *p, const double *v1, const double *v2, const dou
 int cc_ID2name ( char *name, uint64_t id );
 uint64_t cc_name2ID ( const char *name );
 int cc_name2Triangle ( const char *name, double *v0, double *v1, double *v2 );
+int cc_ID2Triangle ( uint64_t id, double *v0, double *v1, double *v2 );
+void cc_subTriangle ( int k, double *v0, double *v1, double *v2 );
 
 // If not NULL, this function is called after a region is loaded asynchronously.
 
@@ -41,20 +44,60 @@ SSHTM::SSHTM ( void )
 
 // Constructor specifies array of magnitude limits for each HTM level,
 // and root path to directory containing region data files in CSV format.
+// An empty root path is allowed for an HTM built in memory with store(); it has no data files.
 
 SSHTM::SSHTM ( const vector<float> &magLevels, const string &rootpath )
 {
     _magLevels = magLevels;
     
     _rootpath = rootpath;
-    if ( _rootpath[ _rootpath.length() - 1 ] != '/' )
+    if ( ! _rootpath.empty() && _rootpath[ _rootpath.length() - 1 ] != '/' )
         _rootpath += '/';
 }
 
-// Destructor frees memory for all loaded regions and all objects therein.
+// Copy constructor and assignment copy the HTM's configuration, region map, and object indexes,
+// but not its pending asynchronous loads, load threads, or mutex. As with the regions themselves,
+// the copy shares the original's region object vectors; only one of them should dump regions.
+
+SSHTM::SSHTM ( const SSHTM &other )
+{
+    *this = other;
+}
+
+SSHTM &SSHTM::operator = ( const SSHTM &other )
+{
+    if ( this == &other )
+        return *this;
+    
+    lock_guard<mutex> lock ( other._regionMutex );
+    _readFunc = other._readFunc;
+    _writeFunc = other._writeFunc;
+    _regions = other._regions;
+    _magLevels = other._magLevels;
+    _rootpath = other._rootpath;
+    _loadCenter = other._loadCenter;
+    _numLoadThreads = other._numLoadThreads;
+    _empty = other._empty;
+    _loadOrder = other._loadOrder;
+    _useArenas = other._useArenas;
+    _regionUse = other._regionUse;
+    _memoryBudget = other._memoryBudget;
+    _memoryUsed = other._memoryUsed;
+    _evictionPolicy = other._evictionPolicy;
+    _nameIndex = other._nameIndex;
+    _identIndex = other._identIndex;
+    _objectIndex = other._objectIndex;
+    return *this;
+}
+
+// Destructor cancels pending asynchronous loads, waits for loads in progress to finish,
+// then frees memory for all loaded regions and all objects therein.
 
 SSHTM::~SSHTM ( void )
 {
+    cancelLoads();
+    delete _pLoadPool;
+    _pLoadPool = nullptr;
     dumpRegions();
 }
 
@@ -103,66 +146,224 @@ bool SSHTM::magLimits ( uint64_t htmID, float &min, float &max )
     return true;
 }
 
-// Stores a pointer to a star or deep sky object in this HTM, creating an HTM region to store it in, if needed.
-// Returns true if successful or false if the star cannot be stored.
+// Computes the ID of the HTM region in which a star or deep sky object (pStar) would be stored, from its
+// magnitude and position; stars closer than 10 parsecs go in the root region. Returns true if successful,
+// or false if the star's magnitude is fainter than all HTM levels, so it cannot be stored.
 
-bool SSHTM::store ( SSStar *pStar )
+bool SSHTM::storeRegionID ( SSStar *pStar, uint64_t &htmID )
 {
     float mag = pStar->getVMagnitude();
     if ( isinf ( mag ) )
         mag = pStar->getBMagnitude();
     
-    SSVector pos = pStar->getFundamentalPosition();
-
     // Store stars closer than 10 parsecs in root region.
     
     int level = pStar->getParallax() > 0.1 ? 0 : magLevel ( mag );
     if ( level < 0 )
         return false;
     
-    uint64_t htmID = 0;
+    htmID = 0;
     if ( level > 0 )
-        htmID = SSHTM::vector2ID ( pos, level - 1 );
+        htmID = SSHTM::vector2ID ( pStar->getFundamentalPosition(), level - 1 );
+
+    return true;
+}
+
+// Stores a pointer to a star or deep sky object in this HTM, creating an HTM region to store it in, if needed.
+// Returns true if successful or false if the star cannot be stored.
+
+bool SSHTM::store ( SSStar *pStar )
+{
+    uint64_t htmID = 0;
+    if ( ! storeRegionID ( pStar, htmID ) )
+        return false;
 
-    if ( _regions.count ( htmID ) == 0 )
-        _regions[htmID] = new SSObjectVec();
+    lock_guard<mutex> lock ( _regionMutex );
+    SSObjectVec *&pObjects = _regions[htmID];
+    if ( pObjects == nullptr )
+        pObjects = new SSObjectVec();
     
-    _regions[htmID]->append ( pStar );
+    pObjects->append ( pStar );
+    
+    size_t bytes = pStar->memoryUsage() + sizeof ( SSObjectPtr );
+    _regionUse[htmID].bytes += bytes;
+    _memoryUsed += bytes;
     return true;
 }
 
+// Sorts HTM region IDs (keys) into ascending order, and reorders a parallel array of object indexes
+// (indexes) with them, using a least-significant-digit radix sort, one byte per pass, with only as many
+// passes as the largest key needs. The sort is stable, so objects with the same region ID stay in order.
+// Since HTM IDs at each level are all larger than those at the level above, this also sorts by level.
+
+static void radixSortRegionIDs ( vector<uint64_t> &keys, vector<uint32_t> &indexes )
+{
+    uint64_t maxKey = 0;
+    for ( uint64_t key : keys )
+        maxKey = max ( maxKey, key );
+    
+    vector<uint64_t> keys2 ( keys.size() );
+    vector<uint32_t> indexes2 ( indexes.size() );
+    
+    for ( int shift = 0; shift < 64 && ( maxKey >> shift ) > 0; shift += 8 )
+    {
+        size_t counts[257] = { 0 };
+        for ( uint64_t key : keys )
+            counts[ ( ( key >> shift ) & 0xff ) + 1 ]++;
+        
+        for ( int d = 1; d < 257; d++ )
+            counts[d] += counts[d - 1];
+        
+        for ( size_t i = 0; i < keys.size(); i++ )
+        {
+            size_t pos = counts[ ( keys[i] >> shift ) & 0xff ]++;
+            keys2[pos] = keys[i];
+            indexes2[pos] = indexes[i];
+        }
+        
+        keys.swap ( keys2 );
+        indexes.swap ( indexes2 );
+    }
+}
+
 // Stores all stars and deep sky objects in an array of object pointers (objects)
 // into this HTM, and returns the total number of pointers stored.
+// Uses all hardware threads for large arrays; see store ( objects, numThreads ).
 
 int SSHTM::store ( SSObjectVec &objects )
 {
-    int n = 0;
+    return store ( objects, 0 );
+}
+
+// As above, but region IDs and memory usage of all objects are computed in parallel on (numThreads)
+// threads, or all hardware threads if zero; objects are then radix-sorted by region ID, and each run
+// of objects in the same region is appended to that region in one step. The result is the same
+// as storing each object individually in order with SSHTM::store ( SSStar * ), but that method
+// is not called, so subclasses which override it should also override store ( SSObjectVec & ).
+
+int SSHTM::store ( SSObjectVec &objects, int numThreads )
+{
+    const size_t kChunkSize = 65536;
+    size_t count = objects.size();
+    vector<uint64_t> htmIDs ( count );
+    vector<size_t> sizes ( count );
+    vector<char> stored ( count );
     
-    for ( int i = 0; i < objects.size(); i++ )
+    auto job = [&] ( size_t begin, size_t end )
     {
-        SSStar *pStar = SSGetStarPtr ( objects[i] );
-        if ( pStar == nullptr )
-            continue;
+        for ( size_t i = begin; i < end; i++ )
+        {
+            SSStar *pStar = SSGetStarPtr ( objects[i] );
+            stored[i] = pStar != nullptr && storeRegionID ( pStar, htmIDs[i] );
+            sizes[i] = stored[i] ? pStar->memoryUsage() + sizeof ( SSObjectPtr ) : 0;
+        }
+    };
+    
+#if USE_THREADS
+    if ( numThreads < 1 )
+        numThreads = max ( 1, (int) thread::hardware_concurrency() );
+#else
+    numThreads = 1;
+#endif
+
+    if ( numThreads > 1 && count > kChunkSize )
+    {
+        SSThreadPool pool ( numThreads );
+        for ( size_t begin = 0; begin < count; begin += kChunkSize )
+            pool.submit ( [&job, begin, count, kChunkSize] () { job ( begin, min ( count, begin + kChunkSize ) ); } );
+        pool.wait();
+    }
+    else
+    {
+        job ( 0, count );
+    }
+    
+    // Sort indexes of objects which can be stored by region ID.
+    
+    vector<uint64_t> keys;
+    vector<uint32_t> indexes;
+    keys.reserve ( count );
+    indexes.reserve ( count );
+    for ( size_t i = 0; i < count; i++ )
+    {
+        if ( stored[i] )
+        {
+            keys.push_back ( htmIDs[i] );
+            indexes.push_back ( (uint32_t) i );
+        }
+    }
+    
+    radixSortRegionIDs ( keys, indexes );
+    
+    // Append each run of objects with the same region ID to that region.
+    
+    lock_guard<mutex> lock ( _regionMutex );
+    for ( size_t first = 0, last = 0; first < keys.size(); first = last )
+    {
+        uint64_t htmID = keys[first];
+        for ( last = first + 1; last < keys.size() && keys[last] == htmID; last++ )
+            ;
         
-        if ( store ( pStar ) )
-            n++;
+        SSObjectVec *&pObjects = _regions[htmID];
+        if ( pObjects == nullptr )
+            pObjects = new SSObjectVec();
+        
+        pObjects->reserve ( pObjects->size() + ( last - first ) );
+        size_t bytes = 0;
+        for ( size_t i = first; i < last; i++ )
+        {
+            pObjects->append ( objects[ indexes[i] ] );
+            bytes += sizes[ indexes[i] ];
+        }
+        
+        _regionUse[htmID].bytes += bytes;
+        _memoryUsed += bytes;
     }
     
-    return n;
+    return (int) keys.size();
 }
 
 // Saves all regions of this HTM as CSV-formatted files in its root directory.
 // Root directory must already exist, and root path must end with a '/' character.
 // CSV files within directory will be named for individual HTM regions and will overwrite
-// any existing files with the same names.
+// any existing files with the same names. Regions are saved concurrently on (numThreads) threads,
+// or all hardware threads if zero; a custom data file writing function must then be thread-safe.
 // Returns the total number of objects written to the file(s).
 
-int SSHTM::saveRegions ( void *userData )
+int SSHTM::saveRegions ( void *userData, int numThreads )
 {
-    int n = 0;
+    vector<uint64_t> htmIDs;
     
-    for ( auto it = _regions.begin(); it != _regions.end(); it++ )
-        saveRegion ( it->first, userData );
+    {
+        lock_guard<mutex> lock ( _regionMutex );
+        for ( auto it = _regions.begin(); it != _regions.end(); it++ )
+            htmIDs.push_back ( it->first );
+    }
+    
+#if USE_THREADS
+    if ( numThreads < 1 )
+        numThreads = max ( 1, (int) thread::hardware_concurrency() );
+#else
+    numThreads = 1;
+#endif
+
+    vector<int> counts ( htmIDs.size() );
+    if ( numThreads > 1 )
+    {
+        SSThreadPool pool ( numThreads );
+        for ( size_t i = 0; i < htmIDs.size(); i++ )
+            pool.submit ( [this, &htmIDs, &counts, i, userData] () { counts[i] = saveRegion ( htmIDs[i], userData, 1 ); } );
+        pool.wait();
+    }
+    else
+    {
+        for ( size_t i = 0; i < htmIDs.size(); i++ )
+            counts[i] = saveRegion ( htmIDs[i], userData, numThreads );
+    }
+    
+    int n = 0;
+    for ( int count : counts )
+        n += count;
     
     return n;
 }
@@ -170,18 +371,23 @@ int SSHTM::saveRegions ( void *userData )
 // Saves a single region of this HTM as a CSV-formatted files in its root directory.
 // Root directory must already exist, and root path must end with a '/' character.
 // CSV file will be named for its HTM region, and overwrites any existing file with same name.
+// CSV text is formatted on (numThreads) threads, by default one, or all hardware threads if zero.
 // Returns the total number of objects written to the file.
 
-int SSHTM::saveRegion ( uint64_t htmID, void *userData )
+int SSHTM::saveRegion ( uint64_t htmID, void *userData, int numThreads )
 {
     int n = 0;
+    SSObjectVec *pObjects = getObjects ( htmID );
     
-    if ( _regions.count ( htmID ) )
+    if ( pObjects != nullptr )
     {
         if ( _writeFunc != nullptr )
-            n = _writeFunc ( this, htmID, _regions[htmID], userData );
+            n = _writeFunc ( this, htmID, pObjects, userData );
         else
-            n = SSExportObjectsToCSV ( _rootpath + ID2name ( htmID ) + ".csv", *_regions[htmID] );
+            n = SSExportObjectsToCSV ( _rootpath + ID2name ( htmID ) + ".csv", *pObjects, nullptr, nullptr, numThreads );
+        
+        lock_guard<mutex> lock ( _regionMutex );
+        _empty.erase ( htmID );
     }
     
     return n;
@@ -209,74 +415,392 @@ int SSHTM::loadRegions ( uint64_t htmID, bool sync, void *userData )
 // Loads star data for a single region in this HTM from a file in the HTM directory.
 // If sync is true, loads the region synchronously on the current thread, and
 // returns pointer to loaded object vector if sucessful, or nullptr on failure.
-// If sync is false, loads the region asynchronously on a background thread, and
-// returns nullptr; when finished loading region, calls notification callback
-// installed by SSHTMSetRegionLoadCallback() above, and subsequent calls to
-// loadRegion() or getObjects() return a pointer to the region's object vector.
-// If USE_THREADS is 0, this function always loads synchronously.
+// If sync is false, queues the region for loading on a background thread, and
+// returns nullptr; queued regions are started in the order set by setLoadOrder() and setLoadCenter().
+// When finished loading region, calls notification callback
+// installed by SSHTMSetRegionLoadCallback() above from the background thread,
+// and subsequent calls to loadRegion() or getObjects() return a pointer to the
+// region's object vector. If USE_THREADS is 0, this function always loads synchronously.
 
 SSObjectVec *SSHTM::loadRegion ( uint64_t htmID, bool sync, void *userData )
 {
-    // If region is loaded, delete thread associated with loading it,
-    // then return pointer to that region's objects.
+    // If region is already loaded, return pointer to that region's objects.
 
-    if ( regionLoaded ( htmID ) )
+    SSObjectVec *pObjects = getObjects ( htmID );
+    if ( pObjects != nullptr )
     {
-#if USE_THREADS
-        if ( _loadThreads.count ( htmID ) != 0 )
-        {
-            if ( _loadThreads[htmID]->joinable() )
-                _loadThreads[htmID]->join();
-            delete _loadThreads[htmID];
-            _loadThreads.erase ( htmID );
-        }
-#endif
-        return getObjects ( htmID );
+        lock_guard<mutex> lock ( _regionMutex );
+        _hits++;
+        return pObjects;
     }
+
+    // Don't re-read regions already known to be empty, or queue regions already queued.
     
+    {
+        lock_guard<mutex> lock ( _regionMutex );
+        if ( _empty.count ( htmID ) > 0 || ( !sync && _loading.count ( htmID ) > 0 ) )
+            return nullptr;
+    }
+    
+    // Region must be read from file; first make room for it if we are over the memory budget.
+    
+    evictRegions();
+
 #if USE_THREADS
     if ( !sync )
     {
-        // Load in a background thread
+        // Queue region for loading on a background thread, unless it is already queued or loading.
 
-        if ( _loadThreads.count ( htmID ) == 0 )
+        lock_guard<mutex> lock ( _regionMutex );
+        if ( _loading.count ( htmID ) == 0 )
         {
-            _loadThreads[htmID] = new thread ( &SSHTM::_loadRegion, this, htmID, _callback, userData );
-            _loadThreads[htmID]->detach();
+            _misses++;
+            if ( _pLoadPool == nullptr )
+                _pLoadPool = new SSThreadPool ( _numLoadThreads > 0 ? _numLoadThreads : min ( 4, max ( 1, (int) thread::hardware_concurrency() ) ) );
+
+            _loading.insert ( htmID );
+            _pLoadPool->submit ( [this, htmID, userData] () { _loadRegion ( htmID, _callback, userData, true ); }, _loadPriority ( htmID ), htmID );
         }
 
         return nullptr;
     }
 #endif
-    
-    // Load region synchronously.
 
-    _loadRegion ( htmID, nullptr, userData );
-    return _regions[htmID];
-}
+    // Load region synchronously. If it was queued for asynchronous loading, cancel that request;
+    // if an asynchronous load is already in progress, its result will be discarded.
+
+    {
+        lock_guard<mutex> lock ( _regionMutex );
+        if ( _loading.erase ( htmID ) && _pLoadPool != nullptr )
+            _pLoadPool->cancel ( htmID );
+        _misses++;
+    }
 
-// Private method to load region, possibly from a background thread.
-// Returns pointed to loaded object vector if successful or nullptr on failure.
+    return _loadRegion ( htmID, nullptr, userData, false );
+}
 
-SSObjectVec *SSHTM::_loadRegion ( uint64_t htmID, RegionLoadCallback callback, void *userData )
+// Private method to load region, possibly from a background thread (if async is true).
+// Objects are read from the data file without holding any lock, then published into
+// the region map under the region mutex. An asynchronous load whose request was
+// cancelled in the meantime discards what it read. If another thread published the
+// region first, the newly-read objects are discarded and the existing ones returned.
+// If arenas are enabled, the region's objects are allocated from its object vector's own arena,
+// so dumping the region frees them all at once, and loader threads never share an allocator.
+// A region is remembered as empty only if its data file was read and contained no objects;
+// a missing or unreadable file (or a read function returning a negative value) is not remembered,
+// so the region is read again next time.
+// Returns pointer to loaded object vector if successful or nullptr on failure.
+
+SSObjectVec *SSHTM::_loadRegion ( uint64_t htmID, RegionLoadCallback callback, void *userData, bool async )
 {
     int n = 0;
-    SSObjectVec *objects = new SSObjectVec();
-    
-    if ( _readFunc != nullptr )
-        n = _readFunc ( this, htmID, objects, userData );
-    else
-        n = SSImportObjectsFromCSV ( _rootpath + ID2name ( htmID ) + ".csv", *objects );
+    SSObjectVec *objects = new SSObjectVec ( _useArenas );
+
+    // If reading throws, forget the region was loading, so it can be requested again,
+    // and free what was read before passing the exception on (to SSThreadPool::wait() if async).
     
-    if ( n > 0 )
-        _regions[htmID] = objects;
-    else
+    try
+    {
+        SSObjectArenaScope scope ( objects->getArena() );
+        if ( _readFunc != nullptr )
+        {
+            n = _readFunc ( this, htmID, objects, userData );
+        }
+        else
+        {
+            string path = _rootpath + ID2name ( htmID ) + ".csv";
+            FILE *file = fopen ( path.c_str(), "rb" );
+            if ( file != nullptr )
+            {
+                fclose ( file );
+                n = SSImportObjectsFromCSV ( path, *objects, nullptr, nullptr, 1 );
+            }
+            else
+            {
+                n = -1;
+            }
+        }
+    }
+    catch ( ... )
+    {
+        if ( async )
+        {
+            lock_guard<mutex> lock ( _regionMutex );
+            _loading.erase ( htmID );
+        }
+        
         delete objects;
+        throw;
+    }
+
+    size_t bytes = n > 0 ? objects->memoryUsage() : 0;
+    SSObjectVec *pLoaded = nullptr;
+    bool wanted = true, overBudget = false;
+
+    {
+        lock_guard<mutex> lock ( _regionMutex );
+        if ( async )
+            wanted = _loading.erase ( htmID ) > 0;
+
+        auto it = _regions.find ( htmID );
+        if ( it != _regions.end() && it->second != nullptr )
+        {
+            pLoaded = it->second;
+        }
+        else if ( n < 1 && wanted )
+        {
+            if ( n == 0 )
+                _empty.insert ( htmID );
+        }
+        else if ( wanted )
+        {
+            _regions[htmID] = objects;
+            pLoaded = objects;
+            
+            RegionUse &use = _regionUse[htmID];
+            use.bytes = bytes;
+            use.lastUse = ++_useClock;
+            _memoryUsed += bytes;
+            
+            overBudget = ! async && _memoryBudget > 0 && _memoryUsed > _memoryBudget;
+            if ( overBudget )
+                use.pins++;
+        }
+    }
+
+    if ( pLoaded != objects )
+        delete objects;
+
+    // If a synchronous load put the HTM over its memory budget, evict others now rather than on the next
+    // load. The new region stays pinned meanwhile, so the pointer returned to the caller remains valid.
+    // Background loads never evict, since only the owner thread may dump regions; the owner's next
+    // loadRegion() or evictRegions() brings the HTM back within its budget.
     
-    if ( callback != nullptr )
+    if ( overBudget )
+    {
+        evictRegions();
+        unpinRegion ( htmID );
+    }
+
+    if ( callback != nullptr && wanted )
         callback ( this, htmID );
 
-    return objects;
+    return pLoaded;
+}
+
+// Returns the angular distance in radians from the load center to the center
+// of a region's triangle, or the region's HTM level if no load center is set.
+
+double SSHTM::_centerDistance ( uint64_t htmID )
+{
+    SSVector center = _loadCenter;
+    if ( htmID == 0 || center.isinf() || center.magnitude() == 0.0 )
+        return IDlevel ( htmID );
+
+    Cap cap;
+    if ( ! getCap ( htmID, cap ) )
+        return INFINITY;
+
+    return center.angularSeparation ( cap.center );
+}
+
+// Returns the priority for asynchronously loading a region; regions with lower values are loaded sooner.
+// With kLoadNearestFirst, this is the region's distance from the load center (see _centerDistance()).
+// With kLoadBrightestFirst, it is the region's HTM level, plus a fraction ordering regions
+// within a level by distance from the load center.
+
+double SSHTM::_loadPriority ( uint64_t htmID )
+{
+    if ( _loadOrder == kLoadNearestFirst )
+        return _centerDistance ( htmID );
+    
+    SSVector center = _loadCenter;
+    int level = IDlevel ( htmID );
+    if ( htmID == 0 || center.isinf() || center.magnitude() == 0.0 )
+        return level;
+    
+    return level + _centerDistance ( htmID ) / ( 2.0 * M_PI );
+}
+
+// Sets the center of interest (typically the view center) as a unit vector.
+// Queued asynchronous loads are re-ordered so that regions nearest the new center are loaded first.
+
+void SSHTM::setLoadCenter ( const SSVector &center )
+{
+    lock_guard<mutex> lock ( _regionMutex );
+    _loadCenter = center;
+    if ( _pLoadPool != nullptr )
+        _pLoadPool->reprioritize ( [this] ( uint64_t htmID ) { return _loadPriority ( htmID ); } );
+}
+
+// Sets the order in which queued asynchronous loads are started, and re-orders loads already queued.
+
+void SSHTM::setLoadOrder ( LoadOrder order )
+{
+    lock_guard<mutex> lock ( _regionMutex );
+    _loadOrder = order;
+    if ( _pLoadPool != nullptr )
+        _pLoadPool->reprioritize ( [this] ( uint64_t htmID ) { return _loadPriority ( htmID ); } );
+}
+
+// Tests whether a region is queued or currently being loaded asynchronously.
+
+bool SSHTM::regionLoading ( uint64_t htmID )
+{
+    lock_guard<mutex> lock ( _regionMutex );
+    return _loading.count ( htmID ) > 0;
+}
+
+// Returns number of regions queued or currently being loaded asynchronously.
+
+int SSHTM::countLoading ( void )
+{
+    lock_guard<mutex> lock ( _regionMutex );
+    return (int) _loading.size();
+}
+
+// Cancels asynchronous loads of all regions if testFunc is nullptr; otherwise
+// cancels only those regions for which testFunc returns true. Regions which have not
+// started loading are removed from the queue; regions already being loaded finish,
+// but their objects are discarded and the load callback is not called.
+// Returns number of region loads cancelled.
+
+int SSHTM::cancelLoads ( RegionTestCallback testFunc, void *userData )
+{
+    vector<uint64_t> htmIDs;
+
+    {
+        lock_guard<mutex> lock ( _regionMutex );
+        htmIDs.assign ( _loading.begin(), _loading.end() );
+    }
+
+    int n = 0;
+    for ( uint64_t htmID : htmIDs )
+    {
+        if ( testFunc != nullptr && ! testFunc ( this, htmID, userData ) )
+            continue;
+
+        lock_guard<mutex> lock ( _regionMutex );
+        if ( _loading.erase ( htmID ) )
+        {
+            if ( _pLoadPool != nullptr )
+                _pLoadPool->cancel ( htmID );
+            n++;
+        }
+    }
+
+    return n;
+}
+
+// Blocks until all queued and in-progress asynchronous region loads have finished.
+
+void SSHTM::waitLoads ( void )
+{
+    if ( _pLoadPool != nullptr )
+        _pLoadPool->wait();
+}
+
+// Returns approximate memory used by all loaded regions in this HTM, in bytes.
+
+size_t SSHTM::getMemoryUsage ( void )
+{
+    lock_guard<mutex> lock ( _regionMutex );
+    return _memoryUsed;
+}
+
+// Returns approximate memory used by a single loaded region, in bytes;
+// zero if the region is not loaded.
+
+size_t SSHTM::getMemoryUsage ( uint64_t htmID )
+{
+    lock_guard<mutex> lock ( _regionMutex );
+    auto it = _regionUse.find ( htmID );
+    return it == _regionUse.end() ? 0 : it->second.bytes;
+}
+
+// Pins a region so it will not be evicted, whether or not it is loaded yet.
+// Pins are counted: each call to pinRegion() must be matched by a call to unpinRegion().
+
+void SSHTM::pinRegion ( uint64_t htmID )
+{
+    lock_guard<mutex> lock ( _regionMutex );
+    _regionUse[htmID].pins++;
+}
+
+void SSHTM::unpinRegion ( uint64_t htmID )
+{
+    lock_guard<mutex> lock ( _regionMutex );
+    auto it = _regionUse.find ( htmID );
+    if ( it != _regionUse.end() && it->second.pins > 0 )
+        it->second.pins--;
+}
+
+// Tests whether a region is currently pinned.
+
+bool SSHTM::regionPinned ( uint64_t htmID )
+{
+    lock_guard<mutex> lock ( _regionMutex );
+    auto it = _regionUse.find ( htmID );
+    return it != _regionUse.end() && it->second.pins > 0;
+}
+
+// Evicts unpinned regions until memory used by loaded regions is within the memory budget.
+// With kEvictLeastRecentlyUsed, least recently accessed regions are evicted first.
+// With kEvictFarthestFromCenter, regions farthest from the load center are evicted first
+// (deepest regions first if no load center is set), least recently accessed among equals.
+// Does nothing if no memory budget is set. Returns the number of regions evicted.
+
+int SSHTM::evictRegions ( void )
+{
+    struct Candidate
+    {
+        uint64_t htmID;
+        double   distance;
+        uint64_t lastUse;
+        size_t   bytes;
+    };
+    
+    vector<Candidate> candidates;
+    size_t excess = 0;
+    
+    {
+        lock_guard<mutex> lock ( _regionMutex );
+        if ( _memoryBudget == 0 || _memoryUsed <= _memoryBudget )
+            return 0;
+        
+        excess = _memoryUsed - _memoryBudget;
+        for ( auto it = _regions.begin(); it != _regions.end(); it++ )
+        {
+            RegionUse &use = _regionUse[it->first];
+            if ( use.pins > 0 )
+                continue;
+            
+            double distance = _evictionPolicy == kEvictFarthestFromCenter ? _centerDistance ( it->first ) : 0.0;
+            candidates.push_back ( { it->first, distance, use.lastUse, use.bytes } );
+        }
+    }
+    
+    // Sort candidates so the first to evict come first.
+    
+    sort ( candidates.begin(), candidates.end(), [] ( const Candidate &c1, const Candidate &c2 )
+    {
+        if ( c1.distance != c2.distance )
+            return c1.distance > c2.distance;
+        return c1.lastUse < c2.lastUse;
+    } );
+    
+    int n = 0;
+    size_t freed = 0;
+    for ( size_t i = 0; i < candidates.size() && freed < excess; i++ )
+    {
+        dumpRegion ( candidates[i].htmID );
+        freed += candidates[i].bytes;
+        n++;
+    }
+    
+    lock_guard<mutex> lock ( _regionMutex );
+    _evictions += n;
+    return n;
 }
 
 // Tests whether star data for a specific region in this HTM has been
@@ -284,90 +808,130 @@ SSObjectVec *SSHTM::_loadRegion ( uint64_t htmID, RegionLoadCallback callback, v
 
 bool SSHTM::regionLoaded ( uint64_t htmID )
 {
-    return _regions[htmID] != nullptr;
+    return getObjects ( htmID ) != nullptr;
+}
+
+// Tests whether a region's data file has been read and found to contain no objects.
+// Such regions are not read again by loadRegion() until saved by saveRegion(), all regions
+// are dumped, or a new data file read function is installed.
+
+bool SSHTM::regionEmpty ( uint64_t htmID )
+{
+    lock_guard<mutex> lock ( _regionMutex );
+    return _empty.count ( htmID ) > 0;
 }
 
 // Returns pointer to array of objects stored in the region
 // with the specified HTM triangle ID. If region is not present
 // in this HTM or objects have not been loaded, returns nullptr.
+// The returned pointer remains valid until the region is dumped or evicted.
+// Marks the region as most recently used.
 
 SSObjectVec *SSHTM::getObjects ( uint64_t htmID )
 {
-    return _regions[htmID];
+    lock_guard<mutex> lock ( _regionMutex );
+    auto it = _regions.find ( htmID );
+    if ( it == _regions.end() )
+        return nullptr;
+    
+    _regionUse[htmID].lastUse = ++_useClock;
+    return it->second;
 }
 
 // Deletes all star data for a specific region in this HTM from memory.
+// If the region is queued or being loaded asynchronously, that load is cancelled.
 
 void SSHTM::dumpRegion ( uint64_t htmID )
 {
-#if USE_THREADS
-    // If still loading this region asynchronously, wait for load to complete
-    
-    if ( _loadThreads.count ( htmID ) != 0 )
+    SSObjectVec *pObjects = nullptr;
+
     {
-        if ( _loadThreads[htmID]->joinable() )
-            _loadThreads[htmID]->join();
-        delete _loadThreads[htmID];
-        _loadThreads.erase ( htmID );
+        lock_guard<mutex> lock ( _regionMutex );
+        if ( _loading.erase ( htmID ) && _pLoadPool != nullptr )
+            _pLoadPool->cancel ( htmID );
+
+        auto it = _regions.find ( htmID );
+        if ( it != _regions.end() )
+        {
+            pObjects = it->second;
+            _regions.erase ( it );
+        }
+        
+        // Release region's memory accounting, but remember its pins in case it is reloaded.
+        
+        auto use = _regionUse.find ( htmID );
+        if ( use != _regionUse.end() )
+        {
+            _memoryUsed -= min ( _memoryUsed, use->second.bytes );
+            if ( use->second.pins > 0 )
+                use->second.bytes = 0;
+            else
+                _regionUse.erase ( use );
+        }
     }
-#endif
 
     // Now delete object vector (and its objects) associated with this region.
-    
-    if ( _regions.count ( htmID ) )
-    {
-        if ( _regions[htmID] != nullptr )
-            delete _regions[htmID];
-        _regions.erase ( htmID );
-    }
+
+    delete pObjects;
 }
 
-// Deletes all star data for all regions in this HTM from memory if testFunc is nullptr.
-// Otherwise deletes only regions for which testFunc returns true.
+// Deletes all star data for all regions in this HTM from memory if testFunc is nullptr,
+// cancels all asynchronous loads, and forgets which regions were found empty. Otherwise deletes only regions for which testFunc
+// returns true, and leaves asynchronous loads in progress.
 // userData is a pointer to arbitrary user-defined data passed to testFunc (if not nullptr).
 
 void SSHTM::dumpRegions ( RegionTestCallback testFunc, void *userData )
 {
-#if USE_THREADS
-    // Let all load threads run to completion, and delete them before destroying regions!
-    
-    for ( auto it = _loadThreads.begin(); it != _loadThreads.end(); it++ )
+    if ( testFunc == nullptr )
     {
-        if ( it->second != nullptr )
-        {
-            if ( it->second->joinable() )
-                it->second->join();
-            delete it->second;
-        }
+        cancelLoads();
+        lock_guard<mutex> lock ( _regionMutex );
+        _empty.clear();
     }
-#endif
-    
-    // Now delete object vectors (and their objects) for all loaded regions.
-    
-    for ( auto it = _regions.begin(); it != _regions.end(); it++ )
+
+    // Collect region IDs first, so testFunc is not called while holding the region mutex.
+
+    vector<uint64_t> htmIDs;
+
     {
-        if ( it->second != nullptr )
-        {
-            if ( testFunc == nullptr )
-                delete it->second;
-            else if ( testFunc ( this, it->first, userData ) )
-                delete it->second;
-        }
+        lock_guard<mutex> lock ( _regionMutex );
+        for ( auto it = _regions.begin(); it != _regions.end(); it++ )
+            htmIDs.push_back ( it->first );
     }
 
-#if USE_THREADS
-    _loadThreads.clear();
-#endif
-    _regions.clear();
+    // Now delete object vectors (and their objects) for regions which pass the test.
+
+    for ( uint64_t htmID : htmIDs )
+        if ( testFunc == nullptr || testFunc ( this, htmID, userData ) )
+            dumpRegion ( htmID );
 }
 
-// Empties all regions in this HTM, but does not delete objects!
+// Empties all regions in this HTM, but does not delete objects! Objects in regions loaded with arenas
+// (see setUseArenas()) were allocated from their regions' arenas, so they still die when the regions
+// are dumped or this HTM is destroyed; use SSObjectArray::detach() to keep them beyond that.
 
 void SSHTM::clearRegions ( void )
 {
+    lock_guard<mutex> lock ( _regionMutex );
     for ( auto it = _regions.begin(); it != _regions.end(); it++ )
         if ( it->second != nullptr )
             it->second->clear();
+    
+    for ( auto it = _regionUse.begin(); it != _regionUse.end(); it++ )
+        it->second.bytes = 0;
+    _memoryUsed = 0;
+}
+
+// Installs a custom function for reading region data files, or restores the default CSV reader
+// if (func) is nullptr. The function should return the number of objects it read, or a negative
+// value if the region's data file could not be read. Regions found empty with the previous
+// function are forgotten, so they will be read again with the new one.
+
+void SSHTM::setDataFileReadFunc ( DataFileFunc func )
+{
+    lock_guard<mutex> lock ( _regionMutex );
+    _readFunc = func;
+    _empty.clear();
 }
 
 // Counts total number of stars stored in all regions in this HTM.
@@ -375,6 +939,7 @@ void SSHTM::clearRegions ( void )
 int SSHTM::countStars ( void )
 {
     int count = 0;
+    lock_guard<mutex> lock ( _regionMutex );
     
     for ( auto it = _regions.begin(); it != _regions.end(); it++ )
         if ( it->second != nullptr )
@@ -387,12 +952,8 @@ int SSHTM::countStars ( void )
 
 int SSHTM::countStars ( uint64_t htmID )
 {
-    int count = 0;
-    
-    if ( _regions.count ( htmID ) && _regions[htmID] != nullptr )
-        count = (int) _regions[htmID]->size();
-
-    return count;
+    SSObjectVec *pObjects = getObjects ( htmID );
+    return pObjects ? (int) pObjects->size() : 0;
 }
 
 // Given a unit vector to a point on the celestial sphere, returns the HTM ID
@@ -444,6 +1005,106 @@ bool SSHTM::name2Triangle ( const string &name, SSVector &v0, SSVector &v1, SSVe
     return cc_name2Triangle ( name.c_str(), &v0.x, &v1.x, &v2.x ) == 0;
 }
 
+// Given an HTM triangle ID, computes unit vectors to the triangle's three vertices
+// on the unit sphere (v0, v1, v2) directly from the ID's bits, without converting
+// the ID to a name string. Returns true if the ID is valid, or false otherwise.
+// The origin region (ID 0) has no vertices, so this returns false for it.
+
+bool SSHTM::ID2Triangle ( uint64_t id, SSVector &v0, SSVector &v1, SSVector &v2 )
+{
+    return cc_ID2Triangle ( id, &v0.x, &v1.x, &v2.x ) == 0;
+}
+
+// Replaces the vertices of an HTM triangle (v0, v1, v2) with those of its
+// child triangle number (child), from 0 to 3, using the HTM midpoint subdivision.
+
+void SSHTM::subTriangle ( int child, SSVector &v0, SSVector &v1, SSVector &v2 )
+{
+    cc_subTriangle ( child, &v0.x, &v1.x, &v2.x );
+}
+
+// Computes the smallest cap centered on the normalized centroid of an HTM triangle
+// whose vertices are (v0, v1, v2) which contains all three vertices.
+
+SSHTM::Cap SSHTM::triangleCap ( SSVector v0, SSVector v1, SSVector v2 )
+{
+    Cap cap;
+    
+    cap.center = ( v0 + v1 + v2 ).normalize();
+    cap.cosRad = min ( min ( cap.center * v0, cap.center * v1 ), cap.center * v2 );
+    cap.cosRad = max ( -1.0, min ( 1.0, cap.cosRad ) );
+    cap.sinRad = sqrt ( 1.0 - cap.cosRad * cap.cosRad );
+    cap.radius = acos ( cap.cosRad );
+    
+    return cap;
+}
+
+// Gets bounding cap of the HTM triangle with the specified ID (id).
+// Caps of triangles in the top levels of the mesh are computed once and cached in a
+// table indexed by ID; deeper caps are computed on demand. The origin region's
+// cap covers the whole sphere. Returns false if the ID is invalid.
+
+static const int kCapCacheLevels = 6;                                       // HTM levels 1 - 6 ...
+static const uint64_t kCapCacheSize = 16ULL << ( 2 * ( kCapCacheLevels - 1 ) );   // ... are IDs 8 - 16383
+
+static void buildCapTable ( vector<SSHTM::Cap> &table, uint64_t id, int level, SSVector v0, SSVector v1, SSVector v2 )
+{
+    table[id] = SSHTM::triangleCap ( v0, v1, v2 );
+    if ( level >= kCapCacheLevels )
+        return;
+
+    for ( int k = 0; k < 4; k++ )
+    {
+        SSVector w0 = v0, w1 = v1, w2 = v2;
+        SSHTM::subTriangle ( k, w0, w1, w2 );
+        buildCapTable ( table, id * 4 + k, level + 1, w0, w1, w2 );
+    }
+}
+
+static const vector<SSHTM::Cap> &capTable ( void )
+{
+    static const vector<SSHTM::Cap> table = []
+    {
+        vector<SSHTM::Cap> t ( kCapCacheSize );
+        for ( uint64_t id = 8; id < 16; id++ )
+        {
+            SSVector v0, v1, v2;
+            cc_ID2Triangle ( id, &v0.x, &v1.x, &v2.x );
+            buildCapTable ( t, id, 1, v0, v1, v2 );
+        }
+        return t;
+    } ();
+    
+    return table;
+}
+
+bool SSHTM::getCap ( uint64_t id, Cap &cap )
+{
+    if ( id == 0 )
+    {
+        cap = { SSVector ( 0.0, 0.0, 1.0 ), M_PI, -1.0, 0.0 };
+        return true;
+    }
+    
+    // Cached caps are only valid for real trixel IDs, whose top bits select a root triangle (8 - 15);
+    // an ID like 16 or 17 would otherwise read an unfilled table entry.
+    
+    if ( id < kCapCacheSize )
+    {
+        if ( id < 8 || ( id >> ( 2 * cc_IDlevel ( id ) ) ) > 15 )
+            return false;
+        cap = capTable()[id];
+        return true;
+    }
+    
+    SSVector v0, v1, v2;
+    if ( cc_ID2Triangle ( id, &v0.x, &v1.x, &v2.x ) != 0 )
+        return false;
+    
+    cap = triangleCap ( v0, v1, v2 );
+    return true;
+}
+
 // Given a unit vector to a point on the celestial sphere (p), determines if p is inside
 // the triangle on the celestial sphere whose vertices are the unit vectors (v0, v1, v2).
 
@@ -547,12 +1208,13 @@ double cc_sqrt3    = 1.7320508075688772935;
 
 #define copy_vec(d, s) { d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; }
 
+// Computes the HTM ID directly as an integer, two bits per level,
+// rather than building a name string and converting it with cc_name2ID().
+
 uint64_t cc_vector2ID(double x, double y, double z, int depth)
 {
   uint64_t rstat = 0;
-  int startID;
   char name[80];
-  int len = 0;
 
   double v1[3], v2[3], v0[3];
   double w1[3], w2[3], w0[3];
@@ -565,8 +1227,7 @@ uint64_t cc_vector2ID(double x, double y, double z, int depth)
 
   // Get the ID of the level0 triangle, and its starting vertices
 
-  startID = cc_startpane(v0, v1, v2, x, y, z, name);
-  len = 2;
+  rstat = cc_startpane(v0, v1, v2, x, y, z, name);
 
   // Start searching for the children
 
@@ -576,24 +1237,24 @@ uint64_t cc_vector2ID(double x, double y, double z, int depth)
     m4_midpoint(v2, v0, w1, dtmp);
 
     if (cc_isinside(p, v0, w2, w1)) {
-      name[len++] = '0';
+      rstat = rstat * 4 + 0;
       copy_vec(v1, w2);
       copy_vec(v2, w1);
     }
     else if (cc_isinside(p, v1, w0, w2)) {
-      name[len++] = '1';
+      rstat = rstat * 4 + 1;
       copy_vec(v0, v1);
       copy_vec(v1, w0);
       copy_vec(v2, w2);
     }
     else if (cc_isinside(p, v2, w1, w0)) {
-      name[len++] = '2';
+      rstat = rstat * 4 + 2;
       copy_vec(v0, v2);
       copy_vec(v1, w1);
       copy_vec(v2, w0);
     }
     else if (cc_isinside(p, w0, w1, w2)) {
-      name[len++] ='3';
+      rstat = rstat * 4 + 3;
       copy_vec(v0, w0);
       copy_vec(v1, w1);
       copy_vec(v2, w2);
@@ -602,8 +1263,6 @@ uint64_t cc_vector2ID(double x, double y, double z, int depth)
       return HTM_INVALID_ID;
     }
   }
-  name[len] = '\0';
-  rstat = cc_name2ID(name);
   return rstat;
 }
 
@@ -717,6 +1376,65 @@ int cc_ID2name(char *name, uint64_t id)
   return 0;
 }
 
+// Computes vertices of the HTM triangle with the given ID directly from the ID's bits:
+// the top bits select one of the eight root triangles, then each following pair of bits
+// selects a child triangle. Returns 0 on success or -1 if the ID is invalid.
+
+int cc_ID2Triangle(uint64_t id, double *v0, double *v1, double *v2)
+{
+  int level = id < 8 ? -1 : cc_IDlevel(id);
+  if(level < 0 || (level == 0 && id < 8))
+    return -1;
+
+  int root = (int) (id >> (2 * level));     // 8 - 15
+  if(root < 8 || root > 15)
+    return -1;
+  const int *offsets = root < 12 ? S_indexes[root - 8] : N_indexes[root - 12];
+
+  copy_vec(v0, anchor[offsets[0]]);
+  copy_vec(v1, anchor[offsets[1]]);
+  copy_vec(v2, anchor[offsets[2]]);
+
+  for(int i = level - 1; i >= 0; i--)
+    cc_subTriangle((int) ((id >> (2 * i)) & 3), v0, v1, v2);
+
+  return 0;
+}
+
+// Replaces triangle vertices (v0, v1, v2) with those of child triangle k (0 - 3).
+
+void cc_subTriangle(int k, double *v0, double *v1, double *v2)
+{
+  double w1[3], w2[3], w0[3];
+  double dtmp;
+
+  m4_midpoint(v0, v1, w2, dtmp);
+  m4_midpoint(v1, v2, w0, dtmp);
+  m4_midpoint(v2, v0, w1, dtmp);
+
+  switch(k) {
+  case 0:
+    copy_vec(v1, w2);
+    copy_vec(v2, w1);
+    break;
+  case 1:
+    copy_vec(v0, v1);
+    copy_vec(v1, w0);
+    copy_vec(v2, w2);
+    break;
+  case 2:
+    copy_vec(v0, v2);
+    copy_vec(v1, w1);
+    copy_vec(v2, w0);
+    break;
+  case 3:
+    copy_vec(v0, w0);
+    copy_vec(v1, w1);
+    copy_vec(v2, w2);
+    break;
+  }
+}
+
 int cc_name2Triangle(const char *name, double *v0, double *v1, double *v2)
 {
   int rstat = 0;
@@ -783,9 +1501,16 @@ size_t SSHTM::makeObjectMap ( SSCatalog cat )
 {
     NameMap  nameMap;
     IdentMap identMap;
+    vector<uint64_t> htmIDs;
 
-    for ( auto it = _regions.begin(); it != _regions.end(); it++ )
-        makeObjectMap ( cat, it->first, nameMap, identMap );
+    {
+        lock_guard<mutex> lock ( _regionMutex );
+        for ( auto it = _regions.begin(); it != _regions.end(); it++ )
+            htmIDs.push_back ( it->first );
+    }
+    
+    for ( uint64_t htmID : htmIDs )
+        makeObjectMap ( cat, htmID, nameMap, identMap );
     
     if ( cat == kCatUnknown && nameMap.size() > 0 )
         _nameIndex[cat] = nameMap;
@@ -958,13 +1683,149 @@ size_t SSHTM::loadObjectMap ( SSCatalog cat, IdentMapFunc loadFunc, void *userDa
     return n;
 }
 
+// Builds a flat index of objects in this HTM with names (if cat is kCatUnknown) or identifiers in
+// a specific catalog (cat), and replaces any existing flat index for that catalog. Every region in the
+// mesh is scanned on (numThreads) threads, or all hardware threads if zero: regions already loaded are
+// read in place; other regions are read from their data files (passing userData to the data file
+// reading function, if any), indexed, and discarded without being stored in the HTM, so the whole HTM
+// need not fit in memory. Returns number of index entries generated.
+
+size_t SSHTM::makeObjectIndex ( SSCatalog cat, int numThreads, void *userData )
+{
+    // Make a list of all possible region IDs at every level of the mesh, except those known to be empty.
+    
+    vector<uint64_t> htmIDs;
+    for ( int level = 0; level < (int) _magLevels.size(); level++ )
+    {
+        uint64_t first = level == 0 ? 0 : 8ULL << ( 2 * ( level - 1 ) );
+        uint64_t count = level == 0 ? 1 : 8ULL << ( 2 * ( level - 1 ) );
+        lock_guard<mutex> lock ( _regionMutex );
+        for ( uint64_t htmID = first; htmID < first + count; htmID++ )
+            if ( _empty.count ( htmID ) == 0 )
+                htmIDs.push_back ( htmID );
+    }
+    
+    // Gather keys and object offsets from each region on worker threads.
+    
+    vector<vector<pair<string,size_t>>> regionKeys ( htmIDs.size() );
+    auto job = [&] ( size_t i )
+    {
+        uint64_t htmID = htmIDs[i];
+        SSObjectVec *pObjects = getObjects ( htmID ), *pRead = nullptr;
+        if ( pObjects == nullptr )
+        {
+            pRead = pObjects = new SSObjectVec();
+            if ( _readFunc != nullptr )
+                _readFunc ( this, htmID, pRead, userData );
+            else
+                SSImportObjectsFromCSV ( _rootpath + ID2name ( htmID ) + ".csv", *pRead, nullptr, nullptr, 1 );
+        }
+        
+        for ( size_t offset = 0; offset < pObjects->size(); offset++ )
+        {
+            SSObjectPtr pObject = pObjects->get ( offset );
+            if ( cat == kCatUnknown )
+            {
+                for ( const string &name : pObject->getNames() )
+                    regionKeys[i].push_back ( { name, offset } );
+            }
+            else
+            {
+                for ( SSIdentifier ident : pObject->getIdentifiers() )
+                    if ( ident.catalog() == cat )
+                        regionKeys[i].push_back ( { ident.toString(), offset } );
+            }
+        }
+        
+        delete pRead;
+    };
+    
+#if USE_THREADS
+    if ( numThreads < 1 )
+        numThreads = max ( 1, (int) thread::hardware_concurrency() );
+#else
+    numThreads = 1;
+#endif
+
+    if ( numThreads > 1 )
+    {
+        SSThreadPool pool ( numThreads );
+        for ( size_t i = 0; i < htmIDs.size(); i++ )
+            pool.submit ( [&job, i] () { job ( i ); } );
+        pool.wait();
+    }
+    else
+    {
+        for ( size_t i = 0; i < htmIDs.size(); i++ )
+            job ( i );
+    }
+    
+    // Merge keys from all regions, in region order, into a new index, then sort it.
+    
+    shared_ptr<SSHTMIndex> pIndex = make_shared<SSHTMIndex>();
+    for ( size_t i = 0; i < htmIDs.size(); i++ )
+    {
+        for ( auto &key : regionKeys[i] )
+            pIndex->add ( key.first, htmIDs[i], key.second );
+        vector<pair<string,size_t>>().swap ( regionKeys[i] );
+    }
+    
+    pIndex->sort();
+    _objectIndex[cat] = pIndex;
+    return pIndex->size();
+}
+
+// Saves this HTM's flat index for the specified catalog (cat) to a binary file in the HTM's "index"
+// subdirectory, named like the CSV object map file but with extension ".idx".
+// Returns number of index entries written to file.
+
+size_t SSHTM::saveObjectIndex ( SSCatalog cat )
+{
+    SSHTMIndex *pIndex = getObjectIndex ( cat );
+    if ( pIndex == nullptr )
+        return 0;
+    
+    string catname = cat == kCatUnknown ? string ( "Name" ) : catalog_to_string ( cat );
+    string filepath ( _rootpath + "index/" + catname + ".idx" );
+    return pIndex->save ( filepath ) ? pIndex->size() : 0;
+}
+
+// Loads a flat index for the specified catalog (cat) saved by saveObjectIndex(); the index file
+// is memory-mapped where possible. Returns number of index entries loaded.
+
+size_t SSHTM::loadObjectIndex ( SSCatalog cat )
+{
+    string catname = cat == kCatUnknown ? string ( "Name" ) : catalog_to_string ( cat );
+    string filepath ( _rootpath + "index/" + catname + ".idx" );
+    
+    shared_ptr<SSHTMIndex> pIndex = make_shared<SSHTMIndex>();
+    if ( ! pIndex->load ( filepath ) )
+        return 0;
+    
+    _objectIndex[cat] = pIndex;
+    return pIndex->size();
+}
+
+// Returns pointer to this HTM's flat index for the specified catalog (cat), or nullptr if none.
+
+SSHTMIndex *SSHTM::getObjectIndex ( SSCatalog cat )
+{
+    auto it = _objectIndex.find ( cat );
+    return it == _objectIndex.end() ? nullptr : it->second.get();
+}
+
 // Given an identifier, uses this HTM's identifier index to find all objects matching
 // the identifier. Object locations are appended to the vector (results).
+// Uses the flat index for the identifier's catalog, if present.
 // Returns number of object locations found.
 
 int SSHTM::findObjectLocs ( SSIdentifier ident, vector<SSHTM::ObjectLoc> &results )
 {
     SSCatalog cat = ident.catalog();
+    SSHTMIndex *pIndex = getObjectIndex ( cat );
+    if ( pIndex != nullptr )
+        return pIndex->find ( ident.toString(), results );
+    
     if ( objectMapSize ( cat ) == 0 )
         return 0;
     
@@ -981,10 +1842,15 @@ int SSHTM::findObjectLocs ( SSIdentifier ident, vector<SSHTM::ObjectLoc> &result
 // Given a name string (name), uses this HTM's name index to find all objects matching the name string.
 // Pass true for (casesens) for Case-Sensitive string matching; pass false for case-insensitive matching.
 // Pass true for (begins) for "begins-with" string matching; pass false for whole-string matching.
+// If this HTM has a flat name index, all of these are binary searches.
 // Object locations are appended to the vector (results); returns number of object locations found.
 
 int SSHTM::findObjectLocs ( const string &name, vector<SSHTM::ObjectLoc> &results, bool casesens, bool begins )
 {
+    SSHTMIndex *pIndex = getObjectIndex ( kCatUnknown );
+    if ( pIndex != nullptr )
+        return pIndex->find ( name, results, casesens, begins );
+    
     if ( objectMapSize ( kCatUnknown ) == 0 )
         return 0;
     
@@ -1013,6 +1879,16 @@ int SSHTM::findObjectLocs ( const string &name, vector<SSHTM::ObjectLoc> &result
     return (int) results.size() - n;
 }
 
+// Finds distinct object names beginning with a string (prefix), ignoring case, for autocompletion,
+// using this HTM's flat name index. Names are appended to (names) in sorted order; at most (maxNames)
+// are returned, unless zero. Returns number of names found, or zero if there is no flat name index.
+
+int SSHTM::completeNames ( const string &prefix, vector<string> &names, int maxNames )
+{
+    SSHTMIndex *pIndex = getObjectIndex ( kCatUnknown );
+    return pIndex ? pIndex->complete ( prefix, names, maxNames ) : 0;
+}
+
 // Given an object location in this HTM, synchronously loads the region containing the object
 // (if not already loaded) and returns a pointer to the object, or nullptr on failure.
 
@@ -1028,32 +1904,403 @@ SSObjectPtr SSHTM::loadObject ( const ObjectLoc &loc )
 // Searches an HTM region and all of its sub-regions, recursively, for objects within a circle
 // centered on the celestial sphere at unit direction vector (center) in the fundamental frame,
 // of (radius) radians. Only searches regions pre-loaded into memory; does not load regions.
+// Only stars and deep sky objects are found, by their fundamental positions; see SSObjectArray::search().
 // Results are appended to vector (results). Returns number of objects found within circle.
 
 int SSHTM::search ( uint64_t htmID, SSVector center, SSAngle rad, vector<SSObjectPtr> &results )
 {
-    // Unless this is the root region, get region center and angular radius. Always search root!
-    // If non-root region's bounding circle does not intersect search circle, don't search it.
+    double cosRad = cos ( rad ), sinRad = sin ( rad );
+    
+    // The root region has no vertices; search its objects, then the eight HTM root triangles.
     
-    if ( htmID > 0 )
+    if ( htmID == 0 )
     {
-        SSVector v0, v1, v2;
-        name2Triangle ( ID2name ( htmID ), v0, v1, v2 );
-        SSVector vC = ( v0 + v1 + v2 ) / 3.0;
-        SSAngle r = vC.angularSeparation ( v0 );
-        if ( center.angularSeparation ( vC ) > r + rad )
-            return 0;
+        SSObjectVec *pObjects = getObjects ( 0 );
+        int n = pObjects ? pObjects->search ( center, rad, results ) : 0;
+        
+        if ( _magLevels.size() > 1 )
+        {
+            for ( uint64_t id = 8; id < 16; id++ )
+            {
+                SSVector v0, v1, v2;
+                ID2Triangle ( id, v0, v1, v2 );
+                n += _search ( id, 1, v0, v1, v2, center, rad, cosRad, sinRad, results );
+            }
+        }
+        
+        return n;
     }
     
+    SSVector v0, v1, v2;
+    if ( ! ID2Triangle ( htmID, v0, v1, v2 ) )
+        return 0;
+    
+    return _search ( htmID, IDlevel ( htmID ), v0, v1, v2, center, rad, cosRad, sinRad, results );
+}
+
+// Recursive part of search(), for a non-root region (htmID) at a known level whose
+// vertices (v0, v1, v2) are passed down from its parent, so no region geometry is
+// recomputed from IDs or names. The search circle's radius (rad) and its cosine
+// and sine (cosRad, sinRad) are precomputed once by search().
+
+int SSHTM::_search ( uint64_t htmID, int level, SSVector v0, SSVector v1, SSVector v2, SSVector center, double rad, double cosRad, double sinRad, vector<SSObjectPtr> &results )
+{
+    // If region's bounding cap does not intersect search circle, don't search it. The cap and circle
+    // intersect if the angle between their centers is at most the sum of their radii, i.e. if the
+    // cosine of that angle is at least cos ( capRad + rad ).
+    
+    Cap cap = htmID < kCapCacheSize ? capTable()[htmID] : triangleCap ( v0, v1, v2 );
+    if ( cap.radius + rad < M_PI && center * cap.center < cap.cosRad * cosRad - cap.sinRad * sinRad )
+        return 0;
+    
     // Search this region's objects if they're loaded into memory.
     // Then recursively search this region's sub-regions.
     
     SSObjectVec *pObjects = getObjects ( htmID );
     int n = pObjects ? pObjects->search ( center, rad, results ) : 0;
     
-    vector<uint64_t> subIDs = subRegionIDs ( htmID );
-    for ( int i = 0; i < subIDs.size(); i++ )
-       n += search ( subIDs[i], center, rad, results );
+    if ( level < (int) _magLevels.size() - 1 )
+    {
+        for ( int k = 0; k < 4; k++ )
+        {
+            SSVector w0 = v0, w1 = v1, w2 = v2;
+            subTriangle ( k, w0, w1, w2 );
+            n += _search ( htmID * 4 + k, level + 1, w0, w1, w2, center, rad, cosRad, sinRad, results );
+        }
+    }
+    
+    return n;
+}
+
+// Returns a convex region containing a single circle of angular radius (rad)
+// centered on the celestial sphere at unit direction vector (center).
+
+SSHTM::Convex SSHTM::circleConvex ( SSVector center, SSAngle rad )
+{
+    Convex convex;
+    
+    if ( rad < SSAngle::kPi )
+        convex.push_back ( { center.normalize(), cos ( rad ) } );
+    
+    return convex;
+}
+
+// Returns a convex region bounded by the great-circle edges of a convex spherical polygon
+// whose vertices are unit vectors on the celestial sphere. Vertices may be given in either
+// clockwise or counter-clockwise order; the polygon must be smaller than a hemisphere.
+
+SSHTM::Convex SSHTM::polygonConvex ( const vector<SSVector> &vertices )
+{
+    Convex convex;
+    size_t n = vertices.size();
+    if ( n < 3 )
+        return convex;
+    
+    SSVector centroid;
+    for ( SSVector v : vertices )
+        centroid += v;
+    
+    for ( size_t i = 0; i < n; i++ )
+    {
+        SSVector v0 = vertices[i], v1 = vertices[ ( i + 1 ) % n ];
+        convex.push_back ( { v0.crossProduct ( v1 ).normalize(), 0.0 } );
+    }
+    
+    // If the polygon's centroid lies outside the edge constraints, vertices were clockwise;
+    // flip all edge normals so they point into the polygon.
+    
+    if ( centroid * convex[0].normal < 0.0 )
+        for ( Constraint &c : convex )
+            c.normal = c.normal * -1.0;
+    
+    return convex;
+}
+
+// Returns a convex region covering the part of the celestial sphere visible in a view's
+// bounding rectangle, in the same frame as the view's center matrix. For gnomonic views,
+// this is the exact spherical quadrilateral whose vertices are the rectangle's corners.
+// For other projections, it is a circle around the view center enclosing points sampled
+// along the rectangle's edges. If the view covers a hemisphere or more, or parts of its
+// rectangle lie off the sphere, returns an empty convex region (i.e. the whole sky).
+
+SSHTM::Convex SSHTM::viewConvex ( SSView &view )
+{
+    double left = view.getLeft(), top = view.getTop(), right = view.getRight(), bottom = view.getBottom();
+    
+    if ( view.getProjection() == kGnomonic )
+    {
+        vector<SSVector> corners =
+        {
+            view.unproject ( SSVector ( left, top, 0.0 ) ),
+            view.unproject ( SSVector ( right, top, 0.0 ) ),
+            view.unproject ( SSVector ( right, bottom, 0.0 ) ),
+            view.unproject ( SSVector ( left, bottom, 0.0 ) )
+        };
+        
+        for ( SSVector &corner : corners )
+            if ( corner.isinf() )
+                return Convex();
+        
+        return polygonConvex ( corners );
+    }
+    
+    // Azimuthal projections are farthest from the center at the rectangle's corners;
+    // other projections are sampled at several points along each edge.
+    
+    bool azimuthal = view.getProjection() == kOrthographic || view.getProjection() == kStereographic;
+    int nSteps = azimuthal ? 1 : 8;
+    SSVector center = view.getCenterVector();
+    double rad = 0.0;
+    
+    for ( int i = 0; i <= nSteps; i++ )
+    {
+        double x = left + ( right - left ) * i / nSteps;
+        double y = top + ( bottom - top ) * i / nSteps;
+        SSVector points[4] =
+        {
+            view.unproject ( SSVector ( x, top, 0.0 ) ),
+            view.unproject ( SSVector ( x, bottom, 0.0 ) ),
+            view.unproject ( SSVector ( left, y, 0.0 ) ),
+            view.unproject ( SSVector ( right, y, 0.0 ) )
+        };
+        
+        for ( SSVector &p : points )
+        {
+            if ( p.isinf() )
+                return Convex();
+            rad = max ( rad, (double) center.angularSeparation ( p ) );
+        }
+    }
+    
+    if ( rad >= SSAngle::kHalfPi )
+        return Convex();
+    
+    return circleConvex ( center, rad );
+}
+
+// Tests whether a unit vector (p) lies inside all constraints of a convex region.
+
+bool SSHTM::insideConvex ( const Convex &convex, SSVector p )
+{
+    for ( const Constraint &c : convex )
+        if ( p * c.normal < c.dist )
+            return false;
+    
+    return true;
+}
+
+// Classifies the HTM triangle with vertices (v0, v1, v2) and bounding cap (cap) relative
+// to a convex region. A triangle is fully inside if it is inside every constraint,
+// and outside if it is outside any one; otherwise it is partially inside. Partial
+// classification is conservative: such a triangle may still miss the convex region.
+
+SSHTM::CoverType SSHTM::classify ( const Convex &convex, SSVector v0, SSVector v1, SSVector v2, const Cap &cap )
+{
+    CoverType type = kCoverFull;
+    
+    for ( const Constraint &c : convex )
+    {
+        SSVector normal = c.normal, center = cap.center;
+        int n = ( v0 * normal >= c.dist ) + ( v1 * normal >= c.dist ) + ( v2 * normal >= c.dist );
+        
+        // A cap no larger than a hemisphere is convex, so contains the whole triangle if it contains
+        // all three vertices. A larger cap's complement is a smaller cap which may still cut into
+        // the triangle, unless the complement and the triangle's bounding cap are disjoint.
+        
+        if ( n == 3 )
+        {
+            double r = acos ( -c.dist );
+            if ( c.dist < 0.0 && ( cap.radius + r >= SSAngle::kPi || center * normal * -1.0 >= cos ( cap.radius + r ) ) )
+                type = kCoverPartial;
+            continue;
+        }
+        
+        // If no vertices are inside, and the constraint is a hemisphere or larger, its convex
+        // complement contains the whole triangle. A smaller cap may still lie inside the triangle
+        // or cross one of its edges, unless the cap and the triangle's bounding cap are disjoint.
+        
+        if ( n == 0 )
+        {
+            if ( c.dist <= 0.0 )
+                return kCoverOutside;
+            
+            double r = acos ( c.dist );
+            if ( cap.radius + r < SSAngle::kPi && center * normal < cos ( cap.radius + r ) )
+                return kCoverOutside;
+        }
+        
+        type = kCoverPartial;
+    }
+    
+    return type;
+}
+
+// Computes the set of HTM triangles at a target level (level) which intersect a convex region.
+// The triangles are returned as sorted, non-overlapping ranges of IDs (ranges) at the target
+// level, where adjacent IDs with the same classification (full or partial) are merged into one
+// range. A triangle fully inside the convex region at a coarser level yields a single range
+// covering all of its descendants at the target level. Level zero is the single origin region
+// (ID 0). Returns the total number of triangles covered at the target level.
+
+int SSHTM::cover ( const Convex &convex, int level, vector<IDRange> &ranges )
+{
+    ranges.clear();
+    if ( level < 1 )
+    {
+        ranges.push_back ( { 0, 0, convex.empty() ? kCoverFull : kCoverPartial } );
+        return 1;
+    }
+    
+    for ( uint64_t id = 8; id < 16; id++ )
+    {
+        SSVector v0, v1, v2;
+        ID2Triangle ( id, v0, v1, v2 );
+        _cover ( convex, id, 1, v0, v1, v2, level, ranges );
+    }
+    
+    int n = 0;
+    for ( IDRange &range : ranges )
+        n += range.last - range.first + 1;
+    
+    return n;
+}
+
+// As above, but expands the covering ID ranges into vectors of IDs of triangles fully
+// inside (fullIDs) and partially inside (partialIDs) the convex region, in ascending order.
+// Returns the total number of triangles covered at the target level.
+
+int SSHTM::cover ( const Convex &convex, int level, vector<uint64_t> &fullIDs, vector<uint64_t> &partialIDs )
+{
+    vector<IDRange> ranges;
+    int n = cover ( convex, level, ranges );
+    
+    fullIDs.clear();
+    partialIDs.clear();
+    for ( IDRange &range : ranges )
+        for ( uint64_t id = range.first; id <= range.last; id++ )
+            ( range.type == kCoverFull ? fullIDs : partialIDs ).push_back ( id );
+    
+    return n;
+}
+
+// Recursive part of cover(), for triangle (htmID) at a known level whose vertices (v0, v1, v2)
+// are passed down from its parent. Appends covering ID ranges at the target level to (ranges),
+// merging each with the preceding range when contiguous and of the same type.
+
+void SSHTM::_cover ( const Convex &convex, uint64_t htmID, int level, SSVector v0, SSVector v1, SSVector v2, int target, vector<IDRange> &ranges )
+{
+    Cap cap = htmID < kCapCacheSize ? capTable()[htmID] : triangleCap ( v0, v1, v2 );
+    CoverType type = classify ( convex, v0, v1, v2, cap );
+    if ( type == kCoverOutside )
+        return;
+    
+    if ( type == kCoverFull || level >= target )
+    {
+        int shift = 2 * ( target - level );
+        IDRange range = { htmID << shift, ( ( htmID + 1 ) << shift ) - 1, type };
+        
+        if ( ! ranges.empty() && ranges.back().type == type && ranges.back().last + 1 == range.first )
+            ranges.back().last = range.last;
+        else
+            ranges.push_back ( range );
+        
+        return;
+    }
+    
+    for ( int k = 0; k < 4; k++ )
+    {
+        SSVector w0 = v0, w1 = v1, w2 = v2;
+        subTriangle ( k, w0, w1, w2 );
+        _cover ( convex, htmID * 4 + k, level + 1, w0, w1, w2, target, ranges );
+    }
+}
+
+// Loads star data for the origin region and for all regions in this HTM which intersect a convex
+// region, down to the deepest magnitude level. Useful for prefetching exactly the region files
+// needed to display a view (see viewConvex()). If sync is false, regions are loaded asynchronously.
+// Returns the number of regions loaded (will be zero if sync is false).
+
+int SSHTM::loadRegions ( const Convex &convex, bool sync, void *userData )
+{
+    int n = loadRegion ( 0, sync, userData ) ? 1 : 0;
+    
+    for ( int level = 1; level < (int) _magLevels.size(); level++ )
+    {
+        vector<IDRange> ranges;
+        cover ( convex, level, ranges );
+        for ( IDRange &range : ranges )
+            for ( uint64_t id = range.first; id <= range.last; id++ )
+                if ( loadRegion ( id, sync, userData ) )
+                    n++;
+    }
+    
+    return n;
+}
+
+// Searches all regions pre-loaded into memory for objects inside a convex region
+// (see circleConvex(), polygonConvex(), viewConvex()); does not load regions.
+// Objects in regions fully inside the convex region are returned without testing
+// their individual positions. As with the circle search(), only stars and deep sky
+// objects are returned; any other objects in a region are skipped, even if the region
+// is fully inside. Results are appended to vector (results). Returns number of objects found.
+
+int SSHTM::search ( const Convex &convex, vector<SSObjectPtr> &results )
+{
+    int n = _search ( convex, 0, 0, SSVector(), SSVector(), SSVector(), convex.empty(), results );
+    
+    if ( _magLevels.size() > 1 )
+    {
+        for ( uint64_t id = 8; id < 16; id++ )
+        {
+            SSVector v0, v1, v2;
+            ID2Triangle ( id, v0, v1, v2 );
+            n += _search ( convex, id, 1, v0, v1, v2, false, results );
+        }
+    }
+    
+    return n;
+}
 
+// Recursive part of convex search(), for region (htmID) at a known level with vertices
+// (v0, v1, v2). If (full) is true, the region is already known to be fully inside the
+// convex region, so its objects and those of all its sub-regions are returned untested.
+
+int SSHTM::_search ( const Convex &convex, uint64_t htmID, int level, SSVector v0, SSVector v1, SSVector v2, bool full, vector<SSObjectPtr> &results )
+{
+    if ( ! full && htmID != 0 )
+    {
+        Cap cap = htmID < kCapCacheSize ? capTable()[htmID] : triangleCap ( v0, v1, v2 );
+        CoverType type = classify ( convex, v0, v1, v2, cap );
+        if ( type == kCoverOutside )
+            return 0;
+        full = type == kCoverFull;
+    }
+    
+    int n = 0;
+    SSObjectVec *pObjects = getObjects ( htmID );
+    if ( pObjects != nullptr )
+    {
+        for ( size_t i = 0; i < pObjects->size(); i++ )
+        {
+            SSObjectPtr pObject = pObjects->get ( i );
+            SSStar *pStar = SSGetStarPtr ( pObject );
+            if ( pStar && ( full || insideConvex ( convex, pStar->getFundamentalPosition() ) ) )
+            {
+                results.push_back ( pObject );
+                n++;
+            }
+        }
+    }
+    
+    if ( htmID != 0 && level < (int) _magLevels.size() - 1 )
+    {
+        for ( int k = 0; k < 4; k++ )
+        {
+            SSVector w0 = v0, w1 = v1, w2 = v2;
+            subTriangle ( k, w0, w1, w2 );
+            n += _search ( convex, htmID * 4 + k, level + 1, w0, w1, w2, full, results );
+        }
+    }
+    
     return n;
 }
@@ -7,21 +7,15 @@
 #ifndef SSHTM_HPP
 #define SSHTM_HPP
 
-#ifndef USE_THREADS
-#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
-#define USE_THREADS 0
-#else
-#define USE_THREADS 1
-#endif
-#endif
-
-#if USE_THREADS
-#include <thread>
-#endif
+#include <set>
+#include <mutex>
+#include <memory>
 
 #include "SSObject.hpp"
 #include "SSStar.hpp"
 #include "SSVector.hpp"
+#include "SSView.hpp"
+#include "SSThreadPool.hpp"
 
 // No, not Hypertext Markup Language!
 // This class implements the Heirarchial Triangle Mesh, a method for subdividing the celestial sphere
@@ -32,7 +26,13 @@
 // with HTM ID numbers 8, 9, 10, 11, 12, 13, 14, 15. Each of those has four childred at level 2,
 // named S00, S01, S02, S02, etc. with HTM ID numbers 32, 33, 34, 35 etc., and so on down the mesh tree.
 // This class also contains methods for loading, saving, and storing objects in the regions to files.
-// Regions can be loaded synchronously on the current thread, or asynchronously on a background thread.
+// Regions can be loaded synchronously on the current thread, or asynchronously by a bounded pool of
+// background worker threads. Asynchronous loads are started in order of distance from a "load center"
+// (typically the view center), and requests which are no longer wanted can be cancelled.
+// Loaded regions are published under a mutex, so getObjects() and regionLoaded() may be called while
+// background loads are in progress. Regions are only deleted (dumped) by the thread which owns the HTM.
+
+class SSHTMIndex;
 
 // Callback function to notify external HTM user when regions are loaded asynchronously.
 
@@ -43,17 +43,74 @@ public:
     typedef int (* DataFileFunc) ( SSHTM *pHTM, uint64_t htmID, SSObjectArray *objects, void *userData );
     typedef bool (* RegionTestCallback) ( SSHTM *pHTM, uint64_t htmID, void *userData );
     
+    // A convex region of the sky is described by a vector of constraints, and is the intersection of
+    // all of them. Each constraint is the set of points (p) on the unit sphere where p * normal >= dist,
+    // i.e. a cap of angular radius acos ( dist ) centered on normal. If dist is zero, the constraint
+    // is a hemisphere bounded by a great circle. An empty vector of constraints covers the whole sky.
+    
+    struct Constraint
+    {
+        SSVector normal;    // unit vector to center of constraint cap
+        double   dist;      // cosine of cap's angular radius, from -1 to +1
+    };
+    
+    typedef vector<Constraint> Convex;
+    
+    // Policies for choosing which regions to evict when memory used by loaded regions exceeds the budget.
+    
+    enum EvictionPolicy
+    {
+        kEvictLeastRecentlyUsed = 0,    // evict regions in order of least recent access
+        kEvictFarthestFromCenter = 1,   // evict regions farthest from load center first; least recently used among equals
+    };
+    
+    // Orders for starting queued asynchronous region loads.
+    
+    enum LoadOrder
+    {
+        kLoadNearestFirst = 0,          // load regions nearest the load center first, regardless of level
+        kLoadBrightestFirst = 1,        // load shallower (brighter) levels first; nearest the load center first within each level
+    };
+    
 protected:
+    
+    // Memory accounting and usage history for a single region; pins can be held before the region is loaded.
+    
+    struct RegionUse
+    {
+        size_t   bytes = 0;     // approximate memory used by region's objects
+        uint64_t lastUse = 0;   // value of _useClock when region was last accessed
+        int      pins = 0;      // number of outstanding pinRegion() calls; pinned regions are never evicted
+    };
+    
+
     DataFileFunc                _readFunc = nullptr;    // custom function for reading region data files
     DataFileFunc                _writeFunc = nullptr;   // custom function for writing region data files
     map<uint64_t,SSObjectVec *> _regions;               // arrays of objects loaded into memory, indexed by HTM region ID
     vector<float>               _magLevels;             // faintest magnitude of objects at each HTM level; vector size is depth of mesh tree
     string                      _rootpath;              // directory containing object data files on filesystem.
     
-#if USE_THREADS
-    map<uint64_t,thread *>      _loadThreads;           // background threads currently loading region objects from data files, indexed by HTM region ID
-#endif
-    SSObjectVec *_loadRegion ( uint64_t htmID, RegionLoadCallback callback, void *userData );    // private method to load object data file for a given HTM region ID
+    mutable mutex               _regionMutex;           // guards _regions, _loading, and region memory accounting against concurrent access from load threads
+    set<uint64_t>               _loading;               // IDs of regions queued or currently being loaded asynchronously
+    set<uint64_t>               _empty;                 // IDs of regions whose data files were read but contained no objects
+    LoadOrder                   _loadOrder = kLoadNearestFirst;
+    SSVector                    _loadCenter;            // unit vector toward center of interest; asynchronous loads nearest this start first
+    int                         _numLoadThreads = 0;    // maximum number of background load threads; zero for default
+    SSThreadPool                *_pLoadPool = nullptr;  // background load threads; created on first asynchronous load
+    bool                        _useArenas = false;     // if true, each loaded region's objects are allocated from the region's own arena
+    
+    map<uint64_t,RegionUse>     _regionUse;             // memory accounting and usage history, indexed by HTM region ID; guarded by _regionMutex
+    size_t                      _memoryBudget = 0;      // maximum memory for loaded regions in bytes; zero for unlimited
+    size_t                      _memoryUsed = 0;        // approximate memory currently used by loaded regions in bytes
+    EvictionPolicy              _evictionPolicy = kEvictLeastRecentlyUsed;
+    uint64_t                    _useClock = 0;          // incremented on each region access, to order regions by recency
+    uint64_t                    _hits = 0;              // number of loadRegion() calls which found region already loaded
+    uint64_t                    _misses = 0;            // number of loadRegion() calls which had to read region from file
+    uint64_t                    _evictions = 0;         // number of regions evicted to stay within memory budget
+    
+    SSObjectVec *_loadRegion ( uint64_t htmID, RegionLoadCallback callback, void *userData, bool async );    // private method to load object data file for a given HTM region ID
+    double _loadPriority ( uint64_t htmID );    // private method returns asynchronous load priority of a region; lower loads sooner
+    double _centerDistance ( uint64_t htmID );  // private method returns angular distance of a region from load center, or its level if no center
     
 public:
     
@@ -61,6 +118,8 @@ public:
     
     SSHTM();
     SSHTM ( const vector<float> &magLevels, const string &rootpath );
+    SSHTM ( const SSHTM &other );
+    SSHTM &operator = ( const SSHTM &other );
     virtual ~SSHTM ( void );
     
     // return path to directory containing region data files
@@ -72,31 +131,75 @@ public:
 
     bool magLimits ( uint64_t id, float &min, float &max );
     int magLevel ( float mag );
+    vector<float> getMagLevels ( void ) { return _magLevels; }
 
     // store an individual object or an antire array of objects in this HTM
 
+    bool storeRegionID ( SSStar *pStar, uint64_t &htmID );
     virtual bool store ( SSStar *pStar );
     virtual int store ( SSObjectVec &objects );
+    int store ( SSObjectVec &objects, int numThreads );
  
     // Count number of regions and objects in HTM or in a region therein.
     
-    int countRegions ( void ) { return (int) _regions.size(); }
+    int countRegions ( void ) { lock_guard<mutex> lock ( _regionMutex ); return (int) _regions.size(); }
     int countStars ( void );
     int countStars ( uint64_t htmID );
     
     // save region objects to file(s), load them from file(s), dump them from memory.
     
-    int saveRegions ( void *userData = nullptr );
-    int saveRegion ( uint64_t id, void *userData = nullptr );
+    int saveRegions ( void *userData = nullptr, int numThreads = 1 );
+    int saveRegion ( uint64_t id, void *userData = nullptr, int numThreads = 1 );
     int loadRegions ( uint64_t htmID = 0, bool sync = true, void *userData = nullptr );
+    int loadRegions ( const Convex &convex, bool sync = true, void *userData = nullptr );
     SSObjectVec *loadRegion ( uint64_t htmID, bool sync = true, void *userData = nullptr );
     void dumpRegions ( RegionTestCallback callback = nullptr, void *userData = nullptr );
     void dumpRegion ( uint64_t htmID );
     void clearRegions ( void );
     
+    // control asynchronous region loading: number of load threads, center of interest
+    // for prioritizing loads, cancellation of loads not yet completed, waiting for loads.
+    
+    void setLoadThreads ( int numThreads ) { _numLoadThreads = numThreads; }
+    int getLoadThreads ( void ) { return _numLoadThreads; }
+    void setLoadCenter ( const SSVector &center );
+    SSVector getLoadCenter ( void ) { return _loadCenter; }
+    void setLoadOrder ( LoadOrder order );
+    LoadOrder getLoadOrder ( void ) { return _loadOrder; }
+    void setUseArenas ( bool useArenas ) { _useArenas = useArenas; }
+    bool getUseArenas ( void ) { return _useArenas; }
+    bool regionLoading ( uint64_t htmID );
+    int countLoading ( void );
+    int cancelLoads ( RegionTestCallback testFunc = nullptr, void *userData = nullptr );
+    void waitLoads ( void );
+    
+    // Memory budget for loaded regions. When a region must be loaded and the budget is exceeded,
+    // unpinned regions are evicted (dumped) first, according to the eviction policy. Eviction
+    // happens only inside loadRegion() and evictRegions(), on the calling thread; object vectors
+    // obtained earlier may be deleted by eviction unless their regions are pinned.
+    
+    void setMemoryBudget ( size_t bytes ) { _memoryBudget = bytes; }
+    size_t getMemoryBudget ( void ) { return _memoryBudget; }
+    void setEvictionPolicy ( EvictionPolicy policy ) { _evictionPolicy = policy; }
+    EvictionPolicy getEvictionPolicy ( void ) { return _evictionPolicy; }
+    size_t getMemoryUsage ( void );
+    size_t getMemoryUsage ( uint64_t htmID );
+    void pinRegion ( uint64_t htmID );
+    void unpinRegion ( uint64_t htmID );
+    bool regionPinned ( uint64_t htmID );
+    int evictRegions ( void );
+    
+    // Region cache statistics: loadRegion() hits and misses, and regions evicted.
+    
+    uint64_t getCacheHits ( void ) { lock_guard<mutex> lock ( _regionMutex ); return _hits; }
+    uint64_t getCacheMisses ( void ) { lock_guard<mutex> lock ( _regionMutex ); return _misses; }
+    uint64_t getEvictions ( void ) { lock_guard<mutex> lock ( _regionMutex ); return _evictions; }
+    void resetCacheStats ( void ) { lock_guard<mutex> lock ( _regionMutex ); _hits = _misses = _evictions = 0; }
+    
     // test whether region objects are loaded into memory, get array of pointers to loaded region objects
     
     bool regionLoaded ( uint64_t id );
+    bool regionEmpty ( uint64_t id );
     SSObjectVec *getObjects ( uint64_t id );
     
     // Get child HTM region IDs of a particular region; gets empty vector if region has no children.
@@ -112,6 +215,53 @@ public:
     virtual bool name2Triangle ( const string &name, SSVector &v0, SSVector &v1, SSVector &v2 );
     virtual bool isinside ( const SSVector &p, const SSVector &v0, SSVector &v1, SSVector &v2 );
     
+    // HTM triangle geometry computed directly from integer IDs, without name strings.
+    
+    virtual bool ID2Triangle ( uint64_t id, SSVector &v0, SSVector &v1, SSVector &v2 );
+    static void subTriangle ( int child, SSVector &v0, SSVector &v1, SSVector &v2 );
+    
+    // Bounding circle ("cap") of an HTM triangle on the unit sphere.
+    
+    struct Cap
+    {
+        SSVector center;    // unit vector to center of cap
+        double   radius;    // angular radius of cap in radians
+        double   cosRad;    // cosine of radius
+        double   sinRad;    // sine of radius
+    };
+    
+    static Cap triangleCap ( SSVector v0, SSVector v1, SSVector v2 );
+    static bool getCap ( uint64_t id, Cap &cap );
+    
+    // Convex regions built from a circle, a convex spherical polygon, or a view's sky footprint
+    
+    static Convex circleConvex ( SSVector center, SSAngle rad );
+    static Convex polygonConvex ( const vector<SSVector> &vertices );
+    static Convex viewConvex ( SSView &view );
+    static bool insideConvex ( const Convex &convex, SSVector p );
+    
+    // Classification of an HTM triangle relative to a convex region
+    
+    enum CoverType
+    {
+        kCoverOutside = 0,  // triangle lies entirely outside convex region
+        kCoverPartial = 1,  // triangle may intersect convex region
+        kCoverFull = 2,     // triangle lies entirely inside convex region
+    };
+    
+    // A range of HTM IDs at one level, from first to last inclusive, all with the same cover type.
+    
+    struct IDRange
+    {
+        uint64_t  first;
+        uint64_t  last;
+        CoverType type;
+    };
+    
+    static CoverType classify ( const Convex &convex, SSVector v0, SSVector v1, SSVector v2, const Cap &cap );
+    int cover ( const Convex &convex, int level, vector<IDRange> &ranges );
+    int cover ( const Convex &convex, int level, vector<uint64_t> &fullIDs, vector<uint64_t> &partialIDs );
+    
     // Describes the location of particular object inside an HTM
     
     struct ObjectLoc
@@ -136,18 +286,35 @@ public:
     
     size_t objectMapSize ( SSCatalog cat ) { return cat == kCatUnknown ? _nameIndex[cat].size() : _identIndex[cat].size(); }
     
+    // Flat, sorted name (kCatUnknown) and identifier indexes; used by findObjectLocs() instead of the maps above when present.
+    
+    map<SSCatalog,shared_ptr<SSHTMIndex>> _objectIndex;
+    
+    size_t makeObjectIndex ( SSCatalog cat, int numThreads = 0, void *userData = nullptr );
+    size_t saveObjectIndex ( SSCatalog cat );
+    size_t loadObjectIndex ( SSCatalog cat );
+    SSHTMIndex *getObjectIndex ( SSCatalog cat );
+    
     int findObjectLocs ( const string &name, vector<ObjectLoc> &locs, bool casesens = true, bool begins = false );
     int findObjectLocs ( SSIdentifier ident, vector<ObjectLoc> &locs );
+    int completeNames ( const string &prefix, vector<string> &names, int maxNames = 0 );
     
     SSObjectPtr loadObject ( const ObjectLoc &loc );
 
-    void setDataFileReadFunc ( DataFileFunc func ) { _readFunc = func; }
+    void setDataFileReadFunc ( DataFileFunc func );
     DataFileFunc getDataFileReadFunc ( void ) { return _readFunc; }
     
     void setDataFileWriteFunc ( DataFileFunc func ) { _writeFunc = func; }
     DataFileFunc getDataFileWriteFunc ( void ) { return _writeFunc; }
 
     int search ( uint64_t htmID, SSVector center, SSAngle rad, vector<SSObjectPtr> &results );
+    int search ( const Convex &convex, vector<SSObjectPtr> &results );
+    
+protected:
+    
+    void _cover ( const Convex &convex, uint64_t htmID, int level, SSVector v0, SSVector v1, SSVector v2, int target, vector<IDRange> &ranges );
+    int _search ( const Convex &convex, uint64_t htmID, int level, SSVector v0, SSVector v1, SSVector v2, bool full, vector<SSObjectPtr> &results );
+    int _search ( uint64_t htmID, int level, SSVector v0, SSVector v1, SSVector v2, SSVector center, double rad, double cosRad, double sinRad, vector<SSObjectPtr> &results );
 };
 
 // Callback function to notify external HTM user when regions are loaded asynchronously.
@@ -0,0 +1,508 @@
+// SSHTMBinary.cpp
+// SSCore
+//
+// Binary fixed-record file format for SSHTM region data files.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#include <string.h>
+#include <unordered_map>
+
+#include "SSHTMBinary.hpp"
+#include "SSUtilities.hpp"
+
+static const char kBinaryTag[8] = { 'S', 'S', 'H', 'T', 'M', 'B', 'I', 'N' };
+static const uint32_t kBinaryVersion = 1;
+
+static_assert ( sizeof ( SSHTMBinaryHeader ) == 32, "SSHTMBinaryHeader must be 32 bytes" );
+static_assert ( sizeof ( SSHTMBinaryStar ) == 88, "SSHTMBinaryStar must be 88 bytes" );
+static_assert ( sizeof ( SSHTMBinaryExtra ) == 120, "SSHTMBinaryExtra must be 120 bytes" );
+
+// Maps a binary region file (path) into memory and validates its header and section sizes.
+// Returns true if successful or false if the file can't be mapped or is not a valid region file.
+
+bool SSHTMBinaryRegion::open ( const string &path )
+{
+    close();
+
+    _data = mapfile ( path, _size );
+    if ( _data == nullptr || _size < sizeof ( SSHTMBinaryHeader ) )
+    {
+        close();
+        return false;
+    }
+
+    const SSHTMBinaryHeader *pHeader = (const SSHTMBinaryHeader *) _data;
+    if ( memcmp ( pHeader->tag, kBinaryTag, sizeof ( kBinaryTag ) ) != 0 || pHeader->version != kBinaryVersion )
+    {
+        close();
+        return false;
+    }
+
+    // Total of all section sizes must exactly equal file size.
+    // The string pool must be non-empty and end with a NUL so every pooled string is terminated.
+
+    size_t expected = sizeof ( SSHTMBinaryHeader )
+                    + pHeader->nStars * (size_t) sizeof ( SSHTMBinaryStar )
+                    + pHeader->nIdents * (size_t) sizeof ( uint64_t )
+                    + pHeader->nExtras * (size_t) sizeof ( SSHTMBinaryExtra )
+                    + pHeader->poolSize;
+
+    const char *bytes = (const char *) _data;
+    if ( expected != _size || pHeader->poolSize == 0 || bytes[ _size - 1 ] != '\0' )
+    {
+        close();
+        return false;
+    }
+
+    _pHeader = pHeader;
+    _pStars = (const SSHTMBinaryStar *) ( bytes + sizeof ( SSHTMBinaryHeader ) );
+    _pIdents = (const uint64_t *) ( _pStars + pHeader->nStars );
+    _pExtras = (const SSHTMBinaryExtra *) ( _pIdents + pHeader->nIdents );
+    _pPool = (const char *) ( _pExtras + pHeader->nExtras );
+
+    return true;
+}
+
+// Unmaps the region file, if any; safe to call more than once.
+
+void SSHTMBinaryRegion::close ( void )
+{
+    unmapfile ( _data, _size );
+    _data = nullptr;
+    _size = 0;
+    _pHeader = nullptr;
+    _pStars = nullptr;
+    _pIdents = nullptr;
+    _pExtras = nullptr;
+    _pPool = nullptr;
+}
+
+// Returns object type of i-th star record without creating an object;
+// returns kTypeNonexistent if i is out of range.
+
+SSObjectType SSHTMBinaryRegion::getType ( size_t i )
+{
+    const SSHTMBinaryStar *pRec = getRecord ( i );
+    return pRec ? (SSObjectType) pRec->type : kTypeNonexistent;
+}
+
+// Returns fundamental position unit vector of i-th star record without creating an object;
+// returns infinite vector if i is out of range.
+
+SSVector SSHTMBinaryRegion::getPosition ( size_t i )
+{
+    const SSHTMBinaryStar *pRec = getRecord ( i );
+    if ( pRec == nullptr )
+        return SSVector ( INFINITY, INFINITY, INFINITY );
+
+    return SSVector ( pRec->position[0], pRec->position[1], pRec->position[2] );
+}
+
+// Returns visual magnitude of i-th star record, or blue magnitude if visual is unknown;
+// returns infinity if both are unknown or i is out of range.
+
+float SSHTMBinaryRegion::getMagnitude ( size_t i )
+{
+    const SSHTMBinaryStar *pRec = getRecord ( i );
+    if ( pRec == nullptr )
+        return INFINITY;
+
+    return ::isinf ( pRec->vmag ) ? pRec->bmag : pRec->vmag;
+}
+
+// Creates a new star object from the i-th star record in the mapped file.
+// Returns nullptr if i is out of range or the record's type is not a star or deep sky object.
+// The caller owns the returned object and is responsible for deleting it.
+
+SSObjectPtr SSHTMBinaryRegion::getObject ( size_t i )
+{
+    const SSHTMBinaryStar *pRec = getRecord ( i );
+    if ( pRec == nullptr )
+        return nullptr;
+
+    SSObjectType type = (SSObjectType) pRec->type;
+    if ( type != kTypeNonexistent && ( type < kTypeStar || type > kTypeGalaxy ) )
+        return nullptr;
+
+    SSStarPtr pStar = SSGetStarPtr ( SSNewObject ( type ) );
+    if ( pStar == nullptr )
+        return nullptr;
+
+    pStar->setFundamentalPosition ( SSVector ( pRec->position[0], pRec->position[1], pRec->position[2] ) );
+    pStar->setFundamentalVelocity ( SSVector ( pRec->velocity[0], pRec->velocity[1], pRec->velocity[2] ) );
+    pStar->setParallax ( pRec->parallax );
+    pStar->setRadVel ( pRec->radvel );
+    pStar->setVMagnitude ( pRec->vmag );
+    pStar->setBMagnitude ( pRec->bmag );
+    pStar->setSpectralType ( poolString ( pRec->spectrum ) );
+
+    // Names are stored as consecutive NUL-terminated strings in the pool.
+
+    if ( pRec->nNames > 0 )
+    {
+        vector<string> names ( pRec->nNames );
+        uint32_t offset = pRec->names;
+        for ( int k = 0; k < pRec->nNames && offset < _pHeader->poolSize; k++ )
+        {
+            names[k] = _pPool + offset;
+            offset += names[k].length() + 1;
+        }
+        pStar->setNames ( names );
+    }
+
+    if ( pRec->nIdents > 0 && (size_t) pRec->ident + pRec->nIdents <= _pHeader->nIdents )
+    {
+        vector<SSIdentifier> idents ( _pIdents + pRec->ident, _pIdents + pRec->ident + pRec->nIdents );
+        pStar->setIdentifiers ( idents );
+    }
+
+    // Copy double star, variable star, and deep sky fields from extra record, if any.
+
+    if ( pRec->extra >= 0 && pRec->extra < (int32_t) _pHeader->nExtras )
+    {
+        const SSHTMBinaryExtra *pExtra = _pExtras + pRec->extra;
+
+        SSDoubleStarPtr pDouble = SSGetDoubleStarPtr ( pStar );
+        if ( pDouble != nullptr )
+        {
+            pDouble->setComponents ( poolString ( pExtra->comps ) );
+            pDouble->setMagnitudeDelta ( pExtra->magDelta );
+            pDouble->setSeparation ( pExtra->sep );
+            pDouble->setPositionAngle ( pExtra->PA );
+            pDouble->setPositionAngleYear ( pExtra->PAyr );
+
+            const double *o = pExtra->orbit;
+            if ( ! ::isinf ( o[0] ) )
+                pDouble->setOrbit ( SSOrbit ( o[0], o[1], o[2], o[3], o[4], o[5], o[6], o[7] ) );
+        }
+
+        SSVariableStarPtr pVariable = SSGetVariableStarPtr ( pStar );
+        if ( pVariable != nullptr )
+        {
+            pVariable->setVariableType ( poolString ( pExtra->varType ) );
+            pVariable->setMaximumMagnitude ( pExtra->varMaxMag );
+            pVariable->setMinimumMagnitude ( pExtra->varMinMag );
+            pVariable->setPeriod ( pExtra->varPeriod );
+            pVariable->setEpoch ( pExtra->varEpoch );
+        }
+
+        SSDeepSkyPtr pDeepSky = SSGetDeepSkyPtr ( pStar );
+        if ( pDeepSky != nullptr )
+        {
+            pDeepSky->setMajorAxis ( pExtra->majAxis );
+            pDeepSky->setMinorAxis ( pExtra->minAxis );
+            pDeepSky->setPositionAngle ( pExtra->PA );
+        }
+    }
+
+    return pStar;
+}
+
+// Materializes all star records in the mapped file and appends the ones which pass
+// an optional filter function (filter) to an object array (objects).
+// Returns the number of objects appended.
+
+int SSHTMBinaryRegion::getObjects ( SSObjectVec &objects, SSObjectFilter filter, void *userData )
+{
+    int numObjects = 0;
+
+    for ( size_t i = 0; i < size(); i++ )
+    {
+        SSObjectPtr pObject = getObject ( i );
+        if ( pObject == nullptr )
+            continue;
+
+        if ( filter == nullptr || filter ( pObject, userData ) )
+        {
+            objects.append ( pObject );
+            numObjects++;
+        }
+        else
+        {
+            delete pObject;
+        }
+    }
+
+    return numObjects;
+}
+
+// Imports stars from a binary region file (filename) into an object array (objects).
+// Objects which do not pass an optional filter function (filter) are not imported.
+// Returns the number of objects imported.
+
+int SSImportObjectsFromBinary ( const string &filename, SSObjectVec &objects, SSObjectFilter filter, void *userData )
+{
+    SSHTMBinaryRegion region;
+
+    if ( ! region.open ( filename ) )
+        return 0;
+
+    return region.getObjects ( objects, filter, userData );
+}
+
+// Builds the string pool for a binary region file.
+// Identical strings (spectral types, variable types, etc.) are stored only once.
+
+class SSHTMBinaryPool
+{
+public:
+    string pool;
+    unordered_map<string,uint32_t> offsets;
+
+    SSHTMBinaryPool ( void ) { pool.push_back ( '\0' ); offsets[""] = 0; }
+
+    uint32_t add ( const string &str )
+    {
+        auto it = offsets.find ( str );
+        if ( it != offsets.end() )
+            return it->second;
+
+        uint32_t offset = (uint32_t) pool.size();
+        pool.append ( str.c_str(), str.length() + 1 );
+        offsets[str] = offset;
+        return offset;
+    }
+
+    // Names of a single star must be contiguous, so they are appended without sharing.
+
+    uint32_t addNames ( const vector<string> &names )
+    {
+        uint32_t offset = (uint32_t) pool.size();
+        for ( const string &name : names )
+            pool.append ( name.c_str(), name.length() + 1 );
+        return offset;
+    }
+};
+
+// Exports stars in an object array (objects) to a binary region file (filename),
+// overwriting any existing file. Objects which are not stars or deep sky objects,
+// or do not pass an optional filter function (filter), are not exported.
+// Returns the number of objects exported.
+
+int SSExportObjectsToBinary ( const string &filename, SSObjectVec &objects, SSObjectFilter filter, void *userData )
+{
+    vector<SSHTMBinaryStar> stars;
+    vector<uint64_t> idents;
+    vector<SSHTMBinaryExtra> extras;
+    SSHTMBinaryPool pool;
+
+    stars.reserve ( objects.size() );
+
+    for ( size_t i = 0; i < objects.size(); i++ )
+    {
+        SSStarPtr pStar = SSGetStarPtr ( objects[i] );
+        if ( pStar == nullptr )
+            continue;
+
+        if ( filter != nullptr && ! filter ( pStar, userData ) )
+            continue;
+
+        SSHTMBinaryStar rec = { 0 };
+
+        SSVector pos = pStar->getFundamentalPosition();
+        SSVector vel = pStar->getFundamentalVelocity();
+
+        rec.position[0] = pos.x;
+        rec.position[1] = pos.y;
+        rec.position[2] = pos.z;
+        rec.velocity[0] = vel.x;
+        rec.velocity[1] = vel.y;
+        rec.velocity[2] = vel.z;
+        rec.parallax = pStar->getParallax();
+        rec.radvel = pStar->getRadVel();
+        rec.vmag = pStar->getVMagnitude();
+        rec.bmag = pStar->getBMagnitude();
+        rec.type = pStar->getType();
+        rec.spectrum = pool.add ( pStar->getSpectralType() );
+
+        vector<string> names = pStar->getNames();
+        if ( names.size() > UINT8_MAX )
+            names.resize ( UINT8_MAX );
+        rec.nNames = names.size();
+        rec.names = names.size() > 0 ? pool.addNames ( names ) : 0;
+
+        vector<SSIdentifier> starIdents = pStar->getIdentifiers();
+        if ( starIdents.size() > UINT16_MAX )
+            starIdents.resize ( UINT16_MAX );
+        rec.nIdents = starIdents.size();
+        rec.ident = (uint32_t) idents.size();
+        for ( SSIdentifier &ident : starIdents )
+            idents.push_back ( ident );
+
+        // Double stars, variable stars, and deep sky objects get an extra record.
+
+        rec.extra = -1;
+        SSDoubleStarPtr pDouble = SSGetDoubleStarPtr ( pStar );
+        SSVariableStarPtr pVariable = SSGetVariableStarPtr ( pStar );
+        SSDeepSkyPtr pDeepSky = SSGetDeepSkyPtr ( pStar );
+
+        if ( pDouble || pVariable || pDeepSky )
+        {
+            SSHTMBinaryExtra extra = { 0 };
+
+            extra.orbit[0] = INFINITY;
+            extra.varEpoch = INFINITY;
+            extra.magDelta = extra.sep = extra.PA = extra.PAyr = INFINITY;
+            extra.majAxis = extra.minAxis = INFINITY;
+            extra.varMaxMag = extra.varMinMag = extra.varPeriod = INFINITY;
+
+            if ( pDouble )
+            {
+                extra.comps = pool.add ( pDouble->getComponents() );
+                extra.magDelta = pDouble->getMagnitudeDelta();
+                extra.sep = pDouble->getSeparation();
+                extra.PA = pDouble->getPositionAngle();
+                extra.PAyr = pDouble->getPositionAngleYear();
+                if ( pDouble->hasOrbit() )
+                {
+                    SSOrbit orbit = pDouble->getOrbit();
+                    double o[8] = { orbit.t, orbit.q, orbit.e, orbit.i, orbit.w, orbit.n, orbit.m, orbit.mm };
+                    memcpy ( extra.orbit, o, sizeof ( o ) );
+                }
+            }
+
+            if ( pVariable )
+            {
+                extra.varType = pool.add ( pVariable->getVariableType() );
+                extra.varMaxMag = pVariable->getMaximumMagnitude();
+                extra.varMinMag = pVariable->getMinimumMagnitude();
+                extra.varPeriod = pVariable->getPeriod();
+                extra.varEpoch = pVariable->getEpoch();
+            }
+
+            if ( pDeepSky )
+            {
+                extra.majAxis = pDeepSky->getMajorAxis();
+                extra.minAxis = pDeepSky->getMinorAxis();
+                extra.PA = pDeepSky->getPositionAngle();
+            }
+
+            rec.extra = (int32_t) extras.size();
+            extras.push_back ( extra );
+        }
+
+        stars.push_back ( rec );
+    }
+
+    // Pad string pool so file size is a multiple of 8 bytes.
+
+    while ( pool.pool.size() % 8 )
+        pool.pool.push_back ( '\0' );
+
+    SSHTMBinaryHeader header = { 0 };
+    memcpy ( header.tag, kBinaryTag, sizeof ( kBinaryTag ) );
+    header.version = kBinaryVersion;
+    header.nStars = (uint32_t) stars.size();
+    header.nIdents = (uint32_t) idents.size();
+    header.nExtras = (uint32_t) extras.size();
+    header.poolSize = (uint32_t) pool.pool.size();
+
+    // Write to a temporary file, then rename over the destination, so that a reader
+    // which has the old file mapped never sees a partially-written one.
+
+    string temppath = filename + ".tmp";
+    FILE *file = fopen ( temppath.c_str(), "wb" );
+    if ( file == nullptr )
+        return 0;
+
+    bool ok = fwrite ( &header, sizeof ( header ), 1, file ) == 1;
+    ok = ok && fwrite ( stars.data(), sizeof ( SSHTMBinaryStar ), stars.size(), file ) == stars.size();
+    ok = ok && fwrite ( idents.data(), sizeof ( uint64_t ), idents.size(), file ) == idents.size();
+    ok = ok && fwrite ( extras.data(), sizeof ( SSHTMBinaryExtra ), extras.size(), file ) == extras.size();
+    ok = ok && fwrite ( pool.pool.data(), 1, pool.pool.size(), file ) == pool.pool.size();
+    ok = fclose ( file ) == 0 && ok;
+
+    if ( ok )
+    {
+        remove ( filename.c_str() );
+        ok = rename ( temppath.c_str(), filename.c_str() ) == 0;
+    }
+
+    if ( ! ok )
+    {
+        remove ( temppath.c_str() );
+        return 0;
+    }
+
+    return (int) stars.size();
+}
+
+// SSHTM data file read function: reads region (htmID) from <rootpath><name>.bin.
+// The HTM needs every object in its region arrays, so all records are materialized here;
+// use SSHTMBinaryRegion directly to read individual records without creating objects.
+// Returns -1 if the file can't be opened, so the HTM doesn't remember the region as empty.
+// Install with pHTM->setDataFileReadFunc ( SSHTMReadBinaryRegion ).
+
+int SSHTMReadBinaryRegion ( SSHTM *pHTM, uint64_t htmID, SSObjectArray *objects, void *userData )
+{
+    SSHTMBinaryRegion region;
+
+    if ( ! region.open ( pHTM->rootPath() + pHTM->ID2name ( htmID ) + ".bin" ) )
+        return -1;
+
+    return region.getObjects ( *objects );
+}
+
+// SSHTM data file write function: writes region (htmID) to <rootpath><name>.bin.
+// Install with pHTM->setDataFileWriteFunc ( SSHTMWriteBinaryRegion ).
+
+int SSHTMWriteBinaryRegion ( SSHTM *pHTM, uint64_t htmID, SSObjectArray *objects, void *userData )
+{
+    return SSExportObjectsToBinary ( pHTM->rootPath() + pHTM->ID2name ( htmID ) + ".bin", *objects );
+}
+
+// Converts every CSV region file (e.g. N0123.csv) in an HTM directory (rootpath)
+// to a binary region file (N0123.bin) in the same directory. Files whose names are
+// not valid HTM region names are ignored. If removeCSV is true, each CSV file is
+// deleted after it is successfully converted. Regions containing any object which is not
+// a star or deep sky object can't be stored in binary form, so they are not converted,
+// and their CSV file names are appended to (pSkipped) if it is not nullptr; so are
+// regions whose binary files could not be written. Returns the number of files converted.
+
+int SSConvertHTMRegionsToBinary ( const string &rootpath, bool removeCSV, vector<string> *pSkipped )
+{
+    vector<string> filenames;
+    string dir = rootpath;
+    if ( dir.empty() || dir[ dir.length() - 1 ] != '/' )
+        dir += '/';
+
+    if ( listDirectory ( dir, filenames ) != 0 )
+        return 0;
+
+    SSHTM htm;
+    int n = 0;
+
+    for ( const string &filename : filenames )
+    {
+        if ( filename.length() < 6 || filename.compare ( filename.length() - 4, 4, ".csv" ) != 0 )
+            continue;
+
+        string name = filename.substr ( 0, filename.length() - 4 );
+        if ( name.compare ( "O0" ) != 0 && htm.name2ID ( name ) == 0 )
+            continue;
+
+        SSObjectVec objects;
+        int nObjects = SSImportObjectsFromCSV ( dir + filename, objects );
+        if ( nObjects < 1 )
+            continue;
+
+        // Don't write a binary file which would silently omit some of the region's objects.
+        
+        bool allStars = true;
+        for ( int i = 0; allStars && i < nObjects; i++ )
+            allStars = SSGetStarPtr ( objects[i] ) != nullptr;
+        
+        if ( allStars && SSExportObjectsToBinary ( dir + name + ".bin", objects ) == nObjects )
+        {
+            if ( removeCSV )
+                remove ( ( dir + filename ).c_str() );
+            n++;
+        }
+        else if ( pSkipped != nullptr )
+        {
+            pSkipped->push_back ( filename );
+        }
+    }
+
+    return n;
+}
@@ -0,0 +1,126 @@
+// SSHTMBinary.hpp
+// SSCore
+//
+// Binary fixed-record file format for SSHTM region data files.
+// A region file can be memory-mapped and its stars materialized lazily,
+// without tokenizing or parsing any text.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#ifndef SSHTMBINARY_HPP
+#define SSHTMBINARY_HPP
+
+#include "SSHTM.hpp"
+
+// File layout, all values in native (little-endian) byte order:
+//   header                        SSHTMBinaryHeader
+//   star records [nStars]         SSHTMBinaryStar
+//   identifier table [nIdents]    uint64_t (SSIdentifier values)
+//   extra records [nExtras]       SSHTMBinaryExtra (double/variable star and deep sky object data)
+//   string pool [poolSize]        NUL-terminated UTF-8 strings; offset zero is always the empty string.
+// Every section begins on an 8-byte boundary, so records can be read in place from a mapped file.
+
+#pragma pack ( push, 1 )
+
+struct SSHTMBinaryHeader
+{
+    char     tag[8];        // always "SSHTMBIN"
+    uint32_t version;       // file format version; currently 1
+    uint32_t nStars;        // number of star records
+    uint32_t nIdents;       // number of entries in identifier table
+    uint32_t nExtras;       // number of extra records
+    uint32_t poolSize;      // size of string pool in bytes
+    uint32_t reserved;      // always zero
+};
+
+struct SSHTMBinaryStar
+{
+    double   position[3];   // fundamental position unit vector (x,y,z)
+    double   velocity[3];   // fundamental space velocity in radians per year; infinite if unknown
+    float    parallax;      // parallax in arcsec; zero if unknown
+    float    radvel;        // radial velocity as fraction of light speed; infinite if unknown
+    float    vmag;          // visual magnitude; infinite if unknown
+    float    bmag;          // blue magnitude; infinite if unknown
+    uint8_t  type;          // SSObjectType
+    uint8_t  nNames;        // number of consecutive name strings in pool
+    uint16_t nIdents;       // number of consecutive identifiers in identifier table
+    uint32_t ident;         // index of first identifier in identifier table
+    uint32_t names;         // string pool offset of first name
+    uint32_t spectrum;      // string pool offset of spectral type (or galaxy type)
+    int32_t  extra;         // index of extra record, or -1 if none
+    uint32_t reserved;      // always zero
+};
+
+struct SSHTMBinaryExtra
+{
+    double   orbit[8];      // binary star orbit t,q,e,i,w,n,m,mm; orbit[0] is infinite if none
+    double   varEpoch;      // variability epoch (JD); infinite if unknown
+    float    magDelta;      // double star magnitude difference
+    float    sep;           // double star separation in radians
+    float    PA;            // double star position angle, or deep sky position angle, in radians
+    float    PAyr;          // double star position angle year
+    float    majAxis;       // deep sky major axis in radians
+    float    minAxis;       // deep sky minor axis in radians
+    float    varMaxMag;     // variable star maximum magnitude
+    float    varMinMag;     // variable star minimum magnitude
+    float    varPeriod;     // variable star period in days
+    uint32_t comps;         // string pool offset of double star components
+    uint32_t varType;       // string pool offset of variable star type
+    uint32_t reserved;      // always zero
+};
+
+#pragma pack ( pop )
+
+// Provides read-only, random access to the stars in a memory-mapped binary region file.
+// Record fields (position, magnitude) can be read without creating any objects;
+// getObject() materializes a single star object on demand.
+
+class SSHTMBinaryRegion
+{
+protected:
+    const void              *_data = nullptr;       // start of mapped file
+    size_t                  _size = 0;              // size of mapped file in bytes
+    const SSHTMBinaryHeader *_pHeader = nullptr;    // pointers to sections within mapped file
+    const SSHTMBinaryStar   *_pStars = nullptr;
+    const uint64_t          *_pIdents = nullptr;
+    const SSHTMBinaryExtra  *_pExtras = nullptr;
+    const char              *_pPool = nullptr;
+
+    const char *poolString ( uint32_t offset ) { return offset < _pHeader->poolSize ? _pPool + offset : ""; }
+
+public:
+
+    SSHTMBinaryRegion ( void ) {}
+    SSHTMBinaryRegion ( const string &path ) { open ( path ); }
+    virtual ~SSHTMBinaryRegion ( void ) { close(); }
+
+    bool open ( const string &path );
+    void close ( void );
+    bool isOpen ( void ) { return _pHeader != nullptr; }
+
+    size_t size ( void ) { return _pHeader ? _pHeader->nStars : 0; }
+    const SSHTMBinaryStar *getRecord ( size_t i ) { return i < size() ? _pStars + i : nullptr; }
+
+    SSObjectType getType ( size_t i );
+    SSVector getPosition ( size_t i );
+    float getMagnitude ( size_t i );
+
+    SSObjectPtr getObject ( size_t i );
+    int getObjects ( SSObjectVec &objects, SSObjectFilter filter = nullptr, void *userData = nullptr );
+};
+
+// Import/export arrays of stars from/to binary region files
+
+int SSImportObjectsFromBinary ( const string &filename, SSObjectVec &objects, SSObjectFilter filter = nullptr, void *userData = nullptr );
+int SSExportObjectsToBinary ( const string &filename, SSObjectVec &objects, SSObjectFilter filter = nullptr, void *userData = nullptr );
+
+// Region data file functions for SSHTM::setDataFileReadFunc() and setDataFileWriteFunc().
+// These read and write <rootpath><name>.bin, where <name> is the region's HTM name (e.g. N0123).
+
+int SSHTMReadBinaryRegion ( SSHTM *pHTM, uint64_t htmID, SSObjectArray *objects, void *userData );
+int SSHTMWriteBinaryRegion ( SSHTM *pHTM, uint64_t htmID, SSObjectArray *objects, void *userData );
+
+// Converts every CSV region file in an HTM directory to binary; optionally returns names of files skipped
+
+int SSConvertHTMRegionsToBinary ( const string &rootpath, bool removeCSV = false, vector<string> *pSkipped = nullptr );
+
+#endif /* SSHTMBINARY_HPP */
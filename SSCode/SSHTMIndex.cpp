@@ -0,0 +1,215 @@
+// SSHTMIndex.cpp
+// SSCore
+//
+// Flat, sorted index of object names or identifiers to their locations in an HTM,
+// for exact, case-insensitive, and prefix (autocomplete) lookups; can be saved to
+// and memory-mapped from a binary file.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#include <algorithm>
+#include <cstring>
+
+#include "SSHTMIndex.hpp"
+#include "SSUtilities.hpp"
+
+// Index files start with this identifier, followed by the number of entries and the size of the key block
+// as 64-bit integers, followed by the entries, followed by the key block.
+
+static const char kHTMIndexFileID[8] = { 'S', 'S', 'H', 'T', 'M', 'I', 'D', 'X' };
+static const size_t kHTMIndexHeaderSize = 24;
+
+// Compares up to (n) characters of two NUL-terminated strings (str1, str2), with ASCII letters folded
+// to lower case, like strncasecmp() in the C locale. Returns a negative number, zero, or a positive number
+// if str1 sorts before, equal to, or after str2. Unlike strncasecmp(), the result does not depend on the
+// current locale, so the sort order of saved index files is the same everywhere.
+
+int SSHTMIndex::foldcmp ( const char *str1, const char *str2, size_t n )
+{
+    for ( size_t i = 0; i < n; i++ )
+    {
+        int c1 = (unsigned char) str1[i], c2 = (unsigned char) str2[i];
+        if ( c1 >= 'A' && c1 <= 'Z' )
+            c1 += 'a' - 'A';
+        if ( c2 >= 'A' && c2 <= 'Z' )
+            c2 += 'a' - 'A';
+        if ( c1 != c2 )
+            return c1 - c2;
+        if ( c1 == 0 )
+            break;
+    }
+
+    return 0;
+}
+
+// Removes all entries from this index, and unmaps its file, if any.
+
+void SSHTMIndex::clear ( void )
+{
+    vector<Entry>().swap ( _entries );
+    vector<char>().swap ( _keys );
+
+    if ( _pMap )
+        unmapfile ( _pMap, _mapSize );
+
+    _pMap = nullptr;
+    _mapSize = _numEntries = 0;
+    _pEntries = nullptr;
+    _pKeys = nullptr;
+}
+
+// Adds an entry for an object with a name or identifier string (key) at position (offset)
+// in HTM region (region). Empty keys are ignored. After adding entries, call sort() before searching.
+// If this index was memory-mapped from a file, its entries are copied into memory first.
+
+void SSHTMIndex::add ( const string &key, uint64_t region, size_t offset )
+{
+    if ( key.empty() )
+        return;
+
+    if ( _pMap )
+    {
+        vector<Entry> entries ( begin(), end() );
+        vector<char> keyBlock ( keys(), keys() + ( _mapSize - kHTMIndexHeaderSize - _numEntries * sizeof ( Entry ) ) );
+        clear();
+        _entries.swap ( entries );
+        _keys.swap ( keyBlock );
+    }
+
+    _entries.push_back ( { region, (uint32_t) offset, (uint32_t) _keys.size() } );
+    _keys.insert ( _keys.end(), key.begin(), key.end() );
+    _keys.push_back ( 0 );
+}
+
+// Sorts entries in this index by key with letters folded to lower case, then by exact key,
+// then by object location. Keys which differ only in case are therefore adjacent.
+
+void SSHTMIndex::sort ( void )
+{
+    const char *pKeys = _keys.data();
+    std::sort ( _entries.begin(), _entries.end(), [pKeys] ( const Entry &e1, const Entry &e2 )
+    {
+        int c = foldcmp ( pKeys + e1.key, pKeys + e2.key );
+        if ( c == 0 )
+            c = strcmp ( pKeys + e1.key, pKeys + e2.key );
+        if ( c == 0 )
+            return e1.region < e2.region || ( e1.region == e2.region && e1.offset < e2.offset );
+        return c < 0;
+    } );
+
+    _entries.shrink_to_fit();
+    _keys.shrink_to_fit();
+}
+
+// Finds the range of entries [first, last) whose keys equal (key) with letters folded to lower case,
+// or begin with (key) if (begins) is true. Takes O ( log n ) time.
+
+void SSHTMIndex::range ( const string &key, bool begins, const Entry *&first, const Entry *&last ) const
+{
+    const char *pKeys = keys(), *pKey = key.c_str();
+    size_t n = begins ? key.length() : SIZE_MAX;
+
+    first = lower_bound ( begin(), end(), pKey, [pKeys, n] ( const Entry &e, const char *k ) { return foldcmp ( pKeys + e.key, k, n ) < 0; } );
+    last = upper_bound ( first, end(), pKey, [pKeys, n] ( const char *k, const Entry &e ) { return foldcmp ( k, pKeys + e.key, n ) < 0; } );
+}
+
+// Finds locations of all objects whose name or identifier matches a string (key).
+// Pass true for (casesens) for case-sensitive matching; pass false for case-insensitive matching.
+// Pass true for (begins) for "begins-with" matching; pass false for whole-string matching.
+// Object locations are appended to (locs), in order of key; returns number of locations found.
+
+int SSHTMIndex::find ( const string &key, vector<SSHTM::ObjectLoc> &locs, bool casesens, bool begins ) const
+{
+    const Entry *first = nullptr, *last = nullptr;
+    range ( key, begins, first, last );
+
+    const char *pKeys = keys();
+    size_t n = locs.size();
+    for ( const Entry *e = first; e < last; e++ )
+    {
+        if ( casesens && ( begins ? strncmp ( pKeys + e->key, key.c_str(), key.length() ) : strcmp ( pKeys + e->key, key.c_str() ) ) != 0 )
+            continue;
+
+        locs.push_back ( { e->region, e->offset } );
+    }
+
+    return (int) ( locs.size() - n );
+}
+
+// Finds distinct keys which begin with a string (prefix), ignoring case, for autocompletion.
+// Keys are appended to (keys) in sorted order; at most (maxKeys) are returned, unless zero.
+// Returns number of keys found.
+
+int SSHTMIndex::complete ( const string &prefix, vector<string> &keys, int maxKeys ) const
+{
+    const Entry *first = nullptr, *last = nullptr;
+    range ( prefix, true, first, last );
+
+    const char *pKeys = this->keys(), *pLast = nullptr;
+    int n = 0;
+    for ( const Entry *e = first; e < last && ( maxKeys < 1 || n < maxKeys ); e++ )
+    {
+        const char *pKey = pKeys + e->key;
+        if ( pLast != nullptr && strcmp ( pKey, pLast ) == 0 )
+            continue;
+
+        keys.push_back ( pKey );
+        pLast = pKey;
+        n++;
+    }
+
+    return n;
+}
+
+// Saves this sorted index to a binary file at (path), which can be memory-mapped
+// with load() on a later run. Returns true if successful.
+
+bool SSHTMIndex::save ( const string &path ) const
+{
+    FILE *file = fopen ( path.c_str(), "wb" );
+    if ( file == NULL )
+        return false;
+
+    uint64_t numEntries = size();
+    uint64_t keyBytes = _pMap ? _mapSize - kHTMIndexHeaderSize - _numEntries * sizeof ( Entry ) : _keys.size();
+    bool ok = fwrite ( kHTMIndexFileID, sizeof ( kHTMIndexFileID ), 1, file ) == 1
+           && fwrite ( &numEntries, sizeof ( numEntries ), 1, file ) == 1
+           && fwrite ( &keyBytes, sizeof ( keyBytes ), 1, file ) == 1
+           && ( numEntries == 0 || fwrite ( begin(), sizeof ( Entry ), numEntries, file ) == numEntries )
+           && ( keyBytes == 0 || fwrite ( keys(), 1, keyBytes, file ) == keyBytes );
+
+    ok = fclose ( file ) == 0 && ok;
+    return ok;
+}
+
+// Loads an index saved by save() from the binary file at (path), replacing any entries in this index.
+// The file is memory-mapped with mapfile(), so entries are paged in as they are searched rather than
+// read all at once. Returns true if successful, or false if the file can't be opened or is not a valid index.
+
+bool SSHTMIndex::load ( const string &path )
+{
+    size_t size = 0;
+    const void *pMap = mapfile ( path, size );
+    if ( pMap == nullptr )
+        return false;
+
+    uint64_t numEntries = 0, keyBytes = 0;
+    if ( size >= kHTMIndexHeaderSize )
+    {
+        memcpy ( &numEntries, (const char *) pMap + 8, sizeof ( numEntries ) );
+        memcpy ( &keyBytes, (const char *) pMap + 16, sizeof ( keyBytes ) );
+    }
+    
+    if ( size < kHTMIndexHeaderSize || memcmp ( pMap, kHTMIndexFileID, sizeof ( kHTMIndexFileID ) ) != 0 || size != kHTMIndexHeaderSize + numEntries * sizeof ( Entry ) + keyBytes )
+    {
+        unmapfile ( pMap, size );
+        return false;
+    }
+
+    clear();
+    _pMap = pMap;
+    _mapSize = size;
+    _numEntries = numEntries;
+    _pEntries = (const Entry *) ( (const char *) pMap + kHTMIndexHeaderSize );
+    _pKeys = (const char *) pMap + kHTMIndexHeaderSize + numEntries * sizeof ( Entry );
+    return true;
+}
@@ -0,0 +1,72 @@
+// SSHTMIndex.hpp
+// SSCore
+//
+// Flat, sorted index of object names or identifiers to their locations in an HTM,
+// for exact, case-insensitive, and prefix (autocomplete) lookups; can be saved to
+// and memory-mapped from a binary file.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#ifndef SSHTMINDEX_HPP
+#define SSHTMINDEX_HPP
+
+#include "SSHTM.hpp"
+
+// An SSHTMIndex holds one entry per (key, object location) pair, in a single array sorted by key
+// with ASCII letters folded to lower case, so that exact, case-insensitive, and begins-with lookups
+// are all binary searches. Keys are object names or identifier strings (e.g. "HIP 32349"), stored
+// once each, NUL-terminated, in a separate block of characters. After sorting, the index is read-only,
+// so it may be searched by several threads at once. Saved index files are in native byte order.
+
+class SSHTMIndex
+{
+public:
+
+    struct Entry
+    {
+        uint64_t region;    // HTM ID of region containing object
+        uint32_t offset;    // position of object within region's object vector
+        uint32_t key;       // position of key's first character in key block
+    };
+
+protected:
+
+    vector<Entry>   _entries;               // entries added or read into memory; sorted by sort()
+    vector<char>    _keys;                  // key block for entries in memory
+
+    const void      *_pMap = nullptr;       // memory-mapped index file, or nullptr if none
+    size_t          _mapSize = 0;           // size of memory-mapped file in bytes
+    const Entry     *_pEntries = nullptr;   // entries in memory-mapped file
+    const char      *_pKeys = nullptr;      // key block in memory-mapped file
+    size_t          _numEntries = 0;        // number of entries in memory-mapped file
+
+    const Entry *begin ( void ) const { return _pMap ? _pEntries : _entries.data(); }
+    const Entry *end ( void ) const { return begin() + size(); }
+    const char *keys ( void ) const { return _pMap ? _pKeys : _keys.data(); }
+    void range ( const string &key, bool begins, const Entry *&first, const Entry *&last ) const;
+
+public:
+
+    SSHTMIndex ( void ) {}
+    SSHTMIndex ( const SSHTMIndex &other ) = delete;
+    SSHTMIndex &operator = ( const SSHTMIndex &other ) = delete;
+    virtual ~SSHTMIndex ( void ) { clear(); }
+
+    static int foldcmp ( const char *str1, const char *str2, size_t n = SIZE_MAX );
+
+    void clear ( void );
+    void add ( const string &key, uint64_t region, size_t offset );
+    void sort ( void );
+    size_t size ( void ) const { return _pMap ? _numEntries : _entries.size(); }
+    size_t memoryUsage ( void ) const { return sizeof ( SSHTMIndex ) + _entries.capacity() * sizeof ( Entry ) + _keys.capacity(); }
+
+    const char *getKey ( size_t i ) const { return i < size() ? keys() + begin()[i].key : nullptr; }
+    SSHTM::ObjectLoc getLoc ( size_t i ) const { return { begin()[i].region, begin()[i].offset }; }
+
+    int find ( const string &key, vector<SSHTM::ObjectLoc> &locs, bool casesens = true, bool begins = false ) const;
+    int complete ( const string &prefix, vector<string> &keys, int maxKeys = 0 ) const;
+
+    bool save ( const string &path ) const;
+    bool load ( const string &path );
+};
+
+#endif /* SSHTMINDEX_HPP */
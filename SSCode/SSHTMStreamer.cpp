@@ -0,0 +1,258 @@
+// SSHTMStreamer.cpp
+// SSCore
+//
+// Streams SSHTM regions needed to display a view down to a limiting magnitude:
+// loads them progressively from bright to faint on background threads, prefetches
+// regions along the view's recent pan and zoom motion, and cancels loads which are
+// no longer needed. Memory is bounded by the HTM's own memory budget and eviction.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#include <algorithm>
+
+#include "SSHTMStreamer.hpp"
+#include "SSUtilities.hpp"
+
+// Constructs a streamer for an HTM (pHTM), which must outlive the streamer.
+// Regions will be loaded shallowest (brightest) level first, nearest the view center
+// first within each level; when over the HTM's memory budget, regions farthest from
+// the view center are evicted first.
+
+SSHTMStreamer::SSHTMStreamer ( SSHTM *pHTM )
+{
+    _pHTM = pHTM;
+    _pHTM->setLoadOrder ( SSHTM::kLoadBrightestFirst );
+    _pHTM->setEvictionPolicy ( SSHTM::kEvictFarthestFromCenter );
+}
+
+// Destructor unpins visible regions and cancels queued loads, but leaves loaded regions in the HTM.
+
+SSHTMStreamer::~SSHTMStreamer ( void )
+{
+    reset();
+}
+
+// Forgets the current view and its motion history; unpins visible regions,
+// and cancels all queued region loads which have not started.
+
+void SSHTMStreamer::reset ( void )
+{
+    if ( _pinVisible )
+        for ( uint64_t htmID : _visible )
+            _pHTM->unpinRegion ( htmID );
+
+    _visible.clear();
+    _prefetch.clear();
+    _convex.clear();
+    _numPending = 0;
+    _hasLast = false;
+    _velocity = SSVector();
+    _zoomRate = 0.0;
+    _pHTM->cancelLoads();
+}
+
+// Turns pinning of visible regions on or off, and pins or unpins the current visible regions.
+
+void SSHTMStreamer::setPinVisible ( bool pin )
+{
+    if ( pin == _pinVisible )
+        return;
+
+    for ( uint64_t htmID : _visible )
+    {
+        if ( pin )
+            _pHTM->pinRegion ( htmID );
+        else
+            _pHTM->unpinRegion ( htmID );
+    }
+
+    _pinVisible = pin;
+}
+
+// Gets sorted IDs of all regions at levels 0 to maxLevel which intersect a convex region,
+// omitting regions already known to be empty. Regions at shallower levels have smaller IDs,
+// so concatenating each level's covering ranges in level order yields a sorted vector.
+
+void SSHTMStreamer::_regionsInConvex ( const SSHTM::Convex &convex, int maxLevel, vector<uint64_t> &regionIDs )
+{
+    regionIDs.clear();
+
+    for ( int level = 0; level <= maxLevel; level++ )
+    {
+        vector<SSHTM::IDRange> ranges;
+        _pHTM->cover ( convex, level, ranges );
+        for ( SSHTM::IDRange &range : ranges )
+            for ( uint64_t htmID = range.first; htmID <= range.last; htmID++ )
+                if ( ! _pHTM->regionEmpty ( htmID ) )
+                    regionIDs.push_back ( htmID );
+    }
+}
+
+// Region test callback for SSHTM::cancelLoads(): returns true if a region
+// is neither visible nor prefetched by the streamer passed as userData.
+
+bool SSHTMStreamer::_unwanted ( SSHTM *pHTM, uint64_t htmID, void *userData )
+{
+    SSHTMStreamer *pStreamer = (SSHTMStreamer *) userData;
+
+    return ! binary_search ( pStreamer->_visible.begin(), pStreamer->_visible.end(), htmID )
+        && ! binary_search ( pStreamer->_prefetch.begin(), pStreamer->_prefetch.end(), htmID );
+}
+
+// Updates streaming for a view (view) and limiting magnitude (limMag) at the current system time.
+
+int SSHTMStreamer::update ( SSView &view, float limMag )
+{
+    return update ( view, limMag, clocksec() );
+}
+
+// Updates streaming for a view (view) and limiting magnitude (limMag) at a time (time) in seconds.
+// Call once per frame. Computes the regions intersecting the view at each level down to the limiting
+// magnitude, and queues any which are not loaded for background loading; then queues regions along
+// the view's predicted path, and cancels queued loads of regions no longer visible or predicted.
+// Returns the number of visible regions still waiting to be loaded; redraw while this is not zero.
+
+int SSHTMStreamer::update ( SSView &view, float limMag, double time )
+{
+    SSVector center = view.getCenterVector();
+    double radius = min ( (double) view.getAngularDiagonal() / 2.0, M_PI );
+
+    // Update smoothed pan and zoom velocity from the change in view since the last update.
+
+    if ( _hasLast && time > _lastTime )
+    {
+        double dt = time - _lastTime;
+        SSVector velocity = ( center - _lastCenter ) / dt;
+        double zoomRate = radius > 0.0 && _lastRadius > 0.0 ? log ( radius / _lastRadius ) / dt : 0.0;
+
+        _velocity = _velocity * ( 1.0 - _smoothing ) + velocity * _smoothing;
+        _zoomRate = _zoomRate * ( 1.0 - _smoothing ) + zoomRate * _smoothing;
+    }
+
+    // If the view or limiting magnitude changed, recompute visible and predicted regions.
+
+    bool changed = ! _hasLast || center != _lastCenter || radius != _lastRadius || limMag != _lastMag;
+    if ( changed )
+    {
+        int depth = (int) _pHTM->getMagLevels().size();
+        _maxLevel = _pHTM->magLevel ( limMag );
+        if ( _maxLevel < 0 )
+            _maxLevel = depth - 1;
+
+        _convex = SSHTM::viewConvex ( view );
+
+        vector<uint64_t> visible;
+        _regionsInConvex ( _convex, _maxLevel, visible );
+
+        // Pin newly-visible regions and unpin regions no longer visible.
+
+        if ( _pinVisible )
+        {
+            vector<uint64_t> added, removed;
+            set_difference ( visible.begin(), visible.end(), _visible.begin(), _visible.end(), back_inserter ( added ) );
+            set_difference ( _visible.begin(), _visible.end(), visible.begin(), visible.end(), back_inserter ( removed ) );
+            for ( uint64_t htmID : added )
+                _pHTM->pinRegion ( htmID );
+            for ( uint64_t htmID : removed )
+                _pHTM->unpinRegion ( htmID );
+        }
+
+        _visible = visible;
+
+        // Predict where the view will be after the prefetch time, and which regions it will then cover:
+        // a circle around the predicted center, enlarged if zooming out. Skip prediction if the
+        // view is moving less than a tenth of its size over the prefetch time, or if the HTM is
+        // already over its memory budget, since prefetched regions would only evict each other.
+
+        _prefetch.clear();
+        double pan = _velocity.magnitude() * _prefetchTime;
+        double zoom = max ( 0.0, _zoomRate * _prefetchTime );
+        size_t budget = _pHTM->getMemoryBudget();
+        if ( radius < M_PI && ( pan > 0.1 * radius || zoom > 0.1 ) && ( budget == 0 || _pHTM->getMemoryUsage() < budget ) )
+        {
+            SSVector predCenter = ( center + _velocity * _prefetchTime ).normalize();
+            double predRadius = min ( radius * exp ( zoom ), M_PI );
+
+            vector<uint64_t> predicted;
+            _regionsInConvex ( SSHTM::circleConvex ( predCenter, predRadius ), _maxLevel, predicted );
+            set_difference ( predicted.begin(), predicted.end(), _visible.begin(), _visible.end(), back_inserter ( _prefetch ) );
+        }
+
+        // Re-order queued loads around a point halfway along the view's predicted path, so regions ahead
+        // of the view load sooner and regions behind it are evicted first; then drop loads nobody wants.
+
+        _pHTM->setLoadCenter ( ( center + _velocity * ( _prefetchTime / 2.0 ) ).normalize() );
+        if ( _pHTM->countLoading() > 0 )
+            _pHTM->cancelLoads ( _unwanted, this );
+    }
+
+    // Regions loaded in the background since the last update may have put the HTM over its memory
+    // budget; evict unpinned regions farthest from the view now, rather than on the next load.
+    
+    _pHTM->evictRegions();
+
+    // Queue loads for visible regions not yet loaded (including any evicted since the last update),
+    // then for predicted regions. loadRegion() returns immediately for regions already queued or empty.
+    // Visible regions still queued or loading are pending; regions whose files are missing are not.
+
+    _numPending = 0;
+    for ( uint64_t htmID : _visible )
+    {
+        if ( ! _pHTM->regionLoaded ( htmID ) && _pHTM->loadRegion ( htmID, false ) == nullptr && _pHTM->regionLoading ( htmID ) )
+            _numPending++;
+    }
+
+    for ( uint64_t htmID : _prefetch )
+        if ( ! _pHTM->regionLoaded ( htmID ) )
+            _pHTM->loadRegion ( htmID, false );
+
+    _hasLast = true;
+    _lastTime = time;
+    _lastCenter = center;
+    _lastRadius = radius;
+    _lastMag = limMag;
+
+    return _numPending;
+}
+
+// Returns the fraction of visible regions which have been loaded, from 0.0 to 1.0.
+
+double SSHTMStreamer::getProgress ( void )
+{
+    return _visible.empty() ? 1.0 : 1.0 - (double) _numPending / _visible.size();
+}
+
+// Appends objects from loaded visible regions which lie inside the view's sky footprint
+// and are no fainter than the limiting magnitude from the last update() to (results).
+// Returns the number of objects found.
+
+int SSHTMStreamer::search ( vector<SSObjectPtr> &results )
+{
+    int n = 0;
+
+    for ( uint64_t htmID : _visible )
+    {
+        SSObjectVec *pObjects = _pHTM->getObjects ( htmID );
+        if ( pObjects == nullptr )
+            continue;
+
+        for ( size_t i = 0; i < pObjects->size(); i++ )
+        {
+            SSObjectPtr pObject = pObjects->get ( i );
+            SSStar *pStar = SSGetStarPtr ( pObject );
+            if ( pStar == nullptr )
+                continue;
+
+            float mag = pStar->getVMagnitude();
+            if ( isinf ( mag ) )
+                mag = pStar->getBMagnitude();
+
+            if ( mag <= _lastMag && SSHTM::insideConvex ( _convex, pStar->getFundamentalPosition() ) )
+            {
+                results.push_back ( pObject );
+                n++;
+            }
+        }
+    }
+
+    return n;
+}
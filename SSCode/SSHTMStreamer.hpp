@@ -0,0 +1,80 @@
+// SSHTMStreamer.hpp
+// SSCore
+//
+// Streams SSHTM regions needed to display a view down to a limiting magnitude:
+// loads them progressively from bright to faint on background threads, prefetches
+// regions along the view's recent pan and zoom motion, and cancels loads which are
+// no longer needed. Memory is bounded by the HTM's own memory budget and eviction.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#ifndef SSHTMSTREAMER_HPP
+#define SSHTMSTREAMER_HPP
+
+#include "SSHTM.hpp"
+#include "SSView.hpp"
+
+// Call update() once per frame with the current view and limiting magnitude, then draw
+// objects from search() or from the regions returned by getVisibleRegions(). update()
+// never blocks on file I/O; regions appear as their background loads complete.
+// The streamer does not own the HTM, which must outlive it. Creating a streamer
+// sets the HTM's load order to kLoadBrightestFirst and its eviction policy to
+// kEvictFarthestFromCenter; set the HTM's memory budget to bound its memory.
+
+class SSHTMStreamer
+{
+protected:
+
+    SSHTM               *_pHTM = nullptr;       // HTM whose regions are streamed; not owned
+    double              _prefetchTime = 0.5;    // seconds of predicted view motion to prefetch
+    double              _smoothing = 0.5;       // weight of newest frame in smoothed pan and zoom velocity, 0 to 1
+    bool                _pinVisible = true;     // if true, visible regions are pinned so they are never evicted
+
+    bool                _hasLast = false;       // true after first update()
+    double              _lastTime = 0.0;        // time of last update() in seconds
+    SSVector            _lastCenter;            // view center unit vector at last update()
+    double              _lastRadius = 0.0;      // radius of circle enclosing view at last update(), radians
+    float               _lastMag = 0.0;         // limiting magnitude at last update()
+
+    SSVector            _velocity;              // smoothed rate of change of view center unit vector, per second
+    double              _zoomRate = 0.0;        // smoothed rate of change of log of view radius, per second
+
+    SSHTM::Convex       _convex;                // sky footprint of view at last update()
+    int                 _maxLevel = 0;          // deepest HTM level needed for limiting magnitude
+    vector<uint64_t>    _visible;               // sorted IDs of regions intersecting view, down to deepest level needed
+    vector<uint64_t>    _prefetch;              // sorted IDs of regions predicted to be needed soon, not already visible
+    int                 _numPending = 0;        // number of visible regions not yet loaded
+
+    void _regionsInConvex ( const SSHTM::Convex &convex, int maxLevel, vector<uint64_t> &regionIDs );
+    static bool _unwanted ( SSHTM *pHTM, uint64_t htmID, void *userData );
+
+public:
+
+    SSHTMStreamer ( SSHTM *pHTM );
+    virtual ~SSHTMStreamer ( void );
+
+    SSHTM *getHTM ( void ) { return _pHTM; }
+
+    void setPrefetchTime ( double seconds ) { _prefetchTime = seconds; }
+    double getPrefetchTime ( void ) { return _prefetchTime; }
+    void setSmoothing ( double smoothing ) { _smoothing = smoothing; }
+    double getSmoothing ( void ) { return _smoothing; }
+    void setPinVisible ( bool pin );
+    bool getPinVisible ( void ) { return _pinVisible; }
+
+    int update ( SSView &view, float limMag );
+    int update ( SSView &view, float limMag, double time );
+    void reset ( void );
+
+    const vector<uint64_t> &getVisibleRegions ( void ) { return _visible; }
+    const vector<uint64_t> &getPrefetchRegions ( void ) { return _prefetch; }
+    const SSHTM::Convex &getConvex ( void ) { return _convex; }
+    int getMaxLevel ( void ) { return _maxLevel; }
+    int countPending ( void ) { return _numPending; }
+    double getProgress ( void );
+    SSVector getVelocity ( void ) { return _velocity; }
+    double getZoomRate ( void ) { return _zoomRate; }
+
+    int search ( vector<SSObjectPtr> &results );
+};
+
+#endif /* SSHTMSTREAMER_HPP */
@@ -143,40 +143,65 @@ vector<string> _convec =
     "TrA", "Tuc", "UMa", "UMi", "Vel", "Vir", "Vol", "Vul"
 };
 
-map<string,int> _conmap;
-static map<string,int> _baymap;
 extern SSObjectVec _constellationVec;
 
-static void mapinit ( void )
-{
-    for ( int i = 0; i < _bayvec.size(); i++ )
-        _baymap.insert ( { _bayvec[i], i + 1 } );
-
-    for ( int i = 0; i < _convec.size(); i++ )
-        _conmap.insert ( { _convec[i], i + 1 } );
-}
+// Returns true if the first (n) characters of two strings (str1, str2) are equal,
+// with ASCII letters folded to lower case unless (casesens) is true.
 
-string con_to_string ( int con )
+static bool equal_chars ( const char *str1, const char *str2, size_t n, bool casesens )
 {
-    return con > 0 && con < _convec.size() ? _convec[con - 1] : "";
+    if ( casesens )
+        return memcmp ( str1, str2, n ) == 0;
+    
+    for ( size_t i = 0; i < n; i++ )
+    {
+        int c1 = (unsigned char) str1[i], c2 = (unsigned char) str2[i];
+        if ( c1 >= 'A' && c1 <= 'Z' )
+            c1 += 'a' - 'A';
+        if ( c2 >= 'A' && c2 <= 'Z' )
+            c2 += 'a' - 'A';
+        if ( c1 != c2 )
+            return false;
+    }
+    
+    return true;
 }
 
-int string_to_con ( const string &str, bool casesens )
+// Returns constellation number (1-88) from abbreviation, name, or genitive (str) of length (len),
+// which need not be NUL-terminated; or zero if not recognized. Does not allocate memory, so may be
+// called from several threads at once.
+
+static int chars_to_con ( const char *str, size_t len, bool casesens )
 {
-    if ( _conmap.size() == 0 )
-        mapinit();
+    // Constellation abbreviations are all three letters; compare them as 24-bit integers.
+    // The table of abbreviations, sorted by integer, is built once, on first use.
+    
+    static const vector<pair<uint32_t,int>> conkeys = [] ()
+    {
+        vector<pair<uint32_t,int>> keys;
+        for ( int i = 0; i < _convec.size(); i++ )
+            keys.push_back ( { (uint32_t) _convec[i][0] << 16 | (uint32_t) _convec[i][1] << 8 | (uint32_t) _convec[i][2], i + 1 } );
+        sort ( keys.begin(), keys.end() );
+        return keys;
+    }();
     
     if ( casesens )
-        return _conmap[ str ];
+    {
+        if ( len != 3 )
+            return 0;
+        
+        uint32_t key = (uint32_t) (unsigned char) str[0] << 16 | (uint32_t) (unsigned char) str[1] << 8 | (unsigned char) str[2];
+        auto it = lower_bound ( conkeys.begin(), conkeys.end(), make_pair ( key, 0 ) );
+        return it != conkeys.end() && it->first == key ? it->second : 0;
+    }
     
-    for ( int i = 0; i < _convec.size(); i++ )
-        if ( compare ( _convec[i], str, 0, casesens ) == 0 )
+    for ( int i = 0; len == 3 && i < _convec.size(); i++ )
+        if ( equal_chars ( _convec[i].c_str(), str, 3, false ) )
             return i + 1;
     
     // If string contains at least 3 characters, test against abbreviation, name, genitive
     // for all constellations previously loaded by SSImportConstellations()
     
-    size_t len = str.length();
     for ( int i = 0; len >= 3 && i < _constellationVec.size(); i++ )
     {
         SSConstellationPtr pCon = SSGetConstellationPtr ( _constellationVec.get ( i ) );
@@ -184,16 +209,31 @@ int string_to_con ( const string &str, bool casesens )
             continue;
         
         for ( int n = 0; n < 3; n++ )
-            if ( compare ( str, pCon->getName ( n ), len, casesens ) == 0 )
+        {
+            const string &name = pCon->getName ( n );
+            if ( name.length() >= len && equal_chars ( name.c_str(), str, len, false ) )
                 return i + 1;
+        }
     }
     return 0;
 }
 
-static int string_to_bayer ( const string &str, bool casesens = true )
+string con_to_string ( int con )
+{
+    return con > 0 && con < _convec.size() ? _convec[con - 1] : "";
+}
+
+int string_to_con ( const string &str, bool casesens )
+{
+    return chars_to_con ( str.c_str(), str.length(), casesens );
+}
+
+// Returns Bayer letter number (1-24 for Greek, 25-50 for lower-case Latin, 51-67 for upper-case Latin)
+// from a Bayer letter string (str) of length (len), which need not be NUL-terminated; or zero if not
+// recognized. Greek letters may be abbreviated ("alp" for "alpha").
+
+static int chars_to_bayer ( const char *str, size_t len, bool casesens = true )
 {
-    size_t len = str.length();
-    
     if ( len == 1 )
     {
         if ( str[0] >= 'a' && str[0] <= 'z' )
@@ -204,7 +244,7 @@ static int string_to_bayer ( const string &str, bool casesens = true )
     else
     {
         for ( int i = 0; i < _bayvec.size(); i++ )
-            if ( compare ( _bayvec[i], str, len, casesens ) == 0 )
+            if ( _bayvec[i].length() >= len && equal_chars ( _bayvec[i].c_str(), str, len, casesens ) )
                 return i + 1;
     }
     
@@ -221,44 +261,45 @@ string bayer_to_string ( uint64_t bay )
         return _bayvec[ bay - 1 ];
 }
 
-static uint64_t string_to_gcvs ( string str, bool casesens = true )
+// Returns GCVS variable star number from a variable star designation (str) of length (len),
+// which need not be NUL-terminated, but must be followed by a non-digit; or zero if not recognized.
+// Designations are always case-sensitive, so that "mu Cep" is never mistaken for "MU Cep".
+
+static uint64_t chars_to_gcvs ( const char *str, size_t len )
 {
-    size_t len = str.length();
     int n1 = 0, n2 = 0;
-    
-    if ( ! casesens )
-        toUpper ( str );
+    char c0 = len > 0 ? str[0] : 0, c1 = len > 1 ? str[1] : 0;
     
     // Sequence R, S, T ... Z
         
-    if ( len == 1 && str[0] >= 'R' && str[0] <= 'Z' )
+    if ( len == 1 && c0 >= 'R' && c0 <= 'Z' )
     {
-        return str[0] - 'R' + 1;
+        return c0 - 'R' + 1;
     }
 
     // Sequence RR, RS, RT ... SS, ST, SU, ... TT, TU ... ZZ
         
-    else if ( len == 2 && str[0] >= 'R' && str[0] <= 'Z' && str[1] >= str[0] && str[1] <= 'Z' )
+    else if ( len == 2 && c0 >= 'R' && c0 <= 'Z' && c1 >= c0 && c1 <= 'Z' )
     {
-        n1 = str[0] - 'R';
-        n2 = str[1] - 'R';
+        n1 = c0 - 'R';
+        n2 = c1 - 'R';
         
         return n1 * 9 - ( n1 - 1 ) * n1 / 2 + ( n2 - n1 ) + 10;
     }
         
     // Sequence AA, AB, AC, ... BB, BC, BD, ... CC, CD, .... QZ
         
-    else if ( len == 2 && str[0] >= 'A' && str[0] < 'R' && str[0] != 'J' && str[1] >= str[0] && str[1] <= 'Z' && str[1] != 'J'  )
+    else if ( len == 2 && c0 >= 'A' && c0 < 'R' && c0 != 'J' && c1 >= c0 && c1 <= 'Z' && c1 != 'J'  )
     {
-        n1 = str[0] - 'A';
-        n2 = str[1] - 'A';
+        n1 = c0 - 'A';
+        n2 = c1 - 'A';
         
         // J is skipped!
         
-        if ( str[0] >= 'K' )
+        if ( c0 >= 'K' )
             n1--;
 
-        if ( str[1] >= 'K' )
+        if ( c1 >= 'K' )
             n2--;
         
         return n1 * 25 - ( n1 - 1 ) * n1 / 2 + ( n2 - n1 ) + 55;
@@ -266,9 +307,9 @@ static uint64_t string_to_gcvs ( string str, bool casesens = true )
 
     // Sequence V335, V336, V337, V338, ...
         
-    if ( len > 3 && str[0] == 'V' && str[1] >= '0' && str[1] <= '9' )
+    if ( len > 3 && c0 == 'V' && c1 >= '0' && c1 <= '9' )
     {
-        return strtoint ( str.substr ( 1, len - 1 ) );
+        return strtoint ( str + 1 );
     }
         
     return 0;
@@ -325,12 +366,12 @@ string gcvs_to_string ( uint64_t n )
     return "";
 }
 
-uint64_t string_to_dm ( string str )
+uint64_t string_to_dm ( const char *str )
 {
     char     sign = 0, suffix = 0;
     int      zone = 0, num = 0;
     
-    sscanf ( str.c_str(), "%c%d%d%c", &sign, &zone, &num, &suffix );
+    sscanf ( str, "%c%d%d%c", &sign, &zone, &num, &suffix );
 
     if ( sign == '+' )
         sign = 1;
@@ -391,12 +432,12 @@ string tyc_to_string ( uint64_t tyc )
     return format ( "%04d-%04d-%d", (int) r, (int) n, (int) c );
 }
 
-uint64_t string_to_tyc ( string str )
+uint64_t string_to_tyc ( const char *str )
 {
     char sep;
     int rgn = 0, num = 0, com = 0;
 
-    sscanf ( str.c_str(), "%d%c%d%c%d", &rgn, &sep, &num, &sep, &com );
+    sscanf ( str, "%d%c%d%c%d", &rgn, &sep, &num, &sep, &com );
 
     if ( rgn >= 1 && rgn <= 9537 && num >= 1 && num <= 12121 && com >= 0 && com <= 4 )
         return (uint64_t) rgn * 1000000 + num * 10 + com;
@@ -418,11 +459,11 @@ string gj_to_string ( uint64_t gj )
         return format ( "%.1f", d / 10.0 ) + comps;
 }
 
-uint64_t string_to_gj ( string str )
+uint64_t string_to_gj ( const char *str )
 {
-    size_t pos = str.find_first_of ( "ABCD" );
+    const char *pos = strpbrk ( str, "ABCD" );
     int d = strtofloat64 ( str ) * 10.0 + 0.1;
-    int c = pos == string::npos ? 0 : str[pos] - 'A' + 1;
+    int c = pos == nullptr ? 0 : *pos - 'A' + 1;
 
     if ( d == 0 )
         return 0;
@@ -438,24 +479,24 @@ string glp_to_string ( uint64_t glp )
     return format ( "%d-%d", (int) r, (int) n );
 }
 
-uint64_t string_to_glp ( string str )
+uint64_t string_to_glp ( const char *str )
 {
     char    sign = 0;
     int     r = 0, n = 0;
     
-    sscanf ( str.c_str(), "%d%c%d", &r, &sign, &n );
+    sscanf ( str, "%d%c%d", &r, &sign, &n );
     if ( r > 0 && r < 10000 & n > 0 && n < 1000 )
         return r * 1000 + n;
     else
         return 0;
 }
 
-uint64_t string_to_wds ( string str )
+uint64_t string_to_wds ( const char *str )
 {
     char    sign = 0;
     int     ra = 0, dec = 0;
     
-    sscanf ( str.c_str(), "%d%c%d", &ra, &sign, &dec );
+    sscanf ( str, "%d%c%d", &ra, &sign, &dec );
     
     if ( sign == '+' )
         sign = 1;
@@ -482,12 +523,12 @@ string wds_to_string ( uint64_t wds )
     return format ( "%05d%c%04d", (int) ra, (int) sign, (int) dec );
 }
 
-uint64_t string_to_ngcic ( string str )
+uint64_t string_to_ngcic ( const char *str )
 {
     int     num = 0;
     char    ext = 0;
 
-    sscanf ( str.c_str(), "%d%c", &num, &ext );
+    sscanf ( str, "%d%c", &num, &ext );
     
     if ( ext >= 'A' && ext <= 'I' )
         ext = ext - 'A' + 1;
@@ -513,19 +554,24 @@ string ngcic_to_string ( uint64_t ngcic )
         return format ( "%d", (int) num );
 }
 
-uint64_t string_to_pngpk ( string str )
+uint64_t string_to_pngpk ( const char *str )
 {
     double    lon = 0, lat = 0;
     int       londec = 0, latdec = 0;
     char      sign = 0;
+    char      buf[32] = { 0 };
     
     // Comvert whitespace in penultimate position to period.
     
-    size_t pos = str.length() - 2;
-    if ( str[pos] == ' ' )
-        str[pos] = '.';
+    size_t len = strlen ( str );
+    if ( len >= sizeof ( buf ) )
+        len = sizeof ( buf ) - 1;
     
-    sscanf ( str.c_str(), "%lf%c%lf", &lon, &sign, &lat );
+    memcpy ( buf, str, len );
+    if ( len >= 2 && buf[len - 2] == ' ' )
+        buf[len - 2] = '.';
+    
+    sscanf ( buf, "%lf%c%lf", &lon, &sign, &lat );
 
     londec = lon * 10.0 + 0.1;
     latdec = lat * 10.0 + 0.1;
@@ -592,325 +638,264 @@ uint64_t SSIdentifier::identifier ( void )
         return _id % 10000000000000000LL;
 }
 
-// Attempts to convert an indentifer in string form ("M 42", "alpha CMa", "HR 7001", "NGC 7992", etc.)
-// to numeric form. The object type code, if other than kTypeNonexistent, may be used as a hint to
-// resolve ambiguities. If Case Sensitivity matters (for example, if "M42" should convert but not "m42")
-// then set (casesens) to true. Caution: case is important for many star identifiers. For example, "mu Cep"
-// (Bayer star mu Cephei) is different from "MU Cep" (variable star MU Cephei).
+// How the rest of an identifier string is parsed after a catalog prefix, in SSIdentifier::fromString().
 
-SSIdentifier SSIdentifier::fromString ( const string &str, SSObjectType type, bool casesens )
+enum IdentParse
 {
-    if ( _conmap.size() == 0 || _baymap.size() == 0 )
-        mapinit();
-
-    size_t len = str.length();
-
-    // if string begins with "M", attempt to parse a Messier number
-    
-    if ( compare ( str, "M", 1, casesens ) == 0 && len > 1 )
-    {
-        uint64_t m = strtoint ( str.substr ( 1, len - 1 ) );
-        if ( m > 0 && m <= 110 )
-            return SSIdentifier ( kCatMessier, m );
-    }
-
-    // if string begins with "C", attempt to parse a Caldwell number
-    
-    if ( compare ( str, "C", 1, casesens ) == 0 && len > 1 )
-    {
-        uint64_t c = strtoint ( str.substr ( 1, len - 1 ) );
-        if ( c > 0 && c <= 109 )
-            return SSIdentifier ( kCatCaldwell, c );
-    }
-
-    // if string begins with "NGC", attempt to parse a New General Catalog identifier
-    
-    if ( compare ( str, "NGC", 3, casesens ) == 0 && len > 3 )
-    {
-        uint64_t ngc = string_to_ngcic ( str.substr ( 3, len - 3 ) );
-        if ( ngc )
-            return SSIdentifier ( kCatNGC, ngc );
-    }
-
-    // if string begins with "IC", attempt to parse an Index Catalog identifier
-    
-    if ( compare ( str, "IC", 2, casesens ) == 0 && len > 2 )
-    {
-        uint64_t ic = string_to_ngcic ( str.substr ( 2, len - 2 ) );
-        if ( ic )
-            return SSIdentifier ( kCatIC, ic );
-    }
-
-    // if string begins with "Mel", attempt to parse a Melotte open cluster identifier
-    
-    if ( compare ( str, "Mel", 3, casesens ) == 0 && len > 3 )
-    {
-        size_t mel = strtoint ( str.substr ( 3, len - 2 ) );
-        if ( mel > 0 )
-            return SSIdentifier ( kCatMel, mel );
-    }
-
-    // if string begins with "Sh2", attempt to parse a Sharpless bright nebula identifier
-    
-    if ( compare ( str, "Sh2", 3, casesens ) == 0 && len > 3 )
-    {
-        uint64_t sh2 = strtoint ( str.substr ( 3, len - 2 ) );
-        if ( sh2 > 0 )
-            return SSIdentifier ( kCatSh2, sh2 );
-    }
-
-    // if string begins with "LBN", attempt to parse a Lynds Bright Nebula identifier
-    
-    if ( compare ( str, "LBN", 3, casesens ) == 0 && len > 3 )
-    {
-        uint64_t lbn = strtoint ( str.substr ( 3, len - 2 ) );
-        if ( lbn > 0 )
-            return SSIdentifier ( kCatLBN, lbn );
-    }
-
-    // if string begins with "LDN", attempt to parse a Lynds Dark Nebula identifier
-    
-    if ( compare ( str, "LDN", 3, casesens ) == 0 && len > 3 )
-    {
-        uint64_t ldn = strtoint ( str.substr ( 3, len - 2 ) );
-        if ( ldn > 0 )
-            return SSIdentifier ( kCatLDN, ldn );
-    }
+    kParseNumber,   // positive integer, optionally limited to a maximum
+    kParseNGCIC,    // NGC or IC number with optional extension letter
+    kParsePNGPK,    // galactic longitude and latitude
+    kParseDigits,   // integer beginning at first digit in string
+    kParseTYC,      // Tycho region-number-component, beginning at first digit in string
+    kParseGAIA,     // 64-bit integer beginning at first digit in string
+    kParseDM,       // Durchmusterung zone and number, beginning at first sign in string
+    kParseWDS,      // WDS right ascension and declination
+    kParseGJ,       // Gliese-Jahreiss number with optional component letter
+    kParseGLP,      // Giclas or Luyten region-number
+};
 
-    // if string begins with "PNG", attempt to parse a Galactic Planetary Nebula number
-    
-    if ( compare ( str, "PNG", 3, casesens ) == 0 && len > 3 )
-    {
-        uint64_t png = string_to_pngpk ( str.substr ( 3, len - 3 ) );
-        if ( png )
-            return SSIdentifier ( kCatPNG, png );
-    }
+// Catalog prefixes recognized by SSIdentifier::fromString(), in the order they are tried. Strings shorter
+// than the minimum length are skipped. There are fewer than 32 prefixes, so the set which begin with
+// any character fits in a 32-bit mask.
 
-    // if string begins with "PK", attempt to parse a Perek-Kohoutek planetary nebula number
-    
-    if ( compare ( str, "PK", 2, casesens ) == 0 && len > 2 )
-    {
-        uint64_t pk = string_to_pngpk ( str.substr ( 2, len - 2 ) );
-        if ( pk )
-            return SSIdentifier ( kCatPK, pk );
-    }
+struct IdentPrefix
+{
+    const char *prefix;     // catalog prefix
+    size_t      length;     // length of prefix in characters
+    SSCatalog   catalog;    // catalog of identifiers with this prefix
+    IdentParse  parse;      // how the rest of the string is parsed
+    size_t      minLength;  // minimum length of whole string
+    uint64_t    maxNumber;  // maximum number for kParseNumber, or zero if none
+};
 
-    // if string begins with "PGC", attempt to parse a Principal Galaxy Catalog identifier
-    
-    if ( compare ( str, "PGC", 3, casesens ) == 0 && len > 3 )
-    {
-        uint64_t pgc = strtoint ( str.substr ( 3, len - 3 ) );
-        if ( pgc )
-            return SSIdentifier ( kCatPGC, pgc );
-    }
+static const IdentPrefix _identPrefixes[] =
+{
+    { "M",    1, kCatMessier,  kParseNumber, 2, 110 },
+    { "C",    1, kCatCaldwell, kParseNumber, 2, 109 },
+    { "NGC",  3, kCatNGC,      kParseNGCIC,  4, 0 },
+    { "IC",   2, kCatIC,       kParseNGCIC,  3, 0 },
+    { "Mel",  3, kCatMel,      kParseNumber, 4, 0 },
+    { "Sh2",  3, kCatSh2,      kParseNumber, 4, 0 },
+    { "LBN",  3, kCatLBN,      kParseNumber, 4, 0 },
+    { "LDN",  3, kCatLDN,      kParseNumber, 4, 0 },
+    { "PNG",  3, kCatPNG,      kParsePNGPK,  4, 0 },
+    { "PK",   2, kCatPK,       kParsePNGPK,  3, 0 },
+    { "PGC",  3, kCatPGC,      kParseNumber, 4, 0 },
+    { "UGCA", 4, kCatUGCA,     kParseNumber, 5, 0 },
+    { "UGC",  3, kCatUGC,      kParseNumber, 4, 0 },
+    { "HR",   2, kCatHR,       kParseDigits, 0, 0 },
+    { "HD",   2, kCatHD,       kParseDigits, 0, 0 },
+    { "SAO",  3, kCatSAO,      kParseDigits, 0, 0 },
+    { "HIP",  3, kCatHIP,      kParseDigits, 0, 0 },
+    { "TYC",  3, kCatTYC,      kParseTYC,    0, 0 },
+    { "GAIA", 4, kCatGAIA,     kParseGAIA,   0, 0 },
+    { "BD",   2, kCatBD,       kParseDM,     0, 0 },
+    { "SD",   2, kCatBD,       kParseDM,     0, 0 },    // Southern Durchmusterung, found in SKY2000 Master Star Catalog
+    { "CD",   2, kCatCD,       kParseDM,     0, 0 },
+    { "CP",   2, kCatCP,       kParseDM,     0, 0 },
+    { "WDS",  3, kCatWDS,      kParseWDS,    4, 0 },
+    { "GJ",   2, kCatGJ,       kParseGJ,     3, 0 },
+    { "Gl",   2, kCatGJ,       kParseGJ,     3, 0 },
+    { "NN",   2, kCatGJ,       kParseGJ,     3, 0 },
+    { "Wo",   2, kCatGJ,       kParseGJ,     3, 0 },
+    { "G",    1, kCatGiclas,   kParseGLP,    4, 0 },
+    { "LP",   2, kCatLP,       kParseGLP,    4, 0 },
+    { "L",    1, kCatLuyten,   kParseGLP,    4, 0 },
+};
 
-    // if string begins with "UGCA", attempt to parse a Uppsala Galaxy Catalog Appendix identifier
-    
-    if ( compare ( str, "UGCA", 4, casesens ) == 0 && len > 4 )
-    {
-        uint64_t ugca = strtoint ( str.substr ( 4, len - 4 ) );
-        if ( ugca )
-            return SSIdentifier ( kCatUGCA, ugca );
-    }
-    
-    // if string begins with "UGC", attempt to parse a Uppsala Galaxy Catalog identifier
-    
-    if ( compare ( str, "UGC", 3, casesens ) == 0 && len > 3 )
-    {
-        uint64_t ugc = strtoint ( str.substr ( 3, len - 3 ) );
-        if ( ugc )
-            return SSIdentifier ( kCatUGC, ugc );
-    }
+static const int kNumIdentPrefixes = sizeof ( _identPrefixes ) / sizeof ( _identPrefixes[0] );
 
-    // if string begins with "HR", attempt to parse a Harvard Revised (Bright Star) catalog identifier
-    
-    if ( compare ( str, "HR", 2, casesens ) == 0 )
-    {
-        size_t pos = str.find_first_of ( "0123456789" );
-        if ( pos != string::npos )
-            return SSIdentifier ( kCatHR, stoi ( str.substr ( pos, len - pos ) ) );
-    }
-    
-    // if string begins with "HD", attempt to parse a Henry Draper catalog identifier
-    
-    if ( compare ( str, "HD", 2, casesens ) == 0 )
-    {
-        size_t pos = str.find_first_of ( "0123456789" );
-        if ( pos != string::npos )
-            return SSIdentifier ( kCatHD, stoi ( str.substr ( pos, len - pos ) ) );
-    }
+// Attempts to parse the rest of an identifier string (str) of length (len) after a catalog prefix (prefix),
+// which the string is known to begin with. If successful, returns true and the catalog identifier in (ident).
 
-    // if string begins with "SAO", attempt to parse a Smithsonian Astrophyiscal Observatory catalog identifier
+static bool parse_prefixed ( const IdentPrefix &prefix, const char *str, size_t len, uint64_t &ident )
+{
+    const char *rest = str + prefix.length, *pos = nullptr;
     
-    if ( compare ( str, "SAO", 3, casesens ) == 0 )
+    switch ( prefix.parse )
     {
-        size_t pos = str.find_first_of ( "0123456789" );
-        if ( pos != string::npos )
-            return SSIdentifier ( kCatSAO, stoi ( str.substr ( pos, len - pos ) ) );
+        case kParseNumber:
+            ident = strtoint ( rest );
+            return ident > 0 && ( prefix.maxNumber == 0 || ident <= prefix.maxNumber );
+            
+        case kParseNGCIC:
+            ident = string_to_ngcic ( rest );
+            return ident > 0;
+            
+        case kParsePNGPK:
+            ident = string_to_pngpk ( rest );
+            return ident > 0;
+            
+        case kParseDigits:
+            if ( ( pos = strpbrk ( str, "0123456789" ) ) != nullptr )
+                ident = strtoint ( pos );
+            return pos != nullptr;
+            
+        case kParseTYC:
+            if ( ( pos = strpbrk ( str, "0123456789" ) ) != nullptr )
+                ident = string_to_tyc ( pos );
+            return pos != nullptr;
+            
+        case kParseGAIA:
+            if ( ( pos = strpbrk ( str, "0123456789" ) ) != nullptr )
+                ident = strtoint64 ( pos );
+            return pos != nullptr;
+            
+        case kParseDM:
+            if ( ( pos = strpbrk ( str, "+-" ) ) != nullptr )
+                ident = string_to_dm ( pos );
+            return pos != nullptr;
+            
+        case kParseWDS:
+            ident = string_to_wds ( rest );
+            return ident > 0;
+            
+        case kParseGJ:
+            ident = string_to_gj ( rest );
+            return ident > 0;
+            
+        case kParseGLP:
+            ident = string_to_glp ( rest );
+            return ident > 0;
     }
-
-    // if string begins with "HIP", attempt to parse a Hipparcos catalog identifier
     
-    if ( compare ( str, "HIP", 3, casesens ) == 0 )
-    {
-        size_t pos = str.find_first_of ( "0123456789" );
-        if ( pos != string::npos )
-            return SSIdentifier ( kCatHIP, stoi ( str.substr ( pos, len - pos ) ) );
-    }
+    return false;
+}
 
-    // if string begins with "TYC", attempt to parse a Tycho catalog identifier
-    
-    if ( compare ( str, "TYC", 3, casesens ) == 0 )
-    {
-        size_t pos = str.find_first_of ( "0123456789" );
-        if ( pos != string::npos )
-            return SSIdentifier ( kCatTYC, string_to_tyc ( str.substr ( pos, len - pos ) ) );
-    }
+// Returns a bit mask of the catalog prefixes which begin with a character (c), ignoring case:
+// bit i is set if _identPrefixes[i] begins with that character. The table of masks is built once,
+// on first use, so this may be called from several threads at once.
 
-    // if string begins with "GAIA", attempt to parse a GAIA catalog identifier
-    
-    if ( compare ( str, "GAIA", 4, casesens ) == 0 )
+static uint32_t prefix_mask ( unsigned char c )
+{
+    static const vector<uint32_t> masks = [] ()
     {
-        size_t pos = str.find_first_of ( "0123456789" );
-        if ( pos != string::npos )
-            return SSIdentifier ( kCatGAIA, stoll ( str.substr ( pos, len - pos ) ) );
-    }
-
-    // if string begins with "BD" or "SD", attempt to parse a Bonner Durchmusterung catalog identifier
-    // Note: "SD" is abbrevieation for Southern Durchmusterung, found in SKY2000 Master Star Catalog.
+        vector<uint32_t> m ( 256, 0 );
+        for ( int i = 0; i < kNumIdentPrefixes; i++ )
+        {
+            unsigned char c0 = _identPrefixes[i].prefix[0];
+            m[ toupper ( c0 ) ] |= 1u << i;
+            m[ tolower ( c0 ) ] |= 1u << i;
+        }
+        return m;
+    }();
     
-    if ( compare ( str, "BD", 2, casesens ) == 0 || compare ( str, "SD", 2, casesens ) == 0 )
-    {
-        size_t pos = str.find_first_of ( "+-" );
-        if ( pos != string::npos )
-            return SSIdentifier ( kCatBD, string_to_dm ( str.substr ( pos, len - pos ) ) );
-    }
+    return masks[c];
+}
 
-    // if string begins with "CD", attempt to parse a Bonner Durchmusterung catalog identifier
-    
-    if ( compare ( str, "CD", 2, casesens ) == 0 )
-    {
-        size_t pos = str.find_first_of ( "+-" );
-        if ( pos != string::npos )
-            return SSIdentifier ( kCatCD, string_to_dm ( str.substr ( pos, len - pos ) ) );
-    }
+// Attempts to convert an indentifer in string form ("M 42", "alpha CMa", "HR 7001", "NGC 7992", etc.)
+// to numeric form. The object type code, if other than kTypeNonexistent, may be used as a hint to
+// resolve ambiguities. If Case Sensitivity matters (for example, if "M42" should convert but not "m42")
+// then set (casesens) to true. Caution: case is important for many star identifiers. For example, "mu Cep"
+// (Bayer star mu Cephei) is different from "MU Cep" (variable star MU Cephei).
 
-    // if string begins with "CP", attempt to parse a Bonner Durchmusterung catalog identifier
-    
-    if ( compare ( str, "CP", 2, casesens ) == 0 )
-    {
-        size_t pos = str.find_first_of ( "+-" );
-        if ( pos != string::npos )
-            return SSIdentifier ( kCatCP, string_to_dm ( str.substr ( pos, len - pos ) ) );
-    }
+SSIdentifier SSIdentifier::fromString ( const string &str, SSObjectType type, bool casesens )
+{
+    const char *s = str.c_str();
+    size_t len = str.length();
 
-    // if string begins with "WDS", attempt to parse a Washington Double Star catalog identifier
-    
-    if ( compare ( str, "WDS", 3, casesens ) == 0 && len > 3 )
-    {
-        uint64_t wds = string_to_wds ( str.substr ( 3, len - 3 ) );
-        if ( wds )
-            return SSIdentifier ( kCatWDS, wds );
-    }
-    
-    // if string begins with "GJ", "Gl", "Wo", or "NN", attempt to parse a Gliese-Jahreiss Nearby Star Catalog identifier
+    // Try only the catalog prefixes which begin with the string's first character, in order;
+    // if the string begins with a prefix, attempt to parse the rest as an identifier in that catalog.
     
-    if ( ( compare ( str, "GJ", 2, casesens ) == 0 || compare ( str, "Gl", 2, casesens ) == 0 || compare ( str, "NN", 2, casesens ) == 0 || compare ( str, "Wo", 2, casesens ) == 0 ) && len > 2 )
+    uint32_t mask = len > 0 ? prefix_mask ( s[0] ) : 0;
+    for ( int i = 0; mask != 0; i++, mask >>= 1 )
     {
-        uint64_t gj = string_to_gj ( str.substr ( 2, len - 2 ) );
-        if ( gj )
-            return SSIdentifier ( kCatGJ, gj );
+        const IdentPrefix &prefix = _identPrefixes[i];
+        if ( ( mask & 1 ) == 0 || len < prefix.length || len < prefix.minLength )
+            continue;
+        
+        uint64_t ident = 0;
+        if ( equal_chars ( s, prefix.prefix, prefix.length, casesens ) && parse_prefixed ( prefix, s, len, ident ) )
+            return SSIdentifier ( prefix.catalog, ident );
     }
 
-    // if string begins with "G", attempt to parse a Giclas catalog identifier
-    
-    if ( compare ( str, "G", 1, casesens ) == 0 && len > 3 )
-    {
-        uint64_t glp = string_to_glp ( str.substr ( 1, len - 1 ) );
-        if ( glp )
-            return SSIdentifier ( kCatGiclas, glp );
-    }
+    // Find the first, second, and last words separated by spaces, without copying them.
+    // If last word is a constellation abbrevation, attempt to parse Bayer/Flamsteed/GCVS identifier.
 
-    // if string begins with "LP", attempt to parse a Luyten-Palomar catalog identifier
-    
-    if ( compare ( str, "LP", 2, casesens ) == 0 && len > 3 )
+    size_t numWords = 0, wordPos[2] = { 0, 0 }, wordLen[2] = { 0, 0 }, lastPos = 0, lastLen = 0;
+    for ( size_t i = 0, j = 0; i < len; i = j )
     {
-        uint64_t glp = string_to_glp ( str.substr ( 2, len - 2 ) );
-        if ( glp )
-            return SSIdentifier ( kCatLP, glp );
+        for ( j = i; j < len && s[j] != ' '; j++ )
+            ;
+        
+        if ( j == i )
+        {
+            j++;
+            continue;
+        }
+        
+        if ( numWords < 2 )
+        {
+            wordPos[numWords] = i;
+            wordLen[numWords] = j - i;
+        }
+        
+        lastPos = i;
+        lastLen = j - i;
+        numWords++;
     }
-
-    // if string begins with "L", attempt to parse a Luyten catalog identifier
     
-    if ( compare ( str, "L", 1, casesens ) == 0 && len > 3 )
-    {
-        uint64_t glp = string_to_glp ( str.substr ( 1, len - 1 ) );
-        if ( glp )
-            return SSIdentifier ( kCatLuyten, glp );
-    }
-
-    // Tokenize string into words separated by whitespace.
-    // if last token is a constellation abbrevation,
-    // attempt to parse Bayer/Flamsteed/GCVS identifier.
-
-    vector<string> tokens = tokenize ( str, " " );
-    int con = tokens.size() >= 2 ? string_to_con ( tokens[ tokens.size() - 1 ], casesens ) : 0;
+    int con = numWords >= 2 ? chars_to_con ( s + lastPos, lastLen, casesens ) : 0;
     if ( con )
     {
-        string constr = tokens[1];
-
-        // try parsing first token as a variable star designation; return GCVS identifier if successful.
+        const char *word = s + wordPos[0];
+        size_t wordlen = wordLen[0];
         
-        uint64_t var = string_to_gcvs ( tokens[0], casesens );
+        // try parsing first word as a variable star designation; return GCVS identifier if successful.
+        
+        uint64_t var = chars_to_gcvs ( word, wordlen );
         if ( var > 0 )
             return SSIdentifier ( kCatGCVS, con * 10000 + var );
         
-        // If first token begins with a number, return a Flamsteed catalog identification
+        // If first word begins with a number, return a Flamsteed catalog identification
+        
+        size_t pos = 0;
+        while ( pos < wordlen && ( word[pos] < '0' || word[pos] > '9' ) )
+            pos++;
         
-        size_t pos = tokens[0].find_first_of ( "0123456789" );
         if ( pos == 0 )
-            return SSIdentifier ( kCatFlamsteed, con * 10000 + strtoint ( tokens[0] ) );
+            return SSIdentifier ( kCatFlamsteed, con * 10000 + strtoint ( word ) );
 
-        // If first token contains a number, convert numeric portion of token to integer,
-        // then erase numeric portion of token. If we have 3 tokens, convert middle to integer.
+        // If first word contains a number, convert numeric portion of word to integer,
+        // then ignore numeric portion of word. If we have 3 words, convert middle to integer.
         // This is the (optional) superscript after a Bayer letter.
         
         int num = 0;
-        if ( pos != string::npos )
+        if ( pos < wordlen )
         {
-            num = strtoint ( tokens[0].substr ( pos, string::npos ) );
-            tokens[0].erase ( pos, string::npos );
+            num = strtoint ( word + pos );
+            wordlen = pos;
         }
-        else if ( tokens.size() == 3 )
-            num = strtoint ( tokens[1] );
+        else if ( numWords == 3 )
+            num = strtoint ( s + wordPos[1] );
         
-        // Try parsing first token as a Bayer letter.  If successful, return
+        // Try parsing first word as a Bayer letter.  If successful, return
         // a Bayer designation with the numeric portion (if any) as superscript
         
-        int bay = string_to_bayer ( tokens[0], casesens );
+        int bay = chars_to_bayer ( word, wordlen, casesens );
         if ( bay > 0 )
             return SSIdentifier ( kCatBayer, con * 10000 + bay * 10 + num );
     }
     
     // if string is a number inside paratheses, attempt to parse as an asteroid number
     
-    if ( str[0] == '(' && str[len - 1] == ')' )
+    if ( len > 0 && s[0] == '(' && s[len - 1] == ')' )
     {
-        uint64_t n = strtoint ( str.substr ( 1, len - 2 ) );
+        uint64_t n = strtoint ( s + 1 );
         if ( n > 0 )
             return SSIdentifier ( kCatAstNum, n );
     }
     
     // if string is a number followed by "P" (or "p" if case-insensitive),
-    // parse as a periodic comet number
+    // parse as a periodic comet number. The number ends before the "P".
     
-    size_t pos = str.find ( "P" );
-    if ( ! casesens && pos == string::npos )
-        pos = str.find ( "p" );
+    const char *pos = strchr ( s, 'P' );
+    if ( ! casesens && pos == nullptr )
+        pos = strchr ( s, 'p' );
     
-    if ( pos != string::npos )
+    if ( pos != nullptr )
     {
-        uint64_t n = strtoint ( str.substr ( 0, pos ) );
+        uint64_t n = strtoint ( s );
         if ( n > 0 )
             return SSIdentifier ( kCatComNum, n );
     }
@@ -940,11 +925,28 @@ SSIdentifier SSIdentifier::fromString ( const string &str, SSObjectType type, bo
     return SSIdentifier ( kCatUnknown, 0 );
 }
 
-string SSIdentifier::toString ( void )
+// Converts a vector of identifier strings (strs) to numeric form, as fromString(), in the same order,
+// replacing the contents of (idents). Returns the number of strings recognized as identifiers in a
+// known catalog. Since fromString() does not modify any shared state, different batches may be
+// converted on different threads at once.
+
+int SSIdentifier::fromStrings ( const vector<string> &strs, vector<SSIdentifier> &idents, SSObjectType type, bool casesens )
 {
-    if ( _conmap.size() == 0 || _baymap.size() == 0 )
-        mapinit();
+    int n = 0;
+    
+    idents.resize ( strs.size() );
+    for ( size_t i = 0; i < strs.size(); i++ )
+    {
+        idents[i] = fromString ( strs[i], type, casesens );
+        if ( idents[i].catalog() != kCatUnknown )
+            n++;
+    }
+    
+    return n;
+}
 
+string SSIdentifier::toString ( void )
+{
     SSCatalog cat = catalog();
     uint64_t id = identifier();
     string str = "";
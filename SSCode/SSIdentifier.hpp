@@ -12,6 +12,7 @@
 #define SSIdentifier_hpp
 
 #include <string>
+#include <vector>
 #include <map>
 
 using namespace std;
@@ -105,6 +106,7 @@ public:
     
     string toString ( void );
     static SSIdentifier fromString ( const string &s, SSObjectType type = kTypeNonexistent, bool casesens = true );
+    static int fromStrings ( const vector<string> &strs, vector<SSIdentifier> &idents, SSObjectType type = kTypeNonexistent, bool casesens = true );
     
     bool operator > ( SSIdentifier other ) { return _id > other._id; }
     bool operator < ( SSIdentifier &other ) const { return _id < other._id; }
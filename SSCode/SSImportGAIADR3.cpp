@@ -5,10 +5,10 @@
 // Copyright ©2023 Southern Stars Group, LLC. All rights reserved.
 //
 // Routines for importing GAIA DR3 star catalog data.
-// Currently only tested on MacOS; will not compile on Windows due to
+// Tested on MacOS and Linux; will not compile on Windows due to
 // dependencies on zlib.h and dirent.h (and possibly others).
 
-#ifdef __APPLE__
+#if defined ( __APPLE__ ) || defined ( __linux__ )
 
 #include <algorithm>
 #include <iostream>
@@ -20,6 +20,7 @@
 #include "SSImportHIP.hpp"
 #include "SSImportTYC.hpp"
 #include "SSUtilities.hpp"
+#include "SSThreadPool.hpp"
 
 #define GAIADR3_HIP2_NUM_FIELDS 5
 #define GAIADR3_TYC2_NUM_FIELDS 6
@@ -35,7 +36,7 @@ struct SSGAIADir
 // Opens the GAIA source data file directory with the given path (root)
 // Returns pointer to GAIADir structure if successful or nullptr on failure.
 
-SSGAIADir *OpenGAIADir ( const string &root )
+SSGAIADir *SSOpenGAIADir ( const string &root )
 {
     SSGAIADir *gdp = new SSGAIADir();
     if ( gdp == NULL )
@@ -125,16 +126,30 @@ static int SSReadGAIACSVRecord ( gzFile gz_fp, vector<string> &fields )
     return (int) fields.size();
 }
 
-// Reads one record from gzip-compressed GAIA DR3 source file.
-// Returns 1 (true) if successful, 0 (false) on parse failure, or -1 (EOF) on end-of-file
+// Reads one CSV record from gzip-compressed GAIA data file into a line buffer (line),
+// and splits it in place into fields (fields), without copying each field into a string.
+// Returns number of fields in record or -1 (EOF) on failure.
 
-int SSReadGAIADR3SourceRecord ( SSGAIADir *gdp, SSGAIADR3SourceRecord &rec )
+static int SSReadGAIACSVRecord ( gzFile gz_fp, string &line, vector<const char *> &fields )
 {
-    vector<string> fields;
-    int result = SSReadGAIACSVRecord ( gdp->fp, fields );
-    if ( result == EOF )
-        return result;
-    if ( result < GAIADR3_SOURCE_NUM_FIELDS )
+    char csv_buf[4086] = { 0 };
+    
+    if ( gzgets ( gz_fp, csv_buf, sizeof ( csv_buf ) ) == NULL )
+        return ( EOF );
+    
+    line.assign ( csv_buf );
+    while ( line.length() > 1 && ( line.back() == '\r' || line.back() == '\n' ) )
+        line.pop_back();
+    
+    return split_csv_inplace ( line, fields );
+}
+
+// Parses one GAIA DR3 source record from its CSV fields (fields) into (rec).
+// Returns 1 (true) if successful, 0 (false) on parse failure.
+
+static int SSParseGAIADR3SourceRecord ( const vector<const char *> &fields, SSGAIADR3SourceRecord &rec )
+{
+    if ( fields.size() < GAIADR3_SOURCE_NUM_FIELDS )
         return false;
     
     rec.solution_id = strtoint64 ( fields[0] );
@@ -172,6 +187,20 @@ int SSReadGAIADR3SourceRecord ( SSGAIADir *gdp, SSGAIADR3SourceRecord &rec )
     return ( rec.solution_id && rec.source_id ) ? true : false;
 }
 
+// Reads one record from gzip-compressed GAIA DR3 source file.
+// Returns 1 (true) if successful, 0 (false) on parse failure, or -1 (EOF) on end-of-file
+
+int SSReadGAIADR3SourceRecord ( SSGAIADir *gdp, SSGAIADR3SourceRecord &rec )
+{
+    string line;
+    vector<const char *> fields;
+    int result = SSReadGAIACSVRecord ( gdp->fp, line, fields );
+    if ( result == EOF )
+        return result;
+    
+    return SSParseGAIADR3SourceRecord ( fields, rec );
+}
+
 // Reads one record from a GAIA DR3 <-> Hipparcos 2 cross-match file.
 // Returns 1 (true) if successful, 0 (false) on parse failure, or -1 (EOF) on end-of-file
 
@@ -220,7 +249,7 @@ static int SSReadGAIADR3Tycho2CrossMatchRecord ( gzFile gz_fp, SSGAIACrossMatchR
 
 // Reads a GAIA cross-match file from the specified path.
 // Returns number of records read from file.
-// Records are returned in the map of SSGAIACrossMatchRecords (records)
+// Records are returned in the cross-match table (records), sorted by source_id.
 
 int SSReadGAIACrossMatchFile ( const string &path, SSGAIACrossMatchFile cmf, SSGAIACrossMatch &records )
 {
@@ -229,7 +258,7 @@ int SSReadGAIACrossMatchFile ( const string &path, SSGAIACrossMatchFile cmf, SSG
 
     gzfp = gzopen ( path.c_str(), "r" );
     if ( gzfp == NULL )
-        return NULL;
+        return 0;
     
     while ( true )
     {
@@ -244,13 +273,120 @@ int SSReadGAIACrossMatchFile ( const string &path, SSGAIACrossMatchFile cmf, SSG
             break;
         
         if ( result == true )
-            records[ record.source_id ] = record;
+            records.add ( record );
     }
 
     gzclose ( gzfp );
+    records.sort();
     return (int) records.size();
 }
 
+// Binary cross-match table files start with this identifier, followed by the number of records
+// as a 64-bit integer, followed by the records themselves in native byte order.
+
+static const char kGAIACrossMatchFileID[8] = { 'S', 'S', 'G', 'A', 'I', 'A', 'X', 'M' };
+
+// Removes all records from this cross-match table, and unmaps its file, if any.
+
+void SSGAIACrossMatch::clear ( void )
+{
+    vector<SSGAIACrossMatchRecord>().swap ( _records );
+    if ( _pMapped )
+        unmapfile ( (const char *) _pMapped - 16, _mappedSize );
+    
+    _pMapped = nullptr;
+    _mappedSize = _numMapped = 0;
+}
+
+// Adds a record to this cross-match table. After adding records, call sort() before searching.
+// If the table was memory-mapped from a file, its records are copied into memory first.
+
+void SSGAIACrossMatch::add ( const SSGAIACrossMatchRecord &record )
+{
+    if ( _pMapped )
+    {
+        vector<SSGAIACrossMatchRecord> records ( begin(), end() );
+        clear();
+        _records.swap ( records );
+    }
+    
+    _records.push_back ( record );
+}
+
+// Sorts records in this cross-match table by source_id. If several records have the same source_id,
+// only the last one added is kept.
+
+void SSGAIACrossMatch::sort ( void )
+{
+    stable_sort ( _records.begin(), _records.end(), [] ( const SSGAIACrossMatchRecord &r1, const SSGAIACrossMatchRecord &r2 ) { return r1.source_id < r2.source_id; } );
+    
+    size_t n = 0;
+    for ( size_t i = 0; i < _records.size(); i++ )
+    {
+        if ( n > 0 && _records[n - 1].source_id == _records[i].source_id )
+            _records[n - 1] = _records[i];
+        else
+            _records[n++] = _records[i];
+    }
+    
+    _records.resize ( n );
+    _records.shrink_to_fit();
+}
+
+// Returns pointer to the record with a particular GAIA source identifier (source_id),
+// or nullptr if this cross-match table has no such record. The table must be sorted.
+
+const SSGAIACrossMatchRecord *SSGAIACrossMatch::find ( uint64_t source_id ) const
+{
+    const SSGAIACrossMatchRecord *pRec = lower_bound ( begin(), end(), source_id, [] ( const SSGAIACrossMatchRecord &r, uint64_t id ) { return r.source_id < id; } );
+    return pRec != end() && pRec->source_id == source_id ? pRec : nullptr;
+}
+
+// Saves this sorted cross-match table to a binary file at (path), which can be
+// memory-mapped with load() on a later run. Returns true if successful.
+
+bool SSGAIACrossMatch::save ( const string &path ) const
+{
+    FILE *file = fopen ( path.c_str(), "wb" );
+    if ( file == NULL )
+        return false;
+    
+    uint64_t count = size();
+    bool ok = fwrite ( kGAIACrossMatchFileID, sizeof ( kGAIACrossMatchFileID ), 1, file ) == 1
+           && fwrite ( &count, sizeof ( count ), 1, file ) == 1
+           && ( count == 0 || fwrite ( begin(), sizeof ( SSGAIACrossMatchRecord ), count, file ) == count );
+    
+    ok = fclose ( file ) == 0 && ok;
+    return ok;
+}
+
+// Memory-maps a cross-match table saved by save() from the binary file at (path), replacing any
+// records in this table. Records are paged in from the file as they are searched, and are not copied.
+// Returns true if successful, or false if the file can't be opened or is not a valid table.
+
+bool SSGAIACrossMatch::load ( const string &path )
+{
+    size_t size = 0;
+    const void *pMap = mapfile ( path, size );
+    if ( pMap == nullptr )
+        return false;
+    
+    uint64_t count = 0;
+    if ( size >= 16 )
+        memcpy ( &count, (const char *) pMap + 8, sizeof ( count ) );
+    if ( size < 16 || memcmp ( pMap, kGAIACrossMatchFileID, sizeof ( kGAIACrossMatchFileID ) ) != 0 || size != 16 + count * sizeof ( SSGAIACrossMatchRecord ) )
+    {
+        unmapfile ( pMap, size );
+        return false;
+    }
+    
+    clear();
+    _pMapped = (const SSGAIACrossMatchRecord *) ( (const char *) pMap + 16 );
+    _mappedSize = size;
+    _numMapped = count;
+    return true;
+}
+
 // Converts GAIA DR3 magnitude sytem (G, G_BP, G_RP) to Tycho magnitude system (V_T, B_T).
 // See DAIA DR3 documentation version 1.1, page 349, Table 5.8; reproduced here:
 // https://gea.esac.esa.int/archive/documentation/GDR3/Data_processing/chap_cu5pho/cu5pho_sec_photSystem/cu5pho_ssec_photRelations.html
@@ -293,28 +429,140 @@ void GAIADR3toJohnsonMagnitude ( float g, float gbp, float grp, float &vj, float
     ic = g - g_i;
 }
 
+// Converts a GAIA DR3 source record (record) to an "essentials" record (outrec), with HIP and TYC
+// identifiers from cross-match indexes (hipCM, tycCM). Returns false if the source is brighter than gmin
+// or fainter than gmax, or has neither a HIP nor a TYC identifier and (onlyHIPTYC) is true.
+
+static bool SSMakeGAIARec ( const SSGAIADR3SourceRecord &record, const SSGAIACrossMatch &hipCM, const SSGAIACrossMatch &tycCM, float gmin, float gmax, bool onlyHIPTYC, SSGAIARec &outrec )
+{
+    // Strip out stars brighter than minimum, or fainter than maximum, G magnitude
+    
+    if ( record.phot_g_mean_mag < gmin || record.phot_g_mean_mag > gmax )
+        return false;
+    
+    outrec = { 0 };
+    outrec.source_id = record.source_id;
+    
+    const SSGAIACrossMatchRecord *pRec = hipCM.find ( record.source_id );
+    if ( pRec != nullptr )
+        outrec.hip_source_id = (uint32_t) pRec->ext_source_id;
+
+    pRec = tycCM.find ( record.source_id );
+    if ( pRec != nullptr )
+        outrec.tyc_source_id = pRec->ext_source_id;
+    
+    // If we only want GAIA stars with HIP or TYC identifiers, skip this star if it does not have either
+    
+    if ( onlyHIPTYC && ( outrec.hip_source_id == 0 && outrec.tyc_source_id == 0 ) )
+        return false;
+    
+    outrec.ra_mas = record.ra * 3600000.0;
+    outrec.dec_mas = record.dec * 3600000.0;
+    outrec.pos_error = sqrt ( record.ra_error * record.ra_error + record.dec_error * record.dec_error );
+    outrec.parallax = record.parallax;
+    outrec.parallax_error = record.parallax_error;
+    outrec.pmra_mas = record.pmra;
+    outrec.pmdec_mas = record.pmdec;
+    outrec.pm_error = sqrt ( record.pmra_error * record.pmra_error + record.pmdec_error * record.pmdec_error );
+    outrec.phot_g_mean_mmag = record.phot_g_mean_mag * 1000.0;
+    outrec.phot_bp_mean_mmag = record.phot_bp_mean_mag * 1000.0;
+    outrec.phot_rp_mean_mmag = record.phot_rp_mean_mag * 1000.0;
+    outrec.radial_velocity = record.radial_velocity;
+    outrec.radial_velocity_error = record.radial_velocity_error;
+    outrec.teff_k = record.teff_gspphot;
+    outrec.logg = record.logg_gspphot;
+    outrec.distance_pc = record.distance_gspphot;
+    outrec.extinction_mmag = record.ag_gspphot * 1000.0;
+    outrec.reddening_mmag = record.ebpminrp_gspphot * 1000.0;
+    
+    return true;
+}
+
+// "Essentials" records exported from one GAIA source file, and number of valid source records read from it.
+
+struct SSGAIAShard
+{
+    vector<SSGAIARec> records;
+    int64_t numRead = 0;
+};
+
+// Reads all records from one gzipped GAIA DR3 source file (path), and converts them to "essentials"
+// records in (shard), as in SSMakeGAIARec(). Returns false if the file can't be opened.
+
+static bool SSExportGAIADR3SourceFile ( const string &path, const SSGAIACrossMatch &hipCM, const SSGAIACrossMatch &tycCM, float gmin, float gmax, bool onlyHIPTYC, SSGAIAShard &shard )
+{
+    gzFile fp = gzopen ( path.c_str(), "rb" );
+    if ( fp == NULL )
+        return false;
+    
+    gzbuffer ( fp, 1 << 18 );
+    
+    string line;
+    vector<const char *> fields;
+    
+    while ( true )
+    {
+        int result = SSReadGAIACSVRecord ( fp, line, fields );
+        if ( result == EOF )
+            break;
+        
+        // skip over invalid records
+        
+        SSGAIADR3SourceRecord record = { 0 };
+        if ( SSParseGAIADR3SourceRecord ( fields, record ) == false )
+            continue;
+        
+        shard.numRead++;
+        SSGAIARec outrec;
+        if ( SSMakeGAIARec ( record, hipCM, tycCM, gmin, gmax, onlyHIPTYC, outrec ) )
+            shard.records.push_back ( outrec );
+    }
+    
+    gzclose ( fp );
+    return true;
+}
+
 // Exports GAIA DR3 "essentials" from full GAIA source catalog.
 // Gzipped GAIA DR2 source files are stored in the root directory.
 // Essentials file is written to the output file at (outpath).
 // Hipparcos (hipCM) and Tycho (tycCM) cross-match indexes should have been read previously.
 // GAIA sources brighter than gmin or fainter than gmax will be discarded.
+// Source files are read concurrently on (numThreads) threads, or all hardware threads if zero;
+// records are written in order of source file name, then record order within each file,
+// so the output does not depend on the number of threads.
 
-int SSExportGAIADR3StarData ( const string &root, const string &outpath, const SSGAIACrossMatch &hipCM, const SSGAIACrossMatch &tycCM, float gmin, float gmax, bool onlyHIPTYC )
+int SSExportGAIADR3StarData ( const string &root, const string &outpath, const SSGAIACrossMatch &hipCM, const SSGAIACrossMatch &tycCM, float gmin, float gmax, bool onlyHIPTYC, int numThreads )
 {
-    int     n_outrecs = 0, n_records = 0, result = 0;
+    int     n_outrecs = 0;
+    int64_t n_records = 0;
     FILE    *outfile = NULL;
     double  startJD = SSTime::fromSystem().jd, endJD = 0;
 
-    // Open GAIA root directory
+    // Open GAIA root directory and list gzipped source files in name order
     
-    SSGAIADir *gdp = OpenGAIADir ( root );
-    if ( gdp == NULL )
+    DIR *dp = opendir ( root.c_str() );
+    if ( dp == NULL )
     {
         printf ( "Can't open GAIA directory!\n" );
         return -1;
     }
     
-    printf ( "Opened GAIA directory.\n" );
+    vector<string> paths;
+    for ( struct dirent *pDirEnt = readdir ( dp ); pDirEnt != NULL; pDirEnt = readdir ( dp ) )
+    {
+        size_t len = strlen ( pDirEnt->d_name );
+        if ( len < 6 || strcmp ( pDirEnt->d_name + len - 6, "csv.gz" ) != 0 )
+            continue;
+        
+        string path = root;
+        if ( path.back() != '/' )
+            path += '/';
+        paths.push_back ( path + pDirEnt->d_name );
+    }
+    
+    closedir ( dp );
+    sort ( paths.begin(), paths.end() );
+    printf ( "Opened GAIA directory, %d source files.\n", (int) paths.size() );
     
     // Attempt to open output file. Return error code on failure.
     
@@ -322,76 +570,64 @@ int SSExportGAIADR3StarData ( const string &root, const string &outpath, const S
     if ( outfile == NULL )
     {
         printf ( "Can't open output file %s!\n", outpath.c_str() );
-        SSCloseGAIADir ( gdp );
         return -1;
     }
     
-    // Read records from GAIA directory individually, until we hit end-of-file.
-    // Write essentials from each record to output file.
-
-    while ( true )
+#if USE_THREADS
+    if ( numThreads < 1 )
+        numThreads = max ( 1, (int) thread::hardware_concurrency() );
+#else
+    numThreads = 1;
+#endif
+    
+    // Read a batch of source files, one or two per thread, concurrently; then write the records
+    // exported from each file to the output file in order, and report progress. Repeat until done.
+    
+    size_t batchSize = numThreads > 1 ? numThreads * 2 : 1;
+    SSThreadPool *pPool = numThreads > 1 ? new SSThreadPool ( numThreads ) : nullptr;
+    
+    for ( size_t first = 0; first < paths.size(); first += batchSize )
     {
-        SSGAIADR3SourceRecord record = { 0 };
-        result = SSReadGAIADir ( gdp, record );
-        if ( result == EOF )
-            break;
-        
-        // skip over invalid records
-        
-        if ( result == false )
-            continue;
+        size_t count = min ( batchSize, paths.size() - first );
+        vector<SSGAIAShard> shards ( count );
+        vector<char> opened ( count );
         
-        n_records++;
-        if ( n_records % 1000000 == 0 )
-            printf ( "Read %d GAIA records...\n", n_records );
-
-        // Strip out stars brighter than minimum, or fainter than maximum, G magnitude
-        
-        if ( record.phot_g_mean_mag < gmin || record.phot_g_mean_mag > gmax )
-            continue;
-        
-        SSGAIARec outrec = { 0 };
-        outrec.source_id = record.source_id;
-        
-        auto it = hipCM.find ( record.source_id );
-        if ( it != hipCM.end() )
-            outrec.hip_source_id = (uint32_t) it->second.ext_source_id;
-
-        it = tycCM.find ( record.source_id );
-        if ( it != tycCM.end() )
-            outrec.tyc_source_id = it->second.ext_source_id;
+        for ( size_t i = 0; i < count; i++ )
+        {
+            auto job = [&, i] () { opened[i] = SSExportGAIADR3SourceFile ( paths[first + i], hipCM, tycCM, gmin, gmax, onlyHIPTYC, shards[i] ); };
+            if ( pPool )
+                pPool->submit ( job );
+            else
+                job();
+        }
         
-        // If we only want GAIA stars with HIP or TYC identifiers, skip this star if it does not have either
+        if ( pPool )
+            pPool->wait();
         
-        if ( onlyHIPTYC && ( outrec.hip_source_id == 0 && outrec.tyc_source_id == 0 ) )
-            continue;
+        for ( size_t i = 0; i < count; i++ )
+        {
+            if ( ! opened[i] )
+            {
+                printf ( "Can't open GAIA source file %s!\n", paths[first + i].c_str() );
+                continue;
+            }
+            
+            vector<SSGAIARec> &records = shards[i].records;
+            size_t written = records.empty() ? 0 : fwrite ( records.data(), sizeof ( SSGAIARec ), records.size(), outfile );
+            if ( written < records.size() )
+                printf ( "Failed to write %d output records to %s!\n", (int) ( records.size() - written ), outpath.c_str() );
+            
+            n_outrecs += written;
+            n_records += shards[i].numRead;
+        }
         
-        outrec.ra_mas = record.ra * 3600000.0;
-        outrec.dec_mas = record.dec * 3600000.0;
-        outrec.pos_error = sqrt ( record.ra_error * record.ra_error + record.dec_error * record.dec_error );
-        outrec.parallax = record.parallax;
-        outrec.parallax_error = record.parallax_error;
-        outrec.pmra_mas = record.pmra;
-        outrec.pmdec_mas = record.pmdec;
-        outrec.pm_error = sqrt ( record.pmra_error * record.pmra_error + record.pmdec_error * record.pmdec_error );
-        outrec.phot_g_mean_mmag = record.phot_g_mean_mag * 1000.0;
-        outrec.phot_bp_mean_mmag = record.phot_bp_mean_mag * 1000.0;
-        outrec.phot_rp_mean_mmag = record.phot_rp_mean_mag * 1000.0;
-        outrec.radial_velocity = record.radial_velocity;
-        outrec.radial_velocity_error = record.radial_velocity_error;
-        outrec.teff_k = record.teff_gspphot;
-        outrec.logg = record.logg_gspphot;
-        outrec.distance_pc = record.distance_gspphot;
-        outrec.extinction_mmag = record.ag_gspphot * 1000.0;
-        outrec.reddening_mmag = record.ebpminrp_gspphot * 1000.0;
-
-        if ( fwrite ( &outrec, sizeof ( outrec ), 1, outfile ) == 1 )
-            n_outrecs++;
-        else
-            printf ( "Failed to write output record for GAIA source ID %lld to %s!\n", outrec.source_id, outpath.c_str() );
+        double elapsed = SSTime::kSecondsPerDay * ( SSTime::fromSystem().jd - startJD );
+        printf ( "Read %lld GAIA records from %d of %d files, %.0f records/sec...\n", (long long) n_records, (int) ( first + count ), (int) paths.size(), elapsed > 0.0 ? n_records / elapsed : 0.0 );
     }
     
-    // Free memory for array anc close file.
+    delete pPool;
+    
+    // Close file.
     
     fclose ( outfile );
     printf ( "Wrote %d records to %s, file closed.\n", n_outrecs, outpath.c_str() );
@@ -572,4 +808,4 @@ int SSImportGAIA17 ( const string &filename, SSObjectArray &stars, float vmin, f
     return numStars;
 }
 
-#endif // __APPLE__
+#endif // __APPLE__ || __linux__
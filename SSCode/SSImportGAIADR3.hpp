@@ -98,9 +98,38 @@ struct SSGAIACrossMatchRecord
     uint8_t     xm_flag = 0;                // Cross-match algorithm flag; see documentation
 };
 
-// Represents an entire GAIA cross-match file, indexed by GAIA DR3 source_id for fast lookups
+// Represents an entire GAIA cross-match file, as a flat array of records sorted by GAIA DR3 source_id
+// for fast binary-search lookups. The array can be saved to a binary file, and later memory-mapped
+// from it, so the cross-match CSV file need not be parsed on every run. Lookups do not modify the
+// array, so it may be searched by several threads at once.
 
-typedef map<uint64_t,SSGAIACrossMatchRecord> SSGAIACrossMatch;
+class SSGAIACrossMatch
+{
+protected:
+    vector<SSGAIACrossMatchRecord> _records;            // records read or added; sorted by source_id after sort()
+    const SSGAIACrossMatchRecord *_pMapped = nullptr;   // records memory-mapped from a file, or nullptr if none
+    size_t _mappedSize = 0;                             // size of memory-mapped file in bytes
+    size_t _numMapped = 0;                              // number of memory-mapped records
+
+    const SSGAIACrossMatchRecord *begin ( void ) const { return _pMapped ? _pMapped : _records.data(); }
+    const SSGAIACrossMatchRecord *end ( void ) const { return begin() + size(); }
+
+public:
+    SSGAIACrossMatch ( void ) {}
+    SSGAIACrossMatch ( const SSGAIACrossMatch &other ) = delete;
+    SSGAIACrossMatch &operator = ( const SSGAIACrossMatch &other ) = delete;
+    virtual ~SSGAIACrossMatch ( void ) { clear(); }
+
+    void clear ( void );
+    void add ( const SSGAIACrossMatchRecord &record );
+    void sort ( void );
+    size_t size ( void ) const { return _pMapped ? _numMapped : _records.size(); }
+    size_t memoryUsage ( void ) const { return sizeof ( SSGAIACrossMatch ) + _records.capacity() * sizeof ( SSGAIACrossMatchRecord ); }
+    const SSGAIACrossMatchRecord *find ( uint64_t source_id ) const;
+
+    bool save ( const string &path ) const;
+    bool load ( const string &path );
+};
 
 struct SSGAIADir;   // Forward declaration of opaque GAIA directory/file reference
 
@@ -110,7 +139,7 @@ void SSCloseGAIADir ( SSGAIADir *gdp );
 
 int SSReadGAIACrossMatchFile ( const string &path, SSGAIACrossMatchFile cmf, SSGAIACrossMatch &records );
 int SSReadGAIADR3SourceRecord ( SSGAIADir *gdp, SSGAIADR3SourceRecord &record );
-int SSExportGAIADR3StarData ( const string &root, const string &outpath, const SSGAIACrossMatch &hipCM, const SSGAIACrossMatch &tycCM, float gmin, float gmax, bool onlyHIPTYC );
+int SSExportGAIADR3StarData ( const string &root, const string &outpath, const SSGAIACrossMatch &hipCM, const SSGAIACrossMatch &tycCM, float gmin, float gmax, bool onlyHIPTYC, int numThreads = 0 );
 int SSImportGAIA17 ( const string &filename, SSObjectArray &stars, float vmin, float vmax );
 
 void GAIADR3toTycho2Magnitude ( float g, float gbp, float grp, float &vt, float &bt );
@@ -0,0 +1,159 @@
+// SSKDTree.cpp
+// SSCore
+//
+// A static k-d tree of points on the unit sphere, for fast cone searches
+// and nearest-neighbor queries among large numbers of stars.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#include <algorithm>
+#include <cmath>
+
+#include "SSKDTree.hpp"
+
+// Adds a unit vector (vec) with an ID (id) to the tree. Infinite or NaN vectors are ignored.
+// The tree must be rebuilt with build() before searching.
+
+void SSKDTree::add ( const SSVector &vec, uint32_t id )
+{
+    if ( ! isfinite ( vec.x ) || ! isfinite ( vec.y ) || ! isfinite ( vec.z ) )
+        return;
+
+    _points.push_back ( { vec.x, vec.y, vec.z, id, 0 } );
+}
+
+// Arranges all points added so far into a balanced tree. Takes O ( n log n ) time.
+
+void SSKDTree::build ( void )
+{
+    _build ( 0, _points.size() );
+}
+
+// Recursively arranges points from (begin) up to but not including (end): finds the axis along
+// which they are most spread out, moves the median point along that axis to the middle of the
+// range, with smaller points before it and larger points after it, then does the same to each half.
+
+void SSKDTree::_build ( size_t begin, size_t end )
+{
+    if ( end - begin < 2 )
+    {
+        if ( end > begin )
+            _points[begin].axis = 0;
+        return;
+    }
+
+    double lo[3] = { INFINITY, INFINITY, INFINITY }, hi[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for ( size_t i = begin; i < end; i++ )
+    {
+        const Point &p = _points[i];
+        lo[0] = min ( lo[0], p.x ); hi[0] = max ( hi[0], p.x );
+        lo[1] = min ( lo[1], p.y ); hi[1] = max ( hi[1], p.y );
+        lo[2] = min ( lo[2], p.z ); hi[2] = max ( hi[2], p.z );
+    }
+
+    uint32_t axis = 0;
+    if ( hi[1] - lo[1] > hi[axis] - lo[axis] )
+        axis = 1;
+    if ( hi[2] - lo[2] > hi[axis] - lo[axis] )
+        axis = 2;
+
+    size_t mid = begin + ( end - begin ) / 2;
+    nth_element ( _points.begin() + begin, _points.begin() + mid, _points.begin() + end,
+                  [axis] ( const Point &p1, const Point &p2 ) { return ( &p1.x )[axis] < ( &p2.x )[axis]; } );
+
+    _points[mid].axis = axis;
+    _build ( begin, mid );
+    _build ( mid + 1, end );
+}
+
+// Appends IDs of points within an angular radius (radius) in radians of a unit vector (center)
+// to (results), in no particular order, and returns the number of points found. Points exactly
+// on the boundary, within rounding error, may or may not be included. If radius >= pi, all points
+// are returned.
+
+int SSKDTree::search ( const SSVector &center, double radius, vector<uint32_t> &results ) const
+{
+    size_t n = results.size();
+    double c[3] = { center.x, center.y, center.z };
+    double chord = radius >= M_PI ? 2.0 : 2.0 * sin ( radius / 2.0 );
+
+    _search ( 0, _points.size(), c, chord * chord, chord, results );
+    return (int) ( results.size() - n );
+}
+
+// Recursive cone search of points from (begin) up to but not including (end), as above.
+// (chord) is the search radius as a straight-line distance, and (chord2) is its square.
+
+void SSKDTree::_search ( size_t begin, size_t end, const double c[3], double chord2, double chord, vector<uint32_t> &results ) const
+{
+    while ( begin < end )
+    {
+        size_t mid = begin + ( end - begin ) / 2;
+        const Point &p = _points[mid];
+
+        double dx = p.x - c[0], dy = p.y - c[1], dz = p.z - c[2];
+        if ( dx * dx + dy * dy + dz * dz < chord2 )
+            results.push_back ( p.id );
+
+        // Search the lower half recursively if the search sphere reaches below the split plane,
+        // then continue with the upper half if it reaches above the split plane.
+
+        double d = c[ p.axis ] - ( &p.x )[ p.axis ];
+        if ( d - chord <= 0.0 )
+            _search ( begin, mid, c, chord2, chord, results );
+
+        if ( d + chord < 0.0 )
+            break;
+
+        begin = mid + 1;
+    }
+}
+
+// Returns the ID of the point nearest a unit vector (center), if it is within an angular radius
+// (radius) in radians; otherwise returns -1.
+
+int64_t SSKDTree::nearest ( const SSVector &center, double radius ) const
+{
+    double c[3] = { center.x, center.y, center.z };
+    double chord = radius >= M_PI ? 2.0 : 2.0 * sin ( radius / 2.0 );
+    double bestDist2 = chord * chord * ( 1.0 + 1.0e-12 );
+    int64_t bestIndex = -1;
+
+    _nearest ( 0, _points.size(), c, bestDist2, bestIndex );
+    return bestIndex < 0 ? -1 : (int64_t) _points[ bestIndex ].id;
+}
+
+// Recursive nearest-neighbor search of points from (begin) up to but not including (end). Searches
+// the half on the same side of the split plane as (c) first, then the other half only if the split
+// plane is nearer than the best point found so far. Updates squared distance to, and index of, the
+// nearest point found so far (bestDist2, bestIndex).
+
+void SSKDTree::_nearest ( size_t begin, size_t end, const double c[3], double &bestDist2, int64_t &bestIndex ) const
+{
+    if ( begin >= end )
+        return;
+
+    size_t mid = begin + ( end - begin ) / 2;
+    const Point &p = _points[mid];
+
+    double dx = p.x - c[0], dy = p.y - c[1], dz = p.z - c[2];
+    double dist2 = dx * dx + dy * dy + dz * dz;
+    if ( dist2 < bestDist2 )
+    {
+        bestDist2 = dist2;
+        bestIndex = mid;
+    }
+
+    double d = c[ p.axis ] - ( &p.x )[ p.axis ];
+    if ( d < 0.0 )
+    {
+        _nearest ( begin, mid, c, bestDist2, bestIndex );
+        if ( d * d < bestDist2 )
+            _nearest ( mid + 1, end, c, bestDist2, bestIndex );
+    }
+    else
+    {
+        _nearest ( mid + 1, end, c, bestDist2, bestIndex );
+        if ( d * d < bestDist2 )
+            _nearest ( begin, mid, c, bestDist2, bestIndex );
+    }
+}
@@ -0,0 +1,61 @@
+// SSKDTree.hpp
+// SSCore
+//
+// A static k-d tree of points on the unit sphere, for fast cone searches
+// and nearest-neighbor queries among large numbers of stars.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#ifndef SSKDTREE_HPP
+#define SSKDTREE_HPP
+
+#include <stdint.h>
+#include <vector>
+
+#include "SSVector.hpp"
+
+using namespace std;
+
+// The tree stores 3-D unit vectors, each with a caller-supplied integer ID (typically the point's
+// index in some other array). It is built once from all points, and stored implicitly in a single
+// array: the median point of each subrange splits it along the axis of greatest extent.
+// Distances are straight-line (chord) distances between unit vectors, which increase monotonically
+// with angular separation, so cone searches and nearest-neighbor queries are exact in angle.
+// After building, the tree is read-only, so it may be searched by several threads at once.
+
+class SSKDTree
+{
+public:
+
+    struct Point
+    {
+        double   x, y, z;   // unit vector
+        uint32_t id;        // caller-supplied ID
+        uint32_t axis;      // axis (0, 1, 2 = x, y, z) along which this point splits its subrange
+    };
+
+protected:
+
+    vector<Point> _points;  // points, in implicit tree order
+
+    void _build ( size_t begin, size_t end );
+    void _search ( size_t begin, size_t end, const double c[3], double chord2, double chord, vector<uint32_t> &results ) const;
+    void _nearest ( size_t begin, size_t end, const double c[3], double &bestDist2, int64_t &bestIndex ) const;
+
+public:
+
+    SSKDTree ( void ) {}
+
+    void clear ( void ) { vector<Point>().swap ( _points ); }
+    void reserve ( size_t n ) { _points.reserve ( n ); }
+    void add ( const SSVector &vec, uint32_t id );
+    void build ( void );
+
+    size_t size ( void ) const { return _points.size(); }
+    size_t memoryUsage ( void ) const { return sizeof ( SSKDTree ) + _points.capacity() * sizeof ( Point ); }
+
+    int search ( const SSVector &center, double radius, vector<uint32_t> &results ) const;
+    int64_t nearest ( const SSVector &center, double radius = M_PI ) const;
+    const Point &getPoint ( size_t i ) const { return _points[i]; }
+};
+
+#endif /* SSKDTREE_HPP */
@@ -17,6 +17,8 @@
 #include "SSStar.hpp"
 #include "SSFeature.hpp"
 #include "SSConstellation.hpp"
+#include "SSThreadPool.hpp"
+#include "SSKDTree.hpp"
 
 typedef map<SSObjectType,string> SSTypeStringMap;
 typedef map<string,SSObjectType> SSStringTypeMap;
@@ -108,7 +110,8 @@ string SSObject::typeToCode ( SSObjectType type )
 
 SSObjectType SSObject::codeToType ( string code )
 {
-    return _stringTypes[ code ];
+    auto it = _stringTypes.find ( code );
+    return it == _stringTypes.end() ? kTypeNonexistent : it->second;
 }
 
 SSObject::SSObject ( void ) : SSObject ( kTypeNonexistent )
@@ -172,6 +175,136 @@ string SSObject::toCSV ( void )
     return "";
 }
 
+// Returns heap memory used by a string's character buffer, or zero if the string
+// is short enough to be stored inside the string object itself, i.e. its capacity
+// is no more than that of an empty string.
+
+size_t SSObject::stringHeapSize ( const string &str )
+{
+    static const size_t inlineCapacity = string().capacity();
+    return str.capacity() > inlineCapacity ? str.capacity() + 1 : 0;
+}
+
+// Returns heap memory used by this object's names and description, excluding subclass data.
+
+size_t SSObject::heapSize ( void )
+{
+    size_t bytes = _names.capacity() * sizeof ( string ) + stringHeapSize ( _description );
+    for ( const string &name : _names )
+        bytes += stringHeapSize ( name );
+
+    return bytes;
+}
+
+// Default implementation of memoryUsage; overridden by subclasses.
+
+size_t SSObject::memoryUsage ( void )
+{
+    return sizeof ( SSObject ) + heapSize();
+}
+
+// Each object is preceded by a header holding the arena it was allocated from, or nullptr if
+// allocated from the heap, so operator delete knows whether to free it. The header is 8 bytes,
+// which keeps objects 8-byte aligned in arenas and on the heap.
+
+static const size_t kObjectHeader = sizeof ( SSObjectArena * );
+static_assert ( kObjectHeader == 8, "object header must be 8 bytes" );
+
+void *SSObject::operator new ( size_t size )
+{
+    SSObjectArena *pArena = SSObjectArena::getCurrent();
+    char *ptr = (char *) ( pArena ? pArena->allocate ( size + kObjectHeader ) : ::operator new ( size + kObjectHeader ) );
+    *(SSObjectArena **) ptr = pArena;
+    return ptr + kObjectHeader;
+}
+
+void SSObject::operator delete ( void *ptr )
+{
+    if ( ptr == nullptr )
+        return;
+
+    char *header = (char *) ptr - kObjectHeader;
+    if ( *(SSObjectArena **) header == nullptr )
+        ::operator delete ( header );
+}
+
+// Returns the arena this object was allocated from, or nullptr if it was allocated from the heap.
+// Double and variable stars inherit SSStar virtually, so the header precedes the most-derived
+// object, which may not start at this SSObject.
+
+SSObjectArena *SSObject::getArena ( void )
+{
+    return *(SSObjectArena **) ( (char *) dynamic_cast<void *> ( this ) - kObjectHeader );
+}
+
+// Each thread's current arena for new objects; nullptr allocates from the heap.
+
+static thread_local SSObjectArena *_pCurrentArena = nullptr;
+
+// Returns the calling thread's current arena, or nullptr if none.
+
+SSObjectArena *SSObjectArena::getCurrent ( void )
+{
+    return _pCurrentArena;
+}
+
+// Makes (pArena) the calling thread's current arena, and returns the previous one.
+// Pass nullptr to allocate new objects from the heap again.
+
+SSObjectArena *SSObjectArena::setCurrent ( SSObjectArena *pArena )
+{
+    SSObjectArena *pPrevious = _pCurrentArena;
+    _pCurrentArena = pArena;
+    return pPrevious;
+}
+
+// Constructs an empty arena which will allocate memory in blocks of (blockSize) bytes.
+
+SSObjectArena::SSObjectArena ( size_t blockSize )
+{
+    _blockSize = blockSize;
+}
+
+// Allocates (bytes) bytes from the current block, rounded up to a multiple of 8 bytes,
+// starting a new block if there is not enough room. Requests larger than a quarter
+// of the block size get a block of their own, so they do not waste the current block.
+
+void *SSObjectArena::allocate ( size_t bytes )
+{
+    bytes = ( bytes + 7 ) & ~(size_t) 7;
+    _allocated += bytes;
+
+    if ( bytes > _blockSize / 4 )
+    {
+        char *block = (char *) ::operator new ( bytes );
+        _blocks.insert ( _blocks.end() - ( _blocks.empty() ? 0 : 1 ), block );
+        _reserved += bytes;
+        return block;
+    }
+
+    if ( _blocks.empty() || _blockUsed + bytes > _blockSize )
+    {
+        _blocks.push_back ( (char *) ::operator new ( _blockSize ) );
+        _reserved += _blockSize;
+        _blockUsed = 0;
+    }
+
+    void *ptr = _blocks.back() + _blockUsed;
+    _blockUsed += bytes;
+    return ptr;
+}
+
+// Frees all memory blocks, and everything allocated from them.
+
+void SSObjectArena::reset ( void )
+{
+    for ( char *block : _blocks )
+        ::operator delete ( block );
+
+    vector<char *>().swap ( _blocks );
+    _blockUsed = _reserved = _allocated = 0;
+}
+
 // Default implementation of computing object's apparent motion in a reference frame
 // returns unknown motion. Overridden by sublcasses SSStar and SSPlanet!
 
@@ -180,12 +313,55 @@ SSSpherical SSObject::computeApparentMotion ( SSCoordinates &coords, SSFrame fra
     return SSSpherical ( INFINITY, INFINITY, INFINITY );
 }
 
+// Deletes all objects in this SSObjectArray, its arena, and its spatial index.
+
+SSObjectArray::~SSObjectArray ( void )
+{
+    for ( SSObjectPtr pObj : _objects )
+        delete pObj;
+    
+    delete _pArena;
+    delete _pIndex;
+}
+
+// Removes the object at (index) from this array, and returns an object which the caller owns and must delete:
+// the object itself if it was not allocated from this array's arena, or else a copy of it allocated from the heap,
+// and the original is deleted. Either way, the returned object outlives this array. Returns nullptr, and leaves
+// the array unchanged, if index is invalid or the object can't be copied.
+
+SSObjectPtr SSObjectArray::detach ( size_t index )
+{
+    SSObjectPtr pObj = get ( index );
+    if ( pObj == nullptr )
+        return nullptr;
+    
+    if ( _pArena != nullptr && pObj->getArena() == _pArena )
+    {
+        SSObjectArenaScope scope ( nullptr );
+        SSObjectPtr pCopy = SSCloneObject ( pObj );
+        if ( pCopy == nullptr )
+            return nullptr;
+        
+        remove ( index );
+        delete pObj;
+        return pCopy;
+    }
+    
+    remove ( index );
+    return pObj;
+}
+
+// Replaces the object at (index) in this array with a new object (pNew), and returns the old object,
+// which is not deleted; but if it was allocated from this array's arena, it still dies with the array.
+// Returns nullptr if index is invalid.
+
 SSObjectPtr SSObjectArray::set ( size_t index, SSObjectPtr pNew )
 {
     if ( index >= 0 && index < size() )
     {
         SSObjectPtr pOld = _objects[index];
         _objects[index] = pNew;
+        _indexStale = true;
         return pOld;
     }
 
@@ -236,11 +412,37 @@ int SSObjectArray::search ( bool (*testfunc) ( const SSObjectPtr &pObject ), vec
 
 // Searches SSObjectArray for objects appearing within a circle of (radius) radians,
 // centered on the celestial sphere at unit direction vector (center) in the fundamental frame.
+// Only stars and deep sky objects are found, tested by their fundamental (catalog) positions;
+// other objects have only apparent directions, which depend on the observer, and are skipped.
 // Indexes of found objects are appended to vector (results); returns number of objects found.
 
 int SSObjectArray::search ( SSVector center, SSAngle radius, vector<size_t> &results )
 {
     int nfound = 0;
+    SSKDTree *pIndex = getIndex();
+    
+    if ( pIndex != nullptr )
+    {
+        // Search the index with a slightly larger radius to allow for rounding error,
+        // then apply the same test as the linear search below to each candidate,
+        // and return found indexes in ascending order, as the linear search does.
+        
+        vector<uint32_t> ids;
+        pIndex->search ( center, radius * ( 1.0 + 1.0e-9 ) + 1.0e-15, ids );
+        std::sort ( ids.begin(), ids.end() );
+        
+        for ( uint32_t index : ids )
+        {
+            SSStar *pStar = SSGetStarPtr ( _objects[index] );
+            if ( pStar && center.angularSeparation ( pStar->getFundamentalPosition() ) < radius )
+            {
+                nfound++;
+                results.push_back ( index );
+            }
+        }
+        
+        return nfound;
+    }
     
     for ( size_t index = 0; index < _objects.size(); index++ )
     {
@@ -255,47 +457,199 @@ int SSObjectArray::search ( SSVector center, SSAngle radius, vector<size_t> &res
     return nfound;
 }
 
-// Deletes objects in this SSObjectArray appearing within a circle of (radius) radians,
-// centered on the celestial sphere at unit direction vector (center) in the fundamental frame.
-// Returns number of objects deleted.
+// Returns index of the object in this SSObjectArray nearest to unit direction vector (center)
+// in the fundamental frame, if within (radius) radians of it; otherwise returns -1.
+// Only stars (and deep sky objects) are considered.
 
-int SSObjectArray::erase ( SSVector center, SSAngle radius )
+int SSObjectArray::nearest ( SSVector center, SSAngle radius )
 {
-    int nfound = 0;
+    SSKDTree *pIndex = getIndex();
+    if ( pIndex != nullptr )
+    {
+        int64_t index = pIndex->nearest ( center, radius * ( 1.0 + 1.0e-9 ) + 1.0e-15 );
+        if ( index < 0 )
+            return -1;
+        
+        SSStar *pStar = SSGetStarPtr ( _objects[index] );
+        if ( pStar && center.angularSeparation ( pStar->getFundamentalPosition() ) < radius )
+            return (int) index;
+        
+        return -1;
+    }
+    
+    int nearest = -1;
+    double minSep = radius;
     
     for ( size_t index = 0; index < _objects.size(); index++ )
     {
         SSStar *pStar = SSGetStarPtr ( _objects[index] );
-        if ( pStar && center.angularSeparation ( pStar->getFundamentalPosition() ) < radius )
+        if ( pStar )
+        {
+            double sep = center.angularSeparation ( pStar->getFundamentalPosition() );
+            if ( sep < minSep )
+            {
+                minSep = sep;
+                nearest = (int) index;
+            }
+        }
+    }
+    
+    return nearest;
+}
+
+// Builds a spatial index of this array's star positions (if indexed is true), or deletes it.
+// The index speeds up cone searches, nearest-neighbor searches, and erasures in large arrays,
+// at a cost of 32 bytes per star. It is rebuilt as needed after objects are added or removed.
+
+void SSObjectArray::setIndexed ( bool indexed )
+{
+    if ( indexed && _pIndex == nullptr )
+    {
+        _pIndex = new SSKDTree();
+        _indexStale = true;
+    }
+    else if ( ! indexed && _pIndex != nullptr )
+    {
+        delete _pIndex;
+        _pIndex = nullptr;
+    }
+}
+
+// Returns this array's spatial index, after rebuilding it if objects have changed since it was built,
+// or nullptr if this array is not indexed. The index IDs are indexes of stars in the array.
+// If several threads search at once, the first one rebuilds the index while the others wait for it.
+
+SSKDTree *SSObjectArray::getIndex ( void )
+{
+    if ( _pIndex == nullptr )
+        return nullptr;
+    
+    lock_guard<mutex> lock ( _indexMutex );
+    if ( ! _indexStale )
+        return _pIndex;
+    
+    _pIndex->clear();
+    _pIndex->reserve ( _objects.size() );
+    for ( size_t index = 0; index < _objects.size(); index++ )
+    {
+        SSStar *pStar = SSGetStarPtr ( _objects[index] );
+        if ( pStar )
+            _pIndex->add ( pStar->getFundamentalPosition(), (uint32_t) index );
+    }
+    
+    _pIndex->build();
+    _indexStale = false;
+    return _pIndex;
+}
+
+// Deletes objects at the given (indexes) in this SSObjectArray, and removes them from it
+// in a single pass, preserving the order of the remaining objects. Indexes may be unsorted
+// and contain duplicates. Returns number of objects deleted.
+
+int SSObjectArray::eraseIndexes ( vector<size_t> &indexes )
+{
+    if ( indexes.empty() )
+        return 0;
+    
+    std::sort ( indexes.begin(), indexes.end() );
+    indexes.erase ( unique ( indexes.begin(), indexes.end() ), indexes.end() );
+    
+    size_t next = 0, dest = 0;
+    for ( size_t index = 0; index < _objects.size(); index++ )
+    {
+        if ( next < indexes.size() && indexes[next] == index )
         {
-            nfound++;
-            // cout << _objects[index]->toCSV() << endl;
             delete _objects[index];
-            _objects.erase ( _objects.begin() + index );
+            next++;
+        }
+        else
+        {
+            _objects[dest++] = _objects[index];
         }
     }
     
-    return nfound;
+    _objects.resize ( dest );
+    _indexStale = true;
+    return (int) indexes.size();
+}
+
+// Gives this array its own arena for allocating objects (if useArena is true), or removes it.
+// Objects are only allocated from the arena while it is made current, e.g. with
+// SSObjectArenaScope scope ( array.getArena() ); existing objects are not moved.
+// The arena is only removed if the array is empty.
+
+void SSObjectArray::setArena ( bool useArena )
+{
+    if ( useArena && _pArena == nullptr )
+    {
+        _pArena = new SSObjectArena();
+    }
+    else if ( ! useArena && _pArena != nullptr && _objects.empty() )
+    {
+        delete _pArena;
+        _pArena = nullptr;
+    }
+}
+
+// Returns approximate memory used by this SSObjectArray, including all objects it contains,
+// unused space in its arena, and its spatial index (if any).
+
+size_t SSObjectArray::memoryUsage ( void )
+{
+    size_t bytes = sizeof ( SSObjectArray ) + _objects.capacity() * sizeof ( SSObjectPtr );
+    for ( SSObjectPtr pObj : _objects )
+        if ( pObj != nullptr )
+            bytes += pObj->memoryUsage();
+    
+    if ( _pArena != nullptr )
+        bytes += _pArena->memoryUsage() - _pArena->bytesAllocated();
+    
+    if ( _pIndex != nullptr )
+        bytes += _pIndex->memoryUsage();
+    
+    return bytes;
+}
+
+// Deletes objects in this SSObjectArray appearing within a circle of (radius) radians,
+// centered on the celestial sphere at unit direction vector (center) in the fundamental frame.
+// Returns number of objects deleted.
+
+int SSObjectArray::erase ( SSVector center, SSAngle radius )
+{
+    vector<size_t> indexes;
+    search ( center, radius, indexes );
+    return eraseIndexes ( indexes );
 }
 
 // Deletes objects in this SSObjectArray appearing within a circle of (radius) radians,
 // centered on any star in another SSObjectArray (stars).
+// If this array is not indexed, a temporary spatial index is built for the search.
 // Returns number of objects deleted.
 
 int SSObjectArray::erase ( SSObjectVec &stars, SSAngle radius )
 {
-    int n = 0;
+    bool temporary = _pIndex == nullptr;
+    if ( temporary )
+        setIndexed ( true );
+    
+    vector<size_t> indexes;
     for ( SSObjectPtr pObject : stars._objects )
     {
         SSStarPtr pStar = SSGetStarPtr ( pObject );
         if ( pStar )
-            n += erase ( pStar->getFundamentalPosition(), radius );
+            search ( pStar->getFundamentalPosition(), radius, indexes );
     }
+    
+    int n = eraseIndexes ( indexes );
+    if ( temporary )
+        setIndexed ( false );
+    
     return n;
 }
 
 // Searches SSObjectArray for objects appearing within a circle of (radius) radians,
 // centered on the celestial sphere at unit direction vector (center) in the fundamental frame.
+// As above, only stars and deep sky objects are found.
 // Pointers to found objects are appended to vector (results); returns number of objects found.
 
 int SSObjectArray::search ( SSVector center, SSAngle radius, vector<SSObjectPtr> &results )
@@ -414,14 +768,50 @@ SSObjectPtr SSCloneObject ( SSObject *pObj )
         return nullptr;
 }
 
+// Parallel CSV import and export work in chunks of about this many bytes or objects;
+// each thread parses or formats one chunk at a time.
+
+static const size_t kCSVChunkBytes = 1 << 20;
+static const size_t kCSVChunkObjects = 4096;
+
+// Returns the number of threads to use for CSV import or export: all hardware threads if (numThreads)
+// is zero or negative, otherwise (numThreads); always one if threads are not available.
+
+static int csvThreads ( int numThreads )
+{
+#if USE_THREADS
+    if ( numThreads < 1 )
+        numThreads = max ( 1, (int) thread::hardware_concurrency() );
+#else
+    numThreads = 1;
+#endif
+    return numThreads;
+}
+
+// Formats a chunk of objects (chunk) as CSV text, one line per object, into (text).
+
+static void formatCSVChunk ( const vector<SSObjectPtr> &chunk, string &text )
+{
+    text.clear();
+    for ( SSObjectPtr pObject : chunk )
+    {
+        text += pObject->toCSV();
+        text += '\n';
+    }
+}
+
 // Exports a vector of objects to a CSV-formatted text file.
 // If the filename is an empty string, streams CSV to standard output.
 // If a non-null filter function (filter) is provided, objects are exported
 // only if they pass the filter; optional data pointer (userData) is passed
 // to the filter but not used otherwise.
-// Returns the number of objects exported.
+// Objects are formatted in chunks on (numThreads) threads (zero for all hardware threads; by default,
+// only the calling thread), and written in their original order. The filter is always called on the
+// calling thread. Each call with more than one thread creates its own thread pool, so don't call it
+// with more than one thread from a pool worker thread. Returns the number of objects exported;
+// if the file can't be written completely, returns the number written before the error.
 
-int SSExportObjectsToCSV ( const string &filename, SSObjectVec &objects, SSObjectFilter filter, void *userData )
+int SSExportObjectsToCSV ( const string &filename, SSObjectVec &objects, SSObjectFilter filter, void *userData, int numThreads )
 {
     int i = 0;
     
@@ -437,35 +827,124 @@ int SSExportObjectsToCSV ( const string &filename, SSObjectVec &objects, SSObjec
 
     // Otherwise open file, overwriting existing content; return on failure.
 
-    ofstream file ( filename, ios::trunc );
+    FILE *file = fopen ( filename.c_str(), "w" );
     if ( ! file )
         return 0;
     
-    // Stream objects which pass filter function to CSV file.
+    // Gather objects which pass filter function into a batch of chunks, one or two per thread;
+    // format chunks in parallel, then write them to the file in order. Repeat until done.
     
+    numThreads = csvThreads ( numThreads );
+    size_t batchSize = numThreads > 1 ? numThreads * 2 : 1;
+    vector<vector<SSObjectPtr>> chunks ( batchSize );
+    vector<string> texts ( batchSize );
+    SSThreadPool *pPool = nullptr;
+    size_t next = 0;
     int n = 0;
-    for ( i = 0; i < objects.size(); i++ )
+    
+    while ( next < objects.size() )
     {
-        if ( filter == nullptr || filter ( objects[i], userData ) )
+        size_t numChunks = 0;
+        for ( numChunks = 0; numChunks < batchSize && next < objects.size(); numChunks++ )
         {
-            file << objects[i]->toCSV() << endl;
-            n++;
+            vector<SSObjectPtr> &chunk = chunks[numChunks];
+            chunk.clear();
+            for ( ; next < objects.size() && chunk.size() < kCSVChunkObjects; next++ )
+                if ( filter == nullptr || filter ( objects[next], userData ) )
+                    chunk.push_back ( objects[next] );
+        }
+        
+        if ( numChunks > 1 && pPool == nullptr )
+            pPool = new SSThreadPool ( numThreads - 1 );
+        
+        for ( size_t k = 1; k < numChunks; k++ )
+            pPool->submit ( [&chunks, &texts, k] () { formatCSVChunk ( chunks[k], texts[k] ); } );
+        
+        formatCSVChunk ( chunks[0], texts[0] );
+        if ( pPool != nullptr )
+            pPool->wait();
+        
+        for ( size_t k = 0; k < numChunks; k++ )
+        {
+            if ( fwrite ( texts[k].data(), 1, texts[k].size(), file ) < texts[k].size() )
+            {
+                next = objects.size();
+                break;
+            }
+            
+            n += (int) chunks[k].size();
         }
     }
     
-    // Return exported object count; file will close automatically.
+    // Close file and return exported object count.
     
+    delete pPool;
+    fclose ( file );
     return n;
 }
 
+// Allocates a new object of whichever class matches the type code in the first field of a CSV-formatted
+// string (csv), and initializes it from the remaining fields. The string is tokenized once, in place,
+// into a reusable vector of field pointers (fields); the string's contents are modified.
+// Returns nullptr if the string does not describe a valid object.
+
+SSObjectPtr SSObjectFromCSV ( string &csv, vector<const char *> &fields )
+{
+    split_csv_inplace ( csv, fields );
+
+    SSObjectType type = SSObject::codeToType ( fields[0] );
+    if ( type >= kTypePlanet && type <= kTypeComet )
+        return SSPlanet::fromCSV ( fields );
+    else if ( ( type >= kTypeStar && type <= kTypeGalaxy ) || type == kTypeNonexistent )
+        return SSStar::fromCSV ( fields );
+    else if ( type == kTypeFeature || type == kTypeCity )
+        return SSFeature::fromCSV ( fields );
+    else if ( type >= kTypeConstellation && type <= kTypeAsterism )
+        return SSConstellation::fromCSV ( fields );
+    else
+        return nullptr;
+}
+
+// Parses complete lines of CSV text (text) into new objects, which are appended to (results).
+// Lines end with LF, CRLF, or CR, as in fgetline(); lines which are not valid objects are skipped.
+
+static void parseCSVChunk ( const string &text, vector<SSObjectPtr> &results )
+{
+    string line;
+    vector<const char *> fields;
+    const char *end = text.data() + text.size();
+    
+    for ( const char *p = text.data(); p < end; )
+    {
+        const char *eol = p;
+        while ( eol < end && *eol != '\n' && *eol != '\r' )
+            eol++;
+        
+        line.assign ( p, eol );
+        p = eol + 1;
+        if ( *eol == '\r' && p < end && *p == '\n' )
+            p++;
+        
+        SSObjectPtr pObject = SSObjectFromCSV ( line, fields );
+        if ( pObject != nullptr )
+            results.push_back ( pObject );
+    }
+}
+
 // Imports objects from CSV-formatted text file (filename).
 // Imported objects are appended to the input vector of SSObjects (objects).
 // If a non-null filter function (filter) is provided, objects are imported
 // only if they pass the filter; optional data pointer (userData) is passed
 // to the filter but not used otherwise.
+// The file is read in chunks which end at line breaks, and chunks are parsed on (numThreads) threads
+// (zero for all hardware threads; by default, only the calling thread). Each call with more than one thread
+// creates its own thread pool, so don't call it with more than one thread from a pool worker thread. Objects are appended in their original order, and the filter is
+// always called on the calling thread. If the calling thread has a current SSObjectArena, the file
+// is parsed on the calling thread only, so that all objects are allocated from that arena.
+// As with fgetline(), a final line without a line break is ignored.
 // Function returns number of objects successfully imported.
 
-int SSImportObjectsFromCSV ( const string &filename, SSObjectVec &objects, SSObjectFilter filter, void *userData )
+int SSImportObjectsFromCSV ( const string &filename, SSObjectVec &objects, SSObjectFilter filter, void *userData, int numThreads )
 {
     // Open file; return on failure.
 
@@ -473,34 +952,74 @@ int SSImportObjectsFromCSV ( const string &filename, SSObjectVec &objects, SSObj
     if ( ! file )
         return 0;
 
-    // Read file line-by-line until we reach end-of-file
-
-    string line = "";
+    numThreads = SSObjectArena::getCurrent() ? 1 : csvThreads ( numThreads );
+    size_t batchSize = numThreads > 1 ? numThreads * 2 : 1;
+    vector<string> texts ( batchSize );
+    vector<vector<SSObjectPtr>> results ( batchSize );
+    SSThreadPool *pPool = nullptr;
+    string partial;
+    bool eof = false;
     int numObjects = 0;
 
-    while ( fgetline ( file, line ) )
+    while ( ! eof )
     {
-        // Attempt to create object from CSV file line
+        // Read a batch of chunks, one or two per thread. Each chunk ends after its last line break;
+        // the partial line following it is carried over to the start of the next chunk.
         
-        SSObjectPtr pObject = SSPlanet::fromCSV ( line );
-        if ( pObject == nullptr )
-            pObject = SSStar::fromCSV ( line );
-        if ( pObject == nullptr )
-            pObject = SSFeature::fromCSV ( line );
-        if ( pObject == nullptr )
-            pObject = SSConstellation::fromCSV ( line );
-
-        // if successful, and object passes filter, add it to object vector.
+        size_t numChunks = 0;
+        for ( numChunks = 0; numChunks < batchSize && ! eof; numChunks++ )
+        {
+            string &text = texts[numChunks];
+            text.swap ( partial );
+            partial.clear();
+            
+            size_t length = text.size();
+            text.resize ( length + kCSVChunkBytes );
+            size_t bytes = fread ( &text[length], 1, kCSVChunkBytes, file );
+            text.resize ( length + bytes );
+            eof = bytes < kCSVChunkBytes;
             
-        if ( pObject != nullptr && ( filter == nullptr || filter ( pObject, userData ) ) )
+            size_t cut = text.find_last_of ( "\r\n" );
+            cut = cut == string::npos ? 0 : cut + 1;
+            partial.assign ( text, cut, string::npos );
+            text.resize ( cut );
+        }
+        
+        // Parse the first chunk on this thread and the rest on worker threads, then append the
+        // objects which pass the filter function in order, and delete the others.
+        
+        if ( numChunks > 1 && pPool == nullptr )
+            pPool = new SSThreadPool ( numThreads - 1 );
+        
+        for ( size_t k = 1; k < numChunks; k++ )
+            pPool->submit ( [&texts, &results, k] () { parseCSVChunk ( texts[k], results[k] ); } );
+        
+        parseCSVChunk ( texts[0], results[0] );
+        if ( pPool != nullptr )
+            pPool->wait();
+        
+        for ( size_t k = 0; k < numChunks; k++ )
         {
-            objects.append ( pObject );
-            numObjects++;
+            for ( SSObjectPtr pObject : results[k] )
+            {
+                if ( filter == nullptr || filter ( pObject, userData ) )
+                {
+                    objects.append ( pObject );
+                    numObjects++;
+                }
+                else
+                {
+                    delete pObject;
+                }
+            }
+            
+            results[k].clear();
         }
     }
     
     // Close file. Return number of objects added to object vector.
 
+    delete pPool;
     fclose ( file );
     return numObjects;
 }
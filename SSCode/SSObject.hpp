@@ -19,6 +19,7 @@
 #include <vector>
 #include <memory>
 #include <map>
+#include <mutex>
 
 #include "SSCoordinates.hpp"
 #include "SSIdentifier.hpp"
@@ -27,6 +28,8 @@ using namespace std;
 
 #pragma pack ( push, 1 )
 
+class SSObjectArena;
+
 // This is the base class for all astronomical objects (planets, stars, deep sky objects, constellations, etc.)
 
 class SSObject
@@ -40,6 +43,8 @@ protected:
     double          _distance;      // distance to object in AU; infinite if unknown
     float           _magnitude;     // visual magnitude; infinite if unknown
     
+    size_t heapSize ( void );       // returns heap memory used by names and description (but not subclass data).
+    
 public:
 
     // constructors
@@ -93,35 +98,120 @@ public:
     virtual SSSpherical computeApparentMotion ( SSCoordinates &coords, SSFrame frame = kFundamental );  // computes object's apparent motion in the specified reference frame.
     
     virtual string toCSV ( void );
+    
+    // Approximate memory used by this object, including heap storage for strings and vectors; overridden by subclasses.
+    
+    virtual size_t memoryUsage ( void );
+    static size_t stringHeapSize ( const string &str );
+    
+    // Objects are allocated from the calling thread's current SSObjectArena, if any; otherwise from the heap.
+    // Deleting an arena-allocated object runs its destructor, but its memory is only freed with the arena.
+    // Either way, each object is preceded by an 8-byte header recording which arena, if any, it came from.
+    
+    static void *operator new ( size_t size );
+    static void operator delete ( void *ptr );
+    SSObjectArena *getArena ( void );
+};
+
+// A bump allocator for objects: allocates them consecutively from large blocks, and frees them all at once
+// when reset or destroyed. New objects are allocated from an arena while it is the current arena on the
+// calling thread (see SSObjectArenaScope). An arena is not thread-safe; each thread should fill its own.
+// Objects allocated from an arena must be deleted before the arena is reset or destroyed.
+
+class SSObjectArena
+{
+protected:
+    vector<char *>  _blocks;            // allocated memory blocks; the last one is current
+    size_t          _blockSize = 0;     // default size of memory blocks in bytes
+    size_t          _blockUsed = 0;     // bytes used in current block
+    size_t          _reserved = 0;      // total size of all memory blocks in bytes
+    size_t          _allocated = 0;     // total bytes allocated from all memory blocks
+    
+public:
+    
+    SSObjectArena ( size_t blockSize = 65536 );
+    SSObjectArena ( const SSObjectArena &other ) = delete;
+    SSObjectArena &operator = ( const SSObjectArena &other ) = delete;
+    ~SSObjectArena ( void ) { reset(); }
+    
+    void *allocate ( size_t bytes );
+    void reset ( void );
+    size_t bytesAllocated ( void ) { return _allocated; }
+    size_t memoryUsage ( void ) { return sizeof ( SSObjectArena ) + _blocks.capacity() * sizeof ( char * ) + _reserved; }
+    
+    static SSObjectArena *getCurrent ( void );
+    static SSObjectArena *setCurrent ( SSObjectArena *pArena );
+};
+
+// Makes an arena (which may be nullptr, for the heap) the calling thread's current arena
+// for the lifetime of this scope object, then restores the previous one.
+
+class SSObjectArenaScope
+{
+protected:
+    SSObjectArena *_pPrevious;
+    
+public:
+    SSObjectArenaScope ( SSObjectArena *pArena ) { _pPrevious = SSObjectArena::setCurrent ( pArena ); }
+    ~SSObjectArenaScope ( void ) { SSObjectArena::setCurrent ( _pPrevious ); }
 };
 
 typedef SSObject *SSObjectPtr;
 
 // This class stores a vector of pointers to SSObject, and deletes them when class instance is destroyed.
+// Optionally, the array owns an arena from which objects added while it is current are allocated;
+// then erasing or destroying the array frees all of their memory at once. Objects allocated from
+// an array's arena die with the array: remove(), set(), and clear() detach them from the array, but
+// they can't be used after the array is erased or destroyed. Use detach() to take ownership of an
+// object so it outlives the array.
+// Optionally, the array also keeps a spatial index (k-d tree) of its stars' positions, which speeds up
+// cone searches, nearest-neighbor searches, and erasures. The index is rebuilt on the next search after
+// objects are added or removed; call invalidateIndex() after changing positions of objects in the array.
+// Several threads may search an array at once, but not while another thread modifies it.
+
+class SSKDTree;
 
 class SSObjectArray
 {
 protected:
     vector<SSObjectPtr> _objects;
+    SSObjectArena *_pArena = nullptr;   // owned arena for this array's objects, or nullptr if none
+    SSKDTree *_pIndex = nullptr;        // spatial index of star positions, or nullptr if not indexed
+    bool _indexStale = false;           // true if objects have changed since spatial index was built
+    mutex _indexMutex;                  // serializes rebuilding the spatial index from concurrent searches
+
+    SSKDTree *getIndex ( void );
+    int eraseIndexes ( vector<size_t> &indexes );
 
 public:
-    ~SSObjectArray ( void ) { for ( SSObjectPtr pObj : _objects ) delete pObj; }
+    SSObjectArray ( void ) {}
+    SSObjectArray ( bool useArena ) { setArena ( useArena ); }
+    ~SSObjectArray ( void );
+    void setArena ( bool useArena );
+    SSObjectArena *getArena ( void ) { return _pArena; }
+    void setIndexed ( bool indexed );
+    bool isIndexed ( void ) { return _pIndex != nullptr; }
+    void invalidateIndex ( void ) { _indexStale = true; }
     SSObjectPtr get ( size_t index ) { return index >= 0 && index < size() ? _objects.at ( index ) : nullptr; }
     SSObjectPtr set ( size_t index, SSObjectPtr pObj );
     SSObjectPtr operator [] ( size_t index ) { return get ( index ); }
-    void append ( SSObjectPtr pObj ) { _objects.push_back ( pObj ); }
-    void insert ( SSObjectPtr pObj, size_t index ) { _objects.insert ( _objects.begin() + index, pObj ); }
-    void remove ( size_t index ) { _objects.erase ( _objects.begin() + index ); }   // DOES NOT actually delete object!!!
+    void append ( SSObjectPtr pObj ) { _objects.push_back ( pObj ); _indexStale = true; }
+    void insert ( SSObjectPtr pObj, size_t index ) { _objects.insert ( _objects.begin() + index, pObj ); _indexStale = true; }
+    void remove ( size_t index ) { _objects.erase ( _objects.begin() + index ); _indexStale = true; }   // DOES NOT actually delete object!!! Arena objects still die with the array.
+    SSObjectPtr detach ( size_t index );
     size_t size ( void ) { return _objects.size(); }
-    void clear ( void ) { _objects.clear(); }   // empties object vector but DOES NOT delete individual objects!!!
-    void erase ( void ) { for ( SSObjectPtr pObj : _objects ) delete pObj; clear(); }   // deletes all objects AND clears vector.
-    void sort ( bool (*cmpfunc) ( const SSObjectPtr &p1, const SSObjectPtr &p2 ) ) { std::sort ( _objects.begin(), _objects.end(), cmpfunc ); }
+    void reserve ( size_t n ) { _objects.reserve ( n ); }
+    void clear ( void ) { _objects.clear(); _indexStale = true; }   // empties object vector but DOES NOT delete individual objects!!! Arena objects still die with the array.
+    void erase ( void ) { for ( SSObjectPtr pObj : _objects ) delete pObj; clear(); if ( _pArena ) _pArena->reset(); }   // deletes all objects AND clears vector.
+    void sort ( bool (*cmpfunc) ( const SSObjectPtr &p1, const SSObjectPtr &p2 ) ) { std::sort ( _objects.begin(), _objects.end(), cmpfunc ); _indexStale = true; }
     int search ( const SSObjectPtr &pKey, bool (*cmpfunc) ( const SSObjectPtr &p1, const SSObjectPtr &p2 ), vector<SSObjectPtr> &results );
     int search ( bool (*testfunc) ( const SSObjectPtr &pObject ), vector<SSObjectPtr> &results );
     int search ( SSVector center, SSAngle rad, vector<SSObjectPtr> &results );
     int search ( SSVector center, SSAngle rad, vector<size_t> &results );
+    int nearest ( SSVector center, SSAngle rad );
     int erase ( SSVector center, SSAngle rad );
     int erase ( SSObjectArray &stars, SSAngle rad );
+    size_t memoryUsage ( void );
 };
 
 typedef SSObjectArray SSObjectVec;          // legacy declaration was typedef vector<SSObjectPtr> SSObjectVec; now we use SSObjectArray class
@@ -133,8 +223,9 @@ SSObjectMap SSMakeObjectMap ( SSObjectVec &objects, SSCatalog cat );
 SSObjectPtr SSIdentifierToObject ( SSIdentifier ident, SSObjectMap &map, SSObjectVec &objects );
 
 typedef bool (*SSObjectFilter) ( SSObjectPtr pObject, void *userData );
-int SSImportObjectsFromCSV ( const string &filename, SSObjectVec &objects, SSObjectFilter filter = nullptr, void *userData = nullptr );
-int SSExportObjectsToCSV ( const string &filename, SSObjectVec &objects, SSObjectFilter filter = nullptr, void *userData = nullptr );
+SSObjectPtr SSObjectFromCSV ( string &csv, vector<const char *> &fields );
+int SSImportObjectsFromCSV ( const string &filename, SSObjectVec &objects, SSObjectFilter filter = nullptr, void *userData = nullptr, int numThreads = 1 );
+int SSExportObjectsToCSV ( const string &filename, SSObjectVec &objects, SSObjectFilter filter = nullptr, void *userData = nullptr, int numThreads = 1 );
 
 #pragma pack ( pop )
 
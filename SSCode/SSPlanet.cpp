@@ -706,32 +706,40 @@ string SSPlanet::toCSV ( void )
 
 SSObjectPtr SSPlanet::fromCSV ( string csv )
 {
-    vector<string> fields = split ( csv, "," );
-    
+    vector<const char *> fields;
+    split_csv_inplace ( csv, fields );
+    return fromCSV ( fields );
+}
+
+// Allocates a new SSPlanet and initializes it from a vector of trimmed CSV fields,
+// as from split_csv_inplace(). Returns nullptr on error.
+
+SSObjectPtr SSPlanet::fromCSV ( const vector<const char *> &fields )
+{
     SSObjectType type = SSObject::codeToType ( fields[0] );
     if ( type < kTypePlanet || type > kTypeComet || fields.size() < 17 )
         return nullptr;
     
     SSOrbit orbit;
     
-    orbit.q = fields[1].empty() ? INFINITY : strtofloat64 ( fields[1] );
-    orbit.e = fields[2].empty() ? INFINITY : strtofloat64 ( fields[2] );
-    orbit.i = fields[3].empty() ? INFINITY : strtofloat64 ( fields[3] ) * SSAngle::kRadPerDeg;
-    orbit.w = fields[4].empty() ? INFINITY : strtofloat64 ( fields[4] ) * SSAngle::kRadPerDeg;
-    orbit.n = fields[5].empty() ? INFINITY : strtofloat64 ( fields[5] ) * SSAngle::kRadPerDeg;
-    orbit.m = fields[6].empty() ? INFINITY : strtofloat64 ( fields[6] ) * SSAngle::kRadPerDeg;
-    orbit.mm = fields[7].empty() ? INFINITY : strtofloat64 ( fields[7] ) * SSAngle::kRadPerDeg;
-    orbit.t = fields[8].empty() ? INFINITY : strtofloat64 ( fields[8] );
+    orbit.q = ! *fields[1] ? INFINITY : strtofloat64 ( fields[1] );
+    orbit.e = ! *fields[2] ? INFINITY : strtofloat64 ( fields[2] );
+    orbit.i = ! *fields[3] ? INFINITY : strtofloat64 ( fields[3] ) * SSAngle::kRadPerDeg;
+    orbit.w = ! *fields[4] ? INFINITY : strtofloat64 ( fields[4] ) * SSAngle::kRadPerDeg;
+    orbit.n = ! *fields[5] ? INFINITY : strtofloat64 ( fields[5] ) * SSAngle::kRadPerDeg;
+    orbit.m = ! *fields[6] ? INFINITY : strtofloat64 ( fields[6] ) * SSAngle::kRadPerDeg;
+    orbit.mm = ! *fields[7] ? INFINITY : strtofloat64 ( fields[7] ) * SSAngle::kRadPerDeg;
+    orbit.t = ! *fields[8] ? INFINITY : strtofloat64 ( fields[8] );
 
     if ( orbit.q > 1000.0 )
         orbit.q /= SSCoordinates::kKmPerAU;
     
-    float h = fields[9].empty() ? INFINITY : strtofloat ( fields[9] );
-    float g = fields[10].empty() ? INFINITY : strtofloat ( fields[10] );
-    float r = fields[11].empty() ? INFINITY : strtofloat ( fields[11] );
-    float m = fields[12].empty() ? INFINITY : strtofloat ( fields[12] );
-    float p = fields[13].empty() ? INFINITY : strtofloat ( fields[13] );
-    float a = fields[14].empty() ? INFINITY : strtofloat ( fields[14] );
+    float h = ! *fields[9] ? INFINITY : strtofloat ( fields[9] );
+    float g = ! *fields[10] ? INFINITY : strtofloat ( fields[10] );
+    float r = ! *fields[11] ? INFINITY : strtofloat ( fields[11] );
+    float m = ! *fields[12] ? INFINITY : strtofloat ( fields[12] );
+    float p = ! *fields[13] ? INFINITY : strtofloat ( fields[13] );
+    float a = ! *fields[14] ? INFINITY : strtofloat ( fields[14] );
 
     SSIdentifier ident;
     if ( type == kTypePlanet || type == kTypeMoon )
@@ -741,7 +749,7 @@ SSObjectPtr SSPlanet::fromCSV ( string csv )
 
     vector<string> names;
     for ( int i = 16; i < fields.size(); i++ )
-        names.push_back ( trim ( fields[i] ) );
+        names.push_back ( fields[i] );
     
 	SSObjectPtr pObject = SSNewObject ( type );
     SSPlanetPtr pPlanet = SSGetPlanetPtr ( pObject );
@@ -761,6 +769,14 @@ SSObjectPtr SSPlanet::fromCSV ( string csv )
     return pObject;
 }
 
+// Returns approximate memory used by this solar system object, including heap storage
+// for its names and taxonomic type; its orbit is stored inline. Overrides SSObject::memoryUsage().
+
+size_t SSPlanet::memoryUsage ( void )
+{
+    return sizeof ( SSPlanet ) + heapSize() + stringHeapSize ( _taxonomy );
+}
+
 // Constructs a satellite object from an input Two-Line Element descriptor (tle).
 
 SSSatellite::SSSatellite ( SSTLE &tle ) : SSPlanet ( kTypeSatellite )
@@ -780,6 +796,25 @@ SSSatellite::SSSatellite ( SSTLE &tle ) : SSPlanet ( kTypeSatellite )
     _launchSite = _sourceCountry = "";
 }
 
+// Returns approximate memory used by this satellite, including heap storage for its names,
+// TLE, launch data, and radio frequencies. Overrides SSPlanet::memoryUsage().
+
+size_t SSSatellite::memoryUsage ( void )
+{
+    size_t bytes = sizeof ( SSSatellite ) + heapSize() + stringHeapSize ( _taxonomy );
+    bytes += stringHeapSize ( _tle.name ) + stringHeapSize ( _tle.desig );
+    bytes += stringHeapSize ( _sourceCountry ) + stringHeapSize ( _launchSite );
+    
+    bytes += _freqData.capacity() * sizeof ( FreqData );
+    for ( const FreqData &freq : _freqData )
+    {
+        bytes += stringHeapSize ( freq.name ) + stringHeapSize ( freq.uplink ) + stringHeapSize ( freq.downlink ) + stringHeapSize ( freq.beacon );
+        bytes += stringHeapSize ( freq.mode ) + stringHeapSize ( freq.callsign ) + stringHeapSize ( freq.status );
+    }
+    
+    return bytes;
+}
+
 // Computes satellite visual magnitude.
 // Satellite's distance from observer (dist) is in kilometers.
 // Satellite's phase angle (phase) is in radians.
@@ -246,7 +246,10 @@ public:
     // imports/exports from/to CSV-format text string
     
     static SSObjectPtr fromCSV ( string csv );
+    static SSObjectPtr fromCSV ( const vector<const char *> &fields );
     string toCSV ( void );
+    
+    virtual size_t memoryUsage ( void );
 };
 
 // Subclass of solar system object for artificial Earth satellites.
@@ -296,6 +299,8 @@ public:
     void setSourceCountry ( string source ) { _sourceCountry = source; }
     void setLaunchSite ( string site ) { _launchSite = site; }
     void setLaunchDate ( double jd ) { _launchDate = jd; }
+    
+    virtual size_t memoryUsage ( void );
 };
 
 // convenient aliases for pointers to various subclasses of SSPlanet
@@ -1435,6 +1435,55 @@ string SSDeepSky::toCSV ( void )
         return toCSV1() + toCSVDS() + toCSV2();
 }
 
+// Returns heap memory used by identifiers and spectral type (excluding base and subclass data).
+
+size_t SSStar::heapSizeS ( void )
+{
+    return _idents.capacity() * sizeof ( SSIdentifier ) + stringHeapSize ( _spectrum );
+}
+
+// Returns heap memory used by double-star data (but not SStar base class).
+
+size_t SSDoubleStar::heapSizeD ( void )
+{
+    return stringHeapSize ( _comps ) + ( _pOrbit ? sizeof ( SSOrbit ) : 0 );
+}
+
+// Returns heap memory used by variable-star data (but not SStar base class).
+
+size_t SSVariableStar::heapSizeV ( void )
+{
+    return stringHeapSize ( _varType );
+}
+
+// Returns approximate memory used by star objects and their subclasses,
+// including heap storage. Overrides SSObject::memoryUsage().
+
+size_t SSStar::memoryUsage ( void )
+{
+    return sizeof ( SSStar ) + heapSize() + heapSizeS();
+}
+
+size_t SSDoubleStar::memoryUsage ( void )
+{
+    return sizeof ( SSDoubleStar ) + heapSize() + heapSizeS() + heapSizeD();
+}
+
+size_t SSVariableStar::memoryUsage ( void )
+{
+    return sizeof ( SSVariableStar ) + heapSize() + heapSizeS() + heapSizeV();
+}
+
+size_t SSDoubleVariableStar::memoryUsage ( void )
+{
+    return sizeof ( SSDoubleVariableStar ) + heapSize() + heapSizeS() + heapSizeD() + heapSizeV();
+}
+
+size_t SSDeepSky::memoryUsage ( void )
+{
+    return sizeof ( SSDeepSky ) + heapSize() + heapSizeS();
+}
+
 // Allocates a new SSStar and initializes it from a CSV-formatted string.
 // Returns nullptr on error (invalid CSV string, heap allocation failure, etc.)
 
@@ -1443,10 +1492,16 @@ SSObjectPtr SSStar::fromCSV ( string csv )
     // split string into comma-delimited fields,
     // remove leading & trailing whitespace from each field.
     
-    vector<string> fields = split_csv ( csv );
-    for ( int i = 0; i < fields.size(); i++ )
-        fields[i] = trim ( fields[i] );
-    
+    vector<const char *> fields;
+    split_csv_inplace ( csv, fields );
+    return fromCSV ( fields );
+}
+
+// Allocates a new SSStar and initializes it from a vector of trimmed CSV fields,
+// as from split_csv_inplace(). Returns nullptr on error, as above.
+
+SSObjectPtr SSStar::fromCSV ( const vector<const char *> &fields )
+{
     SSObjectType type = SSObject::codeToType ( fields[0] );
     if ( type < kTypeStar || type > kTypeGalaxy )
         if ( type != kTypeNonexistent )
@@ -1473,15 +1528,15 @@ SSObjectPtr SSStar::fromCSV ( string csv )
     SSHourMinSec ra ( fields[1] );
     SSDegMinSec dec ( fields[2] );
     
-    double pmRA = fields[3].empty() ? INFINITY : SSAngle::kRadPerArcsec * strtofloat64 ( fields[3] ) * 15.0;
-    double pmDec = fields[4].empty() ? INFINITY : SSAngle::kRadPerArcsec * strtofloat64 ( fields[4] );
+    double pmRA = ! *fields[3] ? INFINITY : SSAngle::kRadPerArcsec * strtofloat64 ( fields[3] ) * 15.0;
+    double pmDec = ! *fields[4] ? INFINITY : SSAngle::kRadPerArcsec * strtofloat64 ( fields[4] );
     
-    float vmag = fields[5].empty() ? INFINITY : strtofloat ( fields[5] );
-    float bmag = fields[6].empty() ? INFINITY : strtofloat ( fields[6] );
+    float vmag = ! *fields[5] ? INFINITY : strtofloat ( fields[5] );
+    float bmag = ! *fields[6] ? INFINITY : strtofloat ( fields[6] );
     
-    float dist = fields[7].empty() ? INFINITY : strtofloat ( fields[7] ) * SSCoordinates::kLYPerParsec;
-    float radvel = fields[8].empty() ? INFINITY : strtofloat ( fields[8] ) / SSCoordinates::kLightKmPerSec;
-    string spec = trim ( fields[9] );
+    float dist = ! *fields[7] ? INFINITY : strtofloat ( fields[7] ) * SSCoordinates::kLYPerParsec;
+    float radvel = ! *fields[8] ? INFINITY : strtofloat ( fields[8] ) / SSCoordinates::kLightKmPerSec;
+    string spec = fields[9];
     
     // For remaining fields, attempt to parse an identifier.
     // If we succeed, add it to the identifier vector; otherwise add it to the name vector.
@@ -1491,7 +1546,7 @@ SSObjectPtr SSStar::fromCSV ( string csv )
     
     for ( int i = fid; i < fields.size(); i++ )
     {
-        if ( fields[i].empty() )
+        if ( ! *fields[i] )
             continue;
         
         SSIdentifier ident = SSIdentifier::fromString ( fields[i] );
@@ -1523,10 +1578,10 @@ SSObjectPtr SSStar::fromCSV ( string csv )
     if ( pDoubleStar )
     {
         string comps = fields[10];
-        float dmag = fields[11].empty() ? INFINITY : strtofloat ( fields[11] );
-        float sep = fields[12].empty() ? INFINITY : strtofloat ( fields[12] ) / SSAngle::kArcsecPerRad;
-        float pa = fields[13].empty() ? INFINITY : strtofloat ( fields[13] ) / SSAngle::kDegPerRad;
-        float year = fields[14].empty() ? INFINITY : strtofloat ( fields[14] );
+        float dmag = ! *fields[11] ? INFINITY : strtofloat ( fields[11] );
+        float sep = ! *fields[12] ? INFINITY : strtofloat ( fields[12] ) / SSAngle::kArcsecPerRad;
+        float pa = ! *fields[13] ? INFINITY : strtofloat ( fields[13] ) / SSAngle::kDegPerRad;
+        float year = ! *fields[14] ? INFINITY : strtofloat ( fields[14] );
 
         pDoubleStar->setComponents ( comps );
         pDoubleStar->setMagnitudeDelta( dmag );
@@ -1534,7 +1589,7 @@ SSObjectPtr SSStar::fromCSV ( string csv )
         pDoubleStar->setPositionAngle ( pa );
         pDoubleStar->setPositionAngleYear ( year );
         
-        if ( fields[15].length() && fields[16].length() && fields[17].length() )
+        if ( *fields[15] && *fields[16] && *fields[17] )
         {
             SSOrbit orbit;
             
@@ -1556,10 +1611,10 @@ SSObjectPtr SSStar::fromCSV ( string csv )
         int fv = ( type == kTypeVariableStar ) ? 10 : 22;
             
         string vtype = fields[fv];
-        float vmin = fields[fv+1].empty() ? INFINITY : strtofloat ( fields[fv+1] );
-        float vmax = fields[fv+2].empty() ? INFINITY : strtofloat ( fields[fv+2] );
-        float vper = fields[fv+3].empty() ? INFINITY : strtofloat ( fields[fv+3] );
-        double vep = fields[fv+4].empty() ? INFINITY : strtofloat64 ( fields[fv+4] );
+        float vmin = ! *fields[fv+1] ? INFINITY : strtofloat ( fields[fv+1] );
+        float vmax = ! *fields[fv+2] ? INFINITY : strtofloat ( fields[fv+2] );
+        float vper = ! *fields[fv+3] ? INFINITY : strtofloat ( fields[fv+3] );
+        double vep = ! *fields[fv+4] ? INFINITY : strtofloat64 ( fields[fv+4] );
         
         pVariableStar->setVariableType ( vtype );
         pVariableStar->setMaximumMagnitude ( vmax );
@@ -1570,9 +1625,9 @@ SSObjectPtr SSStar::fromCSV ( string csv )
     
     if ( pDeepSkyObject )
     {
-        float major = fields[10].empty() ? INFINITY : strtofloat ( fields[10] ) / SSAngle::kArcminPerRad;
-        float minor = fields[11].empty() ? INFINITY : strtofloat ( fields[11] ) / SSAngle::kArcminPerRad;
-        float pa = fields[12].empty() ? INFINITY : strtofloat ( fields[12] ) / SSAngle::kDegPerRad;
+        float major = ! *fields[10] ? INFINITY : strtofloat ( fields[10] ) / SSAngle::kArcminPerRad;
+        float minor = ! *fields[11] ? INFINITY : strtofloat ( fields[11] ) / SSAngle::kArcminPerRad;
+        float pa = ! *fields[12] ? INFINITY : strtofloat ( fields[12] ) / SSAngle::kDegPerRad;
         
         pDeepSkyObject->setMajorAxis ( major );
         pDeepSkyObject->setMinorAxis ( minor );
@@ -43,6 +43,7 @@ protected:
     SSStar ( SSObjectType type ); // constructs a star with a specific type code
     string toCSV1 ( void );       // returns CSV string from base data (excluding names and identifiers).
     string toCSV2 ( void );       // returns CSV string from names and identifiers (excluding base data).
+    size_t heapSizeS ( void );    // returns heap memory used by identifiers and spectrum (excluding base and subclass data).
 
 public:
     
@@ -82,7 +83,9 @@ public:
     // imports/exports from/to CSV-format text string
     
     static SSObjectPtr fromCSV ( string csv );
+    static SSObjectPtr fromCSV ( const vector<const char *> &fields );
     virtual string toCSV ( void );
+    virtual size_t memoryUsage ( void );
     
     // magnitude and color conversion utilities
     
@@ -180,6 +183,7 @@ protected:
     SSStar *_pPrimary;          // pointer to this double star's primary star, or nullptr if this is the primary star of the system.
     
     string toCSVD ( void );     // returns CSV string from double-star data (but not SStar base class).
+    size_t heapSizeD ( void );  // returns heap memory used by double-star data (but not SStar base class).
 
 public:
     
@@ -212,6 +216,7 @@ public:
     
     void computeEphemeris ( SSCoordinates &coords );
     virtual string toCSV ( void );
+    virtual size_t memoryUsage ( void );
 };
 
 // This subclass of SSStar stores data for variable stars
@@ -228,6 +233,7 @@ protected:
     double _varEpoch;            // Variability epoch, as Julian Date; infinite if unknown
     
     string toCSVV ( void );      // returns CSV string from variable-star data (but not SStar base class).
+    size_t heapSizeV ( void );   // returns heap memory used by variable-star data (but not SStar base class).
 
 public:
     
@@ -246,6 +252,7 @@ public:
     double getEpoch ( void ) { return _varEpoch; }
     
     virtual string toCSV ( void );
+    virtual size_t memoryUsage ( void );
 };
 
 // This subclass of SSStar inherits from both SSDoubleStar and SSVariableStar,
@@ -258,6 +265,7 @@ public:
     SSDoubleVariableStar ( void );
 
     virtual string toCSV ( void );
+    virtual size_t memoryUsage ( void );
 };
 
 // This subclass of SSStar stores data for star clusters, nebulae, and galaxies.
@@ -287,6 +295,7 @@ public:
     string getGalaxyType ( void ) { return _spectrum; }
 
     virtual string toCSV ( void );
+    virtual size_t memoryUsage ( void );
 };
 
 #pragma pack ( pop )
@@ -0,0 +1,252 @@
+// SSStarField.cpp
+// SSCore
+//
+// Compact structure-of-arrays copy of the numeric data of many stars, with a
+// multithreaded, vectorizable kernel that computes their apparent places.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#include <algorithm>
+
+#include "SSStarField.hpp"
+
+// Constructs an empty star field.
+
+SSStarField::SSStarField ( void )
+{
+
+}
+
+// Destructor waits for any running computation and stops worker threads; does not delete star objects.
+
+SSStarField::~SSStarField ( void )
+{
+    delete _pPool;
+}
+
+// Removes all stars from the field, and frees memory used by its arrays.
+
+void SSStarField::clear ( void )
+{
+    vector<SSObjectPtr>().swap ( _objects );
+
+    vector<double>().swap ( _posX );
+    vector<double>().swap ( _posY );
+    vector<double>().swap ( _posZ );
+    vector<float>().swap ( _velX );
+    vector<float>().swap ( _velY );
+    vector<float>().swap ( _velZ );
+    vector<float>().swap ( _parallax );
+    vector<float>().swap ( _vmag );
+
+    vector<float>().swap ( _dirX );
+    vector<float>().swap ( _dirY );
+    vector<float>().swap ( _dirZ );
+    vector<float>().swap ( _mag );
+}
+
+// Reserves memory for (n) stars, to avoid reallocation while adding stars.
+
+void SSStarField::reserve ( size_t n )
+{
+    _objects.reserve ( n );
+
+    _posX.reserve ( n );
+    _posY.reserve ( n );
+    _posZ.reserve ( n );
+    _velX.reserve ( n );
+    _velY.reserve ( n );
+    _velZ.reserve ( n );
+    _parallax.reserve ( n );
+    _vmag.reserve ( n );
+}
+
+// Returns approximate memory used by this star field, in bytes.
+
+size_t SSStarField::memoryUsage ( void )
+{
+    return sizeof ( SSStarField ) + _objects.capacity() * sizeof ( SSObjectPtr )
+         + ( _posX.capacity() + _posY.capacity() + _posZ.capacity() ) * sizeof ( double )
+         + ( _velX.capacity() + _velY.capacity() + _velZ.capacity() + _parallax.capacity() + _vmag.capacity() ) * sizeof ( float )
+         + ( _dirX.capacity() + _dirY.capacity() + _dirZ.capacity() + _mag.capacity() ) * sizeof ( float );
+}
+
+// Adds a star to the field. Returns true if successful, or false if the object is not a star
+// (or a deep sky object, which SSStar also represents).
+
+bool SSStarField::add ( SSObjectPtr pObject )
+{
+    SSStar *pStar = SSGetStarPtr ( pObject );
+    if ( pStar == nullptr )
+        return false;
+
+    SSVector pos = pStar->getFundamentalPosition();
+    SSVector vel = pStar->getFundamentalVelocity();
+    if ( vel.isinf() || vel.isnan() )
+        vel = SSVector ( 0.0, 0.0, 0.0 );
+
+    float mag = pStar->getVMagnitude();
+    if ( isinf ( mag ) )
+        mag = pStar->getBMagnitude();
+
+    _objects.push_back ( pObject );
+    _posX.push_back ( pos.x );
+    _posY.push_back ( pos.y );
+    _posZ.push_back ( pos.z );
+    _velX.push_back ( vel.x );
+    _velY.push_back ( vel.y );
+    _velZ.push_back ( vel.z );
+    _parallax.push_back ( max ( pStar->getParallax(), 0.0f ) );
+    _vmag.push_back ( mag );
+
+    return true;
+}
+
+// Adds all stars in an object array to the field, and returns the number of stars added.
+
+int SSStarField::add ( SSObjectVec &objects )
+{
+    int n = 0;
+
+    reserve ( size() + objects.size() );
+    for ( size_t i = 0; i < objects.size(); i++ )
+        if ( add ( objects.get ( i ) ) )
+            n++;
+
+    return n;
+}
+
+// Adds all stars in a loaded HTM region to the field, and returns the number of stars added.
+// The region should stay loaded (e.g. pinned) while the field refers to its stars.
+
+int SSStarField::add ( SSHTM &htm, uint64_t htmID )
+{
+    SSObjectVec *pObjects = htm.getObjects ( htmID );
+    return pObjects ? add ( *pObjects ) : 0;
+}
+
+// Sets number of threads used by compute(); zero uses all hardware threads, one computes on the
+// calling thread only. Changing the number of threads stops any existing worker threads.
+
+void SSStarField::setThreads ( int numThreads )
+{
+    if ( numThreads == _numThreads )
+        return;
+
+    delete _pPool;
+    _pPool = nullptr;
+    _numThreads = numThreads;
+}
+
+// Computes apparent directions and magnitudes of all stars in the field, at the time and observer
+// position and velocity in (coords), applying space motion, parallax, and aberration as enabled
+// in (coords). Large fields are split into chunks computed in parallel; the calling thread
+// computes the first chunk, and returns when all chunks are finished.
+
+void SSStarField::compute ( SSCoordinates &coords )
+{
+    size_t n = size();
+    _dirX.resize ( n );
+    _dirY.resize ( n );
+    _dirZ.resize ( n );
+    _mag.resize ( n );
+    if ( n == 0 )
+        return;
+
+    Params params;
+    params.years = coords.getStarMotion() ? ( coords.getJED() - SSTime::kJ2000 ) / SSTime::kDaysPerJulianYear : 0.0;
+
+    SSVector obs = coords.getStarParallax() ? coords.getObserverPosition() / SSCoordinates::kAUPerParsec : SSVector ( 0.0, 0.0, 0.0 );
+    params.obsX = obs.x;
+    params.obsY = obs.y;
+    params.obsZ = obs.z;
+
+    SSVector ab = coords.getAberration() ? coords.getObserverVelocity() / SSCoordinates::kLightAUPerDay : SSVector ( 0.0, 0.0, 0.0 );
+    params.abX = ab.x;
+    params.abY = ab.y;
+    params.abZ = ab.z;
+    params.beta = sqrt ( 1.0 - ab * ab );
+
+    int numThreads = 1;
+#if USE_THREADS
+    numThreads = _numThreads > 0 ? _numThreads : max ( 1, (int) thread::hardware_concurrency() );
+#endif
+
+    size_t chunk = max ( _chunkSize, ( n + numThreads - 1 ) / numThreads );
+    if ( numThreads < 2 || chunk >= n )
+    {
+        _compute ( params, 0, n );
+        return;
+    }
+
+    if ( _pPool == nullptr )
+        _pPool = new SSThreadPool ( numThreads - 1 );
+
+    for ( size_t begin = chunk; begin < n; begin += chunk )
+    {
+        size_t end = min ( begin + chunk, n );
+        _pPool->submit ( [this, &params, begin, end] () { _compute ( params, begin, end ); } );
+    }
+
+    _compute ( params, 0, chunk );
+    _pPool->wait();
+}
+
+// Apparent place kernel for (n) stars, starting at the array pointers passed in. Equivalent to
+// SSStar::computeEphemeris() followed by SSCoordinates::applyAberration(), but written as one
+// branch-free loop over non-overlapping contiguous arrays so the compiler can vectorize it.
+// Disabled corrections have zero coefficients in (params). The magnitude change 5 log10 ( delta )
+// uses a series in ( delta - 1 ), accurate to 0.0001 mag for distance changes up to 15%.
+
+static inline void apparentPlaces ( const SSStarField::Params &params, size_t n,
+                                    const double *__restrict posX, const double *__restrict posY, const double *__restrict posZ,
+                                    const float *__restrict velX, const float *__restrict velY, const float *__restrict velZ,
+                                    const float *__restrict parallax, const float *__restrict vmag,
+                                    float *__restrict dirX, float *__restrict dirY, float *__restrict dirZ, float *__restrict mag )
+{
+    const double years = params.years, obsX = params.obsX, obsY = params.obsY, obsZ = params.obsZ;
+    const double abX = params.abX, abY = params.abY, abZ = params.abZ, beta = params.beta;
+    const double magPerLn = 5.0 / M_LN10;
+
+    for ( size_t i = 0; i < n; i++ )
+    {
+        // Apply space motion and parallax, then normalize; delta is the ratio of current to J2000 distance.
+
+        double x = posX[i] + velX[i] * years - obsX * parallax[i];
+        double y = posY[i] + velY[i] * years - obsY * parallax[i];
+        double z = posZ[i] + velZ[i] * years - obsZ * parallax[i];
+
+        double delta = sqrt ( x * x + y * y + z * z );
+        x /= delta;
+        y /= delta;
+        z /= delta;
+
+        double e = delta - 1.0;
+        mag[i] = vmag[i] + magPerLn * e * ( 1.0 - e * ( 0.5 - e * ( 1.0 / 3.0 - e * 0.25 ) ) );
+
+        // Relativistic aberration, as in SSCoordinates::applyAberration().
+
+        double dot = abX * x + abY * y + abZ * z;
+        double s = 1.0 + dot / ( 1.0 + beta );
+        double d = 1.0 + dot;
+
+        dirX[i] = ( x * beta + abX * s ) / d;
+        dirY[i] = ( y * beta + abY * s ) / d;
+        dirZ[i] = ( z * beta + abZ * s ) / d;
+    }
+}
+
+// Computes apparent places for stars with indexes from (begin) up to but not including (end).
+// Stars are processed in fixed-size blocks, which compilers vectorize even at moderate
+// optimization levels (GCC also needs -fno-math-errno to vectorize sqrt), then any remainder.
+
+void SSStarField::_compute ( const Params &params, size_t begin, size_t end )
+{
+    static const size_t kBlock = 16;
+    size_t i = begin;
+
+    for ( ; i + kBlock <= end; i += kBlock )
+        apparentPlaces ( params, kBlock, &_posX[i], &_posY[i], &_posZ[i], &_velX[i], &_velY[i], &_velZ[i], &_parallax[i], &_vmag[i], &_dirX[i], &_dirY[i], &_dirZ[i], &_mag[i] );
+
+    if ( i < end )
+        apparentPlaces ( params, end - i, &_posX[i], &_posY[i], &_posZ[i], &_velX[i], &_velY[i], &_velZ[i], &_parallax[i], &_vmag[i], &_dirX[i], &_dirY[i], &_dirZ[i], &_mag[i] );
+}
@@ -0,0 +1,89 @@
+// SSStarField.hpp
+// SSCore
+//
+// Compact structure-of-arrays copy of the numeric data of many stars, with a
+// multithreaded, vectorizable kernel that computes their apparent places.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#ifndef SSSTARFIELD_HPP
+#define SSSTARFIELD_HPP
+
+#include "SSStar.hpp"
+#include "SSHTM.hpp"
+#include "SSCoordinates.hpp"
+#include "SSThreadPool.hpp"
+
+// An SSStarField holds the J2000 position, space velocity, parallax, and magnitude of each star
+// in separate contiguous arrays, and computes apparent directions and magnitudes for all of them
+// into further arrays - the same computation as SSStar::computeEphemeris(), without virtual calls
+// or touching each star's names, identifiers, and other strings. Positions are double precision;
+// velocities, parallaxes, magnitudes, and apparent directions are single precision, which is
+// accurate to about 0.01 arcsec. Double stars are treated as single stars (orbits are ignored).
+// The field keeps pointers to the original star objects, which it does not own.
+
+class SSStarField
+{
+protected:
+
+    vector<SSObjectPtr> _objects;                   // original star objects; not owned
+
+    vector<double>      _posX, _posY, _posZ;        // J2000 heliocentric position unit vectors
+    vector<float>       _velX, _velY, _velZ;        // J2000 space velocities in radians per Julian year; zero if unknown
+    vector<float>       _parallax;                  // parallaxes in arcseconds; zero if unknown
+    vector<float>       _vmag;                      // J2000 visual magnitudes (or blue if visual unknown); infinite if unknown
+
+    vector<float>       _dirX, _dirY, _dirZ;        // apparent direction unit vectors from last compute()
+    vector<float>       _mag;                       // apparent magnitudes from last compute()
+
+    int                 _numThreads = 0;            // number of threads for compute(); zero for all hardware threads
+    size_t              _chunkSize = 65536;         // minimum number of stars per thread job
+    SSThreadPool        *_pPool = nullptr;          // worker threads; created on first multithreaded compute()
+
+public:
+
+    // Per-frame constants for the apparent place kernel.
+
+    struct Params
+    {
+        double years;               // Julian years since J2000; zero if not applying space motion
+        double obsX, obsY, obsZ;    // observer heliocentric position in parsecs; zero if not applying parallax
+        double abX, abY, abZ;       // observer velocity as fraction of light speed; zero if not applying aberration
+        double beta;                // sqrt ( 1 - v^2 ) for observer velocity v
+    };
+
+protected:
+
+    void _compute ( const Params &params, size_t begin, size_t end );
+
+public:
+
+    SSStarField ( void );
+    SSStarField ( const SSStarField &other ) = delete;
+    SSStarField &operator = ( const SSStarField &other ) = delete;
+    virtual ~SSStarField ( void );
+
+    void clear ( void );
+    void reserve ( size_t n );
+    size_t size ( void ) { return _objects.size(); }
+    size_t memoryUsage ( void );
+
+    bool add ( SSObjectPtr pObject );
+    int add ( SSObjectVec &objects );
+    int add ( SSHTM &htm, uint64_t htmID );
+
+    void setThreads ( int numThreads );
+    int getThreads ( void ) { return _numThreads; }
+
+    void compute ( SSCoordinates &coords );
+
+    SSObjectPtr getObject ( size_t i ) { return i < _objects.size() ? _objects[i] : nullptr; }
+    SSVector getDirection ( size_t i ) { return SSVector ( _dirX[i], _dirY[i], _dirZ[i] ); }
+    float getMagnitude ( size_t i ) { return _mag[i]; }
+
+    const float *getDirectionsX ( void ) { return _dirX.data(); }
+    const float *getDirectionsY ( void ) { return _dirY.data(); }
+    const float *getDirectionsZ ( void ) { return _dirZ.data(); }
+    const float *getMagnitudes ( void ) { return _mag.data(); }
+};
+
+#endif /* SSSTARFIELD_HPP */
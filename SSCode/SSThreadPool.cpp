@@ -0,0 +1,211 @@
+// SSThreadPool.cpp
+// SSCore
+//
+// A fixed-size pool of worker threads which run jobs from a shared priority queue.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#include <algorithm>
+
+#include "SSThreadPool.hpp"
+
+// Heap comparison: returns true if task t1 should run after task t2.
+
+bool SSThreadPool::compareTasks ( const Task &t1, const Task &t2 )
+{
+    if ( t1.priority != t2.priority )
+        return t1.priority > t2.priority;
+
+    return t1.seq > t2.seq;
+}
+
+// Creates pool with the specified number of worker threads.
+// If numThreads is zero or negative, uses the number of hardware threads.
+
+SSThreadPool::SSThreadPool ( int numThreads )
+{
+#if USE_THREADS
+    if ( numThreads < 1 )
+        numThreads = max ( 1, (int) thread::hardware_concurrency() );
+
+    for ( int i = 0; i < numThreads; i++ )
+        _threads.push_back ( thread ( &SSThreadPool::_worker, this ) );
+#endif
+}
+
+// Destructor discards jobs which have not started, waits for running jobs
+// to finish, then joins all worker threads.
+
+SSThreadPool::~SSThreadPool ( void )
+{
+#if USE_THREADS
+    {
+        lock_guard<mutex> lock ( _mutex );
+        _queue.clear();
+        _stop = true;
+    }
+
+    _workCond.notify_all();
+    for ( thread &t : _threads )
+        if ( t.joinable() )
+            t.join();
+#endif
+}
+
+// Returns number of worker threads in pool.
+
+int SSThreadPool::numThreads ( void )
+{
+#if USE_THREADS
+    return (int) _threads.size();
+#else
+    return 0;
+#endif
+}
+
+// Returns number of queued jobs which have not yet started.
+
+size_t SSThreadPool::pending ( void )
+{
+    lock_guard<mutex> lock ( _mutex );
+    return _queue.size();
+}
+
+// Queues a job to run on the next available worker thread.
+// Jobs with lower priority values are started first.
+// The tag can be used to cancel the job before it starts.
+
+void SSThreadPool::submit ( Job job, double priority, uint64_t tag )
+{
+#if USE_THREADS
+    {
+        lock_guard<mutex> lock ( _mutex );
+        if ( _stop )
+            return;
+
+        _queue.push_back ( { job, priority, tag, _seq++ } );
+        push_heap ( _queue.begin(), _queue.end(), compareTasks );
+    }
+
+    _workCond.notify_one();
+#else
+    job();
+#endif
+}
+
+// Removes all queued jobs with the specified tag that have not yet started.
+// Jobs which are already running are not affected.
+// Returns the number of jobs removed.
+
+int SSThreadPool::cancel ( uint64_t tag )
+{
+    lock_guard<mutex> lock ( _mutex );
+
+    size_t n = _queue.size();
+    _queue.erase ( remove_if ( _queue.begin(), _queue.end(), [tag] ( const Task &t ) { return t.tag == tag; } ), _queue.end() );
+    n -= _queue.size();
+
+    if ( n > 0 )
+        make_heap ( _queue.begin(), _queue.end(), compareTasks );
+
+#if USE_THREADS
+    if ( n > 0 )
+        _idleCond.notify_all();
+#endif
+
+    return (int) n;
+}
+
+// Removes all queued jobs that have not yet started, and returns the number removed.
+
+int SSThreadPool::cancelAll ( void )
+{
+    lock_guard<mutex> lock ( _mutex );
+
+    int n = (int) _queue.size();
+    _queue.clear();
+
+#if USE_THREADS
+    _idleCond.notify_all();
+#endif
+
+    return n;
+}
+
+// Recomputes priorities of all queued jobs from their tags, using the function (func).
+// Useful when the criterion for ordering jobs (e.g. view center) changes after submission.
+
+void SSThreadPool::reprioritize ( PriorityFunc func )
+{
+    lock_guard<mutex> lock ( _mutex );
+
+    for ( Task &t : _queue )
+        t.priority = func ( t.tag );
+
+    make_heap ( _queue.begin(), _queue.end(), compareTasks );
+}
+
+// Blocks until the queue is empty and no jobs are running. If any job threw an exception
+// since the last call, rethrows the first one. Must not be called from one of this pool's jobs.
+
+void SSThreadPool::wait ( void )
+{
+#if USE_THREADS
+    exception_ptr error;
+    
+    {
+        unique_lock<mutex> lock ( _mutex );
+        _idleCond.wait ( lock, [this] { return _queue.empty() && _running == 0; } );
+        swap ( error, _error );
+    }
+    
+    if ( error )
+        rethrow_exception ( error );
+#endif
+}
+
+#if USE_THREADS
+
+// Worker thread loop: takes the highest-priority job from the queue and runs it,
+// until the pool is stopped. An exception thrown by a job is kept for wait() to rethrow,
+// rather than escaping the thread, which would terminate the program.
+
+void SSThreadPool::_worker ( void )
+{
+    while ( true )
+    {
+        Job job;
+
+        {
+            unique_lock<mutex> lock ( _mutex );
+            _workCond.wait ( lock, [this] { return _stop || ! _queue.empty(); } );
+            if ( _stop )
+                break;
+
+            pop_heap ( _queue.begin(), _queue.end(), compareTasks );
+            job = std::move ( _queue.back().job );
+            _queue.pop_back();
+            _running++;
+        }
+
+        exception_ptr error;
+        try
+        {
+            job();
+        }
+        catch ( ... )
+        {
+            error = current_exception();
+        }
+
+        {
+            lock_guard<mutex> lock ( _mutex );
+            if ( error && ! _error )
+                _error = error;
+            _running--;
+        }
+
+        _idleCond.notify_all();
+    }
+}
+
+#endif
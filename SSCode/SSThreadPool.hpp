@@ -0,0 +1,84 @@
+// SSThreadPool.hpp
+// SSCore
+//
+// A fixed-size pool of worker threads which run jobs from a shared priority queue.
+// Copyright © 2020 Southern Stars. All rights reserved.
+
+#ifndef SSTHREADPOOL_HPP
+#define SSTHREADPOOL_HPP
+
+#ifndef USE_THREADS
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define USE_THREADS 0
+#else
+#define USE_THREADS 1
+#endif
+#endif
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+#include <mutex>
+#include <exception>
+
+#if USE_THREADS
+#include <thread>
+#include <condition_variable>
+#endif
+
+using namespace std;
+
+// Jobs with lower priority values run first; jobs with equal priority run in the order submitted.
+// Each job may carry a tag, so that jobs which have not yet started can be cancelled by tag.
+// If a job throws an exception, the worker thread catches it and carries on; the first such exception
+// is rethrown by the next call to wait(). A job must not call wait() on its own pool, since that
+// would wait for itself to finish, forever.
+// If USE_THREADS is 0, the pool has no threads and submit() runs each job immediately.
+
+class SSThreadPool
+{
+public:
+    typedef function<void ( void )> Job;
+    typedef function<double ( uint64_t tag )> PriorityFunc;
+
+protected:
+    struct Task
+    {
+        Job      job;       // function to run
+        double   priority;  // lower values run first
+        uint64_t tag;       // caller-defined tag for cancellation
+        uint64_t seq;       // submission order, to break priority ties
+    };
+
+    static bool compareTasks ( const Task &t1, const Task &t2 );
+
+    vector<Task>                _queue;             // jobs waiting to run, as a heap ordered by compareTasks()
+    uint64_t                    _seq = 0;           // sequence number of next submitted job
+    int                         _running = 0;       // number of jobs currently running
+    bool                        _stop = false;      // true when pool is being destroyed
+    exception_ptr               _error;             // first exception thrown by a job since the last wait()
+    mutex                       _mutex;             // guards all of the above
+
+#if USE_THREADS
+    vector<thread>              _threads;           // worker threads
+    condition_variable          _workCond;          // signalled when a job is queued or pool is stopping
+    condition_variable          _idleCond;          // signalled when a job finishes
+    void _worker ( void );
+#endif
+
+public:
+
+    SSThreadPool ( int numThreads = 0 );
+    virtual ~SSThreadPool ( void );
+
+    int numThreads ( void );
+    size_t pending ( void );
+
+    void submit ( Job job, double priority = 0.0, uint64_t tag = 0 );
+    int cancel ( uint64_t tag );
+    int cancelAll ( void );
+    void reprioritize ( PriorityFunc func );
+    void wait ( void );
+};
+
+#endif /* SSTHREADPOOL_HPP */
@@ -16,6 +16,8 @@
 #else
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <errno.h>
 #include <unistd.h>
@@ -82,12 +84,14 @@ bool islink ( const string &path )
 
 bool fgetline ( FILE *file, string &line )
 {
-    line = "";
-    char c = 0;
+    line.clear();
+    int c = 0;
+
+    // getc() is much faster than reading single bytes with fread(), and clear() keeps the line's capacity.
 
     while ( true )
     {
-        if ( fread ( &c, 1, 1, file ) != 1 )
+        if ( ( c = getc ( file ) ) == EOF )
             return false;
         
         if ( c == '\n' )
@@ -95,12 +99,12 @@ bool fgetline ( FILE *file, string &line )
 
         if ( c == '\r' )
         {
-            if ( fread ( &c, 1, 1, file ) == 1 && c != '\n' )
-                fseek ( file, -1, SEEK_CUR );
+            if ( ( c = getc ( file ) ) != EOF && c != '\n' )
+                ungetc ( c, file );
             return true;
         }
         
-        line += c;
+        line += (char) c;
     }
 }
 
@@ -464,6 +468,86 @@ vector<string> split_csv ( const string &csv )
     return fields;
 }
 
+// Splits a string containing comma-separated values into fields in place, without copying them.
+// Fields are unquoted and parsed exactly as split_csv(), and trimmed of leading and trailing
+// whitespace as by trim(); each is then NUL-terminated within the string's own buffer, and a
+// pointer to it is stored in (fields), which is cleared first and can be reused from line to line.
+// The pointers are valid until the string is modified or destroyed. Returns the number of fields.
+
+static inline bool is_csv_space ( char c )
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+int split_csv_inplace ( string &csv, vector<const char *> &fields )
+{
+    fields.clear();
+
+    char *buf = &csv[0];
+    char *end = buf + csv.length();
+    char *start = buf, *w = buf;
+    CSVState state = kCSVUnquotedField;
+
+    // Trims the field ending at w, NUL-terminates it, and appends it to the field vector.
+
+    auto endField = [&] ( void )
+    {
+        while ( w > start && is_csv_space ( w[-1] ) )
+            w--;
+        *w = '\0';
+        while ( start < w && is_csv_space ( *start ) )
+            start++;
+        fields.push_back ( start );
+    };
+
+    for ( char *r = buf; r < end; r++ )
+    {
+        char c = *r;
+        switch ( state )
+        {
+            case kCSVUnquotedField:
+                if ( c == ',' )
+                {
+                    endField();
+                    start = w = r + 1;
+                }
+                else if ( c == '"' )
+                    state = kCSVQuotedField;
+                else
+                    *w++ = c;
+                break;
+
+            case kCSVQuotedField:
+                if ( c == '"' )
+                    state = kCSVQuotedQuote;
+                else
+                    *w++ = c;
+                break;
+
+            case kCSVQuotedQuote:
+                if ( c == ',' )
+                {
+                    endField();
+                    start = w = r + 1;
+                    state = kCSVUnquotedField;
+                }
+                else if ( c == '"' )
+                {
+                    *w++ = '"';
+                    state = kCSVQuotedField;
+                }
+                else
+                {
+                    state = kCSVUnquotedField;
+                }
+                break;
+        }
+    }
+
+    endField();
+    return (int) fields.size();
+}
+
 // Converts string to 32-bit signed integer.
 // Avoids throwing exceptions, unlike stoi().
 // Returns zero if string cannot be converted.
@@ -500,6 +584,29 @@ double strtofloat64 ( string str )
     return strtod ( str.c_str(), nullptr );
 }
 
+// Overloads of the above conversions for NUL-terminated C strings,
+// e.g. fields from split_csv_inplace(), which avoid copying them into strings.
+
+int strtoint ( const char *str )
+{
+    return atoi ( str );
+}
+
+int64_t strtoint64 ( const char *str )
+{
+    return atoll ( str );
+}
+
+float strtofloat ( const char *str )
+{
+    return strtof ( str, nullptr );
+}
+
+double strtofloat64 ( const char *str )
+{
+    return strtod ( str, nullptr );
+}
+
 // Converts hexadecimal string to binary data.
 // See https://stackoverflow.com/questions/7363774/c-converting-binary-data-to-a-hex-string-and-back
 
@@ -857,6 +964,79 @@ time_t filetime ( const string &path )
         return 0;
 }
 
+// Maps an entire file (path) into memory read-only, and returns a pointer to the
+// first byte of the mapped file. The file's size in bytes is returned in (size).
+// Returns nullptr if the file does not exist, is empty, or cannot be mapped.
+// Pages are loaded on demand by the operating system, and are shared between
+// all processes which map the same file. Call unmapfile() when finished.
+
+#ifdef _MSC_VER
+
+const void *mapfile ( const string &path, size_t &size )
+{
+    void *data = nullptr;
+    size = 0;
+    
+    HANDLE hFile = CreateFileA ( path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if ( hFile == INVALID_HANDLE_VALUE )
+        return nullptr;
+    
+    LARGE_INTEGER fsize = { 0 };
+    if ( GetFileSizeEx ( hFile, &fsize ) && fsize.QuadPart > 0 )
+    {
+        HANDLE hMap = CreateFileMappingA ( hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+        if ( hMap != NULL )
+        {
+            data = MapViewOfFile ( hMap, FILE_MAP_READ, 0, 0, 0 );
+            if ( data != nullptr )
+                size = (size_t) fsize.QuadPart;
+            CloseHandle ( hMap );   // view keeps mapping alive
+        }
+    }
+    
+    CloseHandle ( hFile );
+    return data;
+}
+
+void unmapfile ( const void *data, size_t size )
+{
+    if ( data != nullptr )
+        UnmapViewOfFile ( data );
+}
+
+#else
+
+const void *mapfile ( const string &path, size_t &size )
+{
+    void *data = nullptr;
+    size = 0;
+    
+    int fd = open ( path.c_str(), O_RDONLY );
+    if ( fd < 0 )
+        return nullptr;
+    
+    struct stat st;
+    if ( fstat ( fd, &st ) == 0 && st.st_size > 0 )
+    {
+        data = mmap ( nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+        if ( data == MAP_FAILED )
+            data = nullptr;
+        else
+            size = st.st_size;
+    }
+    
+    close ( fd );   // mapping remains valid after file descriptor is closed
+    return data;
+}
+
+void unmapfile ( const void *data, size_t size )
+{
+    if ( data != nullptr )
+        munmap ( (void *) data, size );
+}
+
+#endif
+
 // Returns a string which is the URL-encoded form of the source string (src).
 // See https://stackoverflow.com/questions/154536/encode-decode-urls-in-c
 
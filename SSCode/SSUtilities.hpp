@@ -62,6 +62,7 @@ string format ( const char *fmt, ... );
 vector<string> split ( string str, string delim );
 vector<string> tokenize ( string str, string delim );
 vector<string> split_csv ( const string &csv );
+int split_csv_inplace ( string &csv, vector<const char *> &fields );
 
 int compare ( const string &str1, const string &str2, size_t n, bool casesens = true );
 
@@ -85,6 +86,10 @@ int strtoint ( string str );
 int64_t strtoint64 ( string str );
 float strtofloat ( string str );
 double strtofloat64 ( string str );
+int strtoint ( const char *str );
+int64_t strtoint64 ( const char *str );
+float strtofloat ( const char *str );
+double strtofloat64 ( const char *str );
 
 void hexstring_to_binary ( const std::string &source, uint8_t *destination, size_t length );
 void binary_to_hexstring ( const uint8_t *source, size_t length, std::string& destination );
@@ -132,6 +137,9 @@ void set_timezonename ( string zonename );
 size_t filesize ( const string &path );
 time_t filetime ( const string &path );
 
+const void *mapfile ( const string &path, size_t &size );
+void unmapfile ( const void *data, size_t size );
+
 string urlEncode ( const string &src );
 string urlDecode ( const string &src );
 
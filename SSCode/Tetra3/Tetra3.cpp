@@ -8,9 +8,15 @@
 #include <chrono>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <numeric>
 #include <sys/stat.h>
 
 #include "Tetra3.hpp"
+#include "SSCrossMatch.hpp"
+#include "SSUtilities.hpp"
 #include "svdcmp.h"
 #include "cnpy.h"
 
@@ -76,31 +82,34 @@ SSVector mean ( const std::vector<SSVector> &vectors )
 }
 
 
-void indexDistanceFromCenter ( const std::vector<SSVector> &vectors, std::vector<size_t> &indices )
+// Sorts indices (indices) of a pattern's four star vectors (vectors) in order of increasing distance from
+// their centroid. Uses fixed-size arrays, so it does not allocate memory.
+
+void indexDistanceFromCenter ( const SSVector vectors[4], size_t indices[4] )
 {
     // find the centroid, or average position, of the star vectors
-    SSVector centroid = mean ( vectors );
+    SSVector centroid;
+    for ( int i = 0; i < 4; i++ )
+        centroid = centroid.add ( vectors[i] );
+    centroid = centroid / 4.0;
 
-    std::vector<double> radii;
-    for ( SSVector vector : vectors )
-        radii.push_back ( vector.distance ( centroid ) );
+    double radii[4];
+    for ( int i = 0; i < 4; i++ )
+        radii[i] = SSVector ( vectors[i] ).distance ( centroid );
 
     // use the radii to uniquely order the pattern's star vectors so they can be
     // matched with the catalog vectors
 
-    indices = std::vector<size_t> ( vectors.size() );
-    std::iota ( indices.begin(), indices.end(), 0 );
-    std::sort ( indices.begin(), indices.end(),
+    std::iota ( indices, indices + 4, 0 );
+    std::sort ( indices, indices + 4,
               [&radii](size_t i, size_t j) { return radii[i] < radii[j]; } );
 }
 
-void sortByDistanceFromCenter ( const std::vector<SSVector> &vectors, std::vector<SSVector> &sorted_vectors )
+void sortByDistanceFromCenter ( const SSVector vectors[4], SSVector sorted_vectors[4] )
 {
-    std::vector<size_t> indices;
+    size_t indices[4];
     indexDistanceFromCenter ( vectors, indices );
-    
-    sorted_vectors = std::vector<SSVector> ( vectors.size() );
-    for (size_t i = 0; i < vectors.size(); ++i)
+    for ( int i = 0; i < 4; i++ )
         sorted_vectors[i] = vectors[indices[i]];
 }
 
@@ -108,33 +117,26 @@ void sortByDistanceFromCenter ( const std::vector<SSVector> &vectors, std::vecto
 
 void sortByDistanceFromCenter ( T3Pattern &p, const T3PatternVectors &pv )
 {
-    std::vector<size_t> indices;
+    size_t indices[4];
     indexDistanceFromCenter ( pv.vectors, indices );
-    std::vector<uint32_t> stars = std::vector<uint32_t> ( &p.stars[0], &p.stars[4] );
-    for ( size_t i = 0; i < stars.size(); ++i )
+    uint32_t stars[4] = { p.stars[0], p.stars[1], p.stars[2], p.stars[3] };
+    for ( int i = 0; i < 4; i++ )
         p.stars[i] = stars[indices[i]];
 }
 
-std::vector<T3HashCode> generate_hash_codes ( const std::vector<std::vector<int>> &hash_space )
-{
-    std::vector<T3HashCode> hash_codes;
+// Advances a five-element hash code (code) to the next combination of bins in the ranges from (low) up to
+// but not including (high), with the last element changing fastest. Returns true when all combinations are done.
 
-    for ( int i0 = 0; i0 < hash_space[0].size() - 1; i0++ )
-        for ( int i1 = 0; i1 < hash_space[1].size() - 1; i1++ )
-            for ( int i2 = 0; i2 < hash_space[2].size() - 1; i2++ )
-                for ( int i3 = 0; i3 < hash_space[3].size() - 1; i3++ )
-                    for ( int i4 = 0; i4 < hash_space[4].size() - 1; i4++ )
-                    {
-                        T3HashCode code;
-                        code.push_back ( hash_space[0][i0] );
-                        code.push_back ( hash_space[1][i1] );
-                        code.push_back ( hash_space[2][i2] );
-                        code.push_back ( hash_space[3][i3] );
-                        code.push_back ( hash_space[4][i4] );
-                        hash_codes.push_back ( code );
-                    }
+static bool nextHashCode ( int code[5], const int low[5], const int high[5] )
+{
+    for ( int i = 4; i >= 0; i-- )
+    {
+        if ( ++code[i] < high[i] )
+            return false;
+        code[i] = low[i];
+    }
     
-    return hash_codes;
+    return true;
 }
 
 // Projects source (x,y) as 3D unit vector (X,Y,Z) on unit sphere
@@ -189,10 +191,13 @@ bool T3Results::raDectoImageXY ( double ra, double dec, float width, float heigh
     return true;
 }
 
-void T3Database::addPattern ( const T3Pattern &pat )
+// Saves a pattern's largest edge angle in the pattern, sorts its star indices by distance
+// from the pattern centroid, and returns its index in the pattern hash table.
+// Does not modify the database, so it can be called in parallel, by multiple threads.
+
+uint32_t T3Database::hashPattern ( T3Pattern &p )
 {
     // retrieve the vectors of the stars in the pattern
-    T3Pattern p = pat;
     T3PatternVectors pv = getStarPatternVectors ( p );
     pv.computeEdgeRatios();
     p.largest_edge = pv.largestEdge();
@@ -200,46 +205,58 @@ void T3Database::addPattern ( const T3Pattern &pat )
     
     // convert edge ratio float to hash code by binning
     
-    std::vector<int> hash_code;
-    for (size_t i = 0; i < pv.edge_ratios.size(); ++i) {
-        int bin = pv.edge_ratios[i] * pattern_bins;
-        hash_code.push_back ( bin );
-    }
+    int hash_code[5];
+    for (size_t i = 0; i < 5; ++i)
+        hash_code[i] = pv.edge_ratios[i] * pattern_bins;
     
-    uint32_t hash_index = keyToIndex( hash_code, pattern_bins );
-    insertAtIndex ( p, hash_index );
+    return keyToIndex ( hash_code, 5, pattern_bins );
 }
 
-size_t T3Database::numPatterns ( void )
+void T3Database::addPattern ( const T3Pattern &pat )
 {
-    if ( fp == NULL )
-        return patterns.size();
-    else
-        return npatterns;
+    T3Pattern p = pat;
+    uint32_t hash_index = hashPattern ( p );
+    insertAtIndex ( p, hash_index );
 }
 
-T3Pattern T3Database::getPattern ( size_t i )
+// Returns pattern at index (i) in the pattern hash table, or an empty pattern if there is none.
+// Reads only from memory (RAM or memory-mapped file), so can be called by multiple threads at once.
+
+T3Pattern T3Database::getPattern ( size_t i ) const
 {
-    i = patindex[i];
+    i = patIndex()[i];
     if ( i == 0 )
         return T3Pattern();
-    i--;
     
-    if ( fp == NULL )
-        return patterns[i];
+    return map ? map_patterns[ i - 1 ] : patterns[ i - 1 ];
+}
+
+// Releases memory-mapped pattern file, if any. If (copy) is true, its pattern index
+// and patterns are copied into RAM first; otherwise, the database has no patterns afterwards.
+
+void T3Database::unmapPatterns ( bool copy )
+{
+    if ( ! map )
+        return;
     
-    T3Pattern pattern;
-    if ( fseek ( fp, pattern_offset + sizeof ( T3Pattern ) * i, SEEK_SET ) == 0
-      && fread ( &pattern, sizeof ( pattern ), 1, fp ) == 1 )
-        return pattern;
-    else
-        return T3Pattern();
+    if ( copy )
+    {
+        patindex.assign ( map_patindex, map_patindex + npatindex );
+        patterns.assign ( map_patterns, map_patterns + npatterns );
+    }
+    
+    map.reset();
+    map_patindex = nullptr;
+    map_patterns = nullptr;
+    npatindex = 0;
 }
 
 // Inserts to pattern table with quadratic probing.
+// If patterns are memory-mapped, they are copied into RAM first.
 
 void T3Database::insertAtIndex ( const T3Pattern &p, uint32_t index )
 {
+    unmapPatterns ( true );
     size_t max_ind = patindex.size();
     for (unsigned int c = 0;; ++c) {
         unsigned int i = (index + c*c) % max_ind;
@@ -254,15 +271,25 @@ void T3Database::insertAtIndex ( const T3Pattern &p, uint32_t index )
 
 // Gets from pattern table with quadratic probing, returns list of all matches.
 
-std::vector<T3Pattern> T3Database::getAtIndex ( uint32_t index )
+std::vector<T3Pattern> T3Database::getAtIndex ( uint32_t index ) const
 {
-    size_t max_ind = patindex.size();
     std::vector<T3Pattern> found;
+    getAtIndex ( index, found );
+    return found;
+}
+
+// As above, but replaces the contents of an existing vector (found) with the matches, and returns their number.
+// The vector's memory is reused, so repeated calls with the same vector do not allocate once it is large enough.
+
+size_t T3Database::getAtIndex ( uint32_t index, std::vector<T3Pattern> &found ) const
+{
+    size_t max_ind = patIndexSize();
+    found.clear();
     for (unsigned int c = 0;; ++c) {
         unsigned int i = (index + c*c) % max_ind;
         T3Pattern pattern = getPattern ( i );
         if ( pattern.empty() ) {
-            return found;
+            return found.size();
         }
         else {
             found.push_back ( pattern );
@@ -270,7 +297,7 @@ std::vector<T3Pattern> T3Database::getAtIndex ( uint32_t index )
     }
 }
 
-T3PatternVectors T3Database::getStarPatternVectors ( const T3Pattern &p )
+T3PatternVectors T3Database::getStarPatternVectors ( const T3Pattern &p ) const
 {
     T3PatternVectors pv;
     for ( int i = 0; i < 4; i++ )
@@ -318,6 +345,8 @@ bool T3Database::loadFromNumPy ( const std::string &path )
 
     // Allocate vectors to store the pattern catalog and star table
     
+    unmapPatterns ( false );
+    patterns.clear();
     patindex = std::vector<uint32_t> ( pattern_catalog.shape[0] );
     stars = std::vector<T3Star> ( star_table.shape[0] );
     
@@ -414,6 +443,7 @@ bool T3Database::loadFromNumPy ( const std::string &path )
     range_dec[1] = props.read_float32_field ( data );
     
     optimize();
+    indexStars();
     loaded = true;
     return true;
 }
@@ -439,17 +469,83 @@ void T3Database::optimize ( void )
     }
 }
 
+// Builds spatial index of stars, used to find stars near a position quickly.
+// Stars are added to the index as unit vectors, with their indices in the star table as IDs.
+
+void T3Database::indexStars ( void )
+{
+    star_tree.clear();
+    star_tree.reserve ( stars.size() );
+    for ( size_t i = 0; i < stars.size(); i++ )
+    {
+        SSVector v ( stars[i].xyz[0], stars[i].xyz[1], stars[i].xyz[2] );
+        star_tree.add ( v.normalize(), (uint32_t) i );
+    }
+    star_tree.build();
+}
+
+// Gets indices of stars whose vectors have a dot product greater than cos ( radius ) with a unit vector,
+// i.e. within radius radians of it, in increasing order of index. Since the star table is sorted by brightness,
+// these are the brightest nearby stars. At most max_stars indices are returned; returns number of indices.
+// Uses the spatial index if it is up to date, so the time taken depends on the number of stars near the
+// vector, not the number in the database; otherwise scans all stars. The indices vector's memory is reused,
+// so repeated calls with the same vector do not allocate once it is large enough.
+
+size_t T3Database::getNearbyStars ( const SSVector &vector, double radius, size_t max_stars, std::vector<uint32_t> &indices ) const
+{
+    double cosrad = cos ( radius );
+    indices.clear();
+    
+    auto isNearby = [&] ( uint32_t i ) -> bool
+    {
+        const T3Star &star = stars[i];
+        return SSVector ( star.xyz[0], star.xyz[1], star.xyz[2] ).dotProduct ( vector ) > cosrad;
+    };
+    
+    if ( star_tree.size() != stars.size() )
+    {
+        for ( uint32_t i = 0; i < stars.size() && indices.size() < max_stars; i++ )
+            if ( isNearby ( i ) )
+                indices.push_back ( i );
+        return indices.size();
+    }
+    
+    // Star vectors are single-precision, so not exactly unit length. Search the index with a slightly
+    // larger radius to allow for that, then apply the same test as above to the stars found, in index order.
+    
+    // The candidates are collected in the indices vector itself, then compacted in place.
+    
+    star_tree.search ( vector, acos ( std::max ( -1.0, cosrad - 1.0e-6 ) ) + 1.0e-9, indices );
+    std::sort ( indices.begin(), indices.end() );
+    
+    size_t n = 0;
+    for ( size_t k = 0; k < indices.size() && n < max_stars; k++ )
+        if ( isNearby ( indices[k] ) )
+            indices[n++] = indices[k];
+    
+    indices.resize ( n );
+    return n;
+}
+
 // Reads optimized version of Tetra3 database from binary data file.
+// If (loadPatterns) is true, the pattern index and patterns are read into RAM. Otherwise they are
+// memory-mapped read-only with mapfile(), so they are paged in as they are probed, and several
+// processes solving with the same file share one copy of it.
 
 static const char *tetra3_db_tag = "Tetra3DB";  // no more than 8 characters!
 
 bool T3Database::loadOptimized ( const std::string &filename, bool loadPatterns )
 {
-    // Open file; return error code on failure.
+    // Release any patterns already loaded; open file; return error code on failure.
+    
+    unmapPatterns ( false );
+    patterns.clear();
+    patindex.clear();
+    loaded = false;
     
-    uint32_t npatindex = 0;
+    size_t pattern_offset = 0, file_size = 0;
     bool success = false;
-    fp = fopen ( filename.c_str(), "rb" );
+    FILE *fp = fopen ( filename.c_str(), "rb" );
     if ( fp == NULL )
         return false;
     
@@ -500,42 +596,52 @@ bool T3Database::loadOptimized ( const std::string &filename, bool loadPatterns
     if ( fread ( &stars[0], sizeof ( stars[0] ), nstars, fp ) != nstars )
         goto end;
     
-    // Allocate storage for pattern index, read index
+    if ( ! loadPatterns )
+    {
+        // Map the file, make sure it holds the whole pattern index and pattern table,
+        // and point to the pattern index and patterns in the mapped file. The map is released
+        // when the last copy of this database is destroyed.
+        
+        pattern_offset = ftell ( fp );
+        const void *pMap = mapfile ( filename, file_size );
+        if ( pMap == nullptr )
+            goto end;
+        
+        if ( file_size != pattern_offset + npatindex * sizeof ( uint32_t ) + (size_t) npatterns * sizeof ( T3Pattern ) )
+        {
+            unmapfile ( pMap, file_size );
+            goto end;
+        }
+        
+        map = std::shared_ptr<void> ( (void *) pMap, [file_size] ( void *p ) { unmapfile ( p, file_size ); } );
+        map_patindex = (const uint32_t *) ( (const char *) pMap + pattern_offset );
+        map_patterns = (const T3Pattern *) ( map_patindex + npatindex );
+        
+        indexStars();
+        success = true;
+        goto end;
+    }
+    
+    // Allocate storage for pattern index and patterns; read them into RAM.
     
     patindex = std::vector<uint32_t> ( npatindex );
     if ( fread ( &patindex[0], sizeof ( patindex[0] ), npatindex, fp ) != npatindex )
         goto end;
     
-    // if loading patterns into RAM, allocate storage, read patterns, close file.
-
-    if ( loadPatterns )
-    {
-        patterns = std::vector<T3Pattern> ( npatterns );
-        size_t n = fread ( &patterns[0], sizeof ( patterns[0] ), npatterns, fp );
-        if ( n != npatterns )
-            goto end;
-        
-        fclose ( fp );
-        fp = NULL;
-    }
-    else
-    {
-        // save offset to first pattern, but don't read patterns into RAM.
-        // leave file open so we can read patterns later; destructor will close it.
-
-        pattern_offset = ftell ( fp );
-    }
+    patterns = std::vector<T3Pattern> ( npatterns );
+    if ( fread ( &patterns[0], sizeof ( patterns[0] ), npatterns, fp ) != npatterns )
+        goto end;
     
+    indexStars();
     success = true;
     
 end:
     
-    // close file if we failed to read it properly.
-    
+    fclose ( fp );
     if ( ! success )
     {
-        fclose ( fp );
-        fp = NULL;
+        patterns.clear();
+        patindex.clear();
     }
     
     loaded = success;
@@ -563,8 +669,8 @@ bool T3Database::saveOptimized ( const std::string &filename )
     // Write metadata
     
     nstars = stars.size();
-    npatterns = patterns.size();
-    uint32_t npatindex = patindex.size();
+    npatterns = numPatterns();
+    npatindex = patIndexSize();
 
     if ( fwrite ( &nstars, sizeof ( nstars ), 1, fp ) != 1 )
         goto end;
@@ -604,10 +710,10 @@ bool T3Database::saveOptimized ( const std::string &filename )
     if ( fwrite ( &stars[0], sizeof ( stars[0] ), stars.size(), fp ) != stars.size() )
         goto end;
 
-    if ( fwrite ( &patindex[0], sizeof ( patindex[0] ), patindex.size(), fp ) != patindex.size() )
+    if ( fwrite ( patIndex(), sizeof ( uint32_t ), npatindex, fp ) != npatindex )
         goto end;
     
-    if ( fwrite ( &patterns[0], sizeof ( patterns[0] ), patterns.size(), fp ) != patterns.size() )
+    if ( fwrite ( map ? map_patterns : patterns.data(), sizeof ( T3Pattern ), npatterns, fp ) != npatterns )
         goto end;
 
     success = true;
@@ -618,17 +724,354 @@ end:
     return success;
 }
 
-// Get hash index for a given key.
+// tetra3.py passes angular separations (in radians) to scipy's KDTree.query_ball_point() as
+// straight-line distances between unit vectors. Converts such a distance (chord) to the angle
+// it subtends, so SSKDTree cone searches find the same stars.
+
+static double chordToAngle ( double chord )
+{
+    return chord >= 2.0 ? M_PI : 2.0 * asin ( chord / 2.0 );
+}
+
+// Keeps stars in a table sorted by brightness (vectors), so that no two kept stars are within
+// an angle (separation) of each other. Visits stars brightest first, and keeps each star
+// which has no kept star within that angle; stars already kept in (keep) stay kept.
+// The tree must contain all star vectors, with their indices in the table as IDs.
+
+static void trimStars ( const std::vector<SSVector> &vectors, const SSKDTree &tree, double separation, std::vector<bool> &keep )
+{
+    std::vector<uint32_t> neighbours;
+    for ( size_t star_ind = 0; star_ind < vectors.size(); star_ind++ )
+    {
+        if ( keep[star_ind] )
+            continue;
+        
+        neighbours.clear();
+        tree.search ( vectors[star_ind], separation, neighbours );
+        
+        bool occupied = false;
+        for ( uint32_t i : neighbours )
+            if ( keep[i] )
+                occupied = true;
+        
+        if ( ! occupied )
+            keep[star_ind] = true;
+    }
+}
+
+// Generates all patterns of four stars which fit within a field of view (pattern_fov) in radians,
+// from a table of pattern stars sorted by brightness (vectors), whose spatial index is (tree).
+// Each pattern is made from a first star, and three fainter neighbours within pattern_fov of it
+// (or pattern_fov/2 if simplify is true) which are also within pattern_fov of each other (unless simplify).
+// Only first stars whose indices are start, start + step, start + 2 * step, etc. are processed,
+// so this can be called in parallel, by multiple threads. Patterns are appended to (patterns),
+// with star indices in increasing order, converted from pattern star table indices to main
+// star table indices by (pattern_index).
+
+static void generatePatterns ( const std::vector<SSVector> &vectors, const SSKDTree &tree, const std::vector<uint32_t> &pattern_index, double pattern_fov, bool simplify, size_t start, size_t step, std::vector<T3Pattern> &patterns )
+{
+    double radius = chordToAngle ( simplify ? pattern_fov / 2.0 : pattern_fov );
+    double cos_fov = cos ( pattern_fov );
+    std::vector<uint32_t> neighbours;
+    std::vector<bool> within;
+    
+    for ( size_t first = start; first < vectors.size(); first += step )
+    {
+        // Find all neighbours within FOV which have not been used as the first star of a pattern yet.
+        
+        neighbours.clear();
+        tree.search ( vectors[first], radius, neighbours );
+        neighbours.erase ( std::remove_if ( neighbours.begin(), neighbours.end(), [first] ( uint32_t i ) { return i <= first; } ), neighbours.end() );
+        std::sort ( neighbours.begin(), neighbours.end() );
+        
+        // Compute which pairs of neighbours are within the FOV of each other, and the first star.
+        
+        size_t n = neighbours.size();
+        if ( n < 3 )
+            continue;
+        
+        within.assign ( n * ( n + 1 ), simplify );
+        if ( ! simplify )
+        {
+            for ( size_t i = 0; i < n; i++ )
+            {
+                SSVector v = vectors[ neighbours[i] ];
+                within[ n * n + i ] = v.dotProduct ( vectors[first] ) > cos_fov;
+                for ( size_t j = i + 1; j < n; j++ )
+                    within[ i * n + j ] = v.dotProduct ( vectors[ neighbours[j] ] ) > cos_fov;
+            }
+        }
+        
+        // Check all possible combinations of three neighbours.
+        
+        for ( size_t i = 0; i < n; i++ )
+        {
+            if ( ! within[ n * n + i ] )
+                continue;
+            
+            for ( size_t j = i + 1; j < n; j++ )
+            {
+                if ( ! within[ n * n + j ] || ! within[ i * n + j ] )
+                    continue;
+                
+                for ( size_t k = j + 1; k < n; k++ )
+                    if ( within[ n * n + k ] && within[ i * n + k ] && within[ j * n + k ] )
+                        patterns.push_back ( T3Pattern ( pattern_index[first], pattern_index[ neighbours[i] ], pattern_index[ neighbours[j] ], pattern_index[ neighbours[k] ] ) );
+            }
+        }
+    }
+}
+
+// Generates a database of patterns and stars from a star catalog, replacing any database already loaded,
+// using the same algorithm as tetra3.py generate_database(). The catalog is given as unit vectors to stars
+// (vectors) and their magnitudes (mags); stars fainter than options.star_max_magnitude, or whose vectors
+// or magnitudes are infinite, are ignored. Pattern generation runs on options.num_threads threads.
+// Returns true if successful or false on failure. Save the database with saveOptimized().
+
+bool T3Database::generate ( const std::vector<SSVector> &vectors, const std::vector<float> &mags, const T3GenerateOptions &options )
+{
+    // Release any database already loaded.
+    
+    unmapPatterns ( false );
+    loaded = false;
+    stars.clear();
+    patterns.clear();
+    patindex.clear();
+    star_tree.clear();
+    
+    if ( options.max_fov <= 0.0 || options.pattern_max_error <= 0.0 || options.pattern_stars_per_fov < 1 || options.verification_stars_per_fov < 1 )
+        return false;
+    
+    double max_fov_rad = degtorad ( options.max_fov );
+    double min_fov_rad = options.min_fov > 0.0 ? degtorad ( options.min_fov ) : max_fov_rad;
+
+    // Sort stars by brightness. Store their vectors in single precision, like the database,
+    // so patterns are generated from the same star positions the solver will use.
+    
+    std::vector<uint32_t> order;
+    for ( uint32_t i = 0; i < vectors.size() && i < mags.size(); i++ )
+        if ( mags[i] <= options.star_max_magnitude && isfinite ( vectors[i].x ) && isfinite ( vectors[i].y ) && isfinite ( vectors[i].z ) )
+            order.push_back ( i );
+    
+    std::stable_sort ( order.begin(), order.end(), [&mags] ( uint32_t i, uint32_t j ) { return mags[i] < mags[j]; } );
+    
+    size_t num_entries = order.size();
+    if ( num_entries < 4 )
+        return false;
+    
+    std::vector<T3Star> star_table ( num_entries );
+    std::vector<SSVector> all_star_vectors ( num_entries );
+    SSKDTree vector_kd_tree;
+    vector_kd_tree.reserve ( num_entries );
+    for ( size_t i = 0; i < num_entries; i++ )
+    {
+        star_table[i] = T3Star ( SSVector ( vectors[ order[i] ] ).normalize() );
+        all_star_vectors[i] = SSVector ( star_table[i].xyz[0], star_table[i].xyz[1], star_table[i].xyz[2] );
+        vector_kd_tree.add ( all_star_vectors[i].normalize(), (uint32_t) i );
+    }
+    vector_kd_tree.build();
+    
+    // Calculate set of FOV scales to create patterns at, largest first.
+    
+    int fov_divisions = (int) round ( log2 ( max_fov_rad / min_fov_rad ) ) + 1;
+    std::vector<double> pattern_fovs;
+    if ( fov_divisions <= 1 )
+        pattern_fovs.push_back ( max_fov_rad );
+    else
+        for ( int i = fov_divisions - 1; i >= 0; i-- )
+            pattern_fovs.push_back ( exp2 ( log2 ( min_fov_rad ) + ( log2 ( max_fov_rad ) - log2 ( min_fov_rad ) ) * i / ( fov_divisions - 1 ) ) );
+    
+    // At each scale, add pattern stars between those kept at the previous scale, then generate patterns
+    // from them. Each thread generates patterns whose first stars are interleaved with other threads'.
+    
+    std::vector<bool> keep_for_patterns ( num_entries, false );
+    keep_for_patterns[0] = true;
+    
+    int num_threads = std::max ( 1, (int) options.num_threads );
+    std::vector<std::vector<T3Pattern>> thread_patterns ( num_threads );
+    
+    for ( double pattern_fov : pattern_fovs )
+    {
+        double pattern_stars_separation = 0.6 * ( fov_divisions <= 1 ? min_fov_rad : pattern_fov ) / sqrt ( options.pattern_stars_per_fov );
+        trimStars ( all_star_vectors, vector_kd_tree, chordToAngle ( pattern_stars_separation ), keep_for_patterns );
+        
+        std::vector<uint32_t> pattern_index;
+        std::vector<SSVector> pattern_star_vectors;
+        SSKDTree pattern_kd_tree;
+        for ( uint32_t i = 0; i < num_entries; i++ )
+        {
+            if ( keep_for_patterns[i] )
+            {
+                pattern_kd_tree.add ( all_star_vectors[i].normalize(), (uint32_t) pattern_index.size() );
+                pattern_index.push_back ( i );
+                pattern_star_vectors.push_back ( all_star_vectors[i] );
+            }
+        }
+        pattern_kd_tree.build();
+        
+        if ( num_threads == 1 )
+        {
+            generatePatterns ( pattern_star_vectors, pattern_kd_tree, pattern_index, pattern_fov, options.simplify_pattern, 0, 1, thread_patterns[0] );
+        }
+        else
+        {
+            std::vector<std::thread> threads;
+            for ( int i = 0; i < num_threads; i++ )
+                threads.push_back ( std::thread ( generatePatterns, std::cref ( pattern_star_vectors ), std::cref ( pattern_kd_tree ), std::cref ( pattern_index ), pattern_fov, options.simplify_pattern, i, num_threads, std::ref ( thread_patterns[i] ) ) );
+            for ( int i = 0; i < num_threads; i++ )
+                threads[i].join();
+        }
+    }
+    
+    // Merge patterns from all threads, and remove patterns found at more than one scale.
+    
+    std::vector<T3Pattern> pattern_list;
+    for ( std::vector<T3Pattern> &tp : thread_patterns )
+    {
+        pattern_list.insert ( pattern_list.end(), tp.begin(), tp.end() );
+        std::vector<T3Pattern>().swap ( tp );
+    }
+    
+    auto less = [] ( const T3Pattern &p1, const T3Pattern &p2 ) { return std::lexicographical_compare ( p1.stars, p1.stars + 4, p2.stars, p2.stars + 4 ); };
+    auto equal = [] ( const T3Pattern &p1, const T3Pattern &p2 ) { return std::equal ( p1.stars, p1.stars + 4, p2.stars ); };
+    std::sort ( pattern_list.begin(), pattern_list.end(), less );
+    pattern_list.erase ( std::unique ( pattern_list.begin(), pattern_list.end(), equal ), pattern_list.end() );
+    if ( pattern_list.empty() )
+        return false;
+    
+    // Add in missing stars for verification, then trim down star table and update indexing for pattern stars.
+    
+    std::vector<bool> keep_for_verifying = keep_for_patterns;
+    trimStars ( all_star_vectors, vector_kd_tree, chordToAngle ( 0.6 * min_fov_rad / sqrt ( options.verification_stars_per_fov ) ), keep_for_verifying );
+    
+    std::vector<uint32_t> star_index ( num_entries );
+    for ( size_t i = 0; i < num_entries; i++ )
+    {
+        if ( keep_for_verifying[i] )
+        {
+            star_index[i] = (uint32_t) stars.size();
+            stars.push_back ( star_table[i] );
+        }
+    }
+    
+    for ( T3Pattern &p : pattern_list )
+        for ( int i = 0; i < 4; i++ )
+            p.stars[i] = star_index[ p.stars[i] ];
+    
+    // Save metadata.
+    
+    pattern_mode = "edge_ratio";
+    pattern_size = 4;
+    pattern_bins = (int) round ( 0.25 / options.pattern_max_error );
+    pattern_max_error = options.pattern_max_error;
+    max_fov = radtodeg ( max_fov_rad );
+    min_fov = radtodeg ( min_fov_rad );
+    star_catalog = options.star_catalog;
+    pattern_stars_per_fov = options.pattern_stars_per_fov;
+    verification_stars_per_fov = options.verification_stars_per_fov;
+    star_max_magnitude = options.star_max_magnitude;
+    simplify_pattern = options.simplify_pattern;
+    range_ra[0] = range_ra[1] = range_dec[0] = range_dec[1] = 0.0;
+    
+    // Compute hash table indices of all patterns in parallel, then insert them into the hash table in order.
+    
+    newPatterns ( pattern_list.size() );
+    std::vector<uint32_t> hash_indices ( pattern_list.size() );
+    auto hashPatterns = [&] ( size_t start, size_t step )
+    {
+        for ( size_t i = start; i < pattern_list.size(); i += step )
+            hash_indices[i] = hashPattern ( pattern_list[i] );
+    };
+    
+    std::vector<std::thread> threads;
+    for ( int i = 1; i < num_threads; i++ )
+        threads.push_back ( std::thread ( hashPatterns, i, num_threads ) );
+    hashPatterns ( 0, num_threads );
+    for ( std::thread &t : threads )
+        t.join();
+    
+    patterns.reserve ( pattern_list.size() );
+    for ( size_t i = 0; i < pattern_list.size(); i++ )
+        insertAtIndex ( pattern_list[i], hash_indices[i] );
+    
+    nstars = (uint32_t) stars.size();
+    npatterns = (uint32_t) patterns.size();
+    indexStars();
+    loaded = true;
+    return true;
+}
+
+// Generates a database from all stars in an object array (objects), as above. Star positions are
+// propagated from J2000 to options.epoch using their space velocities, if known. Stars' visual magnitudes
+// are used, or blue magnitudes if visual magnitudes are unknown. Objects which are not stars are ignored.
+
+bool T3Database::generate ( SSObjectVec &objects, const T3GenerateOptions &options )
+{
+    std::vector<SSVector> vectors;
+    std::vector<float> mags;
+    
+    for ( size_t i = 0; i < objects.size(); i++ )
+    {
+        SSStarPtr pStar = SSGetStarPtr ( objects[i] );
+        if ( pStar == nullptr )
+            continue;
+        
+        float mag = pStar->getVMagnitude();
+        vectors.push_back ( SSPropagatePosition ( pStar, options.epoch - 2000.0 ) );
+        mags.push_back ( isinf ( mag ) ? pStar->getBMagnitude() : mag );
+    }
+    
+    return generate ( vectors, mags, options );
+}
+
+// Generates a database from stars in an HTM (htm), as above. Loads all regions of the HTM which may contain
+// stars brighter than options.star_max_magnitude; those regions stay loaded in the HTM afterwards.
+
+bool T3Database::generate ( SSHTM &htm, const T3GenerateOptions &options )
+{
+    std::vector<SSVector> vectors;
+    std::vector<float> mags;
+    std::vector<uint64_t> regions = { 0 };
+    
+    while ( ! regions.empty() )
+    {
+        uint64_t htmID = regions.back();
+        regions.pop_back();
+        
+        float min_mag = 0.0, max_mag = 0.0;
+        if ( ! htm.magLimits ( htmID, min_mag, max_mag ) || min_mag >= options.star_max_magnitude )
+            continue;
+        
+        SSObjectVec *pObjects = htm.loadRegion ( htmID );
+        for ( size_t i = 0; pObjects != nullptr && i < pObjects->size(); i++ )
+        {
+            SSStarPtr pStar = SSGetStarPtr ( pObjects->get ( i ) );
+            if ( pStar == nullptr )
+                continue;
+            
+            float mag = pStar->getVMagnitude();
+            vectors.push_back ( SSPropagatePosition ( pStar, options.epoch - 2000.0 ) );
+            mags.push_back ( isinf ( mag ) ? pStar->getBMagnitude() : mag );
+        }
+        
+        std::vector<uint64_t> subIDs = htm.subRegionIDs ( htmID );
+        regions.insert ( regions.end(), subIDs.begin(), subIDs.end() );
+    }
+    
+    return generate ( vectors, mags, options );
+}
+
+// Get hash index for a given key of (size) integers.
 // Note use of 128-bit integer. We need this because we are multiplying a 64-bit integer
 // (index) by a 32-bit integer (_MAGIC_RAND) and this can overflow 2^64. This actually
 // happens when bin_factor is greater than 64, corresponding to pattern_max_arr < 0.0039!
 // Note: bins = 1 / ( 4 * max_err ) and max_err = 1 / ( 4 * bins ) exactly.
 
-uint32_t T3Database::keyToIndex(std::vector<int> key, uint32_t bin_factor)
+uint32_t T3Database::keyToIndex ( const int *key, size_t size, uint32_t bin_factor ) const
 {
-    size_t max_index = patindex.size();
+    size_t max_index = patIndexSize();
     __uint128_t index = 0, bin_factor_pow_i = 1;
-    for (size_t i = 0; i < key.size(); ++i) {
+    for (size_t i = 0; i < size; ++i) {
         index += key[i] * bin_factor_pow_i;
         bin_factor_pow_i *= bin_factor;
     }
@@ -638,26 +1081,23 @@ uint32_t T3Database::keyToIndex(std::vector<int> key, uint32_t bin_factor)
 }
 
 // Get unit vectors from star centroids (pinhole camera).
-// Compute list of (i,j,k) vectors given list of (y,x) star centroids and
+// Compute array of (count) (i,j,k) vectors given array of (count) (y,x) star centroids and
 // an estimate of the image's field-of-view in the x dimension in radians
-// by applying the pinhole camera equations.
+// by applying the pinhole camera equations. The output array (vectors) must hold (count) vectors.
 // Near-clone of SSSource::project().
 
-std::vector<SSVector> Tetra3::computeVectors ( const std::vector<T3Source> &sources, float fov, float width, float height )
+void Tetra3::computeVectors ( const T3Source *sources, size_t count, float fov, float width, float height, SSVector *vectors )
 {
     float scale_factor = tan(fov / 2.0) / width * 2.0;
     float img_center[2] = { width / 2.0f, height / 2.0f };
 
-    std::vector<SSVector> star_vectors;
-    for ( const T3Source &source : sources) {
+    for ( size_t i = 0; i < count; i++ ) {
         
         SSVector v = { 1.0, 1.0, 1.0 };
-        v.y = (img_center[0] - source.x) * scale_factor;
-        v.z = (img_center[1] - source.y) * scale_factor;
-        star_vectors.push_back( v.normalize() );
+        v.y = (img_center[0] - sources[i].x) * scale_factor;
+        v.z = (img_center[1] - sources[i].y) * scale_factor;
+        vectors[i] = v.normalize();
     }
-
-    return star_vectors;
 }
 
 std::vector<T3Pattern> Tetra3::generatePatternsFromCentroids ( const std::vector<T3Source> &star_centroids, int pattern_size )
@@ -694,115 +1134,140 @@ std::vector<T3Pattern> Tetra3::generatePatternsFromCentroids ( const std::vector
     return patterns;
 }
 
-// calculate the least-squares rotation matrix from image frame to catalog using singular value decomposition.
+// Calculate the least-squares rotation matrix from image frame to catalog, given (count) pairs of matching
+// image and catalog vectors. This is the orthogonal polar factor U * V^T of the 3x3 correlation matrix
+// A = U * W * V^T, which is found in closed form with a few steps of the scaled Newton iteration
+// Q = ( g * Q + Q^-T / g ) / 2, without allocating memory. Unlike Horn's quaternion method, this keeps
+// the reflection (determinant -1) which the singular value decomposition finds for flipped images.
+// If A is singular, or nearly so, falls back to the general singular value decomposition.
 
-SSMatrix Tetra3::findRotationMatrix ( const std::vector<SSVector> &image_vectors, const std::vector<SSVector> &catalog_vectors )
+SSMatrix Tetra3::findRotationMatrix ( const SSVector *image_vectors, const SSVector *catalog_vectors, size_t count )
 {
-    SSMatrix u, v;
+    SSMatrix q ( 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 );
+    
+    for ( size_t i = 0; i < count; i++ )
+    {
+        const SSVector &u = image_vectors[i], &v = catalog_vectors[i];
+        q.m00 += u.x * v.x;    q.m01 += u.x * v.y;    q.m02 += u.x * v.z;
+        q.m10 += u.y * v.x;    q.m11 += u.y * v.y;    q.m12 += u.y * v.z;
+        q.m20 += u.z * v.x;    q.m21 += u.z * v.y;    q.m22 += u.z * v.z;
+    }
+    
+    double *m = &q.m00, norm = 0.0;
+    for ( int i = 0; i < 9; i++ )
+        norm += m[i] * m[i];
+    
+    double det = q.determinant();
+    if ( fabs ( det ) > 1.0e-15 * norm * sqrt ( norm ) )
+    {
+        for ( int iter = 0; iter < 100; iter++ )
+        {
+            double g = 1.0 / cbrt ( fabs ( det ) );
+            SSMatrix qit = q.inverse().transpose();
+            double *mit = &qit.m00, delta = 0.0;
+            for ( int i = 0; i < 9; i++ )
+            {
+                double mi = ( g * m[i] + mit[i] / g ) / 2.0;
+                delta = std::max ( delta, fabs ( mi - m[i] ) );
+                m[i] = mi;
+            }
+            
+            if ( delta < 1.0e-15 )
+                break;
+            
+            det = q.determinant();
+        }
+
+        // Note we are returning the transpose!  The python code returns the original matrix,
+        // but then transposes it later when rotating the star vectors.
+
+        return q.transpose();
+    }
     
     double **a = dmatrix ( 3, 3 );
     double **vt = dmatrix ( 3, 3 );
     double *w = dvector ( 3 );
 
-    for ( int i = 0; i < image_vectors.size() && i < catalog_vectors.size(); i++ )
-    {
-        SSVector u = image_vectors[i], v = catalog_vectors[i];
-        a[0][0] += u.x * v.x;    a[0][1] += u.x * v.y;    a[0][2] += u.x * v.z;
-        a[1][0] += u.y * v.x;    a[1][1] += u.y * v.y;    a[1][2] += u.y * v.z;
-        a[2][0] += u.z * v.x;    a[2][1] += u.z * v.y;    a[2][2] += u.z * v.z;
-    }
+    for ( int i = 0; i < 3; i++ )
+        for ( int j = 0; j < 3; j++ )
+            a[i][j] = m[i * 3 + j];
     
     svdcmp ( a, 3, 3, w, vt );
     
-    u = SSMatrix ( a[0][0], a[0][1], a[0][2],
-                   a[1][0], a[1][1], a[1][2],
-                   a[2][0], a[2][1], a[2][2] );
+    SSMatrix u = SSMatrix ( a[0][0], a[0][1], a[0][2],
+                            a[1][0], a[1][1], a[1][2],
+                            a[2][0], a[2][1], a[2][2] );
     
-    v = SSMatrix ( vt[0][0], vt[0][1], vt[0][2],
-                   vt[1][0], vt[1][1], vt[1][2],
-                   vt[2][0], vt[2][1], vt[2][2] ).transpose();
+    SSMatrix v = SSMatrix ( vt[0][0], vt[0][1], vt[0][2],
+                            vt[1][0], vt[1][1], vt[1][2],
+                            vt[2][0], vt[2][1], vt[2][2] ).transpose();
     
     free_dmatrix ( a );
     free_dmatrix ( vt );
     free_dvector ( w );
 
-    // Note we are returning the transpose!  The python code returns the original matrix,
-    // but then transposes it later when rotating the star vectors.
-
     SSMatrix r = u * v;
     return r.transpose();
 }
 
-// Get stars within radius radians of the vector.
+// Get up to max_stars brightest stars within radius radians of the vector. Their indices are returned in (indices),
+// and their vectors in (vectors); the memory of both is reused. Returns number of stars found.
 
-std::vector<SSVector> Tetra3::getNearbyStarVectors ( const SSVector &vector, double radius, int max_stars )
+size_t Tetra3::getNearbyStarVectors ( const SSVector &vector, double radius, int max_stars, std::vector<uint32_t> &indices, std::vector<SSVector> &vectors ) const
 {
-    std::vector<SSVector> nearby_star_vectors;
-    
-    double cosrad = cos ( radius );
-    for ( size_t i = 0; i < db.numStars(); i++ )
+    db.getNearbyStars ( vector, radius, std::max ( max_stars, 0 ), indices );
+    vectors.resize ( indices.size() );
+    for ( size_t i = 0; i < indices.size(); i++ )
     {
-        T3Star star = db.getStar ( i );
-        SSVector star_vector ( star.xyz[0], star.xyz[1], star.xyz[2] );
-        if ( star_vector.dotProduct ( vector ) > cosrad )
-            nearby_star_vectors.push_back ( star_vector );
-        if ( nearby_star_vectors.size() >= max_stars )
-            break;
+        T3Star star = db.getStar ( indices[i] );
+        vectors[i] = SSVector ( star.xyz[0], star.xyz[1], star.xyz[2] );
     }
     
-    return nearby_star_vectors;
+    return vectors.size();
 }
 
 // Multiplies all elements in a vector of vectors (vecs) by a 3x3 rotation matrix (rmat),
-// and return a vector of the rotated input vectors.
+// and returns the rotated input vectors in (rvecs), reusing its memory.
 
-std::vector<SSVector> rotateVectors ( SSMatrix rmat, std::vector<SSVector> &vecs )
+void rotateVectors ( SSMatrix rmat, const std::vector<SSVector> &vecs, std::vector<SSVector> &rvecs )
 {
-    std::vector<SSVector> rvecs;
-    for ( SSVector &vec : vecs )
-        rvecs.push_back ( rmat * vec );
-    return rvecs;
+    rvecs.resize ( vecs.size() );
+    for ( size_t i = 0; i < vecs.size(); i++ )
+        rvecs[i] = rmat * vecs[i];
 }
 
+// Reusable buffers for testing image patterns against the database. Each solver thread has its own,
+// so once they have grown large enough, testing a pattern in solveFromSources() does not allocate memory.
+
+struct T3SolverScratch
+{
+    std::vector<T3Pattern> matches;                 // catalog patterns found at one hash index
+    std::vector<T3PatternVectors> catalog_vectors;  // catalog patterns close enough to the image pattern
+    std::vector<SSVector> all_star_vectors;         // verification source vectors
+    std::vector<SSVector> rotated_star_vectors;     // verification source vectors rotated to catalog frame
+    std::vector<uint32_t> nearby_star_indices;      // catalog stars near image center
+    std::vector<SSVector> nearby_star_vectors;      // vectors to catalog stars near image center
+    std::vector<SSVector> match_image_sources;      // matched verification source vectors
+    std::vector<SSVector> match_catalog_stars;      // matched catalog star vectors
+};
+
+static thread_local T3SolverScratch solver_scratch;
+
 // Solve for the sky location of an image using source locations (centroids) of stars found in the image.
 // The image's dimensions in pixels are width (x) and height (y).
 // The function returns true if it can successfully solve the image, or false if it fails.
 // If successful, details of the solution are returned in the T3Results struct provided.
 // Every combination of the args.pattern_checking_stars brightest stars found is checked against the database
-// before giving up.
+// before giving up, at every FoV in the database range if no FoV estimate is given. If args.num_threads is
+// not zero, combinations are checked on that many threads from a pool kept by this Tetra3 object, and the
+// first solution found stops the rest.
 
 bool Tetra3::solveFromSources ( const std::vector<T3Source> &sources, float width, float height, const T3Options &args, T3Results &results )
 {
     if ( db.numPatterns() < 1 || db.numStars() < 1 )
         return false;
     
-    // If no FoV estimate provided, sweep over the database FoV range from widest to narrowest,
-    // reducing 20% each step. Try solving at each FoV estimate with 10% allowable FoV error.
-    // Choose the solution (if any) with the lowest false-match probability.
-    
-    if ( args.fov_estimate == 0.0 )
-    {
-        T3Options opts = args;
-        T3Results res = results;
-        results.prob = 1.0;
-
-        std::chrono::time_point t0_solve = std::chrono::high_resolution_clock::now();
-        for ( float fov = db.max_fov; fov >= db.min_fov; fov *= 0.8 )
-        {
-            opts.fov_estimate = fov;
-            opts.fov_max_error = fov * 0.1;
-            if ( solveFromSources ( sources, width, height, opts, res ) )
-                if ( res.prob < results.prob )
-                    results = res;
-        }
-        
-        std::chrono::duration<double> t_solve = std::chrono::high_resolution_clock::now() - t0_solve;
-        results.t_solve = t_solve.count() * 1000.0;
-        return results.prob <= args.match_threshold ? true : false;
-    }
-    
-    // If no FOV given at all, guess middle of the range for a start
-    float fov_initial = degtorad ( args.fov_estimate == 0.0 ? ( db.max_fov + db.min_fov ) / 2.0 : args.fov_estimate );
+    std::chrono::time_point t0_solve = std::chrono::high_resolution_clock::now();
     float pattern_max_error = args.pattern_max_error == 0.0 ? db.pattern_max_error : args.pattern_max_error;
     float match_radius = args.match_radius;
 
@@ -816,74 +1281,85 @@ bool Tetra3::solveFromSources ( const std::vector<T3Source> &sources, float widt
 
     std::vector<T3Pattern> image_patterns = generatePatternsFromCentroids ( pattern_sources, db.pattern_size );
 
-    // If we don't have a field of view estimate, calculate the largest
-    // distance in pixels between centroids, for future FOV estimation.
+    // If no FoV estimate provided, sweep over the database FoV range from widest to narrowest,
+    // reducing 20% each step, with 10% allowable FoV error at each FoV estimate.
     
-    float pattern_largest_distance = 0.0;
+    std::vector<float> fov_estimates, fov_max_errors;
     if ( args.fov_estimate == 0.0 )
-        for ( int i = 0; i < pattern_sources.size(); i++ )
-            for ( int j = i + 1; j < pattern_sources.size(); j++ )
-                pattern_largest_distance = std::max ( pattern_largest_distance, pattern_sources[i].distance ( pattern_sources[j] ) );
+    {
+        for ( float fov = db.max_fov; fov >= db.min_fov; fov *= 0.8 )
+        {
+            fov_estimates.push_back ( fov );
+            fov_max_errors.push_back ( fov * 0.1 );
+        }
+    }
+    else
+    {
+        fov_estimates.push_back ( args.fov_estimate );
+        fov_max_errors.push_back ( args.fov_max_error );
+    }
+    
+    // Each work item tests one image pattern at one FoV estimate. Items are numbered so that patterns are tried
+    // in order of brightness, each at every FoV estimate before the next pattern, and the FoV sweep does not
+    // delay trying the brightest patterns. The lowest-numbered item which solves is the solution; once one
+    // has, items with higher numbers are cancelled. So the solution is the same on any number of threads.
+    
+    size_t num_fovs = fov_estimates.size();
+    size_t num_items = image_patterns.size() * num_fovs;
+    std::atomic<size_t> next_item ( 0 ), solved_item ( SIZE_MAX );
+    std::mutex solved_mutex;
     
     // This internal lambda function does the real work. It tests a single pattern of four sources in the input image
-    // and returns true if the pattern results in a sucessful solution. It can be called in parallel, by multiple threads.
+    // at one FoV estimate (fov_estimate) and maximum error (fov_max_error), both in degrees, and returns true if the
+    // pattern results in a sucessful solution, in (results). It stops early if a lower-numbered work item than this
+    // one (item) has already solved. It can be called in parallel, by multiple threads.
     
-    auto solveFromPattern = [&] ( const T3Pattern &pattern ) -> bool
+    auto solveFromPattern = [&] ( const T3Pattern &pattern, float fov_estimate, float fov_max_error, size_t item, T3Results &results ) -> bool
     {
-        std::vector<T3Source> image_centroids;
-        for ( int i = 0; i < db.pattern_size; i++ )
-            image_centroids.push_back ( sources[ pattern.stars[i] ] );
+        T3SolverScratch &scratch = solver_scratch;
+        float fov_initial = degtorad ( fov_estimate );
+        T3Source image_centroids[4];
+        for ( int i = 0; i < 4; i++ )
+            image_centroids[i] = sources[ pattern.stars[i] ];
         
         // Compute star vectors using an estimate for the field-of-view in the x dimension
         T3PatternVectors pattern_vectors;
-        pattern_vectors.vectors = computeVectors(image_centroids, fov_initial, width, height);
+        computeVectors ( image_centroids, 4, fov_initial, width, height, pattern_vectors.vectors );
         pattern_vectors.computeEdgeRatios();
         double pattern_largest_edge = pattern_vectors.largestEdge();
         
-        // Possible hash codes to look up
-        std::vector<std::vector<int>> hash_code_space;
-        for (size_t i = 0; i < pattern_vectors.edge_ratios.size(); ++i) {
-            double low = (pattern_vectors.edge_ratios[i] - pattern_max_error) * db.pattern_bins;
-            double high = (pattern_vectors.edge_ratios[i] + pattern_max_error) * db.pattern_bins;
-            int low_index = std::clamp(static_cast<int>(low), 0, db.pattern_bins);
-            int high_index = std::min(static_cast<int>(high) + 1, db.pattern_bins);
-            std::vector<int> range(high_index - low_index + 1);
-            std::iota(range.begin(), range.end(), low_index);
-            hash_code_space.push_back(range);
+        // Possible hash codes to look up: each edge ratio's bin ranges from low up to but not including high.
+        int low[5], high[5], hash_code[5];
+        bool done = false;
+        for (size_t i = 0; i < 5; ++i) {
+            double lo = (pattern_vectors.edge_ratios[i] - pattern_max_error) * db.pattern_bins;
+            double hi = (pattern_vectors.edge_ratios[i] + pattern_max_error) * db.pattern_bins;
+            low[i] = hash_code[i] = std::clamp(static_cast<int>(lo), 0, db.pattern_bins);
+            high[i] = std::min(static_cast<int>(hi) + 1, db.pattern_bins);
+            if ( high[i] <= low[i] )
+                done = true;
         }
         
-        std::vector<T3HashCode> hash_codes = generate_hash_codes(hash_code_space);
-        for ( T3HashCode &hash_code : hash_codes )
+        for ( ; ! done && solved_item > item; done = nextHashCode ( hash_code, low, high ) )
         {
-            uint32_t hash_index = db.keyToIndex(hash_code, db.pattern_bins );
-            std::vector<T3Pattern> matches = db.getAtIndex ( hash_index );
-         
-            if ( matches.size() == 0 )
+            uint32_t hash_index = db.keyToIndex ( hash_code, 5, db.pattern_bins );
+            std::vector<T3Pattern> &matches = scratch.matches;
+            if ( db.getAtIndex ( hash_index, matches ) == 0 )
                 continue;
 
             // Calculate difference to observed pattern and find sufficiencly close ones
 
-            std::vector<size_t> valid_patterns;
-            std::vector<T3PatternVectors> catalog_star_vectors;
+            std::vector<T3PatternVectors> &catalog_star_vectors = scratch.catalog_vectors;
+            catalog_star_vectors.clear();
 
             for ( size_t i = 0; i < matches.size(); i++ )
             {
-                if ( args.fov_estimate == 0.0 )
-                {
-                    // Calculate actual fov from pattern pixel distance and catalog edge angle
-                    
-                    double f = pattern_largest_distance / 2.0 / tan ( matches[i].largest_edge / 2.0 );
-                    double fov = 2.0 * atan ( width / 2.0 / f );
-                }
-                else
-                {
-                    // Calculate actual fov by scaling estimate
-                    // If the FOV is incorrect we can skip this immediately
+                // Calculate actual fov by scaling estimate
+                // If the FOV is incorrect we can skip this immediately
 
-                    double fov = matches[i].largest_edge / pattern_largest_edge * fov_initial;
-                    if ( args.fov_max_error != 0.0 && fabs ( radtodeg ( fov ) - args.fov_estimate ) > args.fov_max_error )
-                        continue;
-                }
+                double fov = matches[i].largest_edge / pattern_largest_edge * fov_initial;
+                if ( fov_max_error != 0.0 && fabs ( radtodeg ( fov ) - fov_estimate ) > fov_max_error )
+                    continue;
                 
                 T3PatternVectors pv = db.getStarPatternVectors ( matches[i] );
                 pv.computeEdgeRatios();
@@ -891,44 +1367,46 @@ bool Tetra3::solveFromSources ( const std::vector<T3Source> &sources, float widt
                 // Calculate difference to observed pattern and find sufficiencly close ones
 
                 double max_edge_error = 0;
-                for (size_t j = 0; j < pv.edge_ratios.size(); j++ )
+                for (size_t j = 0; j < 5; j++ )
                     max_edge_error = std::max ( max_edge_error, fabs ( pv.edge_ratios[j] - pattern_vectors.edge_ratios[j]));
 
                 if ( max_edge_error < pattern_max_error )
-                {
-                    valid_patterns.push_back ( i );
                     catalog_star_vectors.push_back ( pv );
-                }
             }
 
-            for ( int i = 0; i < valid_patterns.size(); i++ )
+            for ( const T3PatternVectors &catalog_vectors : catalog_star_vectors )
             {
-                size_t index = valid_patterns[i];
-                T3PatternVectors catalog_vectors = catalog_star_vectors[i];
                 double fov = catalog_vectors.largestEdge() / pattern_largest_edge * fov_initial;
 
                 // Recalculate vectors and uniquely sort them by distance from centroid
-                // so they can be uniqely matched with the catalog vectors
+                // so they can be uniqely matched with the catalog vectors;
+                // stars in catalog pattern are already sorted by distance from center.
                 
-                pattern_vectors.vectors = computeVectors(image_centroids, fov, width, height);
-                std::vector<SSVector> pattern_sorted_vectors, catalog_sorted_vectors;
+                SSVector pattern_sorted_vectors[4];
+                computeVectors ( image_centroids, 4, fov, width, height, pattern_vectors.vectors );
                 sortByDistanceFromCenter ( pattern_vectors.vectors, pattern_sorted_vectors );
-                catalog_sorted_vectors = catalog_vectors.vectors;   // stars in pattern are already sorted by distance from center
 
                 // Use the pattern match to find an estimate for the image's rotation matrix
                 
-                SSMatrix rotation_matrix = findRotationMatrix ( pattern_sorted_vectors, catalog_sorted_vectors );
-                std::vector<SSVector> all_star_vectors = computeVectors ( verification_sources, fov, width, height );
-                std::vector<SSVector> rotated_star_vectors = rotateVectors ( rotation_matrix, all_star_vectors );
+                SSMatrix rotation_matrix = findRotationMatrix ( pattern_sorted_vectors, catalog_vectors.vectors, 4 );
+                std::vector<SSVector> &all_star_vectors = scratch.all_star_vectors;
+                std::vector<SSVector> &rotated_star_vectors = scratch.rotated_star_vectors;
+                all_star_vectors.resize ( verification_sources.size() );
+                computeVectors ( verification_sources.data(), verification_sources.size(), fov, width, height, all_star_vectors.data() );
+                rotateVectors ( rotation_matrix, all_star_vectors, rotated_star_vectors );
                 
                 SSVector image_center_vector = rotation_matrix.col ( 0 );
                 double fov_diagonal_rad = fov * hypot ( width, height ) / width / 2.0;
-                std::vector<SSVector> nearby_star_vectors = getNearbyStarVectors ( image_center_vector, fov_diagonal_rad, db.verification_stars_per_fov );
+                std::vector<SSVector> &nearby_star_vectors = scratch.nearby_star_vectors;
+                getNearbyStarVectors ( image_center_vector, fov_diagonal_rad, db.verification_stars_per_fov, scratch.nearby_star_indices, nearby_star_vectors );
                 
                 // Match the nearby star vectors to the proposed measured star vectors
                 
                 double cosrad = cos ( args.match_radius * fov );
-                std::vector<SSVector> match_image_sources, match_catalog_stars;
+                std::vector<SSVector> &match_image_sources = scratch.match_image_sources;
+                std::vector<SSVector> &match_catalog_stars = scratch.match_catalog_stars;
+                match_image_sources.clear();
+                match_catalog_stars.clear();
                 for ( int i = 0; i < rotated_star_vectors.size(); i++ )
                 {
                     int sum = 0, jmatch = 0;
@@ -962,12 +1440,12 @@ bool Tetra3::solveFromSources ( const std::vector<T3Source> &sources, float widt
                 if ( prob_mismatch < args.match_threshold )
                 {
                     // if a match has been found, recompute rotation with all matched vectors
-                    rotation_matrix = findRotationMatrix(match_image_sources, match_catalog_stars );
+                    rotation_matrix = findRotationMatrix ( match_image_sources.data(), match_catalog_stars.data(), match_image_sources.size() );
                     double det = rotation_matrix.determinant();
 
                     // Residuals calculation
                     double residual = 0.0;
-                    rotated_star_vectors = rotateVectors ( rotation_matrix, match_image_sources );
+                    rotateVectors ( rotation_matrix, match_image_sources, rotated_star_vectors );
                     for ( int i = 0; i < rotated_star_vectors.size(); i++ )
                     {
                         double angle = rotated_star_vectors[i].angularSeparation ( match_catalog_stars[i] );
@@ -996,43 +1474,489 @@ bool Tetra3::solveFromSources ( const std::vector<T3Source> &sources, float widt
         return false;
     };
     
-    // This lambda processes part of vector of patterns, so the entire vector of patterns can be
-    // divided among multiple threads that process them in parallel.
-    // The "solved" flag indicates when one thread has solved successfully. At that point, all threads can exit.
+    // This lambda takes work items in order, and tests them, until none are left or one has solved.
+    // Any number of threads can run it at once, so each takes the next item as soon as it is free.
+    // If it finds a solution, it is kept if no lower-numbered item has solved.
     
-    std::atomic_bool solved = false;
-    auto solveFromPatterns = [&] ( const std::vector<T3Pattern> &patterns, int start, int step ) -> bool
+    T3Results solution;
+    auto solveItems = [&] ( void )
     {
-        for ( size_t i = start; i < patterns.size() && solved == false; i += step )
+        T3Results res;
+        for ( size_t i = next_item++; i < num_items && i < solved_item; i = next_item++ )
         {
-            std::this_thread::yield();
-            if ( solveFromPattern ( patterns[i] ) )
-                solved = true;
+            if ( solveFromPattern ( image_patterns[ i / num_fovs ], fov_estimates[ i % num_fovs ], fov_max_errors[ i % num_fovs ], i, res ) )
+            {
+                std::lock_guard<std::mutex> lock ( solved_mutex );
+                if ( i < solved_item )
+                {
+                    solved_item = i;
+                    solution = res;
+                }
+            }
         }
-        
-        return solved;
     };
     
-    // If no threading specified, process all patterns found in the image synchronously.
-    // Otherwise, process them in parallel, divided among the number of threads specified.
+    // If no threading specified, process all work items synchronously. Otherwise, process them
+    // on the specified number of threads from the solver's thread pool, and wait for all to finish.
     
-    std::chrono::time_point t0_solve = std::chrono::high_resolution_clock::now();
-    if ( args.num_threads == 0 )
+    if ( args.num_threads == 0 || num_items < 2 )
+    {
+        solveItems();
+    }
+    else
+    {
+        std::shared_ptr<SSThreadPool> pool = solverPool ( args.num_threads );
+        std::mutex done_mutex;
+        std::condition_variable done_cond;
+        int running = (int) std::min ( (size_t) args.num_threads, num_items );
+        
+        for ( int i = 0, n = running; i < n; i++ )
+        {
+            pool->submit ( [&] ( void )
+            {
+                solveItems();
+                std::lock_guard<std::mutex> lock ( done_mutex );
+                if ( --running == 0 )
+                    done_cond.notify_one();
+            } );
+        }
+        
+        std::unique_lock<std::mutex> lock ( done_mutex );
+        done_cond.wait ( lock, [&] { return running == 0; } );
+    }
+    
+    // Solved or failed in this time. If failed, results are cleared, except time spent extracting sources.
+
+    bool solved = solved_item < num_items;
+    if ( solved )
     {
-        solved = solveFromPatterns ( image_patterns, 0, 1 );
+        results = solution;
     }
     else
     {
-        int num_threads = args.num_threads;
-        std::vector<std::thread> threads;
-        for ( int i = 0; i < num_threads; i++ )
-            threads.push_back ( std::thread ( solveFromPatterns, image_patterns, i, num_threads ) );
-        for ( int i = 0; i < num_threads; i++ )
-            threads[i].join();
+        float t_extract = results.t_extract;
+        results = T3Results();
+        results.t_extract = t_extract;
     }
     
-    // Solved or failed in this time
     std::chrono::duration<double> t_solve = std::chrono::high_resolution_clock::now() - t0_solve;
     results.t_solve = t_solve.count() * 1000.0;
     return solved;
 }
+
+// Returns the pool of threads used by solveFromSources(), with (num_threads) threads. The pool is created
+// on first use, and kept for later calls, so threads are not started and stopped for every solution.
+// If a different number of threads is requested, a new pool replaces it; calls still using the old pool
+// keep it until they finish.
+
+std::shared_ptr<SSThreadPool> Tetra3::solverPool ( int num_threads )
+{
+    std::lock_guard<std::mutex> lock ( pool_mutex );
+    if ( ! pool || pool_threads != num_threads )
+    {
+        pool = std::make_shared<SSThreadPool> ( num_threads );
+        pool_threads = num_threads;
+    }
+    
+    return pool;
+}
+
+// Returns the number of strips of rows an image of (height) rows is divided into for processing
+// on (num_threads) threads: one strip per thread, or one strip if num_threads is zero.
+
+static int countStrips ( int height, int num_threads )
+{
+    return std::max ( 1, std::min ( num_threads, height ) );
+}
+
+// Calls a function (func) for each strip of rows of an image of (height) rows, with the first row in the strip,
+// the row after the last, and the strip index, on (num_threads) threads, one strip per thread. Strips are
+// processed in parallel, so the function must only write to the rows, or per-strip results, of its own strip.
+// Returns after all strips are processed. If num_threads is zero, runs synchronously on the current thread.
+
+static void forEachStrip ( int height, int num_threads, const std::function<void ( int, int, int )> &func )
+{
+    int num_strips = countStrips ( height, num_threads );
+    std::vector<std::thread> threads;
+    for ( int s = 1; s < num_strips; s++ )
+        threads.push_back ( std::thread ( func, (int) ( (int64_t) height * s / num_strips ), (int) ( (int64_t) height * ( s + 1 ) / num_strips ), s ) );
+    
+    func ( 0, height / num_strips, 0 );
+    for ( std::thread &t : threads )
+        t.join();
+}
+
+// Returns index of element (i) in an array of (n) elements extended by reflection about its edges
+// (d c b a | a b c d | d c b a), like the default 'reflect' mode of scipy.ndimage filters.
+
+static int reflectIndex ( int i, int n )
+{
+    i %= 2 * n;
+    if ( i < 0 )
+        i += 2 * n;
+    return i < n ? i : 2 * n - 1 - i;
+}
+
+// Subtracts the mean of the (size) x (size) pixel box around each pixel from a (width) x (height) image (img),
+// like scipy.ndimage.uniform_filter() in tetra3.py's 'local_mean' background subtraction mode. The box filter
+// is separable, so takes a horizontal running sum along each row, then a vertical running sum down each column;
+// the latter is done for a whole row of columns at once, so the compiler can vectorize it.
+
+static void subtractLocalMean ( std::vector<float> &img, int width, int height, int size, int num_threads )
+{
+    int r = size / 2;
+    std::vector<int> xidx ( width + 2 * r ), yidx ( height + 2 * r );
+    for ( int i = 0; i < width + 2 * r; i++ )
+        xidx[i] = reflectIndex ( i - r, width );
+    for ( int i = 0; i < height + 2 * r; i++ )
+        yidx[i] = reflectIndex ( i - r, height );
+    
+    std::vector<float> hsum ( img.size() );
+    forEachStrip ( height, num_threads, [&] ( int y0, int y1, int strip )
+    {
+        for ( int y = y0; y < y1; y++ )
+        {
+            const float *row = &img[ (size_t) y * width ];
+            float *sum_row = &hsum[ (size_t) y * width ];
+            double sum = 0.0;
+            for ( int k = 0; k <= 2 * r; k++ )
+                sum += row[ xidx[k] ];
+            
+            sum_row[0] = sum;
+            for ( int x = 1; x < width; x++ )
+            {
+                sum += row[ xidx[ x + 2 * r ] ] - row[ xidx[ x - 1 ] ];
+                sum_row[x] = sum;
+            }
+        }
+    } );
+    
+    double scale = 1.0 / ( (double) size * size );
+    forEachStrip ( height, num_threads, [&] ( int y0, int y1, int strip )
+    {
+        std::vector<double> colsum ( width, 0.0 );
+        for ( int k = y0; k <= y0 + 2 * r; k++ )
+        {
+            const float *sum_row = &hsum[ (size_t) yidx[k] * width ];
+            for ( int x = 0; x < width; x++ )
+                colsum[x] += sum_row[x];
+        }
+        
+        for ( int y = y0; y < y1; y++ )
+        {
+            if ( y > y0 )
+            {
+                const float *add_row = &hsum[ (size_t) yidx[ y + 2 * r ] * width ];
+                const float *sub_row = &hsum[ (size_t) yidx[ y - 1 ] * width ];
+                for ( int x = 0; x < width; x++ )
+                    colsum[x] += add_row[x] - sub_row[x];
+            }
+            
+            float *row = &img[ (size_t) y * width ];
+            for ( int x = 0; x < width; x++ )
+                row[x] -= colsum[x] * scale;
+        }
+    } );
+}
+
+// Applies binary opening (erosion followed by dilation) with a 3x3 cross as structuring element
+// to a (width) x (height) binary mask of zeros and ones, like scipy.ndimage.binary_opening();
+// pixels outside the mask are treated as zeros.
+
+static void openMask ( std::vector<uint8_t> &mask, int width, int height, int num_threads )
+{
+    std::vector<uint8_t> eroded ( mask.size() ), zeros ( width, 0 );
+    
+    forEachStrip ( height, num_threads, [&] ( int y0, int y1, int strip )
+    {
+        for ( int y = y0; y < y1; y++ )
+        {
+            const uint8_t *m = &mask[ (size_t) y * width ];
+            const uint8_t *up = y > 0 ? m - width : zeros.data();
+            const uint8_t *dn = y < height - 1 ? m + width : zeros.data();
+            uint8_t *e = &eroded[ (size_t) y * width ];
+            
+            e[0] = e[ width - 1 ] = 0;
+            for ( int x = 1; x < width - 1; x++ )
+                e[x] = m[x] & up[x] & dn[x] & m[ x - 1 ] & m[ x + 1 ];
+        }
+    } );
+    
+    forEachStrip ( height, num_threads, [&] ( int y0, int y1, int strip )
+    {
+        for ( int y = y0; y < y1; y++ )
+        {
+            const uint8_t *e = &eroded[ (size_t) y * width ];
+            const uint8_t *up = y > 0 ? e - width : zeros.data();
+            const uint8_t *dn = y < height - 1 ? e + width : zeros.data();
+            uint8_t *m = &mask[ (size_t) y * width ];
+            
+            m[0] = e[0] | up[0] | dn[0] | ( width > 1 ? e[1] : 0 );
+            for ( int x = 1; x < width - 1; x++ )
+                m[x] = e[x] | up[x] | dn[x] | e[ x - 1 ] | e[ x + 1 ];
+            if ( width > 1 )
+                m[ width - 1 ] = e[ width - 1 ] | up[ width - 1 ] | dn[ width - 1 ] | e[ width - 2 ];
+        }
+    } );
+}
+
+// A horizontal run of adjacent pixels in one row of a binary mask, with the sums of the run's pixel values (m0)
+// and the first (mx, my) and second (mxx, myy, mxy) moments of their (x,y) positions, weighted by pixel value.
+
+struct T3Run
+{
+    int y, x0, x1;                          // row, first and last column of run
+    double m0, mx, my, mxx, myy, mxy;       // zeroth, first, and second moments
+};
+
+// Extracts sources (star centroids) from an image with the same algorithm as tetra3.py get_centroids_from_image(),
+// in its default 'local_mean' background subtraction and 'global_root_square' sigma modes. Cropping, downsampling,
+// and centroid windows are not supported. The image has (width) x (height) pixels, stored row by row, from the top,
+// (row_bytes) apart, or width * bits_per_pixel / 8 if zero. Pixels are 8- or 16-bit gray values, according to
+// (bits_per_pixel); 16-bit values are in native byte order. Sources are returned in (sources) with their positions
+// from the top left corner of the image (so x = y = 0.5 is the center of the top-left pixel), brightest first,
+// ready for solveFromSources(). Work is divided into strips of rows on options.num_threads threads.
+// Returns number of sources found, or zero if the image is invalid.
+
+size_t Tetra3::getCentroidsFromImage ( const void *image, int width, int height, int bits_per_pixel, size_t row_bytes, const T3ExtractOptions &options, std::vector<T3Source> &sources )
+{
+    sources.clear();
+    if ( image == nullptr || width < 1 || height < 1 || ( bits_per_pixel != 8 && bits_per_pixel != 16 ) )
+        return 0;
+    
+    if ( row_bytes == 0 )
+        row_bytes = (size_t) width * bits_per_pixel / 8;
+    
+    // Convert image to floating point.
+
+    int num_threads = options.num_threads;
+    int num_strips = countStrips ( height, num_threads );
+    size_t num_pixels = (size_t) width * height;
+    std::vector<float> img ( num_pixels );
+    
+    forEachStrip ( height, num_threads, [&] ( int y0, int y1, int strip )
+    {
+        for ( int y = y0; y < y1; y++ )
+        {
+            const uint8_t *src = (const uint8_t *) image + y * row_bytes;
+            float *row = &img[ (size_t) y * width ];
+            if ( bits_per_pixel == 8 )
+                for ( int x = 0; x < width; x++ )
+                    row[x] = src[x];
+            else
+                for ( int x = 0; x < width; x++ )
+                    row[x] = ( (const uint16_t *) src )[x];
+        }
+    } );
+    
+    // Subtract background, then compute the threshold from the root-mean-square of the result,
+    // summing over each strip on its own thread.
+    
+    std::vector<double> strip_sums ( num_strips );
+    if ( options.filtsize > 1 )
+    {
+        subtractLocalMean ( img, width, height, options.filtsize | 1, num_threads );
+    }
+    else
+    {
+        forEachStrip ( height, num_threads, [&] ( int y0, int y1, int strip )
+        {
+            double sum = 0.0;
+            for ( size_t i = (size_t) y0 * width; i < (size_t) y1 * width; i++ )
+                sum += img[i];
+            strip_sums[ strip ] = sum;
+        } );
+        
+        float mean = std::accumulate ( strip_sums.begin(), strip_sums.end(), 0.0 ) / num_pixels;
+        for ( float &value : img )
+            value -= mean;
+    }
+    
+    float image_th = options.image_th;
+    if ( image_th == 0.0 )
+    {
+        forEachStrip ( height, num_threads, [&] ( int y0, int y1, int strip )
+        {
+            double sum = 0.0;
+            for ( size_t i = (size_t) y0 * width; i < (size_t) y1 * width; i++ )
+                sum += img[i] * img[i];
+            strip_sums[ strip ] = sum;
+        } );
+        
+        image_th = options.sigma * sqrt ( std::accumulate ( strip_sums.begin(), strip_sums.end(), 0.0 ) / num_pixels );
+    }
+    
+    // Threshold to find binary mask, and clean it up with binary opening.
+    
+    std::vector<uint8_t> mask ( num_pixels );
+    forEachStrip ( height, num_threads, [&] ( int y0, int y1, int strip )
+    {
+        for ( size_t i = (size_t) y0 * width; i < (size_t) y1 * width; i++ )
+            mask[i] = img[i] > image_th;
+    } );
+    
+    if ( options.binary_open )
+        openMask ( mask, width, height, num_threads );
+    
+    // Find runs of pixels in each row of the binary mask, and their moments.
+    
+    std::vector<std::vector<T3Run>> strip_runs ( num_strips );
+    forEachStrip ( height, num_threads, [&] ( int y0, int y1, int strip )
+    {
+        for ( int y = y0; y < y1; y++ )
+        {
+            const uint8_t *m = &mask[ (size_t) y * width ];
+            const float *row = &img[ (size_t) y * width ];
+            for ( int x = 0; x < width; x++ )
+            {
+                if ( ! m[x] )
+                    continue;
+                
+                T3Run run = { y, x, x, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+                for ( ; x < width && m[x]; x++ )
+                {
+                    double a = row[x];
+                    run.m0 += a;
+                    run.mx += a * x;
+                    run.mxx += a * x * x;
+                }
+                
+                run.x1 = x - 1;
+                run.my = run.m0 * y;
+                run.myy = run.m0 * y * y;
+                run.mxy = run.mx * y;
+                strip_runs[ strip ].push_back ( run );
+            }
+        }
+    } );
+    
+    std::vector<T3Run> runs;
+    for ( std::vector<T3Run> &sr : strip_runs )
+        runs.insert ( runs.end(), sr.begin(), sr.end() );
+    
+    // Label connected regions of the mask: join runs which overlap runs in the previous row (4-connectivity).
+    // Each region's root is its first run, so regions are numbered in the same order as scipy.ndimage.label().
+    
+    std::vector<size_t> parent ( runs.size() );
+    std::iota ( parent.begin(), parent.end(), 0 );
+    auto findRoot = [&parent] ( size_t i )
+    {
+        while ( parent[i] != i )
+            i = parent[i] = parent[ parent[i] ];
+        return i;
+    };
+    
+    for ( size_t prev = 0, curr = 0; curr < runs.size(); )
+    {
+        // Find the runs in the current row and the previous row.
+        
+        size_t curr_end = curr;
+        while ( curr_end < runs.size() && runs[ curr_end ].y == runs[ curr ].y )
+            curr_end++;
+        
+        while ( prev < curr && runs[ prev ].y < runs[ curr ].y - 1 )
+            prev++;
+        
+        for ( size_t i = prev, j = curr; i < curr && j < curr_end; )
+        {
+            if ( runs[i].x0 <= runs[j].x1 && runs[j].x0 <= runs[i].x1 )
+            {
+                size_t ri = findRoot ( i ), rj = findRoot ( j );
+                if ( ri < rj )
+                    parent[ rj ] = ri;
+                else if ( rj < ri )
+                    parent[ ri ] = rj;
+            }
+            
+            if ( runs[i].x1 < runs[j].x1 )
+                i++;
+            else
+                j++;
+        }
+        
+        prev = curr;
+        curr = curr_end;
+    }
+    
+    // Sum moments and areas of the runs in each region.
+    
+    std::vector<T3Run> regions;
+    std::vector<int> areas;
+    std::vector<size_t> region_index ( runs.size() );
+    for ( size_t i = 0; i < runs.size(); i++ )
+    {
+        size_t root = findRoot ( i );
+        if ( root == i )
+        {
+            region_index[i] = regions.size();
+            regions.push_back ( runs[i] );
+            areas.push_back ( runs[i].x1 - runs[i].x0 + 1 );
+        }
+        else
+        {
+            size_t r = region_index[i] = region_index[ root ];
+            regions[r].m0 += runs[i].m0;
+            regions[r].mx += runs[i].mx;
+            regions[r].my += runs[i].my;
+            regions[r].mxx += runs[i].mxx;
+            regions[r].myy += runs[i].myy;
+            regions[r].mxy += runs[i].mxy;
+            areas[r] += runs[i].x1 - runs[i].x0 + 1;
+        }
+    }
+    
+    // Compute statistics of each region, and reject it if it fails any limits.
+    
+    std::vector<std::pair<double, T3Source>> spots;
+    for ( size_t r = 0; r < regions.size(); r++ )
+    {
+        const T3Run &reg = regions[r];
+        if ( ( options.min_area && areas[r] < options.min_area ) || ( options.max_area && areas[r] > options.max_area ) )
+            continue;
+        
+        if ( reg.m0 <= 0.0 || ( options.min_sum && reg.m0 < options.min_sum ) || ( options.max_sum && reg.m0 > options.max_sum ) )
+            continue;
+        
+        double m1_x = reg.mx / reg.m0, m1_y = reg.my / reg.m0;
+        if ( options.max_axis_ratio )
+        {
+            double m2_xx = std::max ( 0.0, reg.mxx / reg.m0 - m1_x * m1_x );
+            double m2_yy = std::max ( 0.0, reg.myy / reg.m0 - m1_y * m1_y );
+            double m2_xy = reg.mxy / reg.m0 - m1_x * m1_y;
+            double root = sqrt ( ( m2_xx - m2_yy ) * ( m2_xx - m2_yy ) + 4 * m2_xy * m2_xy );
+            double major = sqrt ( 2 * ( m2_xx + m2_yy + root ) );
+            double minor = sqrt ( 2 * std::max ( 0.0, m2_xx + m2_yy - root ) );
+            if ( minor <= 0 || major / std::max ( minor, 1.0e-9 ) > options.max_axis_ratio )
+                continue;
+        }
+        
+        spots.push_back ( { reg.m0, T3Source ( m1_x + 0.5, m1_y + 0.5 ) } );
+    }
+    
+    // Sort spots, largest sum first, and keep at most max_returned.
+    
+    std::stable_sort ( spots.begin(), spots.end(), [] ( const std::pair<double, T3Source> &s1, const std::pair<double, T3Source> &s2 ) { return s1.first > s2.first; } );
+    if ( options.max_returned > 0 && spots.size() > options.max_returned )
+        spots.resize ( options.max_returned );
+    
+    for ( std::pair<double, T3Source> &spot : spots )
+        sources.push_back ( spot.second );
+    
+    return sources.size();
+}
+
+// Extracts sources from an image with getCentroidsFromImage(), using (extract_options), then solves them
+// with solveFromSources(), using (options). Image arguments are the same as for getCentroidsFromImage().
+// The time spent extracting sources is returned in results.t_extract. Returns true if successful.
+
+bool Tetra3::solveFromImage ( const void *image, int width, int height, int bits_per_pixel, size_t row_bytes, const T3ExtractOptions &extract_options, const T3Options &options, T3Results &results )
+{
+    std::chrono::time_point t0_extract = std::chrono::high_resolution_clock::now();
+    std::vector<T3Source> sources;
+    getCentroidsFromImage ( image, width, height, bits_per_pixel, row_bytes, extract_options, sources );
+    std::chrono::duration<double> t_extract = std::chrono::high_resolution_clock::now() - t0_extract;
+    
+    bool solved = solveFromSources ( sources, width, height, options, results );
+    results.t_extract = t_extract.count() * 1000.0;
+    return solved;
+}
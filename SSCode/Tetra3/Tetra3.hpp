@@ -10,11 +10,15 @@
 #include <fstream>
 #include <vector>
 #include <set>
+#include <memory>
 #include <algorithm>
 #include <iterator>
 #include <cmath>
 
 #include "SSMatrix.hpp"
+#include "SSKDTree.hpp"
+#include "SSHTM.hpp"
+#include "SSThreadPool.hpp"
 #include "cnpy.h"
 
 typedef std::vector<int> T3HashCode;
@@ -84,32 +88,26 @@ struct T3Pattern
 
 // Contains geometric information about a patter of four stars.
 // Can be known stars in a star catalog, or sources found in an image.
+// Fixed-size arrays, so the solver can build these on the stack without heap allocation.
 
 struct T3PatternVectors
 {
-    std::vector<SSVector> vectors;    // has 4 elements, vectors to stars making the pattern
-    std::vector<double> edge_angles;  // has 6 elements, angular distances between stars in patter, sorted smallest to largest, in radians
-    std::vector<double> edge_ratios;  // has 5 elements, ratios of edges to largest edge
+    SSVector vectors[4];        // vectors to stars making the pattern
+    double edge_angles[6];      // angular distances between stars in patter, sorted smallest to largest, in radians
+    double edge_ratios[5];      // ratios of edges to largest edge
 
-    T3PatternVectors ( void )
-    {
-        vectors = std::vector<SSVector> ( 4 );
-        edge_angles = std::vector<double> ( 6 );
-        edge_ratios = std::vector<double> ( 5 );
-    }
-
-    double largestEdge ( void ) { return edge_angles.back(); }
+    double largestEdge ( void ) const { return edge_angles[5]; }
 
     void computeEdgeRatios ( void )
     {
         int edge = 0;
-        for ( int i = 0; i < vectors.size(); i++ )
-            for ( int j = i + 1; j < vectors.size(); j++ )
+        for ( int i = 0; i < 4; i++ )
+            for ( int j = i + 1; j < 4; j++ )
                 edge_angles[edge++] = vectors[i].angularSeparation ( vectors[j] );
         
-        std::sort ( edge_angles.begin(), edge_angles.end() );
-        for ( int i = 0; i < edge_ratios.size(); i++ )
-            edge_ratios[i] = edge_angles[i] / edge_angles.back();
+        std::sort ( edge_angles, edge_angles + 6 );
+        for ( int i = 0; i < 5; i++ )
+            edge_ratios[i] = edge_angles[i] / edge_angles[5];
     }
 };
 
@@ -141,6 +139,41 @@ struct T3Options
     uint8_t num_threads;            // Number of parallel threads to run; if zero, run synchronously on current thread.
 };
 
+// Arguments to T3Database::generate() methods. Defaults are the same as in tetra3.py generate_database().
+
+struct T3GenerateOptions
+{
+    float max_fov = 0.0f;                   // Maximum angle (in degrees) between stars in the same pattern.
+    float min_fov = 0.0f;                   // Minimum FOV (in degrees) considered when the catalog density is trimmed to size; if zero, same as max_fov.
+    int pattern_stars_per_fov = 10;         // Number of stars used for pattern matching in each region of size 'min_fov'.
+    int verification_stars_per_fov = 30;    // Number of stars used for verification of the solution in each region of size 'min_fov'.
+    float star_max_magnitude = 7.0f;        // Dimmest apparent magnitude of stars in database.
+    float pattern_max_error = 0.005f;       // Maximum difference allowed in pattern for a match.
+    bool simplify_pattern = false;          // If true, patterns have maximum size of FOV/2 from the first star, and are generated faster.
+    double epoch = 2000.0;                  // Julian year to which star positions are propagated using their space velocities.
+    std::string star_catalog = "";          // Name of star catalog used to generate the database, saved with database metadata.
+    uint8_t num_threads = 0;                // Number of parallel threads to run; if zero, run synchronously on current thread.
+};
+
+// Arguments to Tetra3::getCentroidsFromImage() method. Defaults are the same as in tetra3.py get_centroids_from_image(),
+// which subtracts a local mean background and thresholds at a multiple of the global root-mean-square of the result.
+// Zero disables any of the min/max limits.
+
+struct T3ExtractOptions
+{
+    float sigma = 3.0f;             // Number of noise standard deviations to threshold at.
+    float image_th = 0.0f;          // Value to threshold background-subtracted image at; if zero, computed from sigma.
+    int filtsize = 25;              // Size of local mean background filter in pixels; must be odd. If zero, subtract global mean.
+    bool binary_open = true;        // If true, apply binary opening with 3x3 cross to thresholded binary mask.
+    int min_area = 0;               // Reject spots with fewer pixels than this.
+    int max_area = 0;               // Reject spots with more pixels than this.
+    float min_sum = 0.0f;           // Reject spots with a sum smaller than this.
+    float max_sum = 0.0f;           // Reject spots with a sum larger than this.
+    float max_axis_ratio = 0.0f;    // Reject spots with a ratio of major over minor axis larger than this.
+    int max_returned = 0;           // Return at most this many spots.
+    uint8_t num_threads = 0;        // Number of parallel threads to run; if zero, run synchronously on current thread.
+};
+
 // Results of an attempt to solve a set of sources.
 // If unsuccessful in finding a match, zero is returned for all fields of this
 // struct except prob, t_solve, and t_extract
@@ -166,8 +199,8 @@ struct T3Results
 };
 
 // Contains a Tetra3 database of patterns and stars, and associated metadata.
-// Patterns can be loaded into RAM (faster), or read on-demand from file (slower).
-// Currently multi-threaded execution only works when the database is loaded into RAM!
+// Patterns can be loaded into RAM, or memory-mapped from file, so they are paged in on demand
+// and shared by all processes using the same file. Either way, patterns can be read by multiple threads at once.
 
 struct T3Database
 {
@@ -175,14 +208,22 @@ private:
     static constexpr unsigned int _MAGIC_RAND = 2654435761;
     static constexpr unsigned int _PATTERN_MULT = 2;
     
-    FILE *fp = NULL;                    // pointer to pattern file, NULL if patterns are loaded into RAM.
     std::vector<T3Star> stars;          // vector of stars
-    std::vector<T3Pattern> patterns;    // vector of patterns loaded into RAM, empty if fp is valid.
-    std::vector<uint32_t> patindex;     // 1-based index to valid patterns in patvec; zeros indicate empty patterns
-    size_t pattern_offset = 0;          // offset to first pattern in pattern file, in bytes from start of file
-    uint32_t npatterns = 0;             // number of patterns in database
+    std::vector<T3Pattern> patterns;    // vector of patterns loaded into RAM, empty if patterns are memory-mapped.
+    std::vector<uint32_t> patindex;     // 1-based index to valid patterns in patvec; zeros indicate empty patterns. Empty if memory-mapped.
+    std::shared_ptr<void> map;          // read-only memory map of pattern file, null if patterns are loaded into RAM; shared by copies of database.
+    const uint32_t *map_patindex = nullptr;     // pattern index in memory-mapped file
+    const T3Pattern *map_patterns = nullptr;    // patterns in memory-mapped file
+    uint32_t npatindex = 0;             // number of entries in memory-mapped or saved pattern index
+    uint32_t npatterns = 0;             // number of patterns in memory-mapped file or saved database
     uint32_t nstars = 0;                // number of stars in database
     bool loaded = false;                // true when database has been completely and successfully loaded.
+    SSKDTree star_tree;                 // spatial index of stars; rebuilt by indexStars() after loading or adding stars.
+    
+    uint32_t hashPattern ( T3Pattern &p );
+    void unmapPatterns ( bool copy );
+    const uint32_t *patIndex ( void ) const { return map ? map_patindex : patindex.data(); }
+    size_t patIndexSize ( void ) const { return map ? npatindex : patindex.size(); }
     
 public:
 
@@ -203,47 +244,62 @@ public:
     float range_dec[2] = { 0.0 };       // only stars within the give declination range (min_dec, max_dec) in degrees (-90 to 90)will be kept in the database.
 
     T3Database ( void ) { };
-    ~T3Database ( void ) { if ( fp ) fclose ( fp ); }
     
-    void newPatterns ( size_t max_patterns ) { patindex = std::vector<uint32_t> ( max_patterns * _PATTERN_MULT ); }
+    void newPatterns ( size_t max_patterns ) { unmapPatterns ( false ); patterns.clear(); patindex = std::vector<uint32_t> ( max_patterns * _PATTERN_MULT ); }
     void addPattern ( const T3Pattern &p );
     void addStar ( const T3Star &s ) { stars.push_back ( s ); }
     
-    size_t numPatterns ( void );
+    size_t numPatterns ( void ) const { return map ? npatterns : patterns.size(); }
     size_t numStars ( void ) { return stars.size(); }
     
-    T3Pattern getPattern ( size_t i );
-    T3Star getStar ( size_t i ) { return stars[i]; }
-    uint32_t keyToIndex(std::vector<int> key, uint32_t bin_factor);
-    std::vector<T3Pattern> getAtIndex ( uint32_t index );
+    T3Pattern getPattern ( size_t i ) const;
+    T3Star getStar ( size_t i ) const { return stars[i]; }
+    uint32_t keyToIndex ( const int *key, size_t size, uint32_t bin_factor ) const;
+    uint32_t keyToIndex ( const std::vector<int> &key, uint32_t bin_factor ) const { return keyToIndex ( key.data(), key.size(), bin_factor ); }
+    std::vector<T3Pattern> getAtIndex ( uint32_t index ) const;
+    size_t getAtIndex ( uint32_t index, std::vector<T3Pattern> &found ) const;
     void insertAtIndex ( const T3Pattern &p, uint32_t index );
 
     bool loadFromNumPy ( const std::string &path );
     void optimize ( void );
     bool loadOptimized ( const std::string &path, bool loadPatterns = false );
     bool saveOptimized ( const std::string &path );
+    bool generate ( const std::vector<SSVector> &vectors, const std::vector<float> &mags, const T3GenerateOptions &options );
+    bool generate ( SSObjectVec &objects, const T3GenerateOptions &options );
+    bool generate ( SSHTM &htm, const T3GenerateOptions &options );
     bool isLoaded ( void ) { return loaded; }
     
-    T3PatternVectors getStarPatternVectors ( const T3Pattern &pattern );
+    void indexStars ( void );
+    size_t getNearbyStars ( const SSVector &vector, double radius, size_t max_stars, std::vector<uint32_t> &indices ) const;
+
+    T3PatternVectors getStarPatternVectors ( const T3Pattern &pattern ) const;
     size_t getStarPatternVectors ( const std::vector<T3Pattern> &patterns, std::vector<T3PatternVectors> &pattern_vectors );
 };
 
 // The main Tetra3 class which contains routines for loading the database
 // and solving an image from a set of sources found in it.
+// Owns the threads used for multi-threaded solving, so it can't be copied.
 
 class Tetra3
 {
 private:
-    T3Database db;                  // The associated pattern and star database.
-        
-    std::vector<SSVector> computeVectors ( const std::vector<T3Source> &sources, float fov, float width, float height );
+    T3Database db;                          // The associated pattern and star database.
+    std::shared_ptr<SSThreadPool> pool;     // Solver threads; created on first multi-threaded solve.
+    int pool_threads = 0;                   // Number of threads in solver pool.
+    std::mutex pool_mutex;                  // Guards solver pool creation.
+    
+    std::shared_ptr<SSThreadPool> solverPool ( int num_threads );
+
+    static void computeVectors ( const T3Source *sources, size_t count, float fov, float width, float height, SSVector *vectors );
     std::vector<T3Pattern> generatePatternsFromCentroids ( const std::vector<T3Source> &sources, int pattern_size );
-    SSMatrix findRotationMatrix ( const std::vector<SSVector> &image_vectors, const std::vector<SSVector> &catalog_vectors );
-    std::vector<SSVector> getNearbyStarVectors ( const SSVector &vector, double radius, int max_stars );
+    static SSMatrix findRotationMatrix ( const SSVector *image_vectors, const SSVector *catalog_vectors, size_t count );
+    size_t getNearbyStarVectors ( const SSVector &vector, double radius, int max_stars, std::vector<uint32_t> &indices, std::vector<SSVector> &vectors ) const;
 
 public:
     
     Tetra3 ( void ) { };
+    Tetra3 ( const Tetra3 &other ) = delete;
+    Tetra3 &operator = ( const Tetra3 &other ) = delete;
     
     size_t numPatterns ( void ) { return db.numPatterns(); }
     size_t numStars ( void ) { return db.numStars(); }
@@ -251,9 +307,14 @@ public:
     bool loadDatabase ( const std::string &path ) { return db.loadFromNumPy ( path ); }
     bool loadOptimizedDatabase ( const std::string &path, bool loadPatterns = false ) { return db.loadOptimized ( path, loadPatterns ); }
     bool saveOptimizedDatabase ( const std::string &path ) { return db.saveOptimized ( path ); }
+    bool generateDatabase ( SSObjectVec &objects, const T3GenerateOptions &options ) { return db.generate ( objects, options ); }
+    bool generateDatabase ( SSHTM &htm, const T3GenerateOptions &options ) { return db.generate ( htm, options ); }
     bool databaseLoaded ( void ) { return db.isLoaded(); }
     
     bool solveFromSources ( const std::vector<T3Source> &sources, float width, float height, const T3Options &options, T3Results &results );
+    bool solveFromImage ( const void *image, int width, int height, int bits_per_pixel, size_t row_bytes, const T3ExtractOptions &extract_options, const T3Options &options, T3Results &results );
+    
+    static size_t getCentroidsFromImage ( const void *image, int width, int height, int bits_per_pixel, size_t row_bytes, const T3ExtractOptions &options, std::vector<T3Source> &sources );
 };
 
 #endif // TETRA3_HPP
@@ -29,12 +29,26 @@
 #include "SSImportTLE.hpp"
 #include "SSImportGJ.hpp"
 #include "SSImportWDS.hpp"
+#include "SSHTMStreamer.hpp"
+#include "SSHTMIndex.hpp"
+#include "SSStarField.hpp"
+#include "SSCompactStar.hpp"
+#include "SSCrossMatch.hpp"
+#include "SSHTMBinary.hpp"
 #include "SSJPLDEphemeris.hpp"
 #include "SSTLE.hpp"
 #include "SSEvent.hpp"
 #include "VSOP2013.hpp"
 #include "ELPMPP02.hpp"
 
+// The GAIA DR3 importer needs zlib and dirent.h, so it's only built into the Mac and Linux test programs.
+
+#if ( defined ( __APPLE__ ) && ! TARGET_OS_IOS ) || ( defined ( __linux__ ) && ! defined ( ANDROID ) )
+#define TEST_GAIA 1
+#include <zlib.h>
+#include "SSImportGAIADR3.hpp"
+#endif
+
 void exportCatalog ( SSObjectVec &objects )
 {
     for ( int i = 0; i < objects.size(); i++ )
@@ -309,6 +323,1041 @@ void TestDeepSky ( string inputDir, string outputDir )
     }
 }
 
+// Benchmarks HTM cone search latency for mesh depths 4 - 10, using the bright star catalog.
+// Magnitude limits are spread evenly over the catalog's range so every level holds stars.
+
+void TestHTMSearch ( string inputDir )
+{
+    SSObjectVec brightest;
+    
+    int numStars = SSImportObjectsFromCSV ( inputDir + "/Stars/Brightest.csv", brightest );
+    if ( numStars < 1 )
+    {
+        cout << "Failed to import bright stars for HTM search benchmark" << endl;
+        return;
+    }
+    
+    const int numSearches = 1000;
+    SSAngle rad = SSAngle::fromDegrees ( 5.0 );
+    
+    for ( int depth = 4; depth <= 10; depth++ )
+    {
+        vector<float> magLevels ( depth );
+        for ( int i = 0; i < depth; i++ )
+            magLevels[i] = i < depth - 1 ? 2.0 + 6.0 * i / ( depth - 1 ) : INFINITY;
+        
+        SSHTM htm ( magLevels, "" );
+        for ( int i = 0; i < brightest.size(); i++ )
+            htm.store ( SSGetStarPtr ( SSCloneObject ( brightest[i] ) ) );
+        
+        // Search circles centered on a fixed spiral of points covering the whole sky.
+        
+        size_t numFound = 0;
+        double t0 = clocksec();
+        for ( int i = 0; i < numSearches; i++ )
+        {
+            double z = 1.0 - ( 2.0 * i + 1.0 ) / numSearches;
+            double r = sqrt ( 1.0 - z * z ), lon = i * 2.399963229728653;
+            SSVector center ( r * cos ( lon ), r * sin ( lon ), z );
+            vector<SSObjectPtr> results;
+            numFound += htm.search ( 0, center, rad, results );
+        }
+        double t1 = clocksec();
+        
+        // Repeat the same searches using the convex region cover, which skips per-star tests in fully-covered regions.
+        
+        size_t numConvex = 0;
+        for ( int i = 0; i < numSearches; i++ )
+        {
+            double z = 1.0 - ( 2.0 * i + 1.0 ) / numSearches;
+            double r = sqrt ( 1.0 - z * z ), lon = i * 2.399963229728653;
+            vector<SSObjectPtr> results;
+            numConvex += htm.search ( SSHTM::circleConvex ( SSVector ( r * cos ( lon ), r * sin ( lon ), z ), rad ), results );
+        }
+        double t2 = clocksec();
+        
+        cout << format ( "HTM depth %2d: %d searches, %.1f stars/search, %.2f microsec/search, convex %.2f microsec/search%s", depth, numSearches, (double) numFound / numSearches, ( t1 - t0 ) * 1.0e6 / numSearches, ( t2 - t1 ) * 1.0e6 / numSearches, numConvex == numFound ? "" : " MISMATCH" ) << endl;
+    }
+    
+    // Cover a 20 x 15 degree gnomonic view with HTM triangles at several levels.
+    
+    SSView view ( kGnomonic, SSAngle::fromDegrees ( 20.0 ), 800, 600, 400, 300 );
+    view.setCenter ( SSAngle::fromDegrees ( 83.8 ), SSAngle::fromDegrees ( -5.4 ), 0.0 );
+    SSHTM::Convex convex = SSHTM::viewConvex ( view );
+    
+    for ( int level = 4; level <= 10; level += 2 )
+    {
+        SSHTM htm;
+        vector<SSHTM::IDRange> ranges;
+        vector<uint64_t> fullIDs, partialIDs;
+        
+        double t0 = clocksec();
+        htm.cover ( convex, level, ranges );
+        double t1 = clocksec();
+        htm.cover ( convex, level, fullIDs, partialIDs );
+        
+        cout << format ( "HTM view cover level %2d: %zu ranges, %zu full, %zu partial triangles, %.2f microsec", level, ranges.size(), fullIDs.size(), partialIDs.size(), ( t1 - t0 ) * 1.0e6 ) << endl;
+    }
+    
+    // Bounding caps should exist for valid trixel IDs only, both in and beyond the cached range.
+    
+    SSHTM::Cap cap;
+    int badCaps = 0;
+    for ( uint64_t id : { 8ULL, 15ULL, 32ULL, 63ULL, 1ULL << 23, ( 1ULL << 24 ) - 1 } )
+        badCaps += ! SSHTM::getCap ( id, cap );
+    for ( uint64_t id : { 1ULL, 7ULL, 16ULL, 31ULL, 64ULL, 127ULL, 1ULL << 22 } )
+        badCaps += SSHTM::getCap ( id, cap );
+    cout << format ( "HTM bounding caps: %d wrong for valid and invalid IDs", badCaps ) << endl;
+}
+
+// Simulates a 4-second, 60 fps pan once around the sky through a region-streamed HTM saved in the output directory,
+// with a memory budget, and reports per-frame streaming cost, loading backlog, and memory usage.
+
+void TestHTMStreaming ( string inputDir, string outputDir )
+{
+    SSObjectVec brightest;
+    
+    int numStars = SSImportObjectsFromCSV ( inputDir + "/Stars/Brightest.csv", brightest );
+    if ( numStars < 1 || outputDir.empty() )
+        return;
+    
+    vector<float> magLevels = { 3.0, 4.0, 5.0, 6.0, 7.0, INFINITY };
+    string htmdir = outputDir + "/HTMStream/";
+    mkdir_p ( htmdir.c_str(), 0777 );
+    
+    SSHTM source ( magLevels, htmdir );
+    for ( int i = 0; i < brightest.size(); i++ )
+        source.store ( SSGetStarPtr ( SSCloneObject ( brightest[i] ) ) );
+    source.saveRegions();
+    
+    SSHTM htm ( magLevels, htmdir );
+    htm.setMemoryBudget ( 768 << 10 );
+    SSHTMStreamer streamer ( &htm );
+    
+    SSView view ( kGnomonic, SSAngle::fromDegrees ( 30.0 ), 800, 600, 400, 300 );
+    const int numFrames = 240;
+    double start = clocksec();
+    double maxUpdate = 0.0, sumUpdate = 0.0;
+    size_t numFound = 0;
+    int framesPending = 0;
+    
+    for ( int frame = 0; frame < numFrames; frame++ )
+    {
+        view.setCenter ( SSAngle ( SSAngle::kTwoPi * frame / numFrames ), SSAngle::fromDegrees ( 20.0 ), 0.0 );
+        
+        double t0 = clocksec();
+        if ( streamer.update ( view, 6.5 ) > 0 )
+            framesPending++;
+        
+        vector<SSObjectPtr> results;
+        numFound += streamer.search ( results );
+        double t1 = clocksec() - t0;
+        
+        sumUpdate += t1;
+        maxUpdate = max ( maxUpdate, t1 );
+        
+        double wait = start + ( frame + 1 ) / 60.0 - clocksec();
+        if ( wait > 0.0 )
+            msleep ( wait * 1000.0 );
+    }
+    
+    htm.waitLoads();
+    cout << format ( "HTM streaming: %d frames, %.1f stars/frame, %.3f ms/frame mean, %.3f ms max, %d frames waiting for regions", numFrames, (double) numFound / numFrames, sumUpdate * 1000.0 / numFrames, maxUpdate * 1000.0, framesPending ) << endl;
+    cout << format ( "HTM streaming: %d regions loaded, %.1f KB used of %.1f KB budget, %llu evictions", htm.countRegions(), htm.getMemoryUsage() / 1024.0, htm.getMemoryBudget() / 1024.0, (unsigned long long) htm.getEvictions() ) << endl;
+}
+
+// Returns a pseudo-random unit vector; successive calls with the same (seed) variable give a repeatable sequence.
+
+SSVector RandomUnitVector ( uint64_t &seed )
+{
+    double xyz[3];
+    for ( int i = 0; i < 3; i++ )
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        xyz[i] = ( seed >> 11 ) * ( 2.0 / 9007199254740992.0 ) - 1.0;
+    }
+    
+    return SSVector ( xyz[0], xyz[1], xyz[2] ).normalize();
+}
+
+// Appends (numCopies) copies of each star in (stars) to (copies). The first copy of each star is exact;
+// later copies are moved in a random direction by up to 0.05 radians, and copy (c) is made (c * magStep)
+// magnitudes fainter. Successive calls with the same (seed) variable give a repeatable sequence.
+
+void AppendStarCopies ( SSObjectVec &stars, size_t numCopies, double magStep, uint64_t &seed, SSObjectVec &copies )
+{
+    for ( size_t c = 0; c < numCopies; c++ )
+    {
+        for ( size_t i = 0; i < stars.size(); i++ )
+        {
+            SSStarPtr pStar = SSGetStarPtr ( SSCloneObject ( stars[i] ) );
+            if ( pStar == nullptr )
+                continue;
+            
+            if ( c > 0 )
+            {
+                pStar->setFundamentalPosition ( ( pStar->getFundamentalPosition() + RandomUnitVector ( seed ) * 0.05 ).normalize() );
+                pStar->setVMagnitude ( pStar->getVMagnitude() + c * magStep );
+            }
+            
+            copies.append ( pStar );
+        }
+    }
+}
+
+// Stores about 50,000 stars (jittered copies of the bright stars) in one HTM one star at a time, and in
+// another with the bulk store; checks that both HTMs have identical regions. Then checks that saving
+// the bulk-built HTM's regions to CSV files on one thread and on all hardware threads writes every star.
+
+void TestHTMBuild ( string inputDir, string outputDir )
+{
+    SSObjectVec brightest;
+    
+    int numStars = SSImportObjectsFromCSV ( inputDir + "/Stars/Brightest.csv", brightest );
+    if ( numStars < 1 || outputDir.empty() )
+        return;
+    
+    uint64_t seed = 3;
+    SSObjectVec stars;
+    AppendStarCopies ( brightest, 50000 / numStars, 0.01, seed, stars );
+    
+    vector<float> magLevels = { 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, INFINITY };
+    string htmdir = outputDir + "/HTMBuild/";
+    mkdir_p ( htmdir.c_str(), 0777 );
+    SSHTM single ( magLevels, htmdir ), bulk ( magLevels, htmdir );
+    
+    int numSingle = 0;
+    for ( int i = 0; i < stars.size(); i++ )
+        numSingle += single.store ( SSGetStarPtr ( stars[i] ) );
+    int numBulk = bulk.store ( stars );
+    
+    // Both HTMs must contain the same star pointers in the same regions, in the same order.
+    
+    bool same = numSingle == numBulk && numBulk == stars.size() && single.countRegions() == bulk.countRegions() && single.getMemoryUsage() == bulk.getMemoryUsage();
+    for ( int level = 0; same && level < magLevels.size(); level++ )
+    {
+        uint64_t first = level == 0 ? 0 : 8ULL << ( 2 * ( level - 1 ) );
+        uint64_t count = level == 0 ? 1 : 8ULL << ( 2 * ( level - 1 ) );
+        for ( uint64_t htmID = first; same && htmID < first + count; htmID++ )
+        {
+            SSObjectVec *pSingle = single.getObjects ( htmID ), *pBulk = bulk.getObjects ( htmID );
+            same = ( pSingle == nullptr ) == ( pBulk == nullptr );
+            for ( size_t i = 0; same && pSingle && i < pSingle->size(); i++ )
+                same = pSingle->size() == pBulk->size() && pSingle->get ( i ) == pBulk->get ( i );
+        }
+    }
+    
+    int numSaved1 = bulk.saveRegions ( nullptr, 1 );
+    int numSaved = bulk.saveRegions ( nullptr, 0 );
+    
+    cout << format ( "HTM build: %d stars in %d regions, one at a time and bulk %s", numBulk, bulk.countRegions(), same ? "identical" : "DIFFERENT" ) << endl;
+    cout << format ( "HTM build: saved %d stars on 1 thread, %d on all threads, %s", numSaved1, numSaved, numSaved1 == numBulk && numSaved == numBulk ? "OK" : "FAILED" ) << endl;
+    
+    // Both HTMs share the stars, which the stars array also owns; don't let the HTMs delete them.
+    
+    single.clearRegions();
+    bulk.clearRegions();
+}
+
+// Saves the bright stars into an HTM directory as CSV region files, adds a planet to one region,
+// and converts the regions to binary files. Checks that only the region holding the planet is skipped,
+// then reads every other region back from its binary file and compares each star's fields with the original.
+
+void TestHTMBinary ( string inputDir, string outputDir )
+{
+    SSObjectVec brightest, planets;
+    
+    int numStars = SSImportObjectsFromCSV ( inputDir + "/Stars/Brightest.csv", brightest );
+    int numPlanets = SSImportObjectsFromCSV ( inputDir + "/SolarSystem/Planets.csv", planets );
+    if ( numStars < 1 || numPlanets < 1 || outputDir.empty() )
+        return;
+    
+    vector<float> magLevels = { 3.0, 4.0, 5.0, 6.0, INFINITY };
+    string htmdir = outputDir + "/HTMBinary/";
+    mkdir_p ( htmdir.c_str(), 0777 );
+    
+    SSHTM source ( magLevels, htmdir );
+    for ( int i = 0; i < brightest.size(); i++ )
+        source.store ( SSGetStarPtr ( SSCloneObject ( brightest[i] ) ) );
+    source.saveRegions();
+    
+    vector<uint64_t> htmIDs;
+    for ( int level = 0; level < magLevels.size(); level++ )
+    {
+        uint64_t first = level == 0 ? 0 : 8ULL << ( 2 * ( level - 1 ) );
+        uint64_t count = level == 0 ? 1 : 8ULL << ( 2 * ( level - 1 ) );
+        for ( uint64_t htmID = first; htmID < first + count; htmID++ )
+            if ( source.getObjects ( htmID ) != nullptr )
+                htmIDs.push_back ( htmID );
+    }
+    
+    // Rewrite the last region's CSV file with a planet appended; that region can't be converted.
+    
+    uint64_t planetID = htmIDs.back();
+    SSObjectVec *pPlanetRegion = source.getObjects ( planetID );
+    pPlanetRegion->append ( planets[0] );
+    SSExportObjectsToCSV ( htmdir + source.ID2name ( planetID ) + ".csv", *pPlanetRegion );
+    pPlanetRegion->remove ( pPlanetRegion->size() - 1 );
+    remove ( ( htmdir + source.ID2name ( planetID ) + ".bin" ).c_str() );
+    
+    vector<string> skipped;
+    int numConverted = SSConvertHTMRegionsToBinary ( htmdir, false, &skipped );
+    bool ok = numConverted == htmIDs.size() - 1 && skipped.size() == 1 && skipped[0] == source.ID2name ( planetID ) + ".csv";
+    
+    // Read converted regions back from binary files and compare all stars' fields.
+    
+    SSHTM binary ( magLevels, htmdir );
+    binary.setDataFileReadFunc ( SSHTMReadBinaryRegion );
+    
+    int numCompared = 0, numDiffs = 0;
+    for ( uint64_t htmID : htmIDs )
+    {
+        SSObjectVec *pOriginal = source.getObjects ( htmID );
+        SSObjectVec *pRead = binary.loadRegion ( htmID, true );
+        if ( htmID == planetID )
+        {
+            ok = ok && pRead == nullptr && ! binary.regionEmpty ( htmID );
+            continue;
+        }
+        
+        if ( pRead == nullptr || pRead->size() != pOriginal->size() )
+        {
+            numDiffs++;
+            continue;
+        }
+        
+        for ( size_t i = 0; i < pRead->size(); i++, numCompared++ )
+            if ( pRead->get ( i )->getType() != pOriginal->get ( i )->getType() || pRead->get ( i )->toCSV() != pOriginal->get ( i )->toCSV() )
+                numDiffs++;
+    }
+    
+    ok = ok && numCompared == numStars - pPlanetRegion->size() && numDiffs == 0;
+    cout << format ( "HTM binary: converted %d of %d regions, skipped %s; %d stars read back, %d differences, %s", numConverted, (int) htmIDs.size(), skipped.empty() ? "none" : skipped[0].c_str(), numCompared, numDiffs, ok ? "OK" : "FAILED" ) << endl;
+}
+
+// Returns object locations sorted by region, then offset, so results of different name indexes can be compared.
+
+vector<pair<uint64_t,size_t>> SortedLocs ( const vector<SSHTM::ObjectLoc> &locs )
+{
+    vector<pair<uint64_t,size_t>> sorted;
+    for ( const SSHTM::ObjectLoc &loc : locs )
+        sorted.push_back ( { loc.region, loc.offset } );
+    std::sort ( sorted.begin(), sorted.end() );
+    return sorted;
+}
+
+// Saves the bright stars into an HTM directory; builds a flat name index and a flat HIP identifier index
+// from the region files without loading the HTM, and compares exact, case-insensitive, and prefix lookups
+// with the original name and identifier maps of the fully-loaded HTM. Then saves the flat name index,
+// memory-maps it into another HTM, and checks that lookups and autocompletion still agree.
+
+void TestHTMIndex ( string inputDir, string outputDir )
+{
+    SSObjectVec brightest;
+    
+    int numStars = SSImportObjectsFromCSV ( inputDir + "/Stars/Brightest.csv", brightest );
+    if ( numStars < 1 || outputDir.empty() )
+        return;
+    
+    vector<float> magLevels = { 3.0, 4.0, 5.0, 6.0, 7.0, INFINITY };
+    string htmdir = outputDir + "/HTMIndex/";
+    mkdir_p ( ( htmdir + "index/" ).c_str(), 0777 );
+    
+    SSHTM source ( magLevels, htmdir );
+    for ( int i = 0; i < brightest.size(); i++ )
+        source.store ( SSGetStarPtr ( SSCloneObject ( brightest[i] ) ) );
+    source.saveRegions();
+    source.makeObjectMap ( kCatUnknown );
+    source.makeObjectMap ( kCatHIP );
+    
+    SSHTM htm ( magLevels, htmdir );
+    double t0 = clocksec();
+    size_t numNames = htm.makeObjectIndex ( kCatUnknown );
+    size_t numHIP = htm.makeObjectIndex ( kCatHIP );
+    double t1 = clocksec();
+    
+    // Look up every name exactly, in lower case ignoring case, and by its first three characters.
+    
+    vector<string> names;
+    for ( int i = 0; i < brightest.size(); i++ )
+        for ( const string &name : brightest[i]->getNames() )
+            names.push_back ( name );
+    
+    int numDiffs = 0;
+    double mapTime = 0.0, indexTime = 0.0;
+    for ( int pass = 0; pass < 3; pass++ )
+    {
+        for ( const string &name : names )
+        {
+            string key = pass == 0 ? name : pass == 1 ? toLower ( name ) : name.substr ( 0, 3 );
+            vector<SSHTM::ObjectLoc> mapLocs, indexLocs;
+            double t2 = clocksec();
+            source.findObjectLocs ( key, mapLocs, pass == 0, pass == 2 );
+            double t3 = clocksec();
+            htm.findObjectLocs ( key, indexLocs, pass == 0, pass == 2 );
+            double t4 = clocksec();
+            mapTime += t3 - t2;
+            indexTime += t4 - t3;
+            if ( SortedLocs ( mapLocs ) != SortedLocs ( indexLocs ) )
+                numDiffs++;
+        }
+    }
+    
+    for ( int i = 0; i < brightest.size(); i++ )
+    {
+        SSIdentifier hip = SSGetStarPtr ( brightest[i] )->getIdentifier ( kCatHIP );
+        vector<SSHTM::ObjectLoc> mapLocs, indexLocs;
+        source.findObjectLocs ( hip, mapLocs );
+        htm.findObjectLocs ( hip, indexLocs );
+        if ( SortedLocs ( mapLocs ) != SortedLocs ( indexLocs ) )
+            numDiffs++;
+    }
+    
+    cout << format ( "HTM index: %zu names, %zu HIP identifiers indexed from files in %.1f ms; %d lookup differences", numNames, numHIP, ( t1 - t0 ) * 1000.0, numDiffs ) << endl;
+    cout << format ( "HTM index: %zu name lookups, map %.2f microsec/lookup, flat index %.2f microsec/lookup", names.size() * 3, mapTime * 1.0e6 / ( names.size() * 3 ), indexTime * 1.0e6 / ( names.size() * 3 ) ) << endl;
+    
+    // Save the flat name index, memory-map it into a third HTM, and repeat the case-insensitive prefix lookups.
+    
+    htm.saveObjectIndex ( kCatUnknown );
+    SSHTM mapped ( magLevels, htmdir );
+    t0 = clocksec();
+    size_t numMapped = mapped.loadObjectIndex ( kCatUnknown );
+    t1 = clocksec();
+    
+    numDiffs = 0;
+    for ( const string &name : names )
+    {
+        vector<SSHTM::ObjectLoc> locs1, locs2;
+        htm.findObjectLocs ( name.substr ( 0, 3 ), locs1, false, true );
+        mapped.findObjectLocs ( name.substr ( 0, 3 ), locs2, false, true );
+        if ( SortedLocs ( locs1 ) != SortedLocs ( locs2 ) )
+            numDiffs++;
+    }
+    
+    vector<string> completions;
+    mapped.completeNames ( "alp", completions, 5 );
+    cout << format ( "HTM index: %zu names memory-mapped in %.3f ms; %d lookup differences; \"alp\" completes to ", numMapped, ( t1 - t0 ) * 1000.0, numDiffs );
+    for ( int i = 0; i < completions.size(); i++ )
+        cout << ( i > 0 ? ", " : "" ) << completions[i];
+    cout << endl;
+}
+
+// Compares apparent places of bright stars computed by SSStarField against SSStar::computeEphemeris(),
+// then times SSStarField for a Tycho-2-sized field made of repeated copies of the bright stars.
+
+void TestStarField ( string inputDir )
+{
+    SSObjectVec brightest;
+    
+    int numStars = SSImportObjectsFromCSV ( inputDir + "/Stars/Brightest.csv", brightest );
+    if ( numStars < 1 )
+        return;
+    
+    SSSpherical here = { SSAngle ( SSDegMinSec ( '-', 122, 25, 09.9 ) ), SSAngle ( SSDegMinSec ( '+', 37, 46, 29.7 ) ), 0.026 };
+    SSCoordinates coords ( SSTime ( SSDate ( kGregorian, 0.0, 2020, 4, 15.0, 0, 0, 0.0 ) ), here );
+    
+    SSStarField field;
+    field.add ( brightest );
+    
+    double t0 = clocksec();
+    for ( int i = 0; i < brightest.size(); i++ )
+        brightest[i]->computeEphemeris ( coords );
+    double t1 = clocksec();
+    field.compute ( coords );
+    double t2 = clocksec();
+    
+    double maxSep = 0.0, maxMag = 0.0;
+    for ( size_t i = 0; i < field.size(); i++ )
+    {
+        SSObjectPtr pObj = field.getObject ( i );
+        maxSep = max ( maxSep, (double) pObj->getDirection().angularSeparation ( field.getDirection ( i ).normalize() ) );
+        if ( ! isinf ( pObj->getMagnitude() ) )
+            maxMag = max ( maxMag, (double) fabs ( pObj->getMagnitude() - field.getMagnitude ( i ) ) );
+    }
+    
+    cout << format ( "Star field: %zu stars, max difference %.4f arcsec, %.5f mag", field.size(), maxSep * SSAngle::kArcsecPerRad, maxMag ) << endl;
+    cout << format ( "Star field: computeEphemeris %.1f ns/star, SSStarField %.1f ns/star", ( t1 - t0 ) * 1.0e9 / brightest.size(), ( t2 - t1 ) * 1.0e9 / field.size() ) << endl;
+    
+    // Build a field of about 2.5 million stars, then time one frame with one thread and with all threads.
+    
+    size_t numCopies = 2500000 / field.size();
+    field.reserve ( field.size() * numCopies );
+    for ( size_t i = 1; i < numCopies; i++ )
+        field.add ( brightest );
+    
+    field.setThreads ( 1 );
+    field.compute ( coords );
+    t0 = clocksec();
+    field.compute ( coords );
+    t1 = clocksec();
+    
+    field.setThreads ( 0 );
+    field.compute ( coords );
+    t2 = clocksec();
+    field.compute ( coords );
+    double t3 = clocksec();
+    
+    cout << format ( "Star field: %zu stars, %.1f MB, 1 thread %.2f ms/frame, all threads %.2f ms/frame", field.size(), field.memoryUsage() / 1048576.0, ( t1 - t0 ) * 1000.0, ( t3 - t2 ) * 1000.0 ) << endl;
+}
+
+// Compares memory used per star by SSStar objects and by SSCompactStarArray, first for the bright stars,
+// then for a tree of 16 regions, each holding unnamed copies of the bright stars with Tycho identifiers;
+// also checks that compact stars convert back to identical objects.
+
+void TestCompactStars ( string inputDir )
+{
+    SSObjectVec brightest;
+    
+    int numStars = SSImportObjectsFromCSV ( inputDir + "/Stars/Brightest.csv", brightest );
+    if ( numStars < 1 )
+        return;
+    
+    SSStringPool pool;
+    SSCompactStarArray compact ( &pool );
+    compact.add ( brightest );
+    compact.shrink();
+    
+    int numDiffs = 0;
+    for ( size_t i = 0; i < compact.size(); i++ )
+    {
+        SSObjectPtr pObj = compact.getObject ( i );
+        if ( pObj == nullptr || pObj->toCSV() != brightest[i]->toCSV() )
+            numDiffs++;
+        delete pObj;
+    }
+    
+    size_t fatBytes = brightest.memoryUsage(), compactBytes = compact.memoryUsage() + pool.memoryUsage();
+    cout << format ( "Compact stars: %zu stars, %d round-trip differences, %zu strings pooled", compact.size(), numDiffs, pool.size() ) << endl;
+    cout << format ( "Compact stars: SSStar %.1f bytes/star, compact %.1f bytes/star", (double) fatBytes / numStars, (double) compactBytes / numStars ) << endl;
+    
+    // Build the tree one region at a time, deleting each region's SSStar copies after measuring them
+    // and checking that their compact versions convert back to identical objects.
+    
+    const int numRegions = 16;
+    uint64_t tycNum = 1, seed = 4;
+    
+    SSStringPool tycPool;
+    vector<SSCompactStarArray *> regions;
+    fatBytes = 0;
+    numDiffs = 0;
+    
+    for ( int r = 0; r < numRegions; r++ )
+    {
+        SSObjectVec objects;
+        AppendStarCopies ( brightest, 1, 0.0, seed, objects );
+        for ( size_t i = 0; i < objects.size(); i++ )
+        {
+            objects[i]->setNames ( vector<string>() );
+            SSGetStarPtr ( objects[i] )->setIdentifiers ( vector<SSIdentifier> ( 1, SSIdentifier ( kCatTYC, tycNum++ ) ) );
+        }
+        
+        fatBytes += objects.memoryUsage();
+        SSCompactStarArray *pRegion = new SSCompactStarArray ( &tycPool );
+        pRegion->add ( objects );
+        pRegion->shrink();
+        regions.push_back ( pRegion );
+        
+        for ( size_t i = 0; i < pRegion->size(); i++ )
+        {
+            SSObjectPtr pObj = pRegion->getObject ( i );
+            if ( pObj == nullptr || pObj->toCSV() != objects[i]->toCSV() )
+                numDiffs++;
+            delete pObj;
+        }
+    }
+    
+    size_t numTycho = 0;
+    compactBytes = tycPool.memoryUsage();
+    for ( SSCompactStarArray *pRegion : regions )
+    {
+        numTycho += pRegion->size();
+        compactBytes += pRegion->memoryUsage();
+        delete pRegion;
+    }
+    
+    cout << format ( "Compact stars: %zu stars in %d regions, %d round-trip differences, SSStar %.1f bytes/star, compact %.1f bytes/star", numTycho, numRegions, numDiffs, (double) fatBytes / numTycho, (double) compactBytes / numTycho ) << endl;
+}
+
+// Times loading and dumping a region of bright stars from a binary region file, with objects allocated
+// from the heap and from the region's own arena, on one thread and on four concurrent loader threads.
+
+void TestObjectArena ( string inputDir, string outputDir )
+{
+    SSObjectVec brightest;
+    
+    int numStars = SSImportObjectsFromCSV ( inputDir + "/Stars/Brightest.csv", brightest );
+    if ( numStars < 1 || outputDir.empty() )
+        return;
+    
+    string path = outputDir + "/ArenaTest.bin";
+    if ( SSExportObjectsToBinary ( path, brightest ) != numStars )
+        return;
+    
+    const int numLoads = 40;
+    
+    for ( int numThreads : { 1, 4 } )
+    {
+        for ( bool useArena : { false, true } )
+        {
+            vector<double> loadTime ( numThreads ), dumpTime ( numThreads );
+            SSThreadPool pool ( numThreads );
+            
+            double t0 = clocksec();
+            for ( int t = 0; t < numThreads; t++ )
+            {
+                pool.submit ( [&, t] ()
+                {
+                    for ( int i = 0; i < numLoads; i++ )
+                    {
+                        double t1 = clocksec();
+                        SSObjectVec *pObjects = new SSObjectVec ( useArena );
+                        {
+                            SSObjectArenaScope scope ( pObjects->getArena() );
+                            SSImportObjectsFromBinary ( path, *pObjects );
+                        }
+                        double t2 = clocksec();
+                        delete pObjects;
+                        double t3 = clocksec();
+                        loadTime[t] += t2 - t1;
+                        dumpTime[t] += t3 - t2;
+                    }
+                } );
+            }
+            pool.wait();
+            double elapsed = clocksec() - t0;
+            
+            double load = 0.0, dump = 0.0;
+            for ( int t = 0; t < numThreads; t++ )
+            {
+                load += loadTime[t];
+                dump += dumpTime[t];
+            }
+            
+            int numRegions = numThreads * numLoads;
+            cout << format ( "Object arena: %s, %d thread%s, %d-star region load %.2f ms, dump %.2f ms, %.0f regions/sec", useArena ? "arena" : "heap ", numThreads, numThreads > 1 ? "s" : " ", numStars, load * 1000.0 / numRegions, dump * 1000.0 / numRegions, numRegions / elapsed ) << endl;
+        }
+    }
+    
+    // An object detached from an arena-backed array must be a heap copy which outlives the array.
+    
+    SSObjectVec *pObjects = new SSObjectVec ( true );
+    {
+        SSObjectArenaScope scope ( pObjects->getArena() );
+        SSImportObjectsFromBinary ( path, *pObjects );
+    }
+    
+    string ident = pObjects->get ( 0 )->getIdentifier ( 0 ).toString();
+    bool fromArena = pObjects->get ( 0 )->getArena() == pObjects->getArena();
+    SSObjectPtr pDetached = pObjects->detach ( 0 );
+    size_t numLeft = pObjects->size();
+    delete pObjects;
+    
+    bool ok = fromArena && pDetached && pDetached->getArena() == nullptr && pDetached->getIdentifier ( 0 ).toString() == ident && numLeft == numStars - 1;
+    cout << format ( "Object arena: detached %s from arena-backed array, %s", ident.c_str(), ok ? "heap copy OK" : "FAILED" ) << endl;
+    delete pDetached;
+    
+    remove ( path.c_str() );
+}
+
+// Compares cone searches, nearest-neighbor searches, and erasures in an array of about 50,000 stars
+// (jittered copies of the bright stars) with and without a spatial index; checks that both give
+// identical results.
+
+void TestObjectIndex ( string inputDir )
+{
+    SSObjectVec brightest;
+    
+    int numStars = SSImportObjectsFromCSV ( inputDir + "/Stars/Brightest.csv", brightest );
+    if ( numStars < 1 )
+        return;
+    
+    uint64_t seed = 1;
+    SSObjectVec stars;
+    AppendStarCopies ( brightest, 50000 / numStars, 0.0, seed, stars );
+    
+    // Cone searches of 1 degree radius, then nearest-neighbor searches within 1 degree,
+    // at random points, first linearly, then with the index.
+    
+    const int numSearches = 200;
+    SSAngle radius = SSAngle::fromDegrees ( 1.0 );
+    vector<SSVector> centers;
+    for ( int i = 0; i < numSearches; i++ )
+        centers.push_back ( RandomUnitVector ( seed ) );
+    
+    vector<size_t> linearResults, indexResults;
+    vector<int> linearNearest, indexNearest;
+    
+    for ( SSVector &center : centers )
+        stars.search ( center, radius, linearResults );
+    for ( SSVector &center : centers )
+        linearNearest.push_back ( stars.nearest ( center, radius ) );
+    stars.setIndexed ( true );
+    for ( SSVector &center : centers )
+        stars.search ( center, radius, indexResults );
+    for ( SSVector &center : centers )
+        indexNearest.push_back ( stars.nearest ( center, radius ) );
+    
+    cout << format ( "Object index: %zu stars, %zu stars found by %d cone searches, %s", stars.size(), indexResults.size(), numSearches, ! indexResults.empty() && linearResults == indexResults ? "identical" : "DIFFERENT" ) << endl;
+    cout << format ( "Object index: %d nearest star searches, %s", numSearches, linearNearest == indexNearest ? "identical" : "DIFFERENT" ) << endl;
+    
+    // Erase stars within 1 arcminute of the first 200 bright stars, one star at a time without an index,
+    // then all at once with a temporary index; check that the same stars remain.
+    
+    SSObjectVec others, copy;
+    for ( int i = 0; i < numStars && i < 200; i++ )
+        others.append ( SSCloneObject ( brightest[i] ) );
+    
+    stars.setIndexed ( false );
+    for ( size_t i = 0; i < stars.size(); i++ )
+        copy.append ( SSCloneObject ( stars[i] ) );
+    
+    radius = SSAngle::fromArcmin ( 1.0 );
+    int linearErased = 0;
+    for ( size_t i = 0; i < others.size(); i++ )
+        linearErased += stars.erase ( SSGetStarPtr ( others[i] )->getFundamentalPosition(), radius );
+    int indexErased = copy.erase ( others, radius );
+    
+    bool same = linearErased == indexErased && indexErased >= others.size() && stars.size() == copy.size();
+    for ( size_t i = 0; same && i < stars.size(); i++ )
+        same = SSGetStarPtr ( stars[i] )->getFundamentalPosition() == SSGetStarPtr ( copy[i] )->getFundamentalPosition();
+    
+    cout << format ( "Object index: erased %d stars near %zu stars %s", indexErased, others.size(), same ? "identically" : "DIFFERENTLY" ) << endl;
+}
+
+// Cross-matches about 50,000 stars (jittered copies of the bright stars) at epoch J2000 against the same
+// stars, in reverse order, propagated to epoch 2016 with 0.1 arcsec of noise; checks that matching with
+// propagation pairs every star correctly, and that one thread and all hardware threads agree.
+
+void TestCrossMatch ( string inputDir )
+{
+    SSObjectVec brightest;
+    
+    int numStars = SSImportObjectsFromCSV ( inputDir + "/Stars/Brightest.csv", brightest );
+    if ( numStars < 1 )
+        return;
+    
+    uint64_t seed = 2;
+    SSObjectVec stars1, stars2;
+    AppendStarCopies ( brightest, 50000 / numStars, 0.0, seed, stars1 );
+    
+    for ( size_t i = stars1.size(); i > 0; i-- )
+    {
+        SSStarPtr pStar = SSGetStarPtr ( SSCloneObject ( stars1[i - 1] ) );
+        SSVector pos = SSPropagatePosition ( pStar, 16.0 );
+        pStar->setFundamentalPosition ( ( pos + RandomUnitVector ( seed ) * SSAngle::fromArcsec ( 0.1 ) ).normalize() );
+        stars2.append ( pStar );
+    }
+    
+    SSAngle radius = SSAngle::fromArcsec ( 1.0 );
+    for ( double epoch1 : { 2016.0, 2000.0 } )
+    {
+        vector<pair<size_t,size_t>> pairs[2];
+        size_t numCorrect = 0;
+        for ( int t = 0; t < 2; t++ )
+        {
+            SSCrossMatchVec matches;
+            SSCrossMatchStars ( stars1, epoch1, stars2, 2016.0, radius, kMatchBest, matches, 1.0, t == 0 ? 1 : 0 );
+            
+            numCorrect = 0;
+            for ( SSCrossMatch &match : matches )
+            {
+                pairs[t].push_back ( { match.index1, match.index2 } );
+                if ( match.index2 == stars1.size() - 1 - match.index1 )
+                    numCorrect++;
+            }
+        }
+        
+        bool ok = pairs[0] == pairs[1] && ( epoch1 == 2016.0 || numCorrect == stars1.size() );
+        cout << format ( "Cross match: %zu x %zu stars, %s, %zu matches, %zu correct, %s", stars1.size(), stars2.size(), epoch1 == 2016.0 ? "no propagation" : "propagated 16 years", pairs[1].size(), numCorrect, ok ? "OK" : "FAILED" ) << endl;
+    }
+}
+
+#if TEST_GAIA
+
+// Writes a gzipped GAIA DR3 source file at (path): a header line, which the importer skips, then (count)
+// synthetic sources with consecutive identifiers starting at (firstID), in the 152-field CSV source format.
+
+bool WriteGAIASourceFile ( const string &path, uint64_t firstID, int count )
+{
+    gzFile fp = gzopen ( path.c_str(), "wb" );
+    if ( fp == NULL )
+        return false;
+    
+    gzputs ( fp, "solution_id,designation,source_id,random_index,ref_epoch,ra,ra_error,dec,dec_error,parallax,parallax_error\n" );
+    for ( int i = 0; i < count; i++ )
+    {
+        uint64_t id = firstID + i;
+        vector<string> fields ( 152 );
+        fields[0] = "1636148068921376768";
+        fields[2] = to_string ( id );
+        fields[4] = "2016.0";
+        fields[5] = format ( "%.9f", ( id * 7919 % 360000 ) / 1000.0 );
+        fields[6] = "0.05";
+        fields[7] = format ( "%.9f", ( id * 104729 % 180000 ) / 1000.0 - 90.0 );
+        fields[8] = "0.04";
+        fields[9] = format ( "%.4f", ( id % 1000 ) / 100.0 );
+        fields[10] = "0.02";
+        fields[13] = format ( "%.3f", ( id % 200 ) - 100.0 );
+        fields[14] = "0.03";
+        fields[15] = format ( "%.3f", ( id % 300 ) - 150.0 );
+        fields[16] = "0.03";
+        fields[64] = "False";
+        fields[69] = format ( "%.4f", 6.0 + ( id % 1500 ) / 100.0 );
+        fields[74] = format ( "%.4f", 6.5 + ( id % 1500 ) / 100.0 );
+        fields[79] = format ( "%.4f", 5.5 + ( id % 1500 ) / 100.0 );
+        fields[111] = "NOT_AVAILABLE";
+        fields[130] = format ( "%d", 3000 + (int) ( id % 7000 ) );
+        
+        string line = fields[0];
+        for ( int f = 1; f < fields.size(); f++ )
+            line += "," + fields[f];
+        gzputs ( fp, ( line + "\n" ).c_str() );
+    }
+    
+    return gzclose ( fp ) == Z_OK;
+}
+
+// Exports a directory of synthetic GAIA DR3 source files on one thread and on four, and checks that both
+// "essentials" files are byte-identical, that every source was exported, and that where a cross-match
+// table had several records for one source, the exported star has the identifier from the last of them.
+
+void TestGAIAExport ( string outputDir )
+{
+    if ( outputDir.empty() )
+        return;
+    
+    string gaiadir = outputDir + "/GAIA/";
+    mkdir_p ( gaiadir.c_str(), 0777 );
+    
+    const int numFiles = 8, numPerFile = 500;
+    for ( int f = 0; f < numFiles; f++ )
+        if ( ! WriteGAIASourceFile ( gaiadir + format ( "GaiaSource_%06d-%06d.csv.gz", f * numPerFile, ( f + 1 ) * numPerFile - 1 ), f * 1000 + 1, numPerFile ) )
+            return;
+    
+    SSGAIACrossMatch hipCM, tycCM;
+    hipCM.add ( { 1001, 11 } );
+    hipCM.add ( { 2001, 33 } );
+    hipCM.add ( { 1001, 22 } );
+    tycCM.add ( { 1002, 1000001 } );
+    tycCM.add ( { 1002, 2000002 } );
+    hipCM.sort();
+    tycCM.sort();
+    
+    string path1 = outputDir + "/GAIA1.bin", path4 = outputDir + "/GAIA4.bin";
+    int n1 = SSExportGAIADR3StarData ( gaiadir, path1, hipCM, tycCM, -INFINITY, INFINITY, false, 1 );
+    int n4 = SSExportGAIADR3StarData ( gaiadir, path4, hipCM, tycCM, -INFINITY, INFINITY, false, 4 );
+    
+    size_t size1 = 0, size4 = 0;
+    const void *data1 = mapfile ( path1, size1 );
+    const void *data4 = mapfile ( path4, size4 );
+    bool identical = data1 != nullptr && data4 != nullptr && size1 == size4 && memcmp ( data1, data4, size1 ) == 0;
+    
+    uint32_t hip1001 = 0;
+    uint64_t tyc1002 = 0;
+    const SSGAIARec *recs = (const SSGAIARec *) data1;
+    for ( size_t i = 0; data1 != nullptr && i < size1 / sizeof ( SSGAIARec ); i++ )
+    {
+        if ( recs[i].source_id == 1001 )
+            hip1001 = recs[i].hip_source_id;
+        if ( recs[i].source_id == 1002 )
+            tyc1002 = recs[i].tyc_source_id;
+    }
+    
+    unmapfile ( data1, size1 );
+    unmapfile ( data4, size4 );
+    
+    bool ok = n1 == numFiles * numPerFile && n4 == n1 && identical && hip1001 == 22 && tyc1002 == 2000002;
+    cout << format ( "GAIA export: %d files, %d and %d records on 1 and 4 threads, %s, duplicate cross-matches give HIP %u, TYC %llu, %s", numFiles, n1, n4, identical ? "identical" : "different", hip1001, (unsigned long long) tyc1002, ok ? "OK" : "FAILED" ) << endl;
+}
+
+// Fills a GAIA cross-match table with pseudo-random records, many sharing a source, and checks that after sorting,
+// each source is found with its last record. Then saves the table, memory-maps it into another, and checks
+// that the same records are found there; that a file which isn't a table won't load; and that adding a record
+// to the mapped table copies it into memory without losing any others.
+
+void TestGAIACrossMatch ( string outputDir )
+{
+    if ( outputDir.empty() )
+        return;
+    
+    SSGAIACrossMatch table;
+    map<uint64_t, uint64_t> last;
+    uint64_t seed = 5;
+    for ( int i = 0; i < 200000; i++ )
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        SSGAIACrossMatchRecord record = { ( seed >> 20 ) % 150000 + 1, (uint64_t) i + 1, i * 0.001f, 1, 0 };
+        table.add ( record );
+        last[record.source_id] = record.ext_source_id;
+    }
+    table.sort();
+    
+    auto countFound = [&last] ( const SSGAIACrossMatch &t )
+    {
+        size_t found = 0;
+        for ( auto &entry : last )
+        {
+            const SSGAIACrossMatchRecord *pRec = t.find ( entry.first );
+            if ( pRec != nullptr && pRec->ext_source_id == entry.second )
+                found++;
+        }
+        return found;
+    };
+    
+    size_t numSorted = countFound ( table );
+    bool ok = numSorted == table.size() && table.find ( 0 ) == nullptr && table.find ( 150001 ) == nullptr;
+    
+    string path = outputDir + "/GAIACrossMatch.bin";
+    SSGAIACrossMatch mapped;
+    ok = ok && table.save ( path ) && mapped.load ( path ) && mapped.size() == table.size();
+    size_t numMapped = countFound ( mapped );
+    
+    ok = ok && ! mapped.load ( outputDir + "/GAIA1.bin" ) && ! mapped.load ( outputDir + "/NoSuchFile.bin" ) && mapped.size() == table.size();
+    
+    mapped.add ( { 150001, 1 } );
+    mapped.sort();
+    last[150001] = 1;
+    size_t numAdded = countFound ( mapped );
+    
+    ok = ok && numMapped == numSorted && numAdded == numSorted + 1 && mapped.size() == numAdded;
+    cout << format ( "GAIA cross-match: %zu sources, %zu found sorted, %zu found memory-mapped, %zu after adding one, %s", table.size(), numSorted, numMapped, numAdded, ok ? "OK" : "FAILED" ) << endl;
+}
+
+#endif
+
+// Times converting every field of every CSV file in the SSData folder to an identifier, case-sensitive
+// and not, one string at a time and in batches; checks that both give the same identifiers.
+
+void TestIdentifierParsing ( string inputDir )
+{
+    vector<string> files = { "/Stars/Brightest.csv", "/Stars/Nearest.csv", "/Stars/Names.csv", "/DeepSky/Messier.csv", "/DeepSky/Caldwell.csv", "/DeepSky/Names.csv",
+        "/Constellations/Constellations.csv", "/Constellations/Shapes.csv", "/Constellations/Boundaries.csv", "/SolarSystem/Planets.csv", "/SolarSystem/Moons.csv",
+        "/SolarSystem/JPLComets.csv", "/SolarSystem/Features.csv", "/SolarSystem/Cities.csv", "/SolarSystem/Satellites/n2yo.csv", "/SolarSystem/Satellites/je9pel.csv" };
+    
+    vector<string> strs;
+    for ( const string &file : files )
+    {
+        FILE *pFile = fopen ( ( inputDir + file ).c_str(), "rb" );
+        if ( pFile == nullptr )
+            continue;
+        
+        string line;
+        while ( fgetline ( pFile, line ) )
+            for ( const string &field : split_csv ( line ) )
+                strs.push_back ( field );
+        
+        fclose ( pFile );
+    }
+    
+    if ( strs.empty() )
+        return;
+    
+    for ( bool casesens : { true, false } )
+    {
+        SSIdentifierVec idents ( strs.size() ), batch;
+        int numIdents = 0;
+        
+        double t0 = clocksec();
+        for ( size_t i = 0; i < strs.size(); i++ )
+            idents[i] = SSIdentifier::fromString ( strs[i], kTypeNonexistent, casesens );
+        double t1 = clocksec();
+        int numBatch = SSIdentifier::fromStrings ( strs, batch, kTypeNonexistent, casesens );
+        double t2 = clocksec();
+        
+        size_t numDiffs = 0;
+        for ( size_t i = 0; i < strs.size(); i++ )
+        {
+            if ( idents[i].catalog() != kCatUnknown )
+                numIdents++;
+            if ( (uint64_t) idents[i] != (uint64_t) batch[i] )
+                numDiffs++;
+        }
+        
+        cout << format ( "Identifier parsing: %zu strings, %s, %d identifiers, %.0f ns/string, batch %d identifiers, %.0f ns/string, %zu differences", strs.size(), casesens ? "case-sensitive" : "case-insensitive", numIdents, ( t1 - t0 ) * 1.0e9 / strs.size(), numBatch, ( t2 - t1 ) * 1.0e9 / strs.size(), numDiffs ) << endl;
+    }
+}
+
+// Times identifying constellations of a million random J2000 positions one at a time and in a batch;
+// checks that both give the same constellations.
+
+void TestConstellationIdentify ( void )
+{
+    uint64_t seed = 3;
+    vector<SSVector> positions ( 1000000 );
+    for ( SSVector &pos : positions )
+        pos = RandomUnitVector ( seed );
+    
+    vector<string> abbrevs ( positions.size() );
+    double t0 = clocksec();
+    for ( size_t i = 0; i < positions.size(); i++ )
+        abbrevs[i] = SSConstellation::identify ( positions[i] );
+    double t1 = clocksec();
+    
+    vector<int> indexes;
+    int numIdent = SSConstellation::identify ( positions, indexes );
+    double t2 = clocksec();
+    
+    size_t numDiffs = 0;
+    vector<int> counts ( 89, 0 );
+    for ( size_t i = 0; i < positions.size(); i++ )
+    {
+        if ( SSConstellation::abbreviationToIndex ( abbrevs[i] ) != indexes[i] )
+            numDiffs++;
+        counts[ indexes[i] ]++;
+    }
+    
+    cout << format ( "Constellation identify: %zu positions, %.0f ns/position, batch %d identified, %.0f ns/position, %zu differences; %d in Ori, %d in Vir", positions.size(), ( t1 - t0 ) * 1.0e9 / positions.size(), numIdent, ( t2 - t1 ) * 1.0e9 / positions.size(), numDiffs, counts[ SSConstellation::abbreviationToIndex ( "Ori" ) ], counts[ SSConstellation::abbreviationToIndex ( "Vir" ) ] ) << endl;
+}
+
+// Times importing objects from CSV files of stars, asteroids (as exported by TestSolarSystem),
+// planetary surface features, and cities, then exporting them again, on one thread and on all
+// hardware threads; reports megabytes per second, and checks that both exports are identical.
+
+void TestCSVImportExport ( string inputDir, string outputDir )
+{
+    vector<string> paths = { inputDir + "/Stars/Brightest.csv", outputDir + "/ExportedAsteroids.csv", inputDir + "/SolarSystem/Features.csv", inputDir + "/SolarSystem/Cities.csv" };
+    string exportPath = outputDir + "/CSVExportTest.csv";
+    
+    for ( const string &path : paths )
+    {
+        size_t bytes = filesize ( path );
+        if ( bytes == 0 )
+            continue;
+        
+        // Take the fastest of three runs, so the file is in the OS cache.
+        
+        double importTime[2] = { INFINITY, INFINITY }, exportTime[2] = { INFINITY, INFINITY };
+        string exported[2];
+        int numObjects = 0;
+        
+        for ( int t = 0; t < 2; t++ )
+        {
+            for ( int i = 0; i < 3; i++ )
+            {
+                SSObjectVec objects;
+                double t0 = clocksec();
+                numObjects = SSImportObjectsFromCSV ( path, objects, nullptr, nullptr, t == 0 ? 1 : 0 );
+                double t1 = clocksec();
+                SSExportObjectsToCSV ( exportPath, objects, nullptr, nullptr, t == 0 ? 1 : 0 );
+                double t2 = clocksec();
+                importTime[t] = min ( importTime[t], t1 - t0 );
+                exportTime[t] = min ( exportTime[t], t2 - t1 );
+            }
+            
+            size_t size = 0;
+            const void *data = mapfile ( exportPath, size );
+            exported[t] = data ? string ( (const char *) data, size ) : "";
+            unmapfile ( data, size );
+        }
+        
+        double mb = bytes / 1048576.0;
+        cout << format ( "CSV import: %s, %d objects, 1 thread %.1f MB/sec, all threads %.1f MB/sec", getFileName ( path ).c_str(), numObjects, mb / importTime[0], mb / importTime[1] ) << endl;
+        cout << format ( "CSV export: %s, 1 thread %.1f MB/sec, all threads %.1f MB/sec, outputs %s", getFileName ( path ).c_str(), mb / exportTime[0], mb / exportTime[1], exported[0] == exported[1] ? "identical" : "DIFFER" ) << endl;
+    }
+    
+    remove ( exportPath.c_str() );
+}
+
 void TestJPLDEphemeris ( string inputDir )
 {
     SSJPLDEphemeris jpldeph;
@@ -757,9 +1806,26 @@ int main ( int argc, const char *argv[] )
     TestSatellites ( inpath, outpath );
     TestJPLDEphemeris ( inpath );
     TestSolarSystem ( inpath, outpath );
+    TestCSVImportExport ( inpath, outpath );
     TestConstellations ( inpath, outpath );
     TestStars ( inpath, outpath );
     TestDeepSky ( inpath, outpath );
+    TestHTMSearch ( inpath );
+    TestHTMStreaming ( inpath, outpath );
+    TestHTMIndex ( inpath, outpath );
+    TestHTMBuild ( inpath, outpath );
+    TestHTMBinary ( inpath, outpath );
+    TestStarField ( inpath );
+    TestCompactStars ( inpath );
+    TestObjectArena ( inpath, outpath );
+    TestObjectIndex ( inpath );
+    TestCrossMatch ( inpath );
+#if TEST_GAIA
+    TestGAIAExport ( outpath );
+    TestGAIACrossMatch ( outpath );
+#endif
+    TestIdentifierParsing ( inpath );
+    TestConstellationIdentify();
 
 #ifdef _MSC_VER
     SetConsoleOutputCP ( oldcp );
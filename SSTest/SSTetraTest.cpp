@@ -3,93 +3,129 @@
 //  Created by Tim DeBenedictis on 11/24/23.
 //  Copyright © 2023 Southern Stars. All rights reserved.
 
+#include <chrono>
+#include <thread>
+
 #include "SSMatrix.hpp"
 #include "Tetra3.hpp"
 
-int main ( int argc, const char *argv[] )
+// (x,y) coordinates sources extracted from test image IMG_2023-08-16-20-38-05.png
+
+vector<T3Source> sources =
 {
-    Tetra3 t3 = Tetra3();
-    if ( ! t3.loadDatabase ( argv[1] ) )
+    { 422.2053, 1023.395 },
+    { 281.8795, 717.26306 },
+    { 16.997013, 397.85364 },
+    { 301.96262, 257.07523 },
+    { 257.723, 130.81393 },
+    { 51.945026, 1246.7628 },
+    { 553.97327, 1059.6846 },
+    { 686.87354, 589.4739 },
+    { 520.88165, 200.29431 },
+    { 47.36175, 48.079197 },
+    { 638.39435, 228.18639 },
+    { 238.14902, 572.54694 },
+    { 133.90385, 1207.5717 },
+    { 601.55334, 665.07666 },
+    { 391.38275, 362.40567 },
+    { 3.9298568, 711.7092 },
+    { 509.51547, 761.1291 },
+    { 252.37495, 671.2923 },
+    { 66.05293, 745.0243 },
+    { 527.5116, 1050.9066 },
+    { 414.95157, 680.3477 },
+    { 180.20613, 1091.7495 },
+    { 309.05966, 385.49396 },
+    { 363.34433, 902.1853 },
+    { 693.9221, 459.2104 },
+    { 492.25372, 421.7162 },
+    { 111.76887, 577.5644 },
+    { 136.35097, 1166.6543 },
+    { 231.51476, 630.458 },
+    { 298.34338, 909.7004 },
+    { 685.6176, 854.58813 },
+    { 626.6023, 264.4852 },
+    { 548.761, 589.7871 },
+    { 494.89798, 317.44052 },
+    { 407.7845, 749.5002 },
+    { 175.77464, 1.3097101 },
+    { 625.3755, 588.4812 },
+    { 716.32, 778.4647 },
+    { 512.4454, 687.7868 },
+    { 498.4067, 531.715 },
+    { 55.375015, 651.53796 },
+    { 556.0732, 484.23492 },
+    { 316.3822, 940.83386 },
+    { 620.3483, 151.55928 },
+    { 253.4568, 778.41846 },
+    { 483.61166, 728.68823 },
+    { 29.697231, 754.6336 },
+    { 413.4434, 495.5556 },
+    { 301.53394, 898.5347 },
+    { 662.64374, 355.62747 },
+    { 692.6906, 443.37155 },
+    { 668.5518, 650.63855 },
+    { 262.32025, 1267.565 },
+    { 396.4324, 775.4081 },
+    { 229.59746, 892.5005 },
+    { 446.70026, 223.4975 },
+    { 148.49733, 889.2969 },
+    { 513.2085, 478.54318 },
+    { 368.49814, 670.64166 },
+    { 319.41254, 1032.5724 },
+    { 679.5646, 1158.5579 },
+    { 104.49749, 194.53372 },
+    { 337.4633, 1038.56 },
+    { 33.50009, 79.44353 },
+    { 92.609924, 481.57355 },
+    { 382.47665, 981.4335 }
+};
+
+// Renders a synthetic 16-bit image of the test image sources, brightest first, as Gaussian star images
+// on a sloping background with pseudo-random noise, for testing source extraction.
+
+void renderTestImage ( vector<uint16_t> &image, int width, int height )
+{
+    vector<double> pixels ( (size_t) width * height );
+    uint32_t seed = 12345;
+    for ( int y = 0; y < height; y++ )
     {
-        cout << "Can't load Tetra3 database from " << argv[1] << endl;
-        return -1;
+        for ( int x = 0; x < width; x++ )
+        {
+            double noise = 0.0;
+            for ( int k = 0; k < 4; k++ )
+            {
+                seed = seed * 1664525 + 1013904223;
+                noise += ( seed >> 8 ) / 16777216.0 - 0.5;
+            }
+            pixels[ (size_t) y * width + x ] = 2000.0 + 0.5 * x + 0.25 * y + 35.0 * noise;
+        }
     }
-    cout << "Loaded Tetra3 database with " << t3.numPatterns() << " patterns and " << t3.numStars() << " stars\n";
-
-    // (x,y) coordinates sources extracted from test image IMG_2023-08-16-20-38-05.png
     
-    vector<T3Source> sources =
+    const double sigma = 1.2;
+    for ( int i = 0; i < sources.size(); i++ )
     {
-        { 422.2053, 1023.395 },
-        { 281.8795, 717.26306 },
-        { 16.997013, 397.85364 },
-        { 301.96262, 257.07523 },
-        { 257.723, 130.81393 },
-        { 51.945026, 1246.7628 },
-        { 553.97327, 1059.6846 },
-        { 686.87354, 589.4739 },
-        { 520.88165, 200.29431 },
-        { 47.36175, 48.079197 },
-        { 638.39435, 228.18639 },
-        { 238.14902, 572.54694 },
-        { 133.90385, 1207.5717 },
-        { 601.55334, 665.07666 },
-        { 391.38275, 362.40567 },
-        { 3.9298568, 711.7092 },
-        { 509.51547, 761.1291 },
-        { 252.37495, 671.2923 },
-        { 66.05293, 745.0243 },
-        { 527.5116, 1050.9066 },
-        { 414.95157, 680.3477 },
-        { 180.20613, 1091.7495 },
-        { 309.05966, 385.49396 },
-        { 363.34433, 902.1853 },
-        { 693.9221, 459.2104 },
-        { 492.25372, 421.7162 },
-        { 111.76887, 577.5644 },
-        { 136.35097, 1166.6543 },
-        { 231.51476, 630.458 },
-        { 298.34338, 909.7004 },
-        { 685.6176, 854.58813 },
-        { 626.6023, 264.4852 },
-        { 548.761, 589.7871 },
-        { 494.89798, 317.44052 },
-        { 407.7845, 749.5002 },
-        { 175.77464, 1.3097101 },
-        { 625.3755, 588.4812 },
-        { 716.32, 778.4647 },
-        { 512.4454, 687.7868 },
-        { 498.4067, 531.715 },
-        { 55.375015, 651.53796 },
-        { 556.0732, 484.23492 },
-        { 316.3822, 940.83386 },
-        { 620.3483, 151.55928 },
-        { 253.4568, 778.41846 },
-        { 483.61166, 728.68823 },
-        { 29.697231, 754.6336 },
-        { 413.4434, 495.5556 },
-        { 301.53394, 898.5347 },
-        { 662.64374, 355.62747 },
-        { 692.6906, 443.37155 },
-        { 668.5518, 650.63855 },
-        { 262.32025, 1267.565 },
-        { 396.4324, 775.4081 },
-        { 229.59746, 892.5005 },
-        { 446.70026, 223.4975 },
-        { 148.49733, 889.2969 },
-        { 513.2085, 478.54318 },
-        { 368.49814, 670.64166 },
-        { 319.41254, 1032.5724 },
-        { 679.5646, 1158.5579 },
-        { 104.49749, 194.53372 },
-        { 337.4633, 1038.56 },
-        { 33.50009, 79.44353 },
-        { 92.609924, 481.57355 },
-        { 382.47665, 981.4335 }
-    };
-    
-    // Initialize solver options
+        double flux = 200000.0 * pow ( 0.95, i );
+        int x0 = floor ( sources[i].x ), y0 = floor ( sources[i].y );
+        for ( int y = max ( 0, y0 - 6 ); y <= min ( height - 1, y0 + 6 ); y++ )
+        {
+            for ( int x = max ( 0, x0 - 6 ); x <= min ( width - 1, x0 + 6 ); x++ )
+            {
+                double dx = x + 0.5 - sources[i].x, dy = y + 0.5 - sources[i].y;
+                pixels[ (size_t) y * width + x ] += flux / ( 2.0 * M_PI * sigma * sigma ) * exp ( -( dx * dx + dy * dy ) / ( 2.0 * sigma * sigma ) );
+            }
+        }
+    }
     
+    image.resize ( pixels.size() );
+    for ( size_t i = 0; i < pixels.size(); i++ )
+        image[i] = min ( 65535.0, round ( pixels[i] ) );
+}
+
+// Initializes Tetra3 solver options for the test image.
+
+T3Options testOptions ( void )
+{
     T3Options opts;
     opts.fov_estimate = 24.0;
     opts.fov_max_error = 1.0;
@@ -98,21 +134,179 @@ int main ( int argc, const char *argv[] )
     opts.num_threads = 0;
     opts.pattern_checking_stars = 20;
     opts.pattern_max_error = 0.0;
-    
-    // solve image
-    
+    return opts;
+}
+
+// Prints results of solving the test image.
+
+void printResults ( T3Results &results )
+{
+    cout << "R.A.: " << SSHourMinSec ( results.ra / 15.0 ).toString() << endl;
+    cout << "Dec.: " << SSDegMinSec ( results.dec ).toString() << endl;
+    cout << "FoV:  " << results.fov << " deg\n";
+    cout << "Roll: " << results.roll << " deg\n";
+}
+
+// Solves sources extracted from a test image with a Tetra3 database (t3), and prints results.
+// Returns zero if successful, or a negative number on failure.
+
+int solveTestImage ( Tetra3 &t3 )
+{
     T3Results results;
-    if ( ! t3.solveFromSources ( sources, 720, 1280, opts, results ) )
+    if ( ! t3.solveFromSources ( sources, 720, 1280, testOptions(), results ) )
     {
         cout << "Failed to solve " << sources.size() << " sources in " << results.t_solve << " ms!\n";
         return -2;
     }
     
     cout << "Solved " << sources.size() << " sources in " << results.t_solve << " ms.\n";
-    cout << "R.A.: " << SSHourMinSec ( results.ra / 15.0 ).toString() << endl;
-    cout << "Dec.: " << SSDegMinSec ( results.dec ).toString() << endl;
-    cout << "FoV:  " << results.fov << " deg\n";
-    cout << "Roll: " << results.roll << " deg\n";
+    printResults ( results );
+    return 0;
+}
 
+// Solves the test image sources repeatedly, for about one second, with a Tetra3 database (t3),
+// and solver options (opts), and prints the number of solves per second.
+
+void benchmarkSolver ( Tetra3 &t3, const T3Options &opts )
+{
+    T3Results results;
+    int solves = 0, failures = 0;
+    double secs = 0.0;
+    
+    auto start = chrono::steady_clock::now();
+    while ( secs < 1.0 )
+    {
+        if ( t3.solveFromSources ( sources, 720, 1280, opts, results ) )
+            solves++;
+        else
+            failures++;
+        secs = chrono::duration<double> ( chrono::steady_clock::now() - start ).count();
+    }
+    
+    cout << "Solved test sources with " << ( opts.fov_estimate ? "known" : "unknown" ) << " FoV on " << (int) opts.num_threads << " threads ";
+    cout << solves << " times (" << failures << " failures) in " << secs << " sec: " << ( solves + failures ) / secs << " solves per second.\n";
+}
+
+// Renders a synthetic image of the test image sources, extracts sources from it, compares them to the
+// originals, then solves the image with a Tetra3 database (t3), and prints results.
+// Returns zero if successful, or a negative number on failure.
+
+int extractTestImage ( Tetra3 &t3 )
+{
+    int width = 720, height = 1280;
+    vector<uint16_t> image;
+    renderTestImage ( image, width, height );
+    
+    T3ExtractOptions extract;
+    extract.num_threads = thread::hardware_concurrency();
+    vector<T3Source> extracted;
+    Tetra3::getCentroidsFromImage ( image.data(), width, height, 16, 0, extract, extracted );
+    
+    // Match each source to the nearest extracted source within one pixel.
+    
+    int matched = 0;
+    double sumsq = 0.0;
+    for ( T3Source &source : sources )
+    {
+        double best = 1.0;
+        for ( T3Source &ext : extracted )
+            best = min ( best, (double) source.distance ( ext ) );
+        if ( best < 1.0 )
+        {
+            matched++;
+            sumsq += best * best;
+        }
+    }
+    
+    cout << "Extracted " << extracted.size() << " sources; " << matched << " of " << sources.size() << " match, RMS error " << sqrt ( sumsq / max ( matched, 1 ) ) << " px\n";
+    
+    T3Results results;
+    if ( ! t3.solveFromImage ( image.data(), width, height, 16, 0, extract, testOptions(), results ) )
+    {
+        cout << "Failed to solve image in " << results.t_extract + results.t_solve << " ms!\n";
+        return -6;
+    }
+    
+    cout << "Extracted sources in " << results.t_extract << " ms, solved in " << results.t_solve << " ms.\n";
+    printResults ( results );
     return 0;
 }
+
+// Usage: sstetratest <database.npz> [ <catalog.csv> <database.t3db> ]
+// Solves test image sources, then a synthetic image of them, with Tetra3 database in python .npz format. If a star catalog is given,
+// generates a database from it with the same parameters, saves it in optimized format,
+// reloads it, and solves the test image again.
+
+int main ( int argc, const char *argv[] )
+{
+    Tetra3 t3;
+    if ( ! t3.loadDatabase ( argv[1] ) )
+    {
+        cout << "Can't load Tetra3 database from " << argv[1] << endl;
+        return -1;
+    }
+    cout << "Loaded Tetra3 database with " << t3.numPatterns() << " patterns and " << t3.numStars() << " stars\n";
+
+    int result = solveTestImage ( t3 );
+    if ( result == 0 )
+    {
+        T3Options opts = testOptions();
+        for ( int num_threads : { 0, 4 } )
+        {
+            opts.num_threads = num_threads;
+            opts.fov_estimate = testOptions().fov_estimate;
+            opts.fov_max_error = testOptions().fov_max_error;
+            benchmarkSolver ( t3, opts );
+            opts.fov_estimate = opts.fov_max_error = 0.0;
+            benchmarkSolver ( t3, opts );
+        }
+    }
+    if ( result == 0 )
+        result = extractTestImage ( t3 );
+    if ( result != 0 || argc < 4 )
+        return result;
+    
+    SSObjectVec stars;
+    int numStars = SSImportObjectsFromCSV ( argv[2], stars );
+    cout << "Imported " << numStars << " stars from " << argv[2] << endl;
+    
+    // Same parameters as SSData/Stars/Tetra3.npz, which was generated from the Bright Star Catalog by tetra3.py
+    
+    T3GenerateOptions gen;
+    gen.max_fov = 90.0;
+    gen.min_fov = 10.0;
+    gen.pattern_stars_per_fov = 10;
+    gen.verification_stars_per_fov = 30;
+    gen.star_max_magnitude = 7.0;
+    gen.pattern_max_error = 0.005;
+    gen.simplify_pattern = true;
+    gen.epoch = 2023.0;
+    gen.star_catalog = "Brightest.csv";
+    gen.num_threads = thread::hardware_concurrency();
+    
+    auto start = chrono::steady_clock::now();
+    Tetra3 t3gen = Tetra3();
+    if ( ! t3gen.generateDatabase ( stars, gen ) )
+    {
+        cout << "Can't generate Tetra3 database from " << argv[2] << endl;
+        return -3;
+    }
+    
+    double ms = chrono::duration<double, milli> ( chrono::steady_clock::now() - start ).count();
+    cout << "Generated Tetra3 database with " << t3gen.numPatterns() << " patterns and " << t3gen.numStars() << " stars in " << ms << " ms\n";
+    if ( ! t3gen.saveOptimizedDatabase ( argv[3] ) )
+    {
+        cout << "Can't save Tetra3 database to " << argv[3] << endl;
+        return -4;
+    }
+    
+    Tetra3 t3opt = Tetra3();
+    if ( ! t3opt.loadOptimizedDatabase ( argv[3] ) )
+    {
+        cout << "Can't load Tetra3 database from " << argv[3] << endl;
+        return -5;
+    }
+    cout << "Loaded Tetra3 database with " << t3opt.numPatterns() << " patterns and " << t3opt.numStars() << " stars\n";
+
+    return solveTestImage ( t3opt );
+}